@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides members and functions for implementing a pool
+ * of aligned buffers.
+ *
+ * AlignedBufferPool is a class that hands out and recycles buffers whose
+ * address and length are multiples of DIRECT_IO_ALIGNMENT. Such buffers are
+ * required by the kernel for I/O on file descriptors opened with O_DIRECT.
+ *
+ * It also provides direct_pread() and direct_pwrite(), which let records
+ * with unaligned buffers, offsets or lengths be replayed on O_DIRECT file
+ * descriptors: reads go through an aligned bounce buffer, and writes go
+ * through a private open file description without O_DIRECT, so that they
+ * never rewrite bytes around the request.
+ *
+ * USAGE
+ * A main program could initialize this class once and share it between all
+ * executor threads. Call get() to obtain a buffer and put() to give it back.
+ */
+
+#ifndef ALIGNED_BUFFER_POOL_HPP
+#define ALIGNED_BUFFER_POOL_HPP
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <cstdint>
+#include "tbb/atomic.h"
+#include "tbb/concurrent_queue.h"
+
+/*
+ * Alignment of buffer addresses and lengths. 4KiB satisfies the logical
+ * block size of every device we replay on.
+ */
+#define DIRECT_IO_ALIGNMENT 4096
+/*
+ * Buffers are grouped in power-of-two size classes starting at
+ * DIRECT_IO_ALIGNMENT. Requests larger than the largest class bypass the pool.
+ */
+#define ALIGNED_BUFFER_SIZE_CLASSES 16
+// Maximum number of idle buffers cached per size class.
+#define ALIGNED_BUFFER_CACHE_LIMIT 256
+
+class AlignedBufferPool {
+ private:
+  tbb::concurrent_queue<char *> free_lists_[ALIGNED_BUFFER_SIZE_CLASSES];
+  tbb::atomic<uint64_t> cached_[ALIGNED_BUFFER_SIZE_CLASSES];
+
+  /**
+   * Return the size class of a request of nbytes, or -1 if the request
+   * is larger than the largest size class.
+   */
+  static int size_class(size_t nbytes);
+
+  /**
+   * Return the number of bytes held by every buffer of the given class.
+   */
+  static size_t class_size(int size_class);
+
+  /**
+   * Write to the file of fd through a private open file description
+   * without O_DIRECT, reopened through /proc/self/fd, so that the status
+   * flags other threads see on fd never change. offset is -1 to append,
+   * which leaves the file position of fd at the end of the write.
+   */
+  static ssize_t buffered_write(int fd, int status_flags, const char *buffer,
+                                size_t nbytes, off_t offset);
+
+ public:
+  /**
+   * Constructor
+   */
+  AlignedBufferPool();
+
+  /**
+   * Destructor that frees every cached buffer.
+   */
+  ~AlignedBufferPool();
+
+  /**
+   * Return an aligned buffer that can hold at least nbytes bytes.
+   * The length of the buffer is rounded up to DIRECT_IO_ALIGNMENT.
+   * Return nullptr if memory cannot be allocated.
+   */
+  char *get(size_t nbytes);
+
+  /**
+   * Give a buffer obtained by get(nbytes) back to the pool.
+   */
+  void put(char *buffer, size_t nbytes);
+
+  /**
+   * Round nbytes up to the next multiple of DIRECT_IO_ALIGNMENT.
+   */
+  static size_t align(size_t nbytes);
+
+  /**
+   * Determine whether the address of buffer is suitably aligned.
+   */
+  static bool is_aligned(const void *buffer);
+
+  /**
+   * Determine whether a transfer of nbytes at offset from or to buffer
+   * can be given to the kernel as is on an O_DIRECT file descriptor.
+   */
+  static bool is_aligned_io(const void *buffer, size_t nbytes, off_t offset);
+
+  /**
+   * pread() for file descriptors opened with O_DIRECT. An unaligned
+   * request reads the enclosing aligned range into a bounce buffer and
+   * copies the requested bytes out of it.
+   * Return the same values as pread().
+   */
+  ssize_t direct_pread(int fd, char *buffer, size_t nbytes, off_t offset);
+
+  /**
+   * pwrite() for file descriptors opened with O_DIRECT. An unaligned
+   * request is written through the page cache with buffered_write(),
+   * which touches only the requested bytes.
+   * Return the same values as pwrite().
+   */
+  ssize_t direct_pwrite(int fd, const char *buffer, size_t nbytes,
+                        off_t offset);
+
+  /**
+   * read() counterpart of direct_pread(), which reads at the file
+   * position of fd and advances it by the number of bytes read.
+   */
+  ssize_t direct_read(int fd, char *buffer, size_t nbytes);
+
+  /**
+   * write() counterpart of direct_pwrite(), which writes at the file
+   * position of fd and advances it by the number of bytes written.
+   */
+  ssize_t direct_write(int fd, const char *buffer, size_t nbytes);
+};
+
+#endif /* ALIGNED_BUFFER_POOL_HPP */
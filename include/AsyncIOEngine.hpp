@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides members and functions for implementing the
+ * asynchronous I/O engine.
+ *
+ * AsyncIOEngine is a class that replays read, pread, write and pwrite
+ * records on file descriptors opened with O_DIRECT through libaio instead
+ * of blocking system calls. Requests of the same process are batched into
+ * a single io_submit call, and completed requests are handed back to their
+ * replaying module so that the replayed return value and errno go through
+ * the regular compare_retval_and_errno checks. A request that overlaps an
+ * outstanding write on the same fd, or a write that overlaps an
+ * outstanding read, waits for the outstanding requests of its process
+ * first, so that overlapping requests complete in trace order.
+ *
+ * The engine owns no module: harvest() and drain() return the completed
+ * modules to the executor, which reclaims them once no other executor can
+ * refer to them.
+ *
+ * USAGE
+ * A main program could initialize this class once. Each executor thread
+ * submits the records of its process, calls harvest() after every record it
+ * executes and drain() before a record that must observe all prior I/O.
+ */
+
+#ifndef ASYNC_IO_ENGINE_HPP
+#define ASYNC_IO_ENGINE_HPP
+
+#include <libaio.h>
+#include <sys/types.h>
+#include <map>
+#include <utility>
+#include <vector>
+#include "AlignedBufferPool.hpp"
+#include "SystemCallTraceReplayLogger.hpp"
+#include "tbb/concurrent_hash_map.h"
+
+class SystemCallTraceReplayModule;
+
+// Default number of requests per process that are submitted together.
+#define AIO_DEFAULT_BATCH_SIZE 32
+// Maximum number of requests per process that can be in flight at once.
+#define AIO_QUEUE_DEPTH 256
+
+struct AsyncIORequest {
+  struct iocb iocb;
+  SystemCallTraceReplayModule *module;
+  // True for read and write, which move the file position of the fd
+  bool file_position;
+};
+
+struct AsyncIOContext {
+  io_context_t ctx;
+  // iocbs that are prepared but not yet given to io_submit
+  std::vector<struct iocb *> pending;
+  // Requests that are pending, in flight or rejected
+  std::vector<AsyncIORequest *> outstanding;
+  /*
+   * <fd, end of the first short transfer that used the file position>.
+   * The file position of fd is moved back there once its other requests
+   * that use the file position have completed.
+   */
+  std::map<int, off_t> file_ends;
+  // Number of submitted iocbs whose completion is not harvested yet
+  unsigned int in_flight;
+  /*
+   * iocbs rejected by io_submit with their -errno. They are completed by
+   * the next reap so that a module is never completed from inside its own
+   * submission.
+   */
+  std::vector<std::pair<AsyncIORequest *, int64_t>> rejected;
+  // Completed modules that are not handed back to the executor yet
+  std::vector<SystemCallTraceReplayModule *> completed;
+};
+
+// <pid, libaio context of the process>
+typedef tbb::concurrent_hash_map<pid_t, AsyncIOContext *> AsyncIOContextMap;
+
+class AsyncIOEngine {
+ private:
+  unsigned int batch_size_;
+  AsyncIOContextMap contexts_;
+  SystemCallTraceReplayLogger *logger_;
+
+  /**
+   * Return the libaio context of a process, creating it if needed.
+   * Return nullptr if the context cannot be created.
+   */
+  AsyncIOContext *get_context(pid_t pid);
+
+  /**
+   * Prepare an iocb and queue it on the context of pid. The queue is
+   * submitted once it holds batch_size_ requests. A negative offset
+   * means the file position, which is advanced by nbytes right away.
+   * Return false if the request cannot be replayed asynchronously.
+   */
+  bool submit(pid_t pid, SystemCallTraceReplayModule *module, bool is_write,
+              int fd, char *buffer, size_t nbytes, off_t offset);
+
+  /**
+   * Determine whether an outstanding request of a context on fd must
+   * complete before a request that uses the file position is queued:
+   * the file position is wrong while a short transfer is outstanding,
+   * and a write must not be placed after reads that may come back short.
+   */
+  bool position_unsettled(AsyncIOContext *context, bool is_write, int fd);
+
+  /**
+   * Determine whether an outstanding request of a context overlaps
+   * nbytes at offset of fd, with at least one of the two being a write.
+   */
+  bool overlaps(AsyncIOContext *context, bool is_write, int fd, off_t offset,
+                size_t nbytes);
+
+  /**
+   * Give all pending iocbs of a context to the kernel.
+   */
+  void flush(AsyncIOContext *context);
+
+  /**
+   * Submit every pending iocb of a context and wait for all of them to
+   * complete.
+   */
+  void wait_all(AsyncIOContext *context);
+
+  /**
+   * Complete requests rejected by io_submit, then wait for at least
+   * min_events completions of a context and complete the corresponding
+   * modules.
+   * Return false if libaio fails to report completions.
+   */
+  bool reap(AsyncIOContext *context, long min_events);
+
+  /**
+   * Complete the module owning request with result (bytes transferred or
+   * -errno), queue it on the completed modules of the context and release
+   * the request. A short transfer that used the file
+   * position moves the file position back to where the kernel would have
+   * left it.
+   */
+  void complete(AsyncIOContext *context, AsyncIORequest *request,
+                int64_t result);
+
+ public:
+  /**
+   * Constructor
+   *
+   * @param logger: logger used to report libaio failures
+   * @param batch_size: number of requests per process submitted together
+   */
+  AsyncIOEngine(SystemCallTraceReplayLogger *logger, unsigned int batch_size);
+
+  /**
+   * Destructor that destroys the libaio context of every process.
+   */
+  ~AsyncIOEngine();
+
+  /**
+   * Queue an asynchronous read of nbytes at offset into buffer, or at
+   * the file position if offset is -1.
+   * Return false if the caller has to replay the read synchronously.
+   */
+  bool submit_read(pid_t pid, SystemCallTraceReplayModule *module, int fd,
+                   char *buffer, size_t nbytes, off_t offset);
+
+  /**
+   * Queue an asynchronous write of nbytes at offset from buffer, or at
+   * the file position if offset is -1.
+   * Return false if the caller has to replay the write synchronously.
+   */
+  bool submit_write(pid_t pid, SystemCallTraceReplayModule *module, int fd,
+                    char *buffer, size_t nbytes, off_t offset);
+
+  /**
+   * Complete every request of pid that has already finished, without
+   * blocking, and append the modules completed since the last call to
+   * completed, including modules completed while submitting.
+   */
+  void harvest(pid_t pid,
+               std::vector<SystemCallTraceReplayModule *> &completed);
+
+  /**
+   * Submit every pending request of pid, wait for all of them to complete
+   * and append the modules completed since the last call to completed.
+   */
+  void drain(pid_t pid,
+             std::vector<SystemCallTraceReplayModule *> &completed);
+
+  /**
+   * Determine whether pid has requests that are not completed yet.
+   */
+  bool has_outstanding(pid_t pid);
+};
+
+#endif /* ASYNC_IO_ENGINE_HPP */
@@ -40,10 +40,14 @@
 #define BASIC_STAT_SYSTEM_CALL_TRACE_REPLAY_MODULE_HPP
 
 #include <fcntl.h>
+#include <stdint.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include "SystemCallTraceReplayModule.hpp"
 
+// Value of the stat fields that are null in the trace, which are not verified
+#define STAT_FIELD_NOT_CAPTURED UINT32_MAX
+
 class BasicStatSystemCallTraceReplayModule
     : public SystemCallTraceReplayModule {
  protected:
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides members and functions for tracking which
+ * file descriptor numbers are used by the replayer.
+ *
+ * FileDescriptorAllocator is a class that keeps a reference count for
+ * every replayed fd and a hierarchical bitmap of the fds in use: bit i of
+ * level 0 is set when fd i is used, and bit i of level k + 1 is set when
+ * word i of level k is full. The lowest unused fd is found by descending
+ * from the top level, in O(log64 n) time.
+ *
+ * USAGE
+ * ReplayerResourcesManager calls acquire() and release() whenever a fd
+ * table entry is added, removed or updated, and acquire_lowest_unused()
+ * when a system call needs a fd that is free.
+ */
+
+#ifndef FILE_DESCRIPTOR_ALLOCATOR_HPP
+#define FILE_DESCRIPTOR_ALLOCATOR_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class FileDescriptorAllocator {
+ private:
+  std::mutex lock_;
+  // Number of fd table entries and replayer uses of each fd
+  std::vector<uint32_t> refs_;
+  // levels_[0] has one bit per fd, levels_.back() is a single word
+  std::vector<std::vector<uint64_t>> levels_;
+
+  /**
+   * Make room for fd in refs_ and in every level of the bitmap.
+   */
+  void grow(int fd);
+
+  /**
+   * Mark fd as used in the bitmap, and mark its words as full in the
+   * levels above when they fill up.
+   */
+  void set_bit(int fd);
+
+  /**
+   * Mark fd as unused in the bitmap, and clear the full bits of its
+   * words in the levels above.
+   */
+  void clear_bit(int fd);
+
+  /**
+   * Return the lowest fd without any reference. lock_ must be held.
+   */
+  int find_lowest_unused();
+
+ public:
+  /**
+   * Constructor
+   */
+  FileDescriptorAllocator();
+
+  /**
+   * Add a reference to fd. Negative fds (failed or simulated system
+   * calls, AT_FDCWD) are ignored.
+   */
+  void acquire(int fd);
+
+  /**
+   * Add a reference to every fd in fds, as acquire() does for one.
+   */
+  void acquire(const std::vector<int> &fds);
+
+  /**
+   * Drop a reference to fd. fd becomes unused when no reference is left.
+   * Return true if fd became unused.
+   */
+  bool release(int fd);
+
+  /**
+   * Drop a reference to every fd in fds, as release() does for one.
+   * Return the fds that became unused.
+   */
+  std::vector<int> release(const std::vector<int> &fds);
+
+  /**
+   * Determine whether fd has any reference.
+   */
+  bool is_used(int fd);
+
+  /**
+   * Return the lowest fd without any reference.
+   */
+  int lowest_unused();
+
+  /**
+   * Add a reference to the lowest fd without any reference and return
+   * it, so that no other caller can be given the same fd.
+   */
+  int acquire_lowest_unused();
+
+  /**
+   * Return every fd with a reference, in increasing order.
+   */
+  std::vector<int> used_fds();
+};
+
+#endif /* FILE_DESCRIPTOR_ALLOCATOR_HPP */
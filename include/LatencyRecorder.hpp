@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides members and functions for measuring how long
+ * the replayed system calls take, next to how long they took when traced.
+ *
+ * LatencyHistogram is a log-linear histogram of nanosecond values in the
+ * style of HdrHistogram: values are counted in buckets no wider than 1/128
+ * of their value, so percentiles are accurate to within 1%. The buckets
+ * are allocated in chunks on first use, so a histogram only takes memory
+ * for the range of values it has counted.
+ *
+ * LatencyRecorder keeps a pair of histograms, replayed and traced, per
+ * system call name in every thread that records, so that recording takes
+ * no lock. When a thread finishes, its histograms are merged into those
+ * of the finished threads and freed. report() merges the threads and
+ * writes p50, p99 and p99.9 of both side by side.
+ *
+ * USAGE
+ * A main program creates one LatencyRecorder, the replaying modules call
+ * record() from any thread, each thread calls thread_finished() before it
+ * exits, and once every thread is done the main program calls report().
+ */
+
+#ifndef LATENCY_RECORDER_HPP
+#define LATENCY_RECORDER_HPP
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Values below 2^LATENCY_SUB_BUCKET_BITS get a bucket each; above that,
+ * every power of two is split into 2^(LATENCY_SUB_BUCKET_BITS - 1)
+ * buckets.
+ */
+#define LATENCY_SUB_BUCKET_BITS 8
+// Larger values (about 18 minutes in nanoseconds) are counted as this
+#define LATENCY_MAX_VALUE_BITS 40
+#define LATENCY_MAX_VALUE ((1ULL << LATENCY_MAX_VALUE_BITS) - 1)
+
+// Number of buckets allocated together, one power of two above 2^8
+#define LATENCY_CHUNK_BUCKETS (1ULL << (LATENCY_SUB_BUCKET_BITS - 1))
+
+class LatencyHistogram {
+ private:
+  // Chunks of LATENCY_CHUNK_BUCKETS buckets, nullptr until first counted
+  std::vector<std::unique_ptr<uint64_t[]>> chunks_;
+  uint64_t total_;
+  uint64_t min_;
+  uint64_t max_;
+  double sum_;
+
+  /**
+   * Return the index of the bucket that counts value.
+   */
+  static size_t bucket_index(uint64_t value);
+
+  /**
+   * Return the largest value counted in bucket index.
+   */
+  static uint64_t bucket_max(size_t index);
+
+  /**
+   * Return the chunk of buckets chunk, allocating it if needed.
+   */
+  uint64_t *get_chunk(size_t chunk);
+
+ public:
+  LatencyHistogram();
+
+  /**
+   * Count one value, in nanoseconds.
+   */
+  void record(uint64_t value);
+
+  /**
+   * Add the counts of other to this histogram.
+   */
+  void merge(const LatencyHistogram &other);
+
+  uint64_t count() const { return total_; }
+  uint64_t min() const { return total_ == 0 ? 0 : min_; }
+  uint64_t max() const { return max_; }
+  double mean() const { return total_ == 0 ? 0 : sum_ / total_; }
+
+  /**
+   * Return the smallest value that percentile percent of the counted
+   * values are less than or equal to, up to the width of its bucket.
+   */
+  uint64_t value_at_percentile(double percentile) const;
+};
+
+class LatencyRecorder {
+ public:
+  // Replayed and traced latencies of one system call
+  struct Latencies {
+    LatencyHistogram replayed;
+    LatencyHistogram traced;
+  };
+  typedef std::unordered_map<std::string, Latencies> Table;
+
+ private:
+  std::mutex tables_lock_;
+  // One table per running thread that recorded, owned by the recorder
+  std::vector<std::unique_ptr<Table>> tables_;
+  // Latencies of the threads that finished
+  Table finished_;
+
+  /**
+   * Return the table of the calling thread, creating it on first use.
+   */
+  Table &thread_table();
+
+  /**
+   * Add the latencies of table to those of into.
+   */
+  template <typename Map>
+  static void merge_table(const Table &table, Map &into);
+
+  /**
+   * Merge the tables of all threads, ordered by system call name.
+   */
+  std::map<std::string, Latencies> merge();
+
+  void write_csv(std::ostream &out,
+                 const std::map<std::string, Latencies> &merged);
+  void write_json(std::ostream &out,
+                  const std::map<std::string, Latencies> &merged);
+
+ public:
+  /**
+   * Count one call of syscall that took replayed_ns nanoseconds to replay
+   * and traced_ns nanoseconds when it was traced.
+   */
+  void record(const std::string &syscall, uint64_t replayed_ns,
+              uint64_t traced_ns);
+
+  /**
+   * Merge the latencies recorded by the calling thread into those of the
+   * finished threads and free its table. A later record() from the same
+   * thread starts a new table.
+   */
+  void thread_finished();
+
+  /**
+   * Write the report to filename: JSON if the name ends in ".json", CSV
+   * otherwise. Must not run concurrently with record(). Return false if
+   * the file cannot be written.
+   */
+  bool report(const std::string &filename);
+};
+
+#endif /* LATENCY_RECORDER_HPP */
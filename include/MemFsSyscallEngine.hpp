@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides an engine that replays the system calls on
+ * a file system kept in the memory of the replayer.
+ *
+ * MemFsSyscallEngine models the namespace, metadata, data and open
+ * files of a file system: an inode table, a directory tree, the data of
+ * each file as a map of fixed-size extents, extended attributes, and a
+ * fd table of its own. Path and fd system calls have the semantics and
+ * errno numbers of the kernel, without entering it, so that a replay is
+ * bound by the CPU only and gives the same results on every run.
+ *
+ * Calls it does not model, such as ioctl, file locks, mmap and the I/O
+ * of pipes and of the standard fds, return the traced result, as with
+ * NullSyscallEngine. The file system starts as an empty directory that
+ * is both the root and the current directory.
+ *
+ * Inodes are guarded by MEMFS_INODE_LOCKS mutexes picked by inode
+ * number. Paths are looked up in a concurrent hash map of the
+ * directory entries without taking any of those mutexes; the entries
+ * are changed only with the mutex of their directory held.
+ *
+ * USAGE
+ * SyscallEngine::create("memfs") makes the engine given to
+ * --engine=memfs.
+ */
+
+#ifndef MEMFS_SYSCALL_ENGINE_HPP
+#define MEMFS_SYSCALL_ENGINE_HPP
+
+#include <atomic>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "FileDescriptorAllocator.hpp"
+#include "SyscallEngine.hpp"
+#include "tbb/concurrent_hash_map.h"
+
+// Number of mutexes the inodes are spread over
+#define MEMFS_INODE_LOCKS 256
+// Size of the extents that hold the data of the files
+#define MEMFS_EXTENT_SIZE (64 * 1024)
+// Inode number of the root directory
+#define MEMFS_ROOT_INO 2
+// Symbolic links followed in a single lookup before giving up with ELOOP
+#define MEMFS_MAX_SYMLINKS 40
+
+struct MemFsInode {
+  ino_t ino;
+  // File type bits of the mode, which never change
+  mode_t type;
+  // Permission bits of the mode
+  mode_t mode;
+  nlink_t nlink;
+  uid_t uid;
+  gid_t gid;
+  dev_t rdev;
+  off_t size;
+  struct timespec atime;
+  struct timespec mtime;
+  struct timespec ctime;
+  // Data of regular files, by extent index; missing extents are holes
+  std::map<off_t, std::vector<char>> extents;
+  // Entries of directories, sorted so that getdents is deterministic
+  std::map<std::string, ino_t> entries;
+  // Parent of directories, for ".."
+  ino_t parent;
+  // Target of symbolic links
+  std::string target;
+  std::map<std::string, std::string> xattrs;
+};
+
+typedef std::shared_ptr<MemFsInode> MemFsInodePtr;
+
+/*
+ * An open file description, shared by the fds dup'ed from each other.
+ * inode is null for the fds the replayer inherits (stdin, stdout and
+ * stderr), whose calls return the traced result.
+ */
+struct MemFsOpenFile {
+  MemFsInodePtr inode;
+  std::atomic<int> flags;
+  // Guards offset and dir_position
+  std::mutex lock;
+  off_t offset;
+  // Last entry getdents returned, empty to start from the first one
+  std::string dir_position;
+};
+
+typedef std::shared_ptr<MemFsOpenFile> MemFsOpenFilePtr;
+
+class MemFsSyscallEngine : public NullSyscallEngine {
+ private:
+  struct Dentry {
+    ino_t parent;
+    std::string name;
+  };
+
+  struct DentryHashCompare {
+    static size_t hash(const Dentry &dentry);
+    static bool equal(const Dentry &d1, const Dentry &d2);
+  };
+
+  struct Fd {
+    MemFsOpenFilePtr file;
+    // FD_CLOEXEC
+    int fd_flags;
+  };
+
+  typedef tbb::concurrent_hash_map<ino_t, MemFsInodePtr> InodeTable;
+  typedef tbb::concurrent_hash_map<Dentry, ino_t, DentryHashCompare>
+      DentryTable;
+  typedef tbb::concurrent_hash_map<int, Fd> FdTable;
+  typedef std::vector<std::unique_lock<std::mutex>> InodeLocks;
+
+  InodeTable inodes_;
+  DentryTable dentries_;
+  std::atomic<ino_t> next_ino_;
+  std::mutex inode_locks_[MEMFS_INODE_LOCKS];
+  // Serializes the renames of directories across directories
+  std::mutex rename_lock_;
+  std::atomic<ino_t> cwd_;
+  FdTable fds_;
+  // Guards picking a fd number in fd_allocator_ and installing it
+  std::mutex fd_lock_;
+  FileDescriptorAllocator fd_allocator_;
+  // Extents allocated by all files, for statfs
+  std::atomic<int64_t> allocated_extents_;
+
+  /**
+   * Lock the inodes, in the order of their mutexes so that threads
+   * locking the same inodes cannot deadlock. Inodes sharing a mutex
+   * lock it once.
+   */
+  InodeLocks lock_inodes(std::initializer_list<ino_t> inos);
+
+  /**
+   * Return the inode numbered ino, or nullptr if it was removed.
+   */
+  MemFsInodePtr get_inode(ino_t ino);
+
+  /**
+   * Return the inode that name in directory parent refers to, or
+   * nullptr if there is no such entry.
+   */
+  MemFsInodePtr lookup_entry(ino_t parent, const std::string &name);
+
+  /**
+   * Return the open file of fd, or nullptr if fd is not open.
+   */
+  MemFsOpenFilePtr get_file(int fd, int *fd_flags = nullptr);
+
+  /**
+   * Install file as the lowest unused fd not below min_fd, or as fd
+   * new_fd, closing it first, if new_fd is not negative. Return the fd.
+   */
+  int install_fd(const MemFsOpenFilePtr &file, int fd_flags, int min_fd = 0,
+                 int new_fd = -1);
+
+  /**
+   * Find the directory relative paths start from: the current directory
+   * for AT_FDCWD, or the directory open as dirfd. Return 0 or a negative
+   * errno number.
+   */
+  int start_dir(int dirfd, const char *path, MemFsInodePtr *dir);
+
+  /**
+   * Look up path from the directory start, following a symbolic link in
+   * the last component if follow is true. depth counts the symbolic
+   * links followed so far. Return 0 or a negative errno number.
+   */
+  int walk(MemFsInodePtr start, const std::string &path, bool follow,
+           int depth, MemFsInodePtr *inode);
+
+  /**
+   * Look up path relative to dirfd, as the *at system calls do.
+   */
+  int lookup(int dirfd, const char *path, bool follow, MemFsInodePtr *inode);
+
+  /**
+   * Look up the directory path is in and return the last component of
+   * path in name. Paths without a last component, like "/", ".." and
+   * ".", fail with dot_errno, which differs among the system calls.
+   */
+  int lookup_parent(int dirfd, const char *path, int dot_errno,
+                    MemFsInodePtr *parent, std::string *name);
+
+  /**
+   * Make an inode with mode and add it to directory parent as name.
+   * Return 0 or a negative errno number.
+   */
+  int create(const MemFsInodePtr &parent, const std::string &name,
+             mode_t mode, dev_t rdev, const std::string &target,
+             MemFsInodePtr *inode);
+
+  /**
+   * Remove the entry name from directory parent. directory tells
+   * whether it must be a directory (rmdir) or must not be (unlink).
+   */
+  int remove(const MemFsInodePtr &parent, const std::string &name,
+             bool directory);
+
+  /**
+   * Drop a link to inode, removing it from the inode table once it has
+   * none left; the open files of it keep its data. The caller holds the
+   * mutex of inode.
+   */
+  void drop_link(const MemFsInodePtr &inode);
+
+  /**
+   * Copy up to count bytes at offset out of the data of inode, reading
+   * holes as zeros, and return the number of bytes copied.
+   * The caller holds the mutex of inode.
+   */
+  ssize_t read_data(MemFsInode &inode, char *buf, size_t count, off_t offset);
+
+  /**
+   * Copy count bytes into the data of inode at offset, allocating the
+   * extents, and return count. The caller holds the mutex of inode.
+   */
+  ssize_t write_data(MemFsInode &inode, const char *buf, size_t count,
+                     off_t offset);
+
+  /**
+   * Set the size of inode to length, freeing the extents past it and
+   * zeroing the rest of the last one. The caller holds the mutex of
+   * inode.
+   */
+  void truncate_data(MemFsInode &inode, off_t length);
+
+  /**
+   * Read or write the vector of buffers iov at offset of the open file,
+   * or at its file position if offset is negative.
+   */
+  ssize_t transfer(int fd, const struct iovec *iov, int iovcnt, off_t offset,
+                   bool write);
+
+  /**
+   * Fill buf with the attributes of inode.
+   */
+  void fill_stat(const MemFsInodePtr &inode, struct stat *buf);
+
+  /**
+   * Set the access and modification times of inode, to now for a NULL
+   * times, with the UTIME_NOW and UTIME_OMIT of utimensat.
+   */
+  int set_times(const MemFsInodePtr &inode, const struct timespec times[2]);
+
+  /**
+   * Set the extended attribute name of inode, with the XATTR_CREATE and
+   * XATTR_REPLACE flags of setxattr.
+   */
+  int set_xattr(const MemFsInodePtr &inode, const char *name,
+                const void *value, size_t size, int flags);
+
+  /**
+   * Return value, or set errno to the negative errno number value and
+   * return -1.
+   */
+  static int64_t result(int64_t value);
+
+ public:
+  /**
+   * Constructor
+   *
+   * Makes the root directory and the fds of stdin, stdout and stderr.
+   */
+  MemFsSyscallEngine();
+
+  int access(const char *path, int mode) override;
+  int faccessat(int dirfd, const char *path, int mode, int flags) override;
+  int stat(const char *path, struct stat *buf) override;
+  int lstat(const char *path, struct stat *buf) override;
+  int fstat(int fd, struct stat *buf) override;
+  int fstatat(int dirfd, const char *path, struct stat *buf,
+              int flags) override;
+  int statfs(const char *path, struct statfs *buf) override;
+  int fstatfs(int fd, struct statfs *buf) override;
+  int chdir(const char *path) override;
+  int fchdir(int fd) override;
+  int chmod(const char *path, mode_t mode) override;
+  int fchmod(int fd, mode_t mode) override;
+  int fchmodat(int dirfd, const char *path, mode_t mode, int flags) override;
+  int chown(const char *path, uid_t owner, gid_t group) override;
+  int openat(int dirfd, const char *path, int flags, mode_t mode) override;
+  int creat(const char *path, mode_t mode) override;
+  int close(int fd) override;
+  int dup(int fd) override;
+  int dup2(int old_fd, int new_fd) override;
+  int dup3(int old_fd, int new_fd, int flags) override;
+  using NullSyscallEngine::fcntl;
+  int fcntl(int fd, int cmd, long arg) override;
+  int pipe(int fds[2]) override;
+  ssize_t read(int fd, void *buf, size_t count) override;
+  ssize_t pread(int fd, void *buf, size_t count, off_t offset) override;
+  ssize_t readv(int fd, const struct iovec *iov, int iovcnt) override;
+  ssize_t write(int fd, const void *buf, size_t count) override;
+  ssize_t pwrite(int fd, const void *buf, size_t count,
+                 off_t offset) override;
+  ssize_t writev(int fd, const struct iovec *iov, int iovcnt) override;
+  off_t lseek(int fd, off_t offset, int whence) override;
+  ssize_t readahead(int fd, off64_t offset, size_t count) override;
+  int fallocate(int fd, int mode, off_t offset, off_t len) override;
+  int fsync(int fd) override;
+  int fdatasync(int fd) override;
+  int truncate(const char *path, off_t length) override;
+  int ftruncate(int fd, off_t length) override;
+  long getdents(int fd, void *buf, unsigned int count) override;
+  int mkdir(const char *path, mode_t mode) override;
+  int mkdirat(int dirfd, const char *path, mode_t mode) override;
+  int mknod(const char *path, mode_t mode, dev_t dev) override;
+  int rmdir(const char *path) override;
+  int link(const char *old_path, const char *new_path) override;
+  int linkat(int old_dirfd, const char *old_path, int new_dirfd,
+             const char *new_path, int flags) override;
+  int symlink(const char *target, const char *link_path) override;
+  ssize_t readlink(const char *path, char *buf, size_t size) override;
+  int rename(const char *old_path, const char *new_path) override;
+  int unlink(const char *path) override;
+  int unlinkat(int dirfd, const char *path, int flags) override;
+  int utime(const char *path, const struct utimbuf *times) override;
+  int utimes(const char *path, const struct timeval times[2]) override;
+  int utimensat(int dirfd, const char *path, const struct timespec times[2],
+                int flags) override;
+  int setxattr(const char *path, const char *name, const void *value,
+               size_t size, int flags) override;
+  int lsetxattr(const char *path, const char *name, const void *value,
+                size_t size, int flags) override;
+  int fsetxattr(int fd, const char *name, const void *value, size_t size,
+                int flags) override;
+};
+
+#endif /* MEMFS_SYSCALL_ENGINE_HPP */
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides a small benchmark harness in the style of
+ * Google Benchmark, so that the hot paths of the replayer can be timed
+ * without another dependency.
+ *
+ * A benchmark is a function that takes a BenchmarkState and times the
+ * loop `while (state.running()) { ... }`; what it does before the loop
+ * is not timed. Benchmarks are registered with an argument, such as a
+ * table size, and a number of threads that run the function at once.
+ * The runner grows the number of iterations until a run takes at least
+ * the minimum time, then reports the time per iteration and the items
+ * or bytes per second the benchmark declared.
+ *
+ * USAGE
+ * Register benchmarks with MicroBenchmarks::add() and call
+ * MicroBenchmarks::run(), which prints a table to std::cout.
+ */
+
+#ifndef MICRO_BENCHMARK_HPP
+#define MICRO_BENCHMARK_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class BenchmarkState {
+ private:
+  friend class MicroBenchmarks;
+  int64_t arg_;
+  int thread_index_;
+  int threads_;
+  uint64_t iterations_;
+  uint64_t remaining_;
+  std::chrono::steady_clock::time_point started_;
+  // Time of the loop, without the paused time
+  std::chrono::nanoseconds elapsed_;
+  uint64_t items_;
+  uint64_t bytes_;
+
+  BenchmarkState(int64_t arg, int thread_index, int threads,
+                 uint64_t iterations);
+
+ public:
+  /**
+   * Return true while iterations are left, starting the timer on the
+   * first call and stopping it on the last.
+   */
+  bool running() {
+    if (remaining_ != 0) {
+      if (remaining_-- == iterations_) {
+        started_ = std::chrono::steady_clock::now();
+      }
+      return true;
+    }
+    elapsed_ += std::chrono::steady_clock::now() - started_;
+    return false;
+  }
+
+  /**
+   * Stop the timer, for work of the loop that is not to be timed.
+   */
+  void pause() { elapsed_ += std::chrono::steady_clock::now() - started_; }
+
+  /**
+   * Restart the timer stopped by pause().
+   */
+  void resume() { started_ = std::chrono::steady_clock::now(); }
+
+  int64_t arg() const { return arg_; }
+  int thread_index() const { return thread_index_; }
+  int threads() const { return threads_; }
+  uint64_t iterations() const { return iterations_; }
+
+  /**
+   * Declare the items or bytes processed by this thread, reported per
+   * second of all threads.
+   */
+  void set_items_processed(uint64_t items) { items_ = items; }
+  void set_bytes_processed(uint64_t bytes) { bytes_ = bytes; }
+};
+
+class MicroBenchmarks {
+ private:
+  struct Benchmark {
+    std::string name;
+    std::function<void(BenchmarkState &)> function;
+    int64_t arg;
+    int threads;
+  };
+
+  std::vector<Benchmark> benchmarks_;
+
+  /**
+   * Run benchmark with iterations in every thread, and return the mean
+   * time of the threads in seconds.
+   */
+  double run_once(const Benchmark &benchmark, uint64_t iterations,
+                  uint64_t &items, uint64_t &bytes);
+
+ public:
+  /**
+   * Register function as name, run with arg in threads threads. The
+   * reported name is name/arg, with /threads:N appended if N > 1.
+   */
+  void add(const std::string &name,
+           std::function<void(BenchmarkState &)> function, int64_t arg = -1,
+           int threads = 1);
+
+  /**
+   * Run the benchmarks whose name contains filter, each for at least
+   * min_time seconds, and print the results. Return the number of
+   * benchmarks run.
+   */
+  int run(const std::string &filter, double min_time);
+
+  /**
+   * Print the names of the benchmarks.
+   */
+  void list() const;
+};
+
+#endif /* MICRO_BENCHMARK_HPP */
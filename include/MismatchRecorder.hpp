@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides members and functions for recording the
+ * system calls whose replay did not match the trace.
+ *
+ * MismatchRecorder is a class that writes one DataSeries record per
+ * mismatch, with the unique id and name of the system call, the traced
+ * and replayed return values and errno numbers, and digests of the traced
+ * and replayed payloads instead of the payloads themselves. The records
+ * are read back with mismatch-report, which prints or summarizes them.
+ *
+ * USAGE
+ * A main program creates one MismatchRecorder with the name of the output
+ * file, and the replaying modules call record() for each mismatch from
+ * any thread. The file is complete once close() is called or the
+ * recorder is destroyed.
+ */
+
+#ifndef MISMATCH_RECORDER_HPP
+#define MISMATCH_RECORDER_HPP
+
+#include <DataSeries/ByteField.hpp>
+#include <DataSeries/DataSeriesFile.hpp>
+#include <DataSeries/ExtentType.hpp>
+#include <DataSeries/Int32Field.hpp>
+#include <DataSeries/Int64Field.hpp>
+#include <DataSeries/OutputModule.hpp>
+#include <DataSeries/Variable32Field.hpp>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Extent type of the mismatch records
+#define MISMATCH_EXTENT_TYPE "IOTTAFSL::Replayer::Mismatch"
+
+enum MismatchKind {
+  // The replayed return value differs from the traced one
+  MISMATCH_RETURN_VALUE,
+  // Both calls failed, with different errno numbers
+  MISMATCH_ERRNO,
+  // The data returned by the replayed call differs from the traced data
+  MISMATCH_DATA
+};
+
+/*
+ * One mismatch, as passed to MismatchRecorder::record(). The digests and
+ * first_difference are only meaningful if has_payload is set.
+ */
+struct Mismatch {
+  int64_t unique_id;
+  int64_t time_called;
+  int32_t executing_pid;
+  std::string syscall;
+  MismatchKind kind;
+  int64_t traced_return_value;
+  int64_t replayed_return_value;
+  int32_t traced_errno;
+  int32_t replayed_errno;
+  bool has_payload;
+  uint64_t traced_digest;
+  uint64_t replayed_digest;
+  // Offset of the first byte that differs, -1 if only the sizes differ
+  int64_t first_difference;
+};
+
+class MismatchRecorder {
+ private:
+  std::mutex lock_;
+  bool closed_;
+  DataSeriesSink sink_;
+  ExtentTypeLibrary library_;
+  const ExtentType::Ptr type_;
+  ExtentSeries series_;
+  std::unique_ptr<OutputModule> output_;
+  Int64Field unique_id_;
+  Int64Field time_called_;
+  Int32Field executing_pid_;
+  Variable32Field syscall_;
+  ByteField kind_;
+  Int64Field traced_return_value_;
+  Int64Field replayed_return_value_;
+  Int32Field traced_errno_;
+  Int32Field replayed_errno_;
+  Int64Field traced_digest_;
+  Int64Field replayed_digest_;
+  Int64Field first_difference_;
+
+ public:
+  /**
+   * Constructor, which creates filename and writes the extent type of the
+   * records to it.
+   */
+  explicit MismatchRecorder(const std::string &filename);
+
+  /**
+   * Append a record for mismatch. Records after close() are ignored.
+   */
+  void record(const Mismatch &mismatch);
+
+  /**
+   * Write the buffered records and the index of the file and close it.
+   * Called before aborting the replay, so that the file can be read.
+   */
+  void close();
+
+  /**
+   * Return a 64-bit FNV-1a hash of size bytes at data.
+   */
+  static uint64_t digest(const void *data, size_t size);
+
+  /**
+   * Fill in the payload fields of mismatch from the traced and replayed
+   * data.
+   */
+  static void set_payload(Mismatch &mismatch, const void *traced_data,
+                          size_t traced_size, const void *replayed_data,
+                          size_t replayed_size);
+
+  /**
+   * Destructor, which closes the file.
+   */
+  ~MismatchRecorder();
+};
+
+#endif /* MISMATCH_RECORDER_HPP */
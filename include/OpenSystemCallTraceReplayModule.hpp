@@ -45,6 +45,8 @@
 
 class OpenSystemCallTraceReplayModule : public SystemCallTraceReplayModule {
  protected:
+  // True if files are opened with O_DIRECT to bypass the page cache
+  bool direct_;
   // Open System Call Trace Fields in Dataseries file
   Variable32Field given_pathname_;
   Int32Field open_value_;
@@ -59,6 +61,14 @@ class OpenSystemCallTraceReplayModule : public SystemCallTraceReplayModule {
    */
   void print_specific_fields() override;
 
+  /**
+   * Replay openat() with the traced flags, adding O_DIRECT in direct mode.
+   * If the file system rejects O_DIRECT, the file is opened again without
+   * it. open_flags is set to the flags the file was actually opened with.
+   */
+  int replay_open(int dirfd, const char *path, int traced_flags, mode_t mode,
+                  int &open_flags);
+
   /**
    * This function will gather arguments in the trace file
    * and replay an open system call with those arguments.
@@ -67,10 +77,10 @@ class OpenSystemCallTraceReplayModule : public SystemCallTraceReplayModule {
 
  public:
   OpenSystemCallTraceReplayModule(DataSeriesModule &source, bool verbose_flag,
-                                  int warn_level_flag);
+                                  int warn_level_flag, bool direct_flag);
   SystemCallTraceReplayModule *move() override {
-    auto movePtr =
-        new OpenSystemCallTraceReplayModule(source, verbose_, warn_level_);
+    auto movePtr = new OpenSystemCallTraceReplayModule(source, verbose_,
+                                                       warn_level_, direct_);
     movePtr->setMove(pathname, modeVal, flags, traced_fd);
     movePtr->setCommon(uniqueIdVal, timeCalledVal, timeReturnedVal,
                        timeRecordedVal, executingPidVal, errorNoVal, returnVal,
@@ -105,7 +115,7 @@ class OpenatSystemCallTraceReplayModule
 
  public:
   OpenatSystemCallTraceReplayModule(DataSeriesModule &source, bool verbose_flag,
-                                    int warn_level_flag);
+                                    int warn_level_flag, bool direct_flag);
 };
 
 #endif /* OPEN_SYSTEM_CALL_TRACE_REPLAY_MODULE_HPP */
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides members and functions for putting the page
+ * cache into a known state before a trace is replayed.
+ *
+ * PageCacheManager is a class that scans the open, read and related
+ * records of the trace to find the files the trace opens and the byte
+ * ranges it reads. It can then evict those files from the page cache
+ * (cold cache) or read the ranges into it (warm cache), so that runs of
+ * the same trace start from the same cache state.
+ *
+ * USAGE
+ * A main program could initialize this class with the logger, call scan()
+ * with the DataSeries input files, then call drop() or warm() before
+ * replaying any system call.
+ */
+
+#ifndef PAGE_CACHE_MANAGER_HPP
+#define PAGE_CACHE_MANAGER_HPP
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "SystemCallTraceReplayLogger.hpp"
+
+// Size of the buffer used to read files into the page cache.
+#define PAGE_CACHE_WARM_BUFFER_SIZE (1024 * 1024)
+
+class PageCacheManager {
+ private:
+  // A trace record that changes or uses the file position of a descriptor.
+  enum EventType { OPEN, READ, PREAD, LSEEK, CLOSE };
+  struct Event {
+    int64_t unique_id;
+    EventType type;
+    pid_t pid;
+    int fd;
+    // Directory fd and traced path, for OPEN only
+    int dirfd;
+    std::string path;
+    // Offset for PREAD, new file position for LSEEK
+    int64_t offset;
+    // Bytes actually read for READ and PREAD
+    int64_t length;
+  };
+  // A file opened by the traced application, as seen by the scan.
+  struct OpenFile {
+    int64_t path;
+    int64_t position;
+  };
+  typedef std::map<int, OpenFile> FdTable;
+  typedef std::vector<std::pair<int64_t, int64_t>> RangeList;
+
+  SystemCallTraceReplayLogger *logger_;
+  // Every path the trace opens, indexed by path id
+  std::vector<std::string> paths_;
+  std::unordered_map<std::string, int64_t> path_ids_;
+  // Byte ranges [begin, end) read from each path, indexed by path id
+  std::vector<RangeList> read_ranges_;
+
+  /**
+   * Return the id of path, adding it to paths_ if it is new.
+   */
+  int64_t intern(const std::string &path);
+
+  /**
+   * Read the open, openat, read, pread, lseek and close records of
+   * input_files and return them in unique id order.
+   */
+  std::vector<Event> load_events(const std::vector<std::string> &input_files);
+
+  /**
+   * Merge the overlapping and adjacent ranges of ranges in place.
+   */
+  static void merge_ranges(RangeList &ranges);
+
+ public:
+  /**
+   * Constructor
+   */
+  explicit PageCacheManager(SystemCallTraceReplayLogger *logger);
+
+  /**
+   * Compute the working set of the trace stored in input_files: the
+   * files it opens and the byte ranges read by read and pread records.
+   * File positions are followed through open, read, lseek and close.
+   */
+  void scan(const std::vector<std::string> &input_files);
+
+  /**
+   * Write back and evict every file the trace opens from the page cache
+   * with posix_fadvise(POSIX_FADV_DONTNEED).
+   */
+  void drop();
+
+  /**
+   * Read every byte range the trace reads into the page cache.
+   */
+  void warm();
+};
+
+#endif /* PAGE_CACHE_MANAGER_HPP */
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides members and functions for generating the
+ * pseudo-random payloads used by --pattern random and urandom.
+ *
+ * PatternGenerator is a class that implements the Philox4x32-10 counter
+ * based generator. Every 16-byte block of a payload is a pure function of
+ * the run seed, the unique id of the record and the position of the block
+ * in the payload, so payloads are reproducible across runs, need no shared
+ * state between threads, and can be generated eight blocks at a time with
+ * AVX2 when the CPU supports it.
+ *
+ * USAGE
+ * A main program could initialize this class once with the run seed and
+ * share it between all executor threads, which call fill() to generate
+ * the payload of a record.
+ */
+
+#ifndef PATTERN_GENERATOR_HPP
+#define PATTERN_GENERATOR_HPP
+
+#include <stddef.h>
+#include <cstdint>
+
+// Number of bytes produced by one Philox4x32 block
+#define PATTERN_BLOCK_SIZE 16
+
+class PatternGenerator {
+ private:
+  uint64_t seed_;
+  // True if the CPU supports AVX2
+  bool use_avx2_;
+
+  /**
+   * Compute the Philox4x32-10 block at index block of stream and store
+   * its 16 bytes in out.
+   */
+  void generate_block(uint64_t stream, uint64_t block, uint32_t out[4]) const;
+
+  /**
+   * Fill nblocks whole blocks of stream starting at block first into
+   * buffer, eight blocks at a time.
+   */
+  void generate_blocks_avx2(char *buffer, uint64_t stream, uint64_t first,
+                            size_t nblocks) const;
+
+ public:
+  /**
+   * Constructor
+   */
+  explicit PatternGenerator(uint64_t seed = 0);
+
+  /**
+   * Set the seed of the run. It must not change while executor threads
+   * are running.
+   */
+  void set_seed(uint64_t seed);
+
+  /**
+   * Return the seed of the run.
+   */
+  uint64_t seed() const;
+
+  /**
+   * Fill buffer with nbytes of the payload of stream (the unique id of
+   * the record) starting at byte offset of that payload.
+   */
+  void fill(char *buffer, size_t nbytes, uint64_t stream,
+            uint64_t offset = 0) const;
+};
+
+#endif /* PATTERN_GENERATOR_HPP */
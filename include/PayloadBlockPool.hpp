@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides members and functions for generating write
+ * payloads with a target compression ratio and dedup ratio.
+ *
+ * PayloadBlockPool is a class that builds a pool of blocks when the
+ * replayer starts. Every block holds block_size / compress pseudo-random
+ * bytes followed by zeros, so compressing it saves the requested ratio.
+ * A payload is cut into blocks; a fraction dedup of them are copies of a
+ * small set of shared blocks, and the rest are pool blocks stamped with a
+ * tag unique to the record and position, so that they never dedup. Filling
+ * a payload costs a memcpy per block.
+ *
+ * USAGE
+ * A main program could initialize this class with the specification given
+ * by --pattern gen:compress=2.5,dedup=0.3,block=4k, call build() once with
+ * the run seed and share it between all executor threads.
+ */
+
+#ifndef PAYLOAD_BLOCK_POOL_HPP
+#define PAYLOAD_BLOCK_POOL_HPP
+
+#include <stddef.h>
+#include <cstdint>
+#include <string>
+
+#include "PatternGenerator.hpp"
+
+// Number of distinct blocks that payloads are assembled from
+#define PAYLOAD_POOL_BLOCKS 1024
+// Number of the pool blocks shared by all duplicate blocks
+#define PAYLOAD_DEDUP_BLOCKS 64
+// Bytes at the start of a unique block overwritten with its tag
+#define PAYLOAD_TAG_SIZE PATTERN_BLOCK_SIZE
+#define PAYLOAD_DEFAULT_BLOCK_SIZE 4096
+#define PAYLOAD_MAX_BLOCK_SIZE (1024 * 1024)
+
+class PayloadBlockPool {
+ private:
+  double compress_;
+  double dedup_;
+  size_t block_size_;
+  uint64_t seed_;
+  // PAYLOAD_POOL_BLOCKS blocks of block_size_ bytes
+  char *pool_;
+  PatternGenerator generator_;
+
+  /**
+   * Parse a size such as 4096, 4k or 1m. Return 0 if size is malformed.
+   */
+  static size_t parse_size(const std::string &size);
+
+  /**
+   * Copy the block at index block of the payload of stream into buffer,
+   * starting skip bytes into the block and copying length bytes.
+   */
+  void copy_block(char *buffer, uint64_t stream, uint64_t block, size_t skip,
+                  size_t length) const;
+
+ public:
+  /**
+   * Constructor
+   */
+  PayloadBlockPool();
+
+  /**
+   * Destructor that frees the pool.
+   */
+  ~PayloadBlockPool();
+
+  /**
+   * Read the comma-separated compress=, dedup= and block= settings of
+   * spec. Settings that are left out keep their defaults of compress=1,
+   * dedup=0 and block=4k.
+   * Return false if spec is malformed or out of range.
+   */
+  bool configure(const std::string &spec);
+
+  /**
+   * Generate the blocks of the pool from seed.
+   */
+  void build(uint64_t seed);
+
+  /**
+   * Fill buffer with nbytes of the payload of stream (the unique id of
+   * the record) starting at byte offset of that payload.
+   */
+  void fill(char *buffer, size_t nbytes, uint64_t stream,
+            uint64_t offset = 0) const;
+};
+
+#endif /* PAYLOAD_BLOCK_POOL_HPP */
@@ -52,12 +52,33 @@ class ReadSystemCallTraceReplayModule : public SystemCallTraceReplayModule {
   int nbytes;
   char *buffer;
   char *dataReadBuf;
+  // True if buffer was taken from aligned_buffer_pool_
+  bool aligned_buffer_;
 
   /**
    * Print read sys call field values in a nice format
    */
   void print_specific_fields() override;
 
+  /**
+   * Replace buffer with a buffer from aligned_buffer_pool_ so that it
+   * can be used with a file descriptor opened with O_DIRECT.
+   */
+  void use_aligned_buffer();
+
+  /**
+   * Free buffer, giving it back to the pool if it came from there.
+   */
+  void release_buffer();
+
+  /**
+   * Submit the read on fd, which is opened with O_DIRECT, to the async
+   * I/O engine if the engine is enabled and the request is aligned.
+   * offset is -1 for read, which uses the file position instead.
+   * Return true if the read was submitted.
+   */
+  bool submit_direct_io(int fd, off_t offset);
+
   /**
    * This function will gather arguments in the trace file
    * and then replay an read system call with those arguments.
@@ -69,6 +90,9 @@ class ReadSystemCallTraceReplayModule : public SystemCallTraceReplayModule {
  public:
   ReadSystemCallTraceReplayModule(DataSeriesModule &source, bool verbose_flag,
                                   bool verify_flag, int warn_level_flag);
+  bool supports_async_io() const override { return true; }
+  bool transfers_data() const override { return true; }
+  void complete_async_io(int64_t result) override;
   SystemCallTraceReplayModule *move() override {
     auto movePtr = new ReadSystemCallTraceReplayModule(source, verbose_,
                                                        verify_, warn_level_);
@@ -146,6 +170,7 @@ class MmapPReadSystemCallTraceReplayModule
   MmapPReadSystemCallTraceReplayModule(DataSeriesModule &source,
                                        bool verbose_flag, bool verify_flag,
                                        int warn_level_flag);
+  bool supports_async_io() const override { return false; }
   SystemCallTraceReplayModule *move() override {
     auto movePtr = new MmapPReadSystemCallTraceReplayModule(
         source, verbose_, verify_, warn_level_);
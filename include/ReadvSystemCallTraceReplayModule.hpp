@@ -53,12 +53,39 @@ class ReadvSystemCallTraceReplayModule : public SystemCallTraceReplayModule {
   Int32Field iov_number_;
   Variable32Field data_read_;
   Int64Field bytes_requested_;
+  int traced_fd;
+  int iovcnt;
+  size_t nbytes;
+  /*
+   * One allocation that holds the iovec array, followed in verify mode
+   * by the number of bytes captured in the trace for each iovec, then by
+   * the nbytes the iovecs point to, followed in verify mode by the nbytes
+   * of data read in the trace.
+   */
+  char *arena;
+
+  /**
+   * Return the iovec array at the start of arena.
+   */
+  struct iovec *iov() { return reinterpret_cast<struct iovec *>(arena); }
+
+  /**
+   * Return the captured sizes of the iovecs, which follow iov().
+   */
+  size_t *captured() {
+    return reinterpret_cast<size_t *>(arena + iovcnt * sizeof(struct iovec));
+  }
 
   /**
    * Print readv sys call field values in a nice format
    */
   void print_specific_fields() override;
 
+  /**
+   * Compare the data read by the replayed readv with the traced data.
+   */
+  void verifyRow();
+
   /**
    * This function will gather arguments in the trace file
    * and then replay an readv system call with those arguments.
@@ -68,5 +95,27 @@ class ReadvSystemCallTraceReplayModule : public SystemCallTraceReplayModule {
  public:
   ReadvSystemCallTraceReplayModule(DataSeriesModule &source, bool verbose_flag,
                                    bool verify_flag, int warn_level_flag);
+  bool transfers_data() const override { return true; }
+  SystemCallTraceReplayModule *move() override {
+    auto movePtr = new ReadvSystemCallTraceReplayModule(source, verbose_,
+                                                        verify_, warn_level_);
+    movePtr->setMove(traced_fd, iovcnt, nbytes, arena);
+    movePtr->setCommon(uniqueIdVal, timeCalledVal, timeReturnedVal,
+                       timeRecordedVal, executingPidVal, errorNoVal, returnVal,
+                       replayerIndex);
+    return movePtr;
+  }
+  void setMove(int fd, int count, size_t bytes, char *buffer) {
+    traced_fd = fd;
+    iovcnt = count;
+    nbytes = bytes;
+    arena = buffer;
+  }
+
+  /**
+   * Read the first record and all iovec records of a readv call and
+   * build the iovec array and buffers in arena.
+   */
+  void prepareRow() override;
 };
 #endif /* READV_SYSTEM_CALL_TRACE_REPLAY_MODULE_HPP */
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides members and functions for measuring where
+ * the replayer spends its time.
+ *
+ * ReplayProfiler counts how often each stage of the replay runs and how
+ * long it takes: decoding records, moving and enqueueing them, popping
+ * them from the execution heaps, waiting for the scheduler, executing,
+ * verifying and logging the system calls, reclaiming the records, and
+ * the reader waiting for the executors to catch up.
+ * Every thread adds to counters of its own, so that profiling takes no
+ * lock and no shared cache line. The counters are summed when reported,
+ * periodically by a background thread and once more at exit.
+ *
+ * USAGE
+ * A main program creates one ReplayProfiler when --profile is given and
+ * stores it in SystemCallTraceReplayModule::profiler_. Stages are timed
+ * with a ProfileScope, which does nothing if the profiler is nullptr,
+ * except for verification while ProfileScope::time_verification is set.
+ */
+
+#ifndef REPLAY_PROFILER_HPP
+#define REPLAY_PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+// Seconds between the periodic reports of --profile without an argument
+#define PROFILE_DEFAULT_INTERVAL 10
+
+enum ProfileStage {
+  // prepareRow() of the records read from the DataSeries files
+  PROFILE_DECODE,
+  // move() of the records and pushing them to the execution heaps
+  PROFILE_ENQUEUE,
+  // Popping the next record from an execution heap
+  PROFILE_HEAP_POP,
+  // Waiting for the reader and for earlier records to be replayed
+  PROFILE_SCHEDULER_WAIT,
+  // processRow(), which replays the system call and verifies its data
+  PROFILE_EXECUTE,
+  /*
+   * Comparing the replayed return value, errno and data with the traced
+   * ones. Data is compared within processRow(), so that part is also
+   * counted as execution.
+   */
+  PROFILE_VERIFY,
+  // Logging the replayed system call in verbose mode
+  PROFILE_LOGGING,
+  // Deleting the replayed records
+  PROFILE_RECLAIM,
+  /*
+   * The reader stalled while the executors have enough records queued,
+   * including the reclamation it does meanwhile
+   */
+  PROFILE_READER_WAIT,
+  PROFILE_STAGES
+};
+
+class ReplayProfiler {
+ private:
+  // Counters of one thread, written by that thread only
+  struct ThreadCounters {
+    std::atomic<uint64_t> count[PROFILE_STAGES];
+    std::atomic<uint64_t> nanoseconds[PROFILE_STAGES];
+    // Keeps the counters of other threads off the last cache line
+    char padding[64];
+    ThreadCounters();
+  };
+
+  std::mutex counters_lock_;
+  std::vector<std::unique_ptr<ThreadCounters>> counters_;
+  std::chrono::steady_clock::time_point started_;
+  // Periodic reports, every interval_ seconds unless it is 0
+  unsigned int interval_;
+  std::ostream &out_;
+  bool stop_;
+  std::condition_variable stop_cv_;
+  std::thread reporter_;
+
+  /**
+   * Return the counters of the calling thread, creating them on first
+   * use.
+   */
+  ThreadCounters &thread_counters();
+
+  /**
+   * Write a report every interval_ seconds until stop() is called.
+   */
+  void report_periodically();
+
+ public:
+  /**
+   * Constructor. Reports are written to out, every interval seconds and
+   * when stop() is called.
+   */
+  ReplayProfiler(unsigned int interval, std::ostream &out);
+
+  /**
+   * Count one run of stage that took nanoseconds.
+   */
+  void add(ProfileStage stage, uint64_t nanoseconds);
+
+  /**
+   * Write the number of runs, total and mean time of each stage, summed
+   * over all threads.
+   */
+  void report();
+
+  /**
+   * Stop the periodic reports and write the final one.
+   */
+  void stop();
+
+  /**
+   * Destructor, which stops the periodic reports.
+   */
+  ~ReplayProfiler();
+};
+
+/*
+ * Times the scope it lives in as one run of a stage, if profiler is not
+ * nullptr. PROFILE_VERIFY scopes are also timed while time_verification
+ * is set, and added to verify_nanoseconds of the thread, so that the
+ * replayed latency of a call can leave its verification out.
+ */
+class ProfileScope {
+ private:
+  ReplayProfiler *profiler_;
+  ProfileStage stage_;
+  bool timed_;
+  std::chrono::steady_clock::time_point started_;
+
+ public:
+  // Set by the main program before any executor runs
+  static bool time_verification;
+  // Nanoseconds the calling thread spent in PROFILE_VERIFY scopes
+  static thread_local uint64_t verify_nanoseconds;
+
+  ProfileScope(ReplayProfiler *profiler, ProfileStage stage)
+      : profiler_(profiler),
+        stage_(stage),
+        timed_(profiler != nullptr ||
+               (stage == PROFILE_VERIFY && time_verification)) {
+    if (timed_) {
+      started_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  ~ProfileScope() {
+    if (!timed_) {
+      return;
+    }
+    uint64_t nanoseconds =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - started_)
+            .count();
+    if (stage_ == PROFILE_VERIFY) {
+      verify_nanoseconds += nanoseconds;
+    }
+    if (profiler_ != nullptr) {
+      profiler_->add(stage_, nanoseconds);
+    }
+  }
+
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+};
+
+#endif /* REPLAY_PROFILER_HPP */
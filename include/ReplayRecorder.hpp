@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides members and functions for recording the
+ * replay itself as a DataSeries trace.
+ *
+ * ReplayRecorder writes one record per replayed system call, keyed by
+ * the unique_id of the traced record, with the replayed time_called,
+ * time_returned and time_recorded, return_value and errno_number, the
+ * traced executing_pid and the thread of the replayer that executed it.
+ * The field names and units are those of the common fields of the
+ * traces, so tools that only read those fields work on the replay too.
+ *
+ * Unlike a trace, which has one IOTTAFSL::Trace::Syscall::<name> extent
+ * type per system call, every record is of the single REPLAY_EXTENT_TYPE
+ * with the name of the call in the syscall field: the arguments are not
+ * recorded, so the per-call types would only repeat the common fields.
+ * Analyses that select calls by extent type have to select by the
+ * syscall field instead, and executing_tid has no counterpart in a trace.
+ *
+ * Executors only append the records to a batch of their own. Full
+ * batches are handed to a background thread, which writes them, so that
+ * recording does not slow the replay down.
+ *
+ * USAGE
+ * A main program creates one ReplayRecorder when --record-replay is given
+ * and stores it in SystemCallTraceReplayModule::replay_recorder_. The
+ * modules call record() from any thread, each executor calls
+ * thread_finished() before it exits, and the file is complete once
+ * close() is called after every executor is done, or the recorder is
+ * destroyed.
+ */
+
+#ifndef REPLAY_RECORDER_HPP
+#define REPLAY_RECORDER_HPP
+
+#include <DataSeries/DataSeriesFile.hpp>
+#include <DataSeries/ExtentType.hpp>
+#include <DataSeries/Int32Field.hpp>
+#include <DataSeries/Int64Field.hpp>
+#include <DataSeries/OutputModule.hpp>
+#include <DataSeries/Variable32Field.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Extent type of the replayed records
+#define REPLAY_EXTENT_TYPE "IOTTAFSL::Replayer::ReplayedCall"
+// Records an executor collects before handing them to the writer
+#define REPLAY_BATCH_SIZE 4096
+
+// One replayed system call, as passed to ReplayRecorder::record()
+struct ReplayedCall {
+  int64_t unique_id;
+  // Replayer index of the system call
+  int64_t syscall;
+  std::chrono::steady_clock::time_point called;
+  std::chrono::steady_clock::time_point returned;
+  int64_t return_value;
+  int32_t errno_number;
+  int32_t executing_pid;
+  // Filled in by record()
+  int32_t executing_tid;
+};
+
+class ReplayRecorder {
+ private:
+  typedef std::vector<ReplayedCall> Batch;
+
+  const std::vector<std::string> syscall_names_;
+  // Wall clock time of steady_start_, in Tfracs
+  uint64_t wall_start_;
+  std::chrono::steady_clock::time_point steady_start_;
+
+  DataSeriesSink sink_;
+  ExtentTypeLibrary library_;
+  const ExtentType::Ptr type_;
+  ExtentSeries series_;
+  std::unique_ptr<OutputModule> output_;
+  Int64Field unique_id_;
+  Variable32Field syscall_;
+  Int64Field time_called_;
+  Int64Field time_returned_;
+  Int64Field time_recorded_;
+  Int64Field return_value_;
+  Int32Field errno_number_;
+  Int32Field executing_pid_;
+  Int32Field executing_tid_;
+
+  std::mutex lock_;
+  // Batch of each thread that recorded, filled by that thread only
+  std::vector<std::unique_ptr<Batch>> thread_batches_;
+  // Full batches waiting for the writer
+  std::deque<Batch> full_batches_;
+  std::condition_variable full_cv_;
+  bool closed_;
+  std::thread writer_;
+
+  /**
+   * Return the batch of the calling thread, creating it on first use.
+   */
+  Batch &thread_batch();
+
+  /**
+   * Convert a steady clock time to wall clock Tfracs (2^-32 seconds).
+   */
+  int64_t to_tfracs(std::chrono::steady_clock::time_point time) const;
+
+  /**
+   * Write the records of batch to the file.
+   */
+  void write(const Batch &batch);
+
+  /**
+   * Write the full batches until close() is called.
+   */
+  void write_batches();
+
+ public:
+  /**
+   * Constructor, which creates filename. syscall_names holds the name of
+   * each system call by replayer index.
+   */
+  ReplayRecorder(const std::string &filename,
+                 std::vector<std::string> syscall_names);
+
+  /**
+   * Append the record of call, executed by the calling thread.
+   */
+  void record(ReplayedCall call);
+
+  /**
+   * Hand the partial batch of the calling thread to the writer and free
+   * it. Executors call this before they exit, so that a batch is not
+   * held for each thread the replay ever started.
+   */
+  void thread_finished();
+
+  /**
+   * Write the remaining records and close the file. No thread may call
+   * record() from now on.
+   */
+  void close();
+
+  /**
+   * Destructor, which closes the file.
+   */
+  ~ReplayRecorder();
+};
+
+#endif /* REPLAY_RECORDER_HPP */
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides members and functions for reporting the
+ * progress of a replay while it runs.
+ *
+ * ReplayTelemetry rewrites a JSON stats file every interval with the
+ * number of calls and bytes replayed per system call and their rates,
+ * the unique id and traced time of the latest replayed record next to
+ * the wall clock time, the queue depths per process and per system
+ * call, the number of running executor threads, how long the reader
+ * has stalled, and the number of mismatches of each kind. Every thread
+ * adds to counters of its own, so that counting takes no lock and no
+ * shared cache line; the reporter thread sums them.
+ *
+ * USAGE
+ * A main program creates one ReplayTelemetry when --stats-file is given
+ * and stores it in SystemCallTraceReplayModule::telemetry_. The thread
+ * that adds processes to the execution heaps calls sample_queues() in
+ * its loop, so that the heaps are never walked while they change. The
+ * file is written atomically, so that it can be read at any time, e.g.
+ * with watch cat FILE.
+ */
+
+#ifndef REPLAY_TELEMETRY_HPP
+#define REPLAY_TELEMETRY_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MismatchRecorder.hpp"
+
+// Number of MismatchKind values
+#define MISMATCH_KINDS 3
+
+// Queued records, sampled by the main program for each report
+struct QueueDepths {
+  // Records in the execution heap of each process
+  std::map<int64_t, uint64_t> per_pid;
+  // Records read ahead for each system call, by replayer index
+  std::vector<uint64_t> per_syscall;
+};
+
+class ReplayTelemetry {
+ public:
+  typedef std::function<void(QueueDepths &)> QueueSampler;
+
+ private:
+  // Counters of one system call in one thread
+  struct SyscallCounters {
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> bytes;
+  };
+
+  // Counters of one thread, written by that thread only
+  struct ThreadCounters {
+    std::unique_ptr<SyscallCounters[]> syscalls;
+    std::atomic<int64_t> last_unique_id;
+    std::atomic<uint64_t> last_time_called;
+    std::atomic<uint64_t> first_time_called;
+    std::atomic<uint64_t> mismatches[MISMATCH_KINDS];
+    // Keeps the counters of other threads off the last cache line
+    char padding[64];
+    explicit ThreadCounters(size_t syscalls);
+  };
+
+  // Totals of all threads at the time of a report
+  struct Totals {
+    std::vector<uint64_t> calls;
+    std::vector<uint64_t> bytes;
+    int64_t last_unique_id;
+    uint64_t last_time_called;
+    uint64_t first_time_called;
+    uint64_t mismatches[MISMATCH_KINDS];
+  };
+
+  const std::string filename_;
+  const std::vector<std::string> syscall_names_;
+  const unsigned int interval_;
+  QueueSampler sample_queues_;
+  std::chrono::steady_clock::time_point started_;
+
+  std::mutex counters_lock_;
+  std::vector<std::unique_ptr<ThreadCounters>> counters_;
+  std::atomic<int> executors_;
+  std::atomic<uint64_t> reader_stall_ns_;
+  // Set when the reporter wants new queue depths
+  std::atomic<bool> queues_due_;
+  // Latest queue depths, protected by counters_lock_
+  QueueDepths queues_;
+
+  bool stop_;
+  std::condition_variable stop_cv_;
+  std::thread reporter_;
+
+  /**
+   * Return the counters of the calling thread, creating them on first
+   * use.
+   */
+  ThreadCounters &thread_counters();
+
+  /**
+   * Sum the counters of all threads.
+   */
+  Totals sum();
+
+  /**
+   * Write the stats file; previous holds the totals of the last report,
+   * which the rates are computed from.
+   */
+  void write(const Totals &totals, const Totals &previous,
+             const QueueDepths &queues, double interval_seconds);
+
+  /**
+   * Write the stats file every interval_ seconds until stop() is called.
+   */
+  void report_periodically();
+
+ public:
+  /**
+   * Constructor, which starts rewriting filename every interval seconds.
+   * syscall_names holds the name of each system call by replayer index,
+   * and sample_queues is called for the queue depths of each report.
+   */
+  ReplayTelemetry(const std::string &filename,
+                  std::vector<std::string> syscall_names,
+                  unsigned int interval, QueueSampler sample_queues);
+
+  /**
+   * Count one replayed call of the system call with replayer index
+   * syscall that transferred bytes bytes. unique_id and time_called are
+   * those of its record.
+   */
+  void count_call(int64_t syscall, uint64_t bytes, int64_t unique_id,
+                  uint64_t time_called);
+
+  /**
+   * Sample the queue depths if the reporter asked for them since the
+   * last call. Cheap enough to call in every iteration of a loop.
+   */
+  void sample_queues() {
+    if (queues_due_.load(std::memory_order_relaxed)) {
+      update_queues();
+    }
+  }
+
+  /**
+   * Sample the queue depths for the next report.
+   */
+  void update_queues();
+
+  /**
+   * Count one mismatch of the given kind.
+   */
+  void count_mismatch(MismatchKind kind);
+
+  /**
+   * Count the time the reader waited for the executors to catch up.
+   */
+  void add_reader_stall(uint64_t nanoseconds) {
+    reader_stall_ns_.fetch_add(nanoseconds, std::memory_order_relaxed);
+  }
+
+  /**
+   * Called by each executor thread when it starts and when it finishes.
+   */
+  void executor_started() { executors_++; }
+  void executor_finished() { executors_--; }
+
+  /**
+   * Stop the periodic updates and write the file a last time, with the
+   * queue depths sampled by the calling thread. Called once the replay
+   * is done.
+   */
+  void stop();
+
+  /**
+   * Destructor, which stops the periodic updates.
+   */
+  ~ReplayTelemetry();
+};
+
+#endif /* REPLAY_TELEMETRY_HPP */
@@ -43,15 +43,20 @@
 #include <sys/resource.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <tbb/concurrent_hash_map.h>
 #include <unistd.h>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <iterator>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_set>
 #include <utility>
 #include <vector>
+#include "FileDescriptorAllocator.hpp"
 #include "SystemCallTraceReplayLogger.hpp"
 
 /*
@@ -61,9 +66,22 @@
  */
 #define MAX_FD_TO_SCAN 100
 
+/*
+ * How validate_consistency() compares the fds that are open in the
+ * replayer with the fds known to the resource manager.
+ */
+enum ConsistencyCheckMode {
+  // Never compare
+  CONSISTENCY_CHECK_OFF,
+  // Compare only the fds added or removed since the last check
+  CONSISTENCY_CHECK_SAMPLED,
+  // Compare every open fd with every known fd
+  CONSISTENCY_CHECK_FULL
+};
+
 class BasicEntry {
  protected:
-  unsigned int rc_;
+  std::atomic<unsigned int> rc_;
 
  public:
   /**
@@ -85,7 +103,7 @@ class BasicEntry {
 
 class UmaskEntry : public BasicEntry {
  private:
-  mode_t umask_;
+  std::atomic<mode_t> umask_;
 
  public:
   /**
@@ -118,7 +136,7 @@ class FileDescriptorEntry {
   /**
    * Copy Constructor
    */
-  FileDescriptorEntry(FileDescriptorEntry& fd_entry);
+  FileDescriptorEntry(const FileDescriptorEntry& fd_entry);
 
   /**
    * Return file descriptor
@@ -146,43 +164,118 @@ class FileDescriptorEntry {
   std::string to_string();
 };
 
+/*
+ * An array of fd table slots. Each slot packs a replayed fd in its low
+ * 32 bits and the fd flags in its high 32 bits, so that a slot is read
+ * with a single atomic load.
+ *
+ * Tables of processes cloned without CLONE_FILES share the array of their
+ * parent copy-on-write: sharers counts the tables using it. An array is
+ * only changed in place by its last sharer. A private copy keeps using the
+ * same replayed fds, so every array holds one reference to each of its
+ * replayed fds, and a replayed fd is closed once no array refers to it.
+ */
+struct FileDescriptorSlots {
+  size_t size;
+  std::unique_ptr<std::atomic<uint64_t>[]> slots;
+  std::atomic<unsigned int> sharers;
+  // Bit i is set if the entry in slot i has O_CLOEXEC
+  std::vector<uint64_t> cloexec;
+
+  explicit FileDescriptorSlots(size_t n)
+      : size(n),
+        slots(new std::atomic<uint64_t>[n]),
+        sharers(1),
+        cloexec((n + 63) / 64, 0) {}
+};
+
 class FileDescriptorTableEntry : public BasicEntry {
  private:
-  // <traced fd, replayed FileDescriptorEntry>
-  std::map<int, FileDescriptorEntry*> fd_table_;
-  // TODO(Umit) might be removed I will take a look at
-  std::mutex fd_table_entry_mutex;
+  /*
+   * Slot traced fd + 1 holds the entry of traced fd, so that traced fd -1
+   * (an open that failed in the trace) has slot 0. Lookups load this
+   * pointer and the slot without taking any lock. A resize or a private
+   * copy publishes a new array; the old arrays stay in slot_arrays_ until
+   * the table is destroyed because a lookup may still be reading them.
+   * The current array is always slot_arrays_.back().
+   */
+  std::atomic<FileDescriptorSlots*> slots_;
+  std::vector<std::shared_ptr<FileDescriptorSlots>> slot_arrays_;
+  // Replayed fds used by the replayer, which learns about private copies
+  FileDescriptorAllocator* used_fds_;
+  /*
+   * Odd while a writer is changing a slot. Readers of the whole table
+   * retry until they see the same even generation before and after.
+   */
+  std::atomic<uint64_t> generation_;
+  // Serializes the writers
+  std::mutex write_lock_;
+
+  /**
+   * Return the slot of traced_fd, or an empty slot if it has none.
+   */
+  uint64_t load_slot(int traced_fd);
+
+  /**
+   * Store slot as the entry of traced_fd, growing the array if needed.
+   * The caller must hold write_lock_ and have called make_private().
+   */
+  void store_slot(int traced_fd, uint64_t slot);
+
+  /**
+   * Copy every slot of from into to.
+   */
+  void copy_slots(FileDescriptorSlots* from, FileDescriptorSlots* to);
+
+  /**
+   * Return the replayed fds in the slots of an array.
+   */
+  static std::vector<int> replayed_fds(FileDescriptorSlots* slots);
+
+  /**
+   * If the array is shared with other tables, give this table a private
+   * copy of the slots, which takes a reference to each replayed fd
+   * instead of duplicating it.
+   * The caller must hold write_lock_.
+   */
+  void make_private();
 
  public:
   /**
    * Basic Constructor
    */
-  FileDescriptorTableEntry();
+  explicit FileDescriptorTableEntry(FileDescriptorAllocator* used_fds);
 
   /**
-   * Copy Constructor
+   * Copy Constructor. The copy shares the array of fd_table_entry until
+   * either table changes.
    */
   FileDescriptorTableEntry(FileDescriptorTableEntry& fd_table_entry);
 
   /**
-   * Destructor that frees all the memory used by this table.
+   * Stop sharing the array, before the table is destroyed.
+   * Return true if this table was its last sharer, in which case the
+   * caller has to drop the references of the array to its replayed fds.
    */
-  ~FileDescriptorTableEntry();
+  bool detach();
 
   /**
-   * Return fd table
+   * Return a consistent copy of every <traced fd, replayed entry> in
+   * the table, in increasing order of traced fd.
    */
-  std::map<int, FileDescriptorEntry*>& get_fd_table();
+  std::vector<std::pair<int, FileDescriptorEntry>> get_entries();
 
   /**
    * Add a fd entry to the fd table.
+   * Return false if the entry was not added because the table already
+   * has an entry for traced fd -1.
    */
-  void add_fd_entry(int traced_fd, int replayed_fd, int flags);
+  bool add_fd_entry(int traced_fd, int replayed_fd, int flags);
 
   /**
    * Remove file descriptor entry from the table.
    * Return -1 if traced_fd is invalid, otherwise, return
-   * replayed fd for caller to close.
+   * replayed fd, whose reference the caller has to drop.
    */
   int remove_fd_entry(int traced_fd);
 
@@ -208,10 +301,17 @@ class FileDescriptorTableEntry : public BasicEntry {
    */
   std::unordered_set<int> get_all_replayed_fds();
 
+  /**
+   * Get the traced fds whose flags have O_CLOEXEC, in increasing order.
+   * This takes time in the number of such fds, not in the table size.
+   */
+  std::vector<int> get_cloexec_traced_fds();
+
   /**
    * Update the replayed that is mapped to traced_fd
+   * Return the replayed fd that was mapped to traced_fd before.
    */
-  void update_fd(int traced_fd, int replayed_fd);
+  int update_fd(int traced_fd, int replayed_fd);
 
   /**
    * Get fd flags for the given traced fd
@@ -230,24 +330,71 @@ class FileDescriptorTableEntry : public BasicEntry {
 };
 
 // <pid, FileDescriptorTableEntry>
-typedef std::map<pid_t, FileDescriptorTableEntry*> PerPidFileDescriptorTableMap;
+typedef tbb::concurrent_hash_map<pid_t, FileDescriptorTableEntry*>
+    PerPidFileDescriptorTableMap;
 // <pid, umask entry>
-typedef std::map<pid_t, UmaskEntry*> UmaskTable;
+typedef tbb::concurrent_hash_map<pid_t, UmaskEntry*> UmaskTable;
 
 class ReplayerResourcesManager {
   /*
    * Note:
    * 1. fds are int because fds can be negative. Ex: FDCWD == -100
    * 2. flags are also int because flags in open man page is int.
+   * 3. Every method may be called concurrently from the executor threads.
+   *    A method holds an accessor to the entry of pid in fd_table_map_
+   *    or umask_table_ while it uses the table, so that the table cannot
+   *    be freed under it. The tables synchronize their own contents.
    */
 
  private:
-  std::mutex fd_table_map_lock;
   PerPidFileDescriptorTableMap fd_table_map_;
   UmaskTable umask_table_;
   SystemCallTraceReplayLogger* logger_;
+  std::mutex replayer_used_fds_lock_;
   // Cached currently in-used fds in replayer
   std::unordered_set<int> replayer_used_fds_;
+  // Replayed fds used by any fd table or by the replayer itself
+  FileDescriptorAllocator used_fds_;
+  ConsistencyCheckMode consistency_check_;
+  std::mutex changed_fds_lock_;
+  // Replayed fds added or removed since the last sampled check
+  std::unordered_set<int> changed_fds_;
+
+  /**
+   * Add a reference to a replayed fd and remember that it changed.
+   */
+  void acquire_fd(int fd);
+
+  /**
+   * Drop a reference to a replayed fd and remember that it changed.
+   * Return true if no table uses the fd anymore.
+   */
+  bool release_fd(int fd);
+
+  /**
+   * Return every fd that is open in the replayer, in increasing order.
+   * The fds are listed from /proc/self/fd, or found by probing every fd
+   * up to the limit on open files if /proc is not mounted.
+   */
+  std::vector<int> list_open_fds();
+
+  /**
+   * Print a warning if fd_used and known disagree about fd.
+   */
+  void report_inconsistency(int fd, bool fd_used, bool known);
+
+  /**
+   * Return the fd table of pid, which must exist. The table stays valid
+   * as long as the caller holds the accessor.
+   */
+  FileDescriptorTableEntry* fd_table(
+      pid_t pid, PerPidFileDescriptorTableMap::const_accessor& table);
+
+  /**
+   * Return the umask entry of pid, which must exist. The entry stays
+   * valid as long as the caller holds the accessor.
+   */
+  UmaskEntry* umask_entry(pid_t pid, UmaskTable::const_accessor& entry);
 
  public:
   /**
@@ -280,11 +427,23 @@ class ReplayerResourcesManager {
 
   /**
    * This function generates a fd that is currently
-   * unused in replayer.
+   * unused in replayer. It takes the lowest fd that no fd table
+   * refers to, skipping fds that the replayer opened behind the
+   * manager's back (for example, trace files opened by DataSeries).
+   * The fd is reserved until release_generated_fd(), so that no other
+   * caller is given it. The kernel can still hand it out to an open()
+   * of another thread, so system calls that create a fd should let the
+   * kernel pick it instead (e.g. F_DUPFD rather than dup2).
    * Return a fd that is currently unused.
    */
   int generate_unused_fd(pid_t pid);
 
+  /**
+   * Drop the reservation of a fd returned by generate_unused_fd(), once
+   * it is added to a fd table or no longer needed.
+   */
+  void release_generated_fd(int fd);
+
   /**
    * This function will return replayed file descriptor that corrsponds
    * to given traced file descriptor. Return -1 if traced_fd
@@ -298,6 +457,12 @@ class ReplayerResourcesManager {
    */
   std::unordered_set<int> get_all_traced_fds(pid_t pid);
 
+  /**
+   * This function will return the traced file descriptors of the given
+   * process that are closed by a successful execve (O_CLOEXEC).
+   */
+  std::vector<int> get_cloexec_traced_fds(pid_t pid);
+
   /**
    * This function will update the replayed file descriptor
    * for the given traced_fd.
@@ -308,10 +473,12 @@ class ReplayerResourcesManager {
    * This function will remove the file descriptor entry
    * from pid fd table.
    *
-   * Return a fd to close if traced_fd is valid, otherweise,
-   * return -1.
+   * Return the replayed fd if traced_fd is valid, otherweise,
+   * return -1. If last_use is not nullptr, it is set to whether no
+   * other table uses the replayed fd, in which case the caller closes
+   * it. Otherwise the fd stays open for the tables that share it.
    */
-  int remove_fd(pid_t pid, int traced_fd);
+  int remove_fd(pid_t pid, int traced_fd, bool* last_use = nullptr);
 
   /**
    * This function will return flags of a file descriptor.
@@ -334,7 +501,9 @@ class ReplayerResourcesManager {
    * without creating a new fd table for pid. This means
    * that they both share same fd table. If shared is false,
    * a new fd table will be created and the content of new
-   * fd table is same as ppid fd table.
+   * fd table is same as ppid fd table. The new table shares the
+   * entries of ppid copy-on-write, so the replayed fds are only
+   * duplicated when either process changes its table.
    */
   void clone_fd_table(pid_t ppid, pid_t pid, bool shared);
 
@@ -353,7 +522,8 @@ class ReplayerResourcesManager {
   /**
    * print_fd_manager() function will print out the
    * content of file descriptor manager. This is very useful
-   * for debug.
+   * for debug. It must not run while other threads clone or
+   * remove tables.
    */
   void print_fd_manager();
 
@@ -383,9 +553,16 @@ class ReplayerResourcesManager {
   void remove_umask(pid_t pid);
 
   /**
-   * Scan all fds in the replayer and see if there is any fd that
+   * Set how validate_consistency() checks the fds. The default is
+   * CONSISTENCY_CHECK_SAMPLED.
+   */
+  void set_consistency_check(ConsistencyCheckMode mode);
+
+  /**
+   * Check the fds in the replayer and see if there is any fd that
    * is not known to this manager. Print a warning message to indicate
-   * this situation.
+   * this situation. Depending on the consistency check mode, either no
+   * fd, the fds changed since the last check, or every fd is checked.
    * Note: we can periodically call this function to validate the state of our
    * replayer,
    * so we know that every fd that is open is known to this resource manager.
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides members and functions for finding out what
+ * bounds the time a replay takes.
+ *
+ * StallAnalyzer accounts for all the time of every executor thread:
+ * executing records, and waiting for the reader to queue records, for
+ * the window of records that may run out of order, for a record running
+ * on another thread, or for asynchronous I/O to drain (backpressure).
+ * What is left is scheduling overhead. It also follows the critical
+ * path: the chain of records, across threads, whose completion each
+ * next record waited for. The path that ends last shows what bounded
+ * the replay: its execution time is sped up by a faster device or
+ * engine, its waits for other threads are not removed by adding
+ * threads.
+ *
+ * USAGE
+ * A main program creates one StallAnalyzer when --stall-report is given
+ * and stores it in SystemCallTraceReplayModule::stall_analyzer_. Each
+ * executor gets a StallAnalyzer::Executor from executor_started(), calls
+ * account() at the end of each part of its loop and finish_record() once
+ * a record is executed. report() is called once the executors are done.
+ */
+
+#ifndef STALL_ANALYZER_HPP
+#define STALL_ANALYZER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+enum ReplayActivity {
+  // Executing a record
+  ACTIVITY_EXECUTE,
+  // Waiting for the reader to queue more records
+  ACTIVITY_WAIT_READER,
+  // Waiting for earlier records, as records may only run a limited
+  // number of unique ids ahead of the last executed one
+  ACTIVITY_WAIT_WINDOW,
+  // Waiting for a record that runs on another thread
+  ACTIVITY_WAIT_BLOCKED,
+  // Waiting for outstanding asynchronous I/O to complete
+  ACTIVITY_WAIT_BACKPRESSURE,
+  // Popping records, checking and bookkeeping between them
+  ACTIVITY_SCHEDULING,
+  REPLAY_ACTIVITIES
+};
+
+class StallAnalyzer {
+ public:
+  // A chain of dependent records and where its time went
+  struct CriticalPath {
+    std::chrono::steady_clock::time_point end;
+    uint64_t nanoseconds[REPLAY_ACTIVITIES];
+    uint64_t records;
+    // Number of times the chain moved to another thread
+    uint64_t handoffs;
+    // Time of the chain spent on records of each traced process
+    std::map<int64_t, uint64_t> per_pid;
+    // Execution time of the chain spent in each system call
+    std::map<std::string, uint64_t> per_syscall;
+
+    CriticalPath();
+    uint64_t total() const;
+  };
+
+  // Accounting of one executor thread
+  class Executor {
+   private:
+    friend class StallAnalyzer;
+    StallAnalyzer *analyzer_;
+    int64_t thread_id_;
+    std::chrono::steady_clock::time_point mark_;
+    // Time since the last executed record, by activity
+    uint64_t pending_[REPLAY_ACTIVITIES];
+    // Thread that the current record last waited for, -1 if none
+    int64_t blocker_;
+    // Totals of the thread, by activity
+    uint64_t nanoseconds_[REPLAY_ACTIVITIES];
+    // Records that waited for each activity
+    uint64_t stalled_records_[REPLAY_ACTIVITIES];
+    uint64_t records_;
+    // Critical path ending at the last executed record
+    std::mutex path_lock_;
+    CriticalPath path_;
+
+    Executor(StallAnalyzer *analyzer, int64_t thread_id);
+
+   public:
+    /**
+     * Count the time since the previous call as activity. blocker is the
+     * thread of the record waited for by ACTIVITY_WAIT_BLOCKED.
+     */
+    void account(ReplayActivity activity, int64_t blocker = -1);
+
+    /**
+     * Extend the critical path with the record just executed, a call of
+     * syscall traced in process pid.
+     */
+    void finish_record(const std::string &syscall, int64_t pid);
+  };
+
+ private:
+  std::chrono::steady_clock::time_point started_;
+  std::mutex executors_lock_;
+  std::map<int64_t, std::unique_ptr<Executor>> executors_;
+
+  /**
+   * Return the executor of thread_id, nullptr if there is none.
+   */
+  Executor *find(int64_t thread_id);
+
+ public:
+  StallAnalyzer();
+
+  /**
+   * Register the calling executor thread, which replays the records of
+   * thread_id.
+   */
+  Executor *executor_started(int64_t thread_id);
+
+  /**
+   * Write the time of each executor by activity, the critical path and
+   * its breakdown to out. Called once the executors are done.
+   */
+  void report(std::ostream &out);
+};
+
+/*
+ * Account the time since the last account() of executor as activity, if
+ * executor is not nullptr.
+ */
+#define STALL_ACCOUNT(executor, ...)    \
+  do {                                  \
+    if ((executor) != nullptr) {        \
+      (executor)->account(__VA_ARGS__); \
+    }                                   \
+  } while (0)
+
+#endif /* STALL_ANALYZER_HPP */
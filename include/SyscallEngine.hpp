@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides the engines that the replaying modules call
+ * instead of calling the system calls themselves.
+ *
+ * SyscallEngine has one method per system call that the modules replay,
+ * with the arguments and result of the libc function of the same name:
+ * it returns -1 and sets errno on failure. The modules keep doing their
+ * own bookkeeping, such as mapping traced fds to replayed fds and
+ * tracking mapped regions, around the calls.
+ *
+ * KernelSyscallEngine makes the system calls; this is the default.
+ * NullSyscallEngine never enters the kernel: every call returns the
+ * return value and errno of the record being executed, so a replay runs
+ * the whole pipeline of the replayer and nothing else. The fds it opens
+ * are the traced fds themselves. MemFsSyscallEngine, in
+ * MemFsSyscallEngine.hpp, replays them on a file system in memory.
+ *
+ * USAGE
+ * SyscallEngine::create() makes the engine given to --engine.
+ * SystemCallTraceReplayModule::execute() calls begin_call() before each
+ * record, and processRow() calls the system calls through the engine.
+ */
+
+#ifndef SYSCALL_ENGINE_HPP
+#define SYSCALL_ENGINE_HPP
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <utime.h>
+#include <cstdint>
+#include <string>
+
+class SyscallEngine {
+ public:
+  virtual ~SyscallEngine() {}
+
+  /**
+   * Return the engine called name (kernel, null or memfs), or nullptr
+   * if there is no such engine.
+   */
+  static SyscallEngine *create(const std::string &name);
+
+  /**
+   * Determine whether the replayed fds are fds of the replayer process,
+   * which the kernel knows about. Direct I/O, async I/O and the checks
+   * of the open fds need them.
+   */
+  virtual bool uses_kernel_fds() const = 0;
+
+  /**
+   * Called by the executing thread before each record is replayed, with
+   * the return value and errno the record had in the trace.
+   */
+  virtual void begin_call(int64_t traced_return_value, int traced_errno) {}
+
+  virtual int access(const char *path, int mode) = 0;
+  virtual int faccessat(int dirfd, const char *path, int mode, int flags) = 0;
+  virtual int stat(const char *path, struct stat *buf) = 0;
+  virtual int lstat(const char *path, struct stat *buf) = 0;
+  virtual int fstat(int fd, struct stat *buf) = 0;
+  virtual int fstatat(int dirfd, const char *path, struct stat *buf,
+                      int flags) = 0;
+  virtual int statfs(const char *path, struct statfs *buf) = 0;
+  virtual int fstatfs(int fd, struct statfs *buf) = 0;
+  virtual int chdir(const char *path) = 0;
+  virtual int fchdir(int fd) = 0;
+  virtual int chmod(const char *path, mode_t mode) = 0;
+  virtual int fchmod(int fd, mode_t mode) = 0;
+  virtual int fchmodat(int dirfd, const char *path, mode_t mode,
+                       int flags) = 0;
+  virtual int chown(const char *path, uid_t owner, gid_t group) = 0;
+  virtual int openat(int dirfd, const char *path, int flags, mode_t mode) = 0;
+  virtual int creat(const char *path, mode_t mode) = 0;
+  virtual int close(int fd) = 0;
+  virtual int dup(int fd) = 0;
+  virtual int dup2(int old_fd, int new_fd) = 0;
+  virtual int dup3(int old_fd, int new_fd, int flags) = 0;
+  virtual int fcntl(int fd, int cmd, long arg) = 0;
+  virtual int fcntl(int fd, int cmd, struct flock *lock) = 0;
+  virtual int ioctl(int fd, unsigned long request, long arg) = 0;
+  virtual int ioctl(int fd, unsigned long request, void *arg) = 0;
+  virtual int pipe(int fds[2]) = 0;
+  virtual ssize_t read(int fd, void *buf, size_t count) = 0;
+  virtual ssize_t pread(int fd, void *buf, size_t count, off_t offset) = 0;
+  virtual ssize_t readv(int fd, const struct iovec *iov, int iovcnt) = 0;
+  virtual ssize_t write(int fd, const void *buf, size_t count) = 0;
+  virtual ssize_t pwrite(int fd, const void *buf, size_t count,
+                         off_t offset) = 0;
+  virtual ssize_t writev(int fd, const struct iovec *iov, int iovcnt) = 0;
+  virtual off_t lseek(int fd, off_t offset, int whence) = 0;
+  virtual ssize_t readahead(int fd, off64_t offset, size_t count) = 0;
+  virtual int fallocate(int fd, int mode, off_t offset, off_t len) = 0;
+  virtual int fsync(int fd) = 0;
+  virtual int fdatasync(int fd) = 0;
+  virtual int truncate(const char *path, off_t length) = 0;
+  virtual int ftruncate(int fd, off_t length) = 0;
+  virtual long getdents(int fd, void *buf, unsigned int count) = 0;
+  virtual int mkdir(const char *path, mode_t mode) = 0;
+  virtual int mkdirat(int dirfd, const char *path, mode_t mode) = 0;
+  virtual int mknod(const char *path, mode_t mode, dev_t dev) = 0;
+  virtual int rmdir(const char *path) = 0;
+  virtual int link(const char *old_path, const char *new_path) = 0;
+  virtual int linkat(int old_dirfd, const char *old_path, int new_dirfd,
+                     const char *new_path, int flags) = 0;
+  virtual int symlink(const char *target, const char *link_path) = 0;
+  virtual ssize_t readlink(const char *path, char *buf, size_t size) = 0;
+  virtual int rename(const char *old_path, const char *new_path) = 0;
+  virtual int unlink(const char *path) = 0;
+  virtual int unlinkat(int dirfd, const char *path, int flags) = 0;
+  virtual int utime(const char *path, const struct utimbuf *times) = 0;
+  virtual int utimes(const char *path, const struct timeval times[2]) = 0;
+  /**
+   * Unlike the glibc wrapper, path may be NULL, as for the system call.
+   */
+  virtual int utimensat(int dirfd, const char *path,
+                        const struct timespec times[2], int flags) = 0;
+  virtual int setxattr(const char *path, const char *name, const void *value,
+                       size_t size, int flags) = 0;
+  virtual int lsetxattr(const char *path, const char *name, const void *value,
+                        size_t size, int flags) = 0;
+  virtual int fsetxattr(int fd, const char *name, const void *value,
+                        size_t size, int flags) = 0;
+  /**
+   * Returns MAP_FAILED and sets errno on failure.
+   */
+  virtual void *mmap(void *addr, size_t length, int prot, int flags, int fd,
+                     off_t offset) = 0;
+};
+
+class KernelSyscallEngine : public SyscallEngine {
+ public:
+  bool uses_kernel_fds() const override { return true; }
+  int access(const char *path, int mode) override;
+  int faccessat(int dirfd, const char *path, int mode, int flags) override;
+  int stat(const char *path, struct stat *buf) override;
+  int lstat(const char *path, struct stat *buf) override;
+  int fstat(int fd, struct stat *buf) override;
+  int fstatat(int dirfd, const char *path, struct stat *buf,
+              int flags) override;
+  int statfs(const char *path, struct statfs *buf) override;
+  int fstatfs(int fd, struct statfs *buf) override;
+  int chdir(const char *path) override;
+  int fchdir(int fd) override;
+  int chmod(const char *path, mode_t mode) override;
+  int fchmod(int fd, mode_t mode) override;
+  int fchmodat(int dirfd, const char *path, mode_t mode, int flags) override;
+  int chown(const char *path, uid_t owner, gid_t group) override;
+  int openat(int dirfd, const char *path, int flags, mode_t mode) override;
+  int creat(const char *path, mode_t mode) override;
+  int close(int fd) override;
+  int dup(int fd) override;
+  int dup2(int old_fd, int new_fd) override;
+  int dup3(int old_fd, int new_fd, int flags) override;
+  int fcntl(int fd, int cmd, long arg) override;
+  int fcntl(int fd, int cmd, struct flock *lock) override;
+  int ioctl(int fd, unsigned long request, long arg) override;
+  int ioctl(int fd, unsigned long request, void *arg) override;
+  int pipe(int fds[2]) override;
+  ssize_t read(int fd, void *buf, size_t count) override;
+  ssize_t pread(int fd, void *buf, size_t count, off_t offset) override;
+  ssize_t readv(int fd, const struct iovec *iov, int iovcnt) override;
+  ssize_t write(int fd, const void *buf, size_t count) override;
+  ssize_t pwrite(int fd, const void *buf, size_t count,
+                 off_t offset) override;
+  ssize_t writev(int fd, const struct iovec *iov, int iovcnt) override;
+  off_t lseek(int fd, off_t offset, int whence) override;
+  ssize_t readahead(int fd, off64_t offset, size_t count) override;
+  int fallocate(int fd, int mode, off_t offset, off_t len) override;
+  int fsync(int fd) override;
+  int fdatasync(int fd) override;
+  int truncate(const char *path, off_t length) override;
+  int ftruncate(int fd, off_t length) override;
+  long getdents(int fd, void *buf, unsigned int count) override;
+  int mkdir(const char *path, mode_t mode) override;
+  int mkdirat(int dirfd, const char *path, mode_t mode) override;
+  int mknod(const char *path, mode_t mode, dev_t dev) override;
+  int rmdir(const char *path) override;
+  int link(const char *old_path, const char *new_path) override;
+  int linkat(int old_dirfd, const char *old_path, int new_dirfd,
+             const char *new_path, int flags) override;
+  int symlink(const char *target, const char *link_path) override;
+  ssize_t readlink(const char *path, char *buf, size_t size) override;
+  int rename(const char *old_path, const char *new_path) override;
+  int unlink(const char *path) override;
+  int unlinkat(int dirfd, const char *path, int flags) override;
+  int utime(const char *path, const struct utimbuf *times) override;
+  int utimes(const char *path, const struct timeval times[2]) override;
+  int utimensat(int dirfd, const char *path, const struct timespec times[2],
+                int flags) override;
+  int setxattr(const char *path, const char *name, const void *value,
+               size_t size, int flags) override;
+  int lsetxattr(const char *path, const char *name, const void *value,
+                size_t size, int flags) override;
+  int fsetxattr(int fd, const char *name, const void *value, size_t size,
+                int flags) override;
+  void *mmap(void *addr, size_t length, int prot, int flags, int fd,
+             off_t offset) override;
+};
+
+class NullSyscallEngine : public SyscallEngine {
+ protected:
+  // Traced result of the record the thread is executing
+  static thread_local int64_t traced_return_value_;
+  static thread_local int traced_errno_;
+
+  /**
+   * Return the traced return value, setting errno to the traced errno
+   * if the call failed.
+   */
+  int64_t traced_result() const;
+
+ public:
+  bool uses_kernel_fds() const override { return false; }
+  void begin_call(int64_t traced_return_value, int traced_errno) override;
+  int access(const char *path, int mode) override;
+  int faccessat(int dirfd, const char *path, int mode, int flags) override;
+  int stat(const char *path, struct stat *buf) override;
+  int lstat(const char *path, struct stat *buf) override;
+  int fstat(int fd, struct stat *buf) override;
+  int fstatat(int dirfd, const char *path, struct stat *buf,
+              int flags) override;
+  int statfs(const char *path, struct statfs *buf) override;
+  int fstatfs(int fd, struct statfs *buf) override;
+  int chdir(const char *path) override;
+  int fchdir(int fd) override;
+  int chmod(const char *path, mode_t mode) override;
+  int fchmod(int fd, mode_t mode) override;
+  int fchmodat(int dirfd, const char *path, mode_t mode, int flags) override;
+  int chown(const char *path, uid_t owner, gid_t group) override;
+  int openat(int dirfd, const char *path, int flags, mode_t mode) override;
+  int creat(const char *path, mode_t mode) override;
+  int close(int fd) override;
+  int dup(int fd) override;
+  int dup2(int old_fd, int new_fd) override;
+  int dup3(int old_fd, int new_fd, int flags) override;
+  int fcntl(int fd, int cmd, long arg) override;
+  int fcntl(int fd, int cmd, struct flock *lock) override;
+  int ioctl(int fd, unsigned long request, long arg) override;
+  int ioctl(int fd, unsigned long request, void *arg) override;
+  int pipe(int fds[2]) override;
+  ssize_t read(int fd, void *buf, size_t count) override;
+  ssize_t pread(int fd, void *buf, size_t count, off_t offset) override;
+  ssize_t readv(int fd, const struct iovec *iov, int iovcnt) override;
+  ssize_t write(int fd, const void *buf, size_t count) override;
+  ssize_t pwrite(int fd, const void *buf, size_t count,
+                 off_t offset) override;
+  ssize_t writev(int fd, const struct iovec *iov, int iovcnt) override;
+  off_t lseek(int fd, off_t offset, int whence) override;
+  ssize_t readahead(int fd, off64_t offset, size_t count) override;
+  int fallocate(int fd, int mode, off_t offset, off_t len) override;
+  int fsync(int fd) override;
+  int fdatasync(int fd) override;
+  int truncate(const char *path, off_t length) override;
+  int ftruncate(int fd, off_t length) override;
+  long getdents(int fd, void *buf, unsigned int count) override;
+  int mkdir(const char *path, mode_t mode) override;
+  int mkdirat(int dirfd, const char *path, mode_t mode) override;
+  int mknod(const char *path, mode_t mode, dev_t dev) override;
+  int rmdir(const char *path) override;
+  int link(const char *old_path, const char *new_path) override;
+  int linkat(int old_dirfd, const char *old_path, int new_dirfd,
+             const char *new_path, int flags) override;
+  int symlink(const char *target, const char *link_path) override;
+  ssize_t readlink(const char *path, char *buf, size_t size) override;
+  int rename(const char *old_path, const char *new_path) override;
+  int unlink(const char *path) override;
+  int unlinkat(int dirfd, const char *path, int flags) override;
+  int utime(const char *path, const struct utimbuf *times) override;
+  int utimes(const char *path, const struct timeval times[2]) override;
+  int utimensat(int dirfd, const char *path, const struct timespec times[2],
+                int flags) override;
+  int setxattr(const char *path, const char *name, const void *value,
+               size_t size, int flags) override;
+  int lsetxattr(const char *path, const char *name, const void *value,
+                size_t size, int flags) override;
+  int fsetxattr(int fd, const char *name, const void *value, size_t size,
+                int flags) override;
+  /**
+   * Map anonymous memory instead of the file, so that the mapped regions
+   * the modules track can still be read and written.
+   */
+  void *mmap(void *addr, size_t length, int prot, int flags, int fd,
+             off_t offset) override;
+};
+
+#endif /* SYSCALL_ENGINE_HPP */
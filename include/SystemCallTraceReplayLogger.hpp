@@ -31,6 +31,20 @@
  * SystemCallTraceReplayLogger is a class that has members and functions for
  * printing log messages during replaying.
  *
+ * By default the logger is asynchronous: each thread encodes its log
+ * calls into binary records (a tag and the raw value of every argument)
+ * in a ring buffer of its own, and a background thread formats the
+ * records and writes them to the log file. The background thread frees
+ * the ring buffer of a thread once the thread has exited and the records
+ * in it are written. Only arguments of other types
+ * than numbers, characters, strings, pointers and stream manipulators are
+ * formatted by the calling thread.
+ *
+ * Messages above the level set with set_level() are dropped. The
+ * LOGGER_ERR, LOGGER_WARN, LOGGER_INFO and LOGGER_DEBUG macros also skip
+ * evaluating their arguments then, and compile to nothing for levels
+ * above LOG_LEVEL_FLOOR.
+ *
  * USAGE
  * A main program could initialize this class and call desired
  * function to add logs in the logger file.
@@ -40,46 +54,338 @@
 #define SYSTEM_CALL_TRACE_REPLAY_LOGGER_HPP
 
 #include <errno.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #define TIMESTAMP_BUFFER_SIZE 20
+// Default size in bytes of the ring buffer of each logging thread
+#define LOG_RING_DEFAULT_SIZE (1 << 16)
+// Longer records have their string arguments truncated
+#define LOG_RECORD_MAX_SIZE (1 << 13)
+// Smallest ring buffer, which holds a few of the longest records
+#define LOG_RING_MIN_SIZE (4 * LOG_RECORD_MAX_SIZE)
+
+enum LogLevel { LOG_ERROR, LOG_WARN, LOG_INFO, LOG_DEBUG };
+
+/*
+ * Most verbose level compiled in. Build with, e.g.,
+ * -DLOG_LEVEL_FLOOR=LOG_WARN to remove the info and debug messages logged
+ * through the macros below.
+ */
+#ifndef LOG_LEVEL_FLOOR
+#define LOG_LEVEL_FLOOR LOG_DEBUG
+#endif
+
+/*
+ * True if messages at level are compiled in and logged by logger.
+ */
+#define LOGGER_ENABLED(logger, level) \
+  ((level) <= LOG_LEVEL_FLOOR && (logger)->is_enabled(level))
+
+/*
+ * Log the arguments with logger if level is enabled. The arguments are
+ * not evaluated otherwise.
+ */
+#define LOGGER_LOG(logger, level, method, ...) \
+  do {                                         \
+    if (LOGGER_ENABLED(logger, level)) {       \
+      (logger)->method(__VA_ARGS__);           \
+    }                                          \
+  } while (0)
+
+#define LOGGER_ERR(logger, ...) \
+  LOGGER_LOG(logger, LOG_ERROR, log_err, __VA_ARGS__)
+#define LOGGER_WARN(logger, ...) \
+  LOGGER_LOG(logger, LOG_WARN, log_warn, __VA_ARGS__)
+#define LOGGER_INFO(logger, ...) \
+  LOGGER_LOG(logger, LOG_INFO, log_info, __VA_ARGS__)
+#define LOGGER_DEBUG(logger, ...) \
+  LOGGER_LOG(logger, LOG_DEBUG, log_debug, __VA_ARGS__)
+
+/*
+ * What happens to a log record:
+ *   LOG_SYNC writes it to the log file before the log call returns,
+ *   LOG_ASYNC_BLOCK hands it to the background thread, waiting for room
+ *   in the ring buffer of the calling thread if it is full,
+ *   LOG_ASYNC_DROP hands it to the background thread, or drops it and
+ *   counts it if the ring buffer is full.
+ */
+enum LogMode { LOG_SYNC, LOG_ASYNC_BLOCK, LOG_ASYNC_DROP };
 
 class SystemCallTraceReplayLogger {
  private:
+  // Tags of the encoded arguments of a log record
+  enum LogArgType {
+    LOG_ARG_CHAR,
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING,
+    LOG_ARG_POINTER,
+    LOG_ARG_IOS_MANIPULATOR,
+    LOG_ARG_OSTREAM_MANIPULATOR,
+    LOG_ARG_OTHER
+  };
+
+  typedef std::ios_base& (*IosManipulator)(std::ios_base&);
+  typedef std::ostream& (*OstreamManipulator)(std::ostream&);
+
+  template <typename T>
+  struct is_log_char {
+    typedef typename std::remove_cv<T>::type type;
+    static const bool value = std::is_same<type, char>::value ||
+                              std::is_same<type, signed char>::value ||
+                              std::is_same<type, unsigned char>::value;
+  };
+
+  /*
+   * Maps the type of an argument to the way it is encoded. Pointers to
+   * characters are printed as strings, like operator<< does.
+   */
+  template <typename T>
+  struct log_arg_type {
+    typedef typename std::decay<T>::type type;
+    typedef typename std::remove_pointer<type>::type pointee;
+    static const bool is_number =
+        std::is_integral<type>::value || std::is_enum<type>::value;
+    static const bool is_signed =
+        std::is_signed<type>::value || std::is_enum<type>::value;
+    static const bool is_string =
+        std::is_same<type, std::string>::value ||
+        (std::is_pointer<type>::value && is_log_char<pointee>::value);
+    static const bool is_pointer =
+        std::is_pointer<type>::value && !std::is_function<pointee>::value;
+    static const int value =
+        is_log_char<type>::value
+            ? LOG_ARG_CHAR
+            : is_number ? (is_signed ? LOG_ARG_INT : LOG_ARG_UINT)
+            : std::is_floating_point<type>::value ? LOG_ARG_DOUBLE
+            : is_string ? LOG_ARG_STRING
+            : std::is_same<type, IosManipulator>::value
+                ? LOG_ARG_IOS_MANIPULATOR
+            : std::is_same<type, OstreamManipulator>::value
+                ? LOG_ARG_OSTREAM_MANIPULATOR
+            : is_pointer ? LOG_ARG_POINTER : LOG_ARG_OTHER;
+  };
+
+  template <int N>
+  using LogArgTag = std::integral_constant<int, N>;
+
+  /*
+   * Single producer, single consumer ring buffer of encoded log
+   * records. The thread that owns it pushes records and the background
+   * thread pops them.
+   */
+  struct LogRing {
+    std::unique_ptr<char[]> buffer;
+    size_t size;
+    // Bytes ever pushed and popped
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+    // Records dropped because the ring was full
+    std::atomic<uint64_t> dropped;
+    // Set once the owning thread exits
+    std::atomic<bool> retired;
+
+    explicit LogRing(size_t ring_size);
+
+    /**
+     * Copy record into the ring. Return false if there is no room.
+     */
+    bool push(const std::string& record);
+
+    /**
+     * Move the oldest record into record. Return false if the ring is
+     * empty.
+     */
+    bool pop(std::string& record);
+
+    bool empty() const;
+  };
+
+  // Instances are told apart by id, since the address can be reused
+  static std::atomic<uint64_t> next_id_;
+  uint64_t id_;
   std::ofstream logger_file_;
+  bool enabled_;
+  LogMode mode_;
+  // Size in bytes of the ring buffer of each logging thread
+  size_t ring_size_;
+  // Most verbose level that is logged
+  std::atomic<int> level_;
+
+  // Rings of the threads that logged through this instance
+  std::mutex rings_lock_;
+  std::vector<std::shared_ptr<LogRing>> rings_;
+
+  // Background thread which formats and writes the records
+  std::thread writer_;
+  std::atomic<bool> stop_;
+  std::mutex wake_lock_;
+  std::condition_variable wake_cv_;
+  // Passes of the background thread over every ring
+  std::mutex flush_lock_;
+  std::condition_variable flushed_cv_;
+  uint64_t passes_;
+  // Seconds since the epoch, refreshed by the background thread
+  std::atomic<int64_t> coarse_time_;
+
+  // Used by whichever thread formats records
+  std::mutex sync_lock_;
+  std::ostringstream format_stream_;
+  time_t formatted_time_;
+  std::string formatted_time_str_;
 
   /**
-   * This function actually prints the log message to the
-   * logger file
+   * Return the record buffer of the calling thread, holding the header of
+   * a new record at level.
    */
-  void print_logs(std::stringstream&& log_stream);
+  std::string& begin_record(LogLevel level);
 
   /**
-   * This function calls itself recursively to combine the arguments
-   * in a stringstream.
+   * Write the size into the record and pass it on as mode_ asks.
+   */
+  void commit_record(std::string& record);
+
+  /**
+   * Return the ring of the calling thread, creating it on first use.
+   */
+  LogRing* thread_ring();
+
+  /**
+   * Body of the background thread.
+   */
+  void drain();
+
+  /**
+   * Format an encoded record and write it to the log file.
+   */
+  void write_record(const std::string& record);
+
+  /**
+   * This function calls itself recursively to encode the arguments
+   * into the record.
    */
   template <typename First, typename... Rest>
-  void print_logs(std::stringstream&& log_stream, First&& parm1,
-                  Rest&&... parm);
+  void encode_args(std::string& record, First&& parm1, Rest&&... parm);
+  void encode_args(std::string& record) {}
+
+  template <typename T>
+  static void encode_raw(std::string& record, LogArgType type, T value) {
+    record.push_back(static_cast<char>(type));
+    record.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  static void encode_string(std::string& record, const char* data,
+                            size_t size);
 
   /**
-   * This function is used to print the current time to the log file
-   * while appending logs to the log file.
-   *
-   * @return: returns buffer having timestamp in the format
-   *          YYYY-MM-DD HH:MM:SS
+   * Return the stream of the calling thread for formatting arguments
+   * that cannot be encoded, emptied.
    */
-  std::string format_time();
+  static std::ostringstream& fallback_stream();
+
+  template <typename T>
+  static void encode_arg(std::string& record, T&& value,
+                         LogArgTag<LOG_ARG_CHAR>) {
+    encode_raw(record, LOG_ARG_CHAR, static_cast<char>(value));
+  }
+  template <typename T>
+  static void encode_arg(std::string& record, T&& value,
+                         LogArgTag<LOG_ARG_INT>) {
+    encode_raw(record, LOG_ARG_INT, static_cast<int64_t>(value));
+  }
+  template <typename T>
+  static void encode_arg(std::string& record, T&& value,
+                         LogArgTag<LOG_ARG_UINT>) {
+    encode_raw(record, LOG_ARG_UINT, static_cast<uint64_t>(value));
+  }
+  template <typename T>
+  static void encode_arg(std::string& record, T&& value,
+                         LogArgTag<LOG_ARG_DOUBLE>) {
+    encode_raw(record, LOG_ARG_DOUBLE, static_cast<double>(value));
+  }
+  static void encode_arg(std::string& record, const std::string& value,
+                         LogArgTag<LOG_ARG_STRING>) {
+    encode_string(record, value.data(), value.size());
+  }
+  template <typename T>
+  static void encode_arg(std::string& record, const T* value,
+                         LogArgTag<LOG_ARG_STRING>) {
+    const char* data = reinterpret_cast<const char*>(value);
+    if (data == nullptr) {
+      encode_string(record, "(null)", 6);
+    } else {
+      encode_string(record, data, strnlen(data, LOG_RECORD_MAX_SIZE));
+    }
+  }
+  template <typename T>
+  static void encode_arg(std::string& record, T&& value,
+                         LogArgTag<LOG_ARG_POINTER>) {
+    encode_raw(record, LOG_ARG_POINTER, reinterpret_cast<const void*>(value));
+  }
+  static void encode_arg(std::string& record, IosManipulator value,
+                         LogArgTag<LOG_ARG_IOS_MANIPULATOR>) {
+    encode_raw(record, LOG_ARG_IOS_MANIPULATOR, value);
+  }
+  static void encode_arg(std::string& record, OstreamManipulator value,
+                         LogArgTag<LOG_ARG_OSTREAM_MANIPULATOR>) {
+    encode_raw(record, LOG_ARG_OSTREAM_MANIPULATOR, value);
+  }
+  template <typename T>
+  static void encode_arg(std::string& record, T&& value,
+                         LogArgTag<LOG_ARG_OTHER>) {
+    std::ostringstream& stream = fallback_stream();
+    stream << value;
+    const std::string& text = stream.str();
+    encode_string(record, text.data(), text.size());
+  }
+
+  /**
+   * Encode and pass on one log record.
+   */
+  template <typename... Args>
+  void log(LogLevel level, Args&&... args);
 
  public:
   /**
    * This is the constructor of SystemCallTraceReplayLogger
-   * class which opens the logger file to write logs.
+   * class which opens the logger file to write logs, and starts the
+   * background thread unless mode is LOG_SYNC. Each thread that logs
+   * asynchronously gets a ring buffer of ring_size bytes, at least
+   * LOG_RING_MIN_SIZE.
+   */
+  SystemCallTraceReplayLogger(std::string log_filename,
+                              LogMode mode = LOG_ASYNC_BLOCK,
+                              size_t ring_size = LOG_RING_DEFAULT_SIZE);
+
+  /**
+   * Log only the messages at level or less verbose ones. Everything up
+   * to LOG_INFO is logged by default.
    */
-  SystemCallTraceReplayLogger(std::string log_filename);
+  void set_level(LogLevel level) {
+    level_.store(level, std::memory_order_relaxed);
+  }
+
+  /**
+   * Determine whether messages at level are written to the log file.
+   */
+  bool is_enabled(LogLevel level) const {
+    return enabled_ && level <= level_.load(std::memory_order_relaxed);
+  }
 
   /**
    * This function takes the variable number of arguments and prints
@@ -90,7 +396,8 @@ class SystemCallTraceReplayLogger {
 
   /**
    * This function takes the variable number of arguments and prints
-   * the error messages to the logger file.
+   * the error messages to the logger file. It returns once the message
+   * is written, since an error often ends the replay.
    */
   template <typename... Args>
   void log_err(Args&&... args);
@@ -109,6 +416,12 @@ class SystemCallTraceReplayLogger {
   template <typename... Args>
   void log_debug(Args&&... args);
 
+  /**
+   * Wait until every message logged before the call is written to the
+   * log file.
+   */
+  void flush();
+
   /**
    * Deconstructor
    */
@@ -116,47 +429,42 @@ class SystemCallTraceReplayLogger {
 };
 
 template <typename First, typename... Rest>
-void SystemCallTraceReplayLogger::print_logs(std::stringstream&& log_stream,
-                                             First&& parm1, Rest&&... parm) {
-  log_stream << parm1;
-  this->print_logs(std::forward<std::stringstream>(log_stream),
-                   std::move(parm)...);
+void SystemCallTraceReplayLogger::encode_args(std::string& record,
+                                              First&& parm1, Rest&&... parm) {
+  encode_arg(record, std::forward<First>(parm1),
+             LogArgTag<log_arg_type<First>::value>());
+  this->encode_args(record, std::forward<Rest>(parm)...);
+}
+
+template <typename... Args>
+void SystemCallTraceReplayLogger::log(LogLevel level, Args&&... args) {
+  if (!is_enabled(level)) {
+    return;
+  }
+  std::string& record = begin_record(level);
+  this->encode_args(record, std::forward<Args>(args)...);
+  commit_record(record);
 }
 
 template <typename... Args>
 void SystemCallTraceReplayLogger::log_info(Args&&... args) {
-  this->logger_file_ << this->format_time() << "[INFO] ";
-  std::stringstream log_stream;
-  this->print_logs(std::forward<std::stringstream>(log_stream),
-                   std::move(args)...);
-  this->logger_file_ << std::endl;
+  this->log(LOG_INFO, std::forward<Args>(args)...);
 }
 
 template <typename... Args>
 void SystemCallTraceReplayLogger::log_err(Args&&... args) {
-  this->logger_file_ << this->format_time() << "[ERROR] ";
-  std::stringstream log_stream;
-  this->print_logs(std::forward<std::stringstream>(log_stream),
-                   std::move(args)...);
-  this->logger_file_ << std::endl;
+  this->log(LOG_ERROR, std::forward<Args>(args)...);
+  this->flush();
 }
 
 template <typename... Args>
 void SystemCallTraceReplayLogger::log_warn(Args&&... args) {
-  this->logger_file_ << this->format_time() << "[WARN] ";
-  std::stringstream log_stream;
-  this->print_logs(std::forward<std::stringstream>(log_stream),
-                   std::move(args)...);
-  this->logger_file_ << std::endl;
+  this->log(LOG_WARN, std::forward<Args>(args)...);
 }
 
 template <typename... Args>
 void SystemCallTraceReplayLogger::log_debug(Args&&... args) {
-  this->logger_file_ << this->format_time() << "[DEBUG] ";
-  std::stringstream log_stream;
-  this->print_logs(std::forward<std::stringstream>(log_stream),
-                   std::move(args)...);
-  this->logger_file_ << std::endl;
+  this->log(LOG_DEBUG, std::forward<Args>(args)...);
 }
 
 #endif /* SYSTEM_CALL_TRACE_REPLAY_LOGGER_HPP */
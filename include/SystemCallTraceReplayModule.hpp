@@ -46,12 +46,23 @@
 #include <sys/types.h>
 #include <DataSeries/RowAnalysisModule.hpp>
 #include <boost/format.hpp>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <map>
 #include <sstream>
 #include <string>
+#include "AlignedBufferPool.hpp"
+#include "LatencyRecorder.hpp"
+#include "MismatchRecorder.hpp"
+#include "PatternGenerator.hpp"
+#include "PayloadBlockPool.hpp"
+#include "ReplayProfiler.hpp"
+#include "ReplayRecorder.hpp"
+#include "ReplayTelemetry.hpp"
 #include "ReplayerResourcesManager.hpp"
+#include "StallAnalyzer.hpp"
+#include "SyscallEngine.hpp"
 #include "SystemCallTraceReplayLogger.hpp"
 #include "strace2ds.h"
 
@@ -66,6 +77,8 @@
  */
 #define DEC_PRECISION "%.25f"
 
+class AsyncIOEngine;
+
 class SystemCallTraceReplayModule : public RowAnalysisModule {
  protected:
   std::string sys_call_name_;
@@ -81,6 +94,12 @@ class SystemCallTraceReplayModule : public RowAnalysisModule {
   int rows_per_call_;  // It stores the number of rows processed per system
                        // call.
   int replayed_ret_val_;
+  // True while the record is submitted to the async I/O engine
+  bool async_pending_;
+  // When processRow() was called, if latencies or the replay are recorded
+  std::chrono::steady_clock::time_point replay_started_;
+  // ProfileScope::verify_nanoseconds when processRow() was called
+  uint64_t verify_started_;
 
   int64_t uniqueIdVal;
   int64_t timeCalledVal;
@@ -117,6 +136,24 @@ class SystemCallTraceReplayModule : public RowAnalysisModule {
    */
   void compare_retval_and_errno();
 
+  /**
+   * Write a record of kind for the current system call to
+   * mismatch_recorder_, if there is one, and count it in telemetry_. Data
+   * mismatches pass the traced and replayed payloads, which are recorded
+   * as digests.
+   */
+  void record_mismatch(MismatchKind kind, int replayed_errno,
+                       const void *traced_data = nullptr,
+                       size_t traced_size = 0,
+                       const void *replayed_data = nullptr,
+                       size_t replayed_size = 0);
+
+  /**
+   * Abort the replay in abort mode, after writing out the buffered log
+   * messages and mismatch records.
+   */
+  [[noreturn]] void abort_replay();
+
   /**
    * This function is where all the replaying takes action.
    * It will be called by execute() function for each record
@@ -159,13 +196,53 @@ class SystemCallTraceReplayModule : public RowAnalysisModule {
    */
   mode_t get_mode(mode_t mode);
 
+  /**
+   * Determine whether traced_fd of process pid was opened with O_DIRECT.
+   * Buffers used with such fds must come from aligned_buffer_pool_.
+   */
+  bool is_direct_io(pid_t pid, int traced_fd);
+
+  /**
+   * Record the result of an asynchronous request as if it was returned
+   * by the system call: bytes transferred, or -1 with errno set.
+   */
+  void set_async_result(int64_t result);
+
+  /**
+   * Count the replayed call in latency_recorder_, with the time since
+   * replay_started_ but for the verifying time spent meanwhile, and the
+   * traced time of the call, in telemetry_, and record it in
+   * replay_recorder_, if there are.
+   */
+  void record_replayed_call(std::chrono::nanoseconds verifying);
+
  public:
   // A resource manager for umask and file descriptors
   static ReplayerResourcesManager replayer_resources_manager_;
-  // An input file stream for reading random data from /dev/urandom
-  static std::ifstream random_file_;
+  // Generator of the payloads for --pattern random and urandom
+  static PatternGenerator pattern_generator_;
+  // Block pool for --pattern gen:..., nullptr for other patterns
+  static PayloadBlockPool *payload_block_pool_;
   // An object of logger class
   static SystemCallTraceReplayLogger *syscall_logger_;
+  // A pool of aligned buffers for file descriptors opened with O_DIRECT
+  static AlignedBufferPool aligned_buffer_pool_;
+  // Asynchronous engine for O_DIRECT I/O, nullptr when I/O is synchronous
+  static AsyncIOEngine *aio_engine_;
+  // Binary log of the mismatches, nullptr unless --mismatch-log is given
+  static MismatchRecorder *mismatch_recorder_;
+  // Latencies of the replayed calls, nullptr unless --latency-report is given
+  static LatencyRecorder *latency_recorder_;
+  // Per-stage counters and timers, nullptr unless --profile is given
+  static ReplayProfiler *profiler_;
+  // Live stats of the replay, nullptr unless --stats-file is given
+  static ReplayTelemetry *telemetry_;
+  // Trace of the replay, nullptr unless --record-replay is given
+  static ReplayRecorder *replay_recorder_;
+  // Stalls of the executors, nullptr unless --stall-report is given
+  static StallAnalyzer *stall_analyzer_;
+  // Makes the system calls of processRow(), chosen with --engine
+  static SyscallEngine *engine_;
 
   /**
    * Basic Constructor
@@ -311,6 +388,33 @@ class SystemCallTraceReplayModule : public RowAnalysisModule {
    */
   void execute();
 
+  /**
+   * Determine whether this kind of record can be handed to the async
+   * I/O engine. Records that cannot are only executed once all earlier
+   * asynchronous requests of the process have completed.
+   */
+  virtual bool supports_async_io() const { return false; }
+
+  /**
+   * Determine whether the return value of this kind of call is the
+   * number of bytes read or written, which telemetry_ counts.
+   */
+  virtual bool transfers_data() const { return false; }
+
+  /**
+   * Determine whether the record was submitted to the async I/O engine
+   * and has not completed yet. Such a record must not be freed.
+   */
+  bool async_pending() const;
+
+  /**
+   * Called by the async I/O engine once the request of this record has
+   * completed. result is the number of bytes transferred or -errno.
+   * It finishes the work execute() skipped: return value and errno
+   * comparison and verbose printing.
+   */
+  virtual void complete_async_io(int64_t result);
+
   /**
    * Convert a time value stored in Tfrac units (2^32 Tfracs = 1 sec)
    * (as a uint64_t) to seconds (as a double)
@@ -338,11 +442,20 @@ class SystemCallTraceReplayModule : public RowAnalysisModule {
   /**
    * For system calls such as write, pwrite and writev, replayer has
    * an option to fill buffers with zeros, any pattern or random values.
-   * If pattern is set as random, this function will randomly generate
-   * numbers using standard rand() and srand() library functions to
-   * fill the buffer.
+   * If pattern is set as random or urandom, this function fills the
+   * buffer with the bytes of the payload of this record starting at
+   * offset, generated by pattern_generator_ from the unique id.
+   */
+  char *random_fill_buffer(char *buffer, size_t nbytes, uint64_t offset = 0);
+
+  /**
+   * Fill buffer with nbytes of the payload described by pattern_data,
+   * starting at offset of the payload of this record: generated blocks
+   * for gen:..., pseudo-random bytes for random and urandom, or else the
+   * first byte of pattern_data repeated.
    */
-  char *random_fill_buffer(char *buffer, size_t nbytes);
+  void fill_pattern_buffer(const std::string &pattern_data, char *buffer,
+                           size_t nbytes, uint64_t offset = 0);
 
   /**
    * Some system calls such as _exit, execve, mmap and munmap are not
@@ -33,6 +33,7 @@
 #include "Accept4SystemCallTraceReplayModule.hpp"
 #include "AcceptSystemCallTraceReplayModule.hpp"
 #include "AccessSystemCallTraceReplayModule.hpp"
+#include "AsyncIOEngine.hpp"
 #include "BasicStatSystemCallTraceReplayModule.hpp"
 #include "BasicStatfsSystemCallTraceReplayModule.hpp"
 #include "ChdirSystemCallTraceReplayModule.hpp"
@@ -64,6 +65,7 @@
 #include "MmapSystemCallTraceReplayModule.hpp"
 #include "MunmapSystemCallTraceReplayModule.hpp"
 #include "OpenSystemCallTraceReplayModule.hpp"
+#include "PageCacheManager.hpp"
 #include "PipeSystemCallTraceReplayModule.hpp"
 #include "ReadSystemCallTraceReplayModule.hpp"
 #include "ReadaheadSystemCallTraceReplayModule.hpp"
@@ -82,14 +84,51 @@
 #include "VForkSystemCallTraceReplayModule.hpp"
 #include "WriteSystemCallTraceReplayModule.hpp"
 #include "WritevSystemCallTraceReplayModule.hpp"
+#include "tbb/concurrent_priority_queue.h"
 
 // Define the static replayer resources manager in SystemCallTraceReplayModule
 ReplayerResourcesManager
     SystemCallTraceReplayModule::replayer_resources_manager_;
-// Define the input file stream random_file_ in SystemCallTraceReplayModule
-std::ifstream SystemCallTraceReplayModule::random_file_;
+// Define the payload generator in SystemCallTraceReplayModule
+PatternGenerator SystemCallTraceReplayModule::pattern_generator_;
+// Define the payload block pool in SystemCallTraceReplayModule
+PayloadBlockPool *SystemCallTraceReplayModule::payload_block_pool_ = nullptr;
 // Define the object of logger class in SystemCallTraceReplayModule
 SystemCallTraceReplayLogger *SystemCallTraceReplayModule::syscall_logger_;
+// Define the aligned buffer pool in SystemCallTraceReplayModule
+AlignedBufferPool SystemCallTraceReplayModule::aligned_buffer_pool_;
+// Define the async I/O engine in SystemCallTraceReplayModule
+AsyncIOEngine *SystemCallTraceReplayModule::aio_engine_ = nullptr;
+// Define the mismatch recorder in SystemCallTraceReplayModule
+MismatchRecorder *SystemCallTraceReplayModule::mismatch_recorder_ = nullptr;
+// Define the latency recorder in SystemCallTraceReplayModule
+LatencyRecorder *SystemCallTraceReplayModule::latency_recorder_ = nullptr;
+// Define the profiler in SystemCallTraceReplayModule
+ReplayProfiler *SystemCallTraceReplayModule::profiler_ = nullptr;
+// Define the live stats in SystemCallTraceReplayModule
+ReplayTelemetry *SystemCallTraceReplayModule::telemetry_ = nullptr;
+// Define the replay recorder in SystemCallTraceReplayModule
+ReplayRecorder *SystemCallTraceReplayModule::replay_recorder_ = nullptr;
+// Define the stall analyzer in SystemCallTraceReplayModule
+StallAnalyzer *SystemCallTraceReplayModule::stall_analyzer_ = nullptr;
+// Define the system call engine in SystemCallTraceReplayModule
+SyscallEngine *SystemCallTraceReplayModule::engine_ = nullptr;
+
+/**
+ * min heap uses this function to sort elements in the tree.
+ * The sorting key is unique id.
+ */
+struct CompareByUniqueID {
+  bool operator()(SystemCallTraceReplayModule *m1,
+                  SystemCallTraceReplayModule *m2) const {
+    return (m1->unique_id() >= m2->unique_id());
+  }
+};
+
+// Records of a traced thread waiting to be executed, by unique id
+typedef tbb::concurrent_priority_queue<SystemCallTraceReplayModule *,
+                                       CompareByUniqueID>
+    ExecutionHeap;
 
 // Assert that only version 1 is allowed (at this point)
 static const unsigned int supported_major_version = 1;
@@ -97,8 +136,8 @@ static const unsigned int supported_minor_version = 0;
 
 /*
  * This number is the number of system calls that are need to replayed
- * in order to invoke next fd scanning done to verify the state
- * of resource manager. Ex: 10 means that replayer will scan all fds
+ * in order to invoke next fd check done to verify the state
+ * of resource manager. Ex: 10 means that replayer will check the fds
  * for every 10 system calls that are replayed.
  */
 #define SCAN_FD_FREQUENCY 100000
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This header file provides members and functions for generating
+ * synthetic system call traces from a workload spec.
+ *
+ * WorkloadSpec describes the workload: how many processes and threads,
+ * the mix of system calls, the file set, the I/O sizes, how much of the
+ * I/O is sequential, how often files are fsynced and how long threads
+ * think between calls. TraceSynthesizer turns it into a DataSeries file
+ * with the extent types and fields that system-call-replayer reads.
+ *
+ * The trace starts with a setup that creates the file set, sized with
+ * ftruncate, and clones the processes and threads. Then every thread
+ * runs sessions that open a file, do I/O on it and close it. Offsets
+ * and sizes stay within the file size, so the return values of the
+ * trace are the ones the replay gets. Traces carry no data: writes
+ * replay zeros or the --pattern of the replayer.
+ *
+ * Threads are independent streams of calls, each with its own random
+ * generator and clock, so they are generated in parallel. The streams
+ * are cut into windows of trace time, merged in time order, numbered
+ * and written while the next window is generated.
+ *
+ * USAGE
+ * Fill a WorkloadSpec with set() or load(), then create a
+ * TraceSynthesizer with it and call generate().
+ */
+
+#ifndef TRACE_SYNTHESIZER_HPP
+#define TRACE_SYNTHESIZER_HPP
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// System calls in synthetic traces
+enum SynthSyscall {
+  SYNTH_UMASK,
+  SYNTH_MKDIR,
+  SYNTH_OPEN,
+  SYNTH_FTRUNCATE,
+  SYNTH_CLONE,
+  SYNTH_CLOSE,
+  SYNTH_READ,
+  SYNTH_WRITE,
+  SYNTH_PREAD,
+  SYNTH_PWRITE,
+  SYNTH_LSEEK,
+  SYNTH_FSYNC,
+  SYNTH_STAT,
+  SYNTH_FSTAT,
+  SYNTH_SYSCALLS
+};
+
+// Workload of a synthetic trace, see trace-synth --help for the keys
+struct WorkloadSpec {
+  uint32_t processes;
+  // Threads of each process
+  uint32_t threads;
+  // Approximate number of records after the setup
+  uint64_t records;
+  uint32_t files;
+  uint64_t file_size;
+  std::string directory;
+  // Relative weight of each system call, by SynthSyscall
+  std::vector<std::pair<SynthSyscall, double>> mix;
+  // Relative weight of each I/O size, or a range if io_size_range is set
+  std::vector<std::pair<uint64_t, double>> io_sizes;
+  bool io_size_range;
+  // Fraction of the I/O that continues where the previous one ended
+  double sequential;
+  // I/O calls between the open and the close of a file
+  uint64_t ops_per_open;
+  // Writes between fsyncs of a file, 0 for never
+  uint64_t fsync_every;
+  // Duration of each call and mean pause between calls, in nanoseconds
+  uint64_t syscall_time;
+  uint64_t think_time;
+  // Wall clock time of the first record, in seconds since the epoch
+  uint64_t start_time;
+  uint64_t seed;
+
+  /**
+   * Constructor, which sets the defaults: one thread doing 4k reads and
+   * writes on 100 files of 1m.
+   */
+  WorkloadSpec();
+
+  /**
+   * Set key to value. Return false and set error if either is wrong.
+   */
+  bool set(const std::string &key, const std::string &value,
+           std::string &error);
+
+  /**
+   * Set the keys of a spec file, with one key = value per line and
+   * comments starting with #. Return false and set error on the first
+   * wrong line.
+   */
+  bool load(std::istream &spec, std::string &error);
+};
+
+// One record of a synthetic trace
+struct SynthRecord {
+  // Trace times, in nanoseconds since the start of the trace
+  uint64_t time_called;
+  uint64_t time_returned;
+  int64_t unique_id;
+  int64_t return_value;
+  // Offset of pread, pwrite and lseek, length of ftruncate, flags of
+  // open and clone
+  int64_t offset;
+  // Bytes of read and write, mode of umask, mkdir and open
+  int64_t size;
+  int32_t executing_pid;
+  int32_t descriptor;
+  // Index of the file of open and stat, -1 for the directory
+  int32_t file;
+  SynthSyscall syscall;
+};
+
+class SynthThread;
+class SynthWriter;
+
+class TraceSynthesizer {
+ private:
+  const WorkloadSpec spec_;
+  unsigned int jobs_;
+  std::vector<std::unique_ptr<SynthThread>> threads_;
+  std::unique_ptr<SynthWriter> writer_;
+  // Records written so far
+  uint64_t written_;
+
+  /**
+   * Return the records that create the file set and the threads.
+   */
+  std::vector<SynthRecord> setup() const;
+
+  /**
+   * Generate the records of every thread that are called before end, in
+   * parallel, and return them merged in time order.
+   */
+  std::vector<SynthRecord> generate_window(uint64_t end);
+
+ public:
+  /**
+   * Constructor, which creates filename. jobs threads generate the
+   * records.
+   */
+  TraceSynthesizer(const WorkloadSpec &spec, const std::string &filename,
+                   unsigned int jobs);
+
+  /**
+   * Generate the whole trace and close the file. Return the number of
+   * records written.
+   */
+  uint64_t generate();
+
+  ~TraceSynthesizer();
+};
+
+#endif /* TRACE_SYNTHESIZER_HPP */
@@ -27,11 +27,67 @@
 
 #include <stdint.h>
 #include <sys/types.h>
+#include <tbb/concurrent_hash_map.h>
 #include <cstdint>
+#include <map>
+#include <memory>
 #include <mutex>
-#include <unordered_map>
+#include <utility>
 #include <vector>
 
+// Replayed address ranges [start, end)
+typedef std::vector<std::pair<uint64_t, uint64_t>> ReplayedRanges;
+
+/*
+ * Memory mapped in the replayer by a replayed mmap. The regions of every
+ * address space that still map part of it, e.g. of a parent and its
+ * forked child, share it and count how many of them map each of its
+ * pages. A range is unmapped once no region maps it anymore.
+ */
+class ReplayedMapping {
+ private:
+  std::mutex lock_;
+  // <replayed address, regions mapping it up to the next key>
+  std::map<uint64_t, uint32_t> refs_;
+
+  /*
+   * Makes addr a key of refs_, counting what the range it falls in
+   * counts. lock_ must be held.
+   */
+  void split(uint64_t addr);
+
+  /*
+   * Adds delta to the counts of [start, end) and appends the ranges
+   * whose count dropped to zero to unused. lock_ must be held.
+   */
+  void adjust(uint64_t start, uint64_t end, int delta, ReplayedRanges *unused);
+
+ public:
+  /*
+   * Takes over size bytes mapped at start, mapped by one region.
+   */
+  ReplayedMapping(void *start, uint64_t size);
+
+  /*
+   * Counts one more region mapping size bytes at start.
+   */
+  void acquire(void *start, uint64_t size);
+
+  /*
+   * Counts one region less mapping size bytes at start, and unmaps the
+   * ranges that no region maps anymore, except those within keep, which
+   * a later mmap has already replaced.
+   */
+  void release(void *start, uint64_t size,
+               std::pair<uint64_t, uint64_t> keep = {0, 0});
+
+  /*
+   * Copies size bytes at addr into buffer. The ranges cannot be unmapped
+   * meanwhile. Returns false if part of them is not mapped anymore.
+   */
+  bool read(const void *addr, size_t size, void *buffer);
+};
+
 class VM_node {
  public:
   void *traced_start_address;
@@ -39,43 +95,107 @@ class VM_node {
   uint64_t map_size;
   int32_t traced_fd;
   int32_t replayed_fd;
+  // Memory the region maps, nullptr if the replayed mmap failed
+  std::shared_ptr<ReplayedMapping> mapping;
 
   VM_node(void *t_start_addr, void *r_start_addr, uint64_t size, int32_t t_fd,
-          int32_t r_fd)
+          int32_t r_fd, std::shared_ptr<ReplayedMapping> r_mapping = nullptr)
       : traced_start_address(t_start_addr),
         replayed_start_address(r_start_addr),
         map_size(size),
         traced_fd(t_fd),
-        replayed_fd(r_fd) {}
+        replayed_fd(r_fd),
+        mapping(std::move(r_mapping)) {}
 };
 
 class VM_area {
  private:
-  std::mutex vma_lock;
+  mutable std::mutex vma_lock;
+
+  /*
+   * Mapped regions keyed by traced start address. Regions never
+   * overlap, so the only region that can contain an address is the
+   * one with the greatest start address not above it.
+   */
+  std::map<uint64_t, VM_node> vma;
+
+  /*
+   * Returns the first region that ends after addr, which is where a
+   * walk over the regions overlapping [addr, ...) starts.
+   */
+  std::map<uint64_t, VM_node>::iterator first_overlap(uint64_t addr);
+
+  /*
+   * Unmaps the traced range [start, end), shrinking or splitting the
+   * regions that straddle its boundaries, and releases the memory of the
+   * parts removed except the replayed range keep. Returns true if any
+   * region overlapped the range. vma_lock must be held.
+   */
+  bool carve(uint64_t start, uint64_t end,
+             std::pair<uint64_t, uint64_t> keep = {0, 0});
 
  public:
   VM_area() {}
-  std::vector<VM_node *> vma;
+
   /*
-   * find method is responsible for finding
-   * VM_node which contains the addr
+   * Copies the regions of other, as fork does for the address space
+   * of the child. The copies share the replayed memory of the regions.
    */
-  std::vector<VM_node *> *find_VM_node(void *addr, size_t size);
+  VM_area(const VM_area &other);
+
+  VM_area &operator=(const VM_area &) = delete;
 
   /*
-   * find the target to delete
+   * Releases the memory of every region, as exit and execve do.
+   */
+  ~VM_area();
+
+  /*
+   * find method is responsible for finding every VM_node which
+   * overlaps [addr, addr + size) and calling visit on each of them in
+   * address order, with vma_lock held.
+   */
+  template <typename Visitor>
+  void find_VM_node(void *addr, size_t size, Visitor visit) {
+    auto start = reinterpret_cast<uint64_t>(addr);
+    std::lock_guard<std::mutex> lock(vma_lock);
+    for (auto it = first_overlap(start);
+         it != vma.end() && it->first < start + size; ++it) {
+      visit(it->second);
+    }
+  }
+
+  /*
+   * Copies the first VM_node which overlaps [addr, addr + size) into
+   * node, so that the caller can use it without holding vma_lock.
+   * Returns false if no region overlaps the range.
+   */
+  bool get_VM_node(void *addr, size_t size, VM_node *node);
+
+  /*
+   * find the target to delete; returns true if any region was unmapped
    */
   bool delete_VM_node(void *addr, size_t size);
 
-  void insert_VM_node(VM_node *node);
+  /*
+   * Adds a region, replacing whatever was mapped at the same traced
+   * addresses before, as mmap does. The region takes over the memory of
+   * node.mapping.
+   */
+  void insert_VM_node(const VM_node &node);
 
   void list();
 };
 
 class VM_manager {
  private:
-  static VM_manager *instance;
-  std::unordered_map<pid_t, VM_area *> process_map;
+  /*
+   * Processes that share an address space (CLONE_VM) point to the same
+   * VM_area, which is freed when the last of them exits or execs.
+   */
+  typedef tbb::concurrent_hash_map<pid_t, std::shared_ptr<VM_area>>
+      ProcessMap;
+  ProcessMap process_map;
   VM_manager() {}
 
  public:
@@ -83,9 +203,29 @@ class VM_manager {
 
   /*
    * gets the virtual address space for
-   * particular process
+   * particular process, creating an empty one on first use. The
+   * area stays valid for as long as the caller holds on to it, even if
+   * the process exits meanwhile.
+   */
+  std::shared_ptr<VM_area> get_VM_area(pid_t pid);
+
+  /*
+   * gives the process pid created by ppid the address space of its
+   * parent if shared_vm (CLONE_VM), or a copy of it otherwise
+   */
+  void clone_VM_area(pid_t ppid, pid_t pid, bool shared_vm);
+
+  /*
+   * gives pid a new empty address space, as a successful execve does.
+   * The memory of the old one is unmapped once no process maps it.
+   */
+  void reset_VM_area(pid_t pid);
+
+  /*
+   * drops the address space of pid once the process exits, unmapping
+   * the memory that no other process maps
    */
-  VM_area *get_VM_area(pid_t pid);
+  void remove_VM_area(pid_t pid);
 };
 
 #endif
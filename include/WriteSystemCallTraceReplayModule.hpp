@@ -51,12 +51,33 @@ class WriteSystemCallTraceReplayModule : public SystemCallTraceReplayModule {
   char *data_buffer;
   size_t nbytes;
   int traced_fd;
+  // True if data_buffer was taken from aligned_buffer_pool_
+  bool aligned_buffer_;
 
   /**
    * Print write sys call field values in a nice format
    */
   void print_specific_fields() override;
 
+  /**
+   * Copy data_buffer into a buffer from aligned_buffer_pool_ so that it
+   * can be used with a file descriptor opened with O_DIRECT.
+   */
+  void use_aligned_buffer();
+
+  /**
+   * Free data_buffer, giving it back to the pool if it came from there.
+   */
+  void release_buffer();
+
+  /**
+   * Submit the write on fd, which is opened with O_DIRECT, to the async
+   * I/O engine if the engine is enabled and the request is aligned.
+   * offset is -1 for write, which uses the file position instead.
+   * Return true if the write was submitted.
+   */
+  bool submit_direct_io(int fd, off_t offset);
+
   /**
    * This function will gather arguments in the trace file
    * or create our own arguments (for example, pattern),
@@ -68,6 +89,9 @@ class WriteSystemCallTraceReplayModule : public SystemCallTraceReplayModule {
   WriteSystemCallTraceReplayModule(DataSeriesModule &source, bool verbose_flag,
                                    bool verify_flag, int warn_level_flag,
                                    std::string pattern_data);
+  bool supports_async_io() const override { return true; }
+  bool transfers_data() const override { return true; }
+  void complete_async_io(int64_t result) override;
   SystemCallTraceReplayModule *move() override {
     auto movePtr = new WriteSystemCallTraceReplayModule(
         source, verbose_, verify_, warn_level_, pattern_data_);
@@ -52,6 +52,17 @@ class WritevSystemCallTraceReplayModule : public SystemCallTraceReplayModule {
   Int32Field iov_number_;
   Variable32Field data_written_;
   Int64Field bytes_requested_;
+  int traced_fd;
+  int iovcnt;
+  size_t nbytes;
+  // One allocation that holds the iovec array followed by the nbytes of
+  // data the iovecs point to
+  char *arena;
+
+  /**
+   * Return the iovec array at the start of arena.
+   */
+  struct iovec *iov() { return reinterpret_cast<struct iovec *>(arena); }
 
   /**
    * Print writev sys call field values in a nice format
@@ -68,5 +79,27 @@ class WritevSystemCallTraceReplayModule : public SystemCallTraceReplayModule {
   WritevSystemCallTraceReplayModule(DataSeriesModule &source, bool verbose_flag,
                                     int warn_level_flag,
                                     std::string pattern_data);
+  bool transfers_data() const override { return true; }
+  SystemCallTraceReplayModule *move() override {
+    auto movePtr = new WritevSystemCallTraceReplayModule(
+        source, verbose_, warn_level_, pattern_data_);
+    movePtr->setMove(traced_fd, iovcnt, nbytes, arena);
+    movePtr->setCommon(uniqueIdVal, timeCalledVal, timeReturnedVal,
+                       timeRecordedVal, executingPidVal, errorNoVal, returnVal,
+                       replayerIndex);
+    return movePtr;
+  }
+  void setMove(int fd, int count, size_t bytes, char *buffer) {
+    traced_fd = fd;
+    iovcnt = count;
+    nbytes = bytes;
+    arena = buffer;
+  }
+
+  /**
+   * Read the first record and all iovec records of a writev call and
+   * build the iovec array and data in arena.
+   */
+  void prepareRow() override;
 };
 #endif /* WRITEV_SYSTEM_CALL_TRACE_REPLAY_MODULE_HPP */
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program stresses MemFsSyscallEngine from many threads at once.
+ * Every worker creates, writes, reads back, links, renames and removes
+ * files and directories in a directory of its own and in one that all
+ * workers share, while a reader keeps listing the shared directory and
+ * looking paths up through "..". Build it with -fsanitize=thread (make
+ * test-stress-memfs) so that data races are reported too.
+ *
+ * USAGE:
+ * ./memfs-stress-prog [threads] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MemFsSyscallEngine.hpp"
+
+// Size of the files the workers write, spanning two extents
+#define FILE_SIZE (MEMFS_EXTENT_SIZE + 4096)
+// Number of file names each worker cycles through
+#define FILES_PER_WORKER 16
+
+static MemFsSyscallEngine engine;
+static std::atomic<int> failures(0);
+
+static void check(bool condition, const char *what) {
+  if (!condition) {
+    fprintf(stderr, "check failed: %s\n", what);
+    failures++;
+  }
+}
+
+static void worker(int id, int iterations) {
+  std::string own_dir = "/w" + std::to_string(id);
+  check(engine.mkdir(own_dir.c_str(), 0755) == 0, "mkdir of the own dir");
+  std::vector<char> data(FILE_SIZE, static_cast<char>('a' + id));
+  std::vector<char> read_back(FILE_SIZE);
+
+  for (int iteration = 0; iteration < iterations; iteration++) {
+    int slot = iteration % FILES_PER_WORKER;
+    std::string name = "f" + std::to_string(slot);
+    std::string path = own_dir + "/" + name;
+    std::string shared_path = "/shared/" + std::to_string(id) + "-" + name;
+
+    int fd = engine.openat(AT_FDCWD, path.c_str(),
+                           O_CREAT | O_RDWR | O_TRUNC, 0644);
+    check(fd > 2, "openat with O_CREAT");
+    check(engine.write(fd, data.data(), FILE_SIZE) == FILE_SIZE, "write");
+    check(engine.pread(fd, read_back.data(), FILE_SIZE, 0) == FILE_SIZE &&
+              read_back == data,
+          "pread returns the data written");
+    int dup_fd = engine.dup(fd);
+    check(engine.lseek(dup_fd, 0, SEEK_CUR) == FILE_SIZE,
+          "dup shares the file position");
+    check(engine.close(dup_fd) == 0 && engine.close(fd) == 0, "close");
+
+    // Move the file through the shared directory and back
+    check(engine.rename(path.c_str(), shared_path.c_str()) == 0,
+          "rename into the shared dir");
+    check(engine.link(shared_path.c_str(), path.c_str()) == 0, "link");
+    struct stat buf;
+    check(engine.stat(path.c_str(), &buf) == 0 && buf.st_nlink == 2 &&
+              buf.st_size == FILE_SIZE,
+          "stat of a linked file");
+    check(engine.unlink(shared_path.c_str()) == 0, "unlink");
+
+    std::string sub_dir = own_dir + "/d" + std::to_string(slot);
+    check(engine.mkdir(sub_dir.c_str(), 0700) == 0, "mkdir");
+    check(engine.access((sub_dir + "/../" + name).c_str(), F_OK) == 0,
+          "lookup through ..");
+    check(engine.rmdir(sub_dir.c_str()) == 0, "rmdir");
+    if (slot % 2 == 0) {
+      check(engine.unlink(path.c_str()) == 0, "unlink of the own file");
+    }
+  }
+  for (int slot = 0; slot < FILES_PER_WORKER; slot++) {
+    engine.unlink((own_dir + "/f" + std::to_string(slot)).c_str());
+  }
+  check(engine.rmdir(own_dir.c_str()) == 0, "rmdir of the emptied own dir");
+}
+
+int main(int argc, char *argv[]) {
+  int nthreads = argc > 1 ? atoi(argv[1]) : 8;
+  int iterations = argc > 2 ? atoi(argv[2]) : 5000;
+
+  check(engine.mkdir("/shared", 0755) == 0, "mkdir of the shared dir");
+  std::atomic<bool> done(false);
+  std::thread reader([&]() {
+    int fd = engine.openat(AT_FDCWD, "/shared", O_RDONLY | O_DIRECTORY, 0);
+    check(fd > 2, "open of the shared dir");
+    char dirents[4096];
+    while (!done) {
+      check(engine.lseek(fd, 0, SEEK_SET) == 0, "lseek of the shared dir");
+      while (engine.getdents(fd, dirents, sizeof(dirents)) > 0) {
+      }
+      check(engine.access("/shared/../shared/.", F_OK) == 0,
+            "lookup of the shared dir");
+    }
+    engine.close(fd);
+  });
+  std::vector<std::thread> workers;
+  for (int id = 0; id < nthreads; id++) {
+    workers.emplace_back(worker, id, iterations);
+  }
+  for (auto &thread : workers) {
+    thread.join();
+  }
+  done = true;
+  reader.join();
+
+  check(engine.rmdir("/shared") == 0, "rmdir of the emptied shared dir");
+  // Every fd above the standard streams was closed
+  int fd = engine.dup(STDIN_FILENO);
+  check(fd == 3, "lowest fd is free again");
+  engine.close(fd);
+  if (failures != 0) {
+    printf("FAIL: %d checks failed\n", failures.load());
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program runs a command and prints, on one line of the file given
+ * with -o, the wall clock seconds it took, its user and system CPU
+ * seconds and its peak resident set size in KiB, as measured by wait4().
+ * perf-test.sh measures the replayer with it.
+ *
+ * USAGE
+ * perf-measure-prog -o output-file command [args ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+
+static double timeval_to_sec(const struct timeval &time) {
+  return time.tv_sec + time.tv_usec / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 4 || strcmp(argv[1], "-o") != 0) {
+    fprintf(stderr, "Usage: %s -o output-file command [args ...]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  auto started = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return EXIT_FAILURE;
+  }
+  if (pid == 0) {
+    execvp(argv[3], argv + 3);
+    perror(argv[3]);
+    _exit(127);
+  }
+
+  int status;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) < 0) {
+    perror("wait4");
+    return EXIT_FAILURE;
+  }
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - started)
+                       .count();
+
+  FILE *output = fopen(argv[2], "w");
+  if (output == nullptr) {
+    perror(argv[2]);
+    return EXIT_FAILURE;
+  }
+  fprintf(output, "%.3f %.3f %.3f %ld\n", elapsed,
+          timeval_to_sec(usage.ru_utime), timeval_to_sec(usage.ru_stime),
+          usage.ru_maxrss);
+  fclose(output);
+
+  if (WIFEXITED(status)) {
+    return WEXITSTATUS(status);
+  }
+  return 128 + WTERMSIG(status);
+}
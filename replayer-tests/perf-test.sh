@@ -0,0 +1,171 @@
+#!/bin/bash
+#
+# Replay throughput regression test.
+#
+# Each workload in perf-workloads/ is a trace-synth spec. The script
+# generates its trace, replays it $PERF_RUNS times into a scratch
+# directory on tmpfs and takes the median of the runs of:
+#   - replayed system calls per second (ops/s),
+#   - CPU time of the replayer per replayed system call (cpu us/op),
+#   - peak resident set size of the replayer (rss KiB).
+# The results are compared with the baseline file: the test fails if
+# ops/s dropped or cpu us/op grew by more than $PERF_TOLERANCE percent,
+# or rss grew by more than $PERF_RSS_TOLERANCE percent.
+#
+# The numbers only mean something on the machine that recorded them, so
+# the baseline is kept per host. Without one, the results of the run
+# become the baseline.
+#
+# Usage: perf-test.sh [--update-baseline] [workload ...]
+#
+# Modify following variables, or set them in the environment, if the
+# binaries or the scratch directory are elsewhere.
+PERF_TEST_DIR=$(cd "$(dirname "$0")" && pwd)
+REPLAYER_BIN_DIR=${REPLAYER_BIN_DIR:-$PERF_TEST_DIR/../build}
+SYS_CALL_REPLAYER=${SYS_CALL_REPLAYER:-$REPLAYER_BIN_DIR/system-call-replayer}
+TRACE_SYNTH=${TRACE_SYNTH:-$REPLAYER_BIN_DIR/trace-synth}
+# Extra options of the replayer, such as --aio
+PERF_REPLAYER_ARGS=${PERF_REPLAYER_ARGS:-}
+PERF_SCRATCH_DIR=${PERF_SCRATCH_DIR:-/dev/shm}
+PERF_BASELINE=${PERF_BASELINE:-$PERF_TEST_DIR/perf-baseline-$(hostname -s).txt}
+PERF_RUNS=${PERF_RUNS:-3}
+PERF_TOLERANCE=${PERF_TOLERANCE:-15}
+PERF_RSS_TOLERANCE=${PERF_RSS_TOLERANCE:-25}
+PERF_MEASURE=$PERF_TEST_DIR/perf-measure-prog
+
+UPDATE_BASELINE=0
+if [ "$1" = "--update-baseline" ]
+then
+    UPDATE_BASELINE=1
+    shift
+fi
+
+WORKLOADS="$@"
+if [ -z "$WORKLOADS" ]
+then
+    WORKLOADS=`ls $PERF_TEST_DIR/perf-workloads | sed -n 's/\.spec$//p'`
+fi
+
+###########################Setup Start########################################
+for PROG in $SYS_CALL_REPLAYER $TRACE_SYNTH
+do
+    if [ ! -x $PROG ]
+    then
+        echo "$PROG not found, set REPLAYER_BIN_DIR to the build directory"
+        exit 1
+    fi
+done
+
+if [ ! -x $PERF_MEASURE ]
+then
+    echo "$PERF_MEASURE not found, run make perf-measure-prog"
+    exit 1
+fi
+
+if [ "`stat -f -c %T $PERF_SCRATCH_DIR`" != "tmpfs" ]
+then
+    echo "Warning: $PERF_SCRATCH_DIR is not tmpfs, the storage will be measured too"
+fi
+
+SCRATCH=`mktemp -d $PERF_SCRATCH_DIR/replayer-perf.XXXXXX`
+if test $? != 0
+then
+    echo "Create scratch directory in $PERF_SCRATCH_DIR - Failed"
+    exit 1
+fi
+trap "rm -rf $SCRATCH" EXIT
+###########################Setup End##########################################
+
+# Print the median of the numbers given as arguments
+median() {
+    printf '%s\n' "$@" | sort -g | sed -n "$(( ($# + 1) / 2 ))p"
+}
+
+# Replay workload $1 $PERF_RUNS times, printing its median results as
+# "workload ops/s cpu-us/op rss-KiB"
+measure() {
+    local WORKLOAD=$1
+    local TRACE=$SCRATCH/$WORKLOAD.ds
+    local RECORDS
+    RECORDS=`$TRACE_SYNTH --spec $PERF_TEST_DIR/perf-workloads/$WORKLOAD.spec \
+        $TRACE 2>&1 | sed -n 's/^Wrote \([0-9]*\) records.*/\1/p'`
+    if [ -z "$RECORDS" ]
+    then
+        echo "Generating the trace of $WORKLOAD - Failed" >&2
+        return 1
+    fi
+
+    local OPS=() CPU=() RSS=()
+    for RUN in `seq $PERF_RUNS`
+    do
+        # Every run starts from an empty directory
+        rm -rf $SCRATCH/replay && mkdir $SCRATCH/replay
+        (cd $SCRATCH/replay &&
+            $PERF_MEASURE -o $SCRATCH/time \
+            $SYS_CALL_REPLAYER $PERF_REPLAYER_ARGS $TRACE > $SCRATCH/replay.log 2>&1)
+        if test $? != 0
+        then
+            echo "Replaying $WORKLOAD - Failed, output:" >&2
+            cat $SCRATCH/replay.log >&2
+            return 1
+        fi
+        read ELAPSED USER SYSTEM MAX_RSS < $SCRATCH/time
+        OPS+=(`awk -v n=$RECORDS -v s=$ELAPSED 'BEGIN { printf "%.0f", n / (s > 0 ? s : 0.01) }'`)
+        CPU+=(`awk -v n=$RECORDS -v u=$USER -v s=$SYSTEM 'BEGIN { printf "%.3f", (u + s) * 1e6 / n }'`)
+        RSS+=($MAX_RSS)
+    done
+    echo "$WORKLOAD `median ${OPS[@]}` `median ${CPU[@]}` `median ${RSS[@]}`"
+}
+
+###########################Measuring Start####################################
+echo "# workload ops/s cpu-us/op rss-KiB" > $SCRATCH/results
+for WORKLOAD in $WORKLOADS
+do
+    echo "Replay $WORKLOAD $PERF_RUNS times"
+    measure $WORKLOAD >> $SCRATCH/results || exit 1
+done
+###########################Measuring End######################################
+
+if [ $UPDATE_BASELINE = 1 ] || [ ! -f $PERF_BASELINE ]
+then
+    cp $SCRATCH/results $PERF_BASELINE
+    cat $PERF_BASELINE
+    echo "Recorded the baseline in $PERF_BASELINE"
+    exit 0
+fi
+
+###########################Comparing Start####################################
+# A workload missing from the baseline is reported but does not fail
+awk -v tolerance=$PERF_TOLERANCE -v rss_tolerance=$PERF_RSS_TOLERANCE '
+    function change(now, then) { return then > 0 ? (now - then) * 100 / then : 0 }
+    FNR == 1 { next }
+    FNR == NR { ops[$1] = $2; cpu[$1] = $3; rss[$1] = $4; next }
+    {
+        if (!($1 in ops)) {
+            printf "%-18s %10d ops/s %8.3f cpu-us/op %8d rss-KiB  no baseline\n",
+                $1, $2, $3, $4
+            next
+        }
+        d_ops = change($2, ops[$1])
+        d_cpu = change($3, cpu[$1])
+        d_rss = change($4, rss[$1])
+        verdict = "passed"
+        if (-d_ops > tolerance || d_cpu > tolerance || d_rss > rss_tolerance) {
+            verdict = "failed"
+            failed++
+        }
+        printf "%-18s %10d ops/s (%+6.1f%%) %8.3f cpu-us/op (%+6.1f%%) %8d rss-KiB (%+6.1f%%)  %s\n",
+            $1, $2, d_ops, $3, d_cpu, $4, d_rss, verdict
+    }
+    END { exit failed > 0 }' $PERF_BASELINE $SCRATCH/results
+TEST_RESULT=$?
+###########################Comparing End######################################
+
+echo -n "Replay performance test "
+if test $TEST_RESULT = 0
+then
+    echo "passed"
+else
+    echo "failed against $PERF_BASELINE"
+fi
+exit $TEST_RESULT
@@ -0,0 +1,9 @@
+# 1m reads and writes streaming through a few files
+threads = 2
+records = 10000
+files = 4
+file_size = 32m
+mix = read:1,write:1
+io_size = 1m
+sequential = 1
+ops_per_open = 1000
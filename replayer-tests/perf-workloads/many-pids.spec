@@ -0,0 +1,9 @@
+# Many processes doing small mixed I/O, which stresses the scheduling
+processes = 64
+threads = 2
+records = 200000
+files = 256
+file_size = 1m
+mix = read:2,write:2,lseek:1,fsync:1
+io_size = 4k
+ops_per_open = 50
@@ -0,0 +1,9 @@
+# Many small files, opened for a couple of calls each and stat'ed often
+threads = 4
+records = 200000
+files = 2000
+file_size = 4k
+mix = stat:4,fstat:2,read:1,write:1
+io_size = 512
+sequential = 0
+ops_per_open = 2
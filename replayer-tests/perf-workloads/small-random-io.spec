@@ -0,0 +1,9 @@
+# 4k reads and writes at random offsets of a few long-open files
+threads = 4
+records = 200000
+files = 8
+file_size = 8m
+mix = pread:7,pwrite:3
+io_size = 4k
+sequential = 0
+ops_per_open = 10000
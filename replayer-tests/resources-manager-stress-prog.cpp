@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program stresses ReplayerResourcesManager from many threads at
+ * once. Every worker clones its own process from a root process, then
+ * keeps cloning children of that process, sharing or copying its fd
+ * table and umask, adds, updates and removes fds, and exits the children
+ * again, while a reader keeps looking up the root process. Build it
+ * with -fsanitize=thread (make test-stress-resources-manager) so that
+ * data races are reported too.
+ *
+ * USAGE:
+ * ./resources-manager-stress-prog [threads] [iterations]
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "ReplayerResourcesManager.hpp"
+
+// Pid of the process every worker clones from
+#define ROOT_PID 1
+// Number of fds each worker adds to a cloned process at once
+#define FDS_PER_PROCESS 4
+// First traced fd used by the workers, above the standard streams
+#define FIRST_TRACED_FD 100
+
+static ReplayerResourcesManager manager;
+static std::atomic<int> failures(0);
+
+static void check(bool condition, const char *what) {
+  if (!condition) {
+    fprintf(stderr, "check failed: %s\n", what);
+    failures++;
+  }
+}
+
+static int count_open_fds() {
+  int count = 0;
+  for (int fd = 0; fd < 4096; fd++) {
+    if (manager.is_fd_in_use(fd)) {
+      count++;
+    }
+  }
+  return count;
+}
+
+static void exit_process(pid_t pid) {
+  manager.remove_umask(pid);
+  for (int fd : manager.remove_fd_table(pid)) {
+    // No table uses these replayed fds anymore
+    close(fd);
+  }
+}
+
+static void worker(int id, int nthreads, int iterations) {
+  /*
+   * All workers clone the root process at the same time. Children share
+   * the table of the worker process only, so that no other worker copies
+   * a fd while this worker closes it.
+   */
+  pid_t parent = ROOT_PID + 1 + id;
+  manager.clone_umask(ROOT_PID, parent, false);
+  manager.clone_fd_table(ROOT_PID, parent, false);
+
+  for (int iteration = 1; iteration <= iterations; iteration++) {
+    pid_t pid = parent + nthreads * iteration;
+    bool shared = iteration % 2 == 0;
+    manager.clone_umask(parent, pid, shared);
+    manager.clone_fd_table(parent, pid, shared);
+
+    mode_t mask = iteration & 0777;
+    manager.set_umask(pid, mask);
+    check(manager.get_umask(pid) == mask, "get_umask after set_umask");
+
+    int first_fd = FIRST_TRACED_FD;
+    int replayed_fds[FDS_PER_PROCESS];
+    for (int i = 0; i < FDS_PER_PROCESS; i++) {
+      replayed_fds[i] = open("/dev/null", O_RDONLY);
+      manager.add_fd(pid, first_fd + i, replayed_fds[i], O_RDONLY);
+      check(manager.has_fd(pid, first_fd + i), "has_fd after add_fd");
+      check(manager.get_fd(pid, first_fd + i) == replayed_fds[i],
+            "get_fd after add_fd");
+    }
+
+    // Move the first fd, as dup2 over an existing traced fd does
+    int new_fd = dup(replayed_fds[0]);
+    manager.update_fd(pid, first_fd, new_fd);
+    close(replayed_fds[0]);
+    replayed_fds[0] = new_fd;
+    manager.add_flags(pid, first_fd, O_CLOEXEC);
+    check(manager.get_flags(pid, first_fd) == (O_RDONLY | O_CLOEXEC),
+          "get_flags after add_flags");
+    check(manager.get_fd(pid, first_fd) == new_fd, "get_fd after update_fd");
+    std::vector<int> cloexec_fds = manager.get_cloexec_traced_fds(pid);
+    check(cloexec_fds.size() == 1 && cloexec_fds[0] == first_fd,
+          "get_cloexec_traced_fds after add_flags");
+    // A copied table is private as soon as it changes
+    check(manager.has_fd(parent, first_fd) == shared,
+          "copy-on-write table is private after add_fd");
+
+    for (int i = 0; i < FDS_PER_PROCESS; i++) {
+      int fd = manager.remove_fd(pid, first_fd + i);
+      check(fd == replayed_fds[i], "remove_fd returns the replayed fd");
+      close(fd);
+    }
+    if (!shared) {
+      // A copy shares the replayed fds of the root process with it
+      bool last_use = true;
+      check(manager.remove_fd(pid, 1, &last_use) == 1 && !last_use,
+            "remove_fd of a fd the root process still uses");
+    }
+
+    exit_process(pid);
+  }
+  exit_process(parent);
+}
+
+int main(int argc, char *argv[]) {
+  int nthreads = argc > 1 ? atoi(argv[1]) : 8;
+  int iterations = argc > 2 ? atoi(argv[2]) : 20000;
+
+  SystemCallTraceReplayLogger logger("");
+  std::map<int, int> fd_map = {{0, 0}, {1, 1}, {2, 2}};
+  manager.initialize(&logger, ROOT_PID, fd_map);
+  int open_fds = count_open_fds();
+
+  std::atomic<bool> done(false);
+  std::thread reader([&]() {
+    while (!done) {
+      check(manager.get_fd(ROOT_PID, 1) == 1, "get_fd of the root process");
+      check(manager.get_umask(ROOT_PID) == 0, "get_umask of the root process");
+      int fd = manager.generate_unused_fd(ROOT_PID);
+      int other = manager.generate_unused_fd(ROOT_PID);
+      check(fd > 2 && other > 2 && fd != other,
+            "generate_unused_fd reserves the fd it returns");
+      manager.release_generated_fd(other);
+      manager.release_generated_fd(fd);
+    }
+  });
+  std::vector<std::thread> workers;
+  for (int id = 0; id < nthreads; id++) {
+    workers.emplace_back(worker, id, nthreads, iterations);
+  }
+  for (auto &thread : workers) {
+    thread.join();
+  }
+  done = true;
+  reader.join();
+
+  check(manager.get_all_traced_fds(ROOT_PID).size() == fd_map.size(),
+        "root process keeps only its own fds");
+  check(count_open_fds() == open_fds, "every replayed fd is closed");
+  if (failures != 0) {
+    printf("FAIL: %d checks failed\n", failures.load());
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
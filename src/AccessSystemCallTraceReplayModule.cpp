@@ -55,7 +55,7 @@ void AccessSystemCallTraceReplayModule::print_specific_fields() {
 
 void AccessSystemCallTraceReplayModule::processRow() {
   // Replay the access system call
-  replayed_ret_val_ = access(pathname, get_mode(mode_value));
+  replayed_ret_val_ = engine_->access(pathname, get_mode(mode_value));
 
   if (!verbose_mode()) {
     delete[] pathname;
@@ -108,5 +108,5 @@ void FAccessatSystemCallTraceReplayModule::processRow() {
   }
 
   // Replay the faccessat system call
-  replayed_ret_val_ = faccessat(replayed_fd, pathname, mode, flags);
+  replayed_ret_val_ = engine_->faccessat(replayed_fd, pathname, mode, flags);
 }
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the AlignedBufferPool
+ * header file.
+ *
+ * Read AlignedBufferPool.hpp for more information about this class.
+ */
+
+#include "AlignedBufferPool.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+AlignedBufferPool::AlignedBufferPool() {
+  for (auto &cached : cached_) {
+    cached = 0;
+  }
+}
+
+AlignedBufferPool::~AlignedBufferPool() {
+  char *buffer = nullptr;
+  for (auto &free_list : free_lists_) {
+    while (free_list.try_pop(buffer)) {
+      free(buffer);
+    }
+  }
+}
+
+int AlignedBufferPool::size_class(size_t nbytes) {
+  size_t size = DIRECT_IO_ALIGNMENT;
+  for (int i = 0; i < ALIGNED_BUFFER_SIZE_CLASSES; i++) {
+    if (nbytes <= size) {
+      return i;
+    }
+    size <<= 1;
+  }
+  return -1;
+}
+
+size_t AlignedBufferPool::class_size(int size_class) {
+  return static_cast<size_t>(DIRECT_IO_ALIGNMENT) << size_class;
+}
+
+size_t AlignedBufferPool::align(size_t nbytes) {
+  return (nbytes + DIRECT_IO_ALIGNMENT - 1) & ~(size_t)(DIRECT_IO_ALIGNMENT - 1);
+}
+
+bool AlignedBufferPool::is_aligned(const void *buffer) {
+  return (reinterpret_cast<uintptr_t>(buffer) & (DIRECT_IO_ALIGNMENT - 1)) == 0;
+}
+
+char *AlignedBufferPool::get(size_t nbytes) {
+  int idx = size_class(nbytes);
+  char *buffer = nullptr;
+  if (idx >= 0 && free_lists_[idx].try_pop(buffer)) {
+    cached_[idx]--;
+    return buffer;
+  }
+
+  // Nothing cached for this size, so allocate a fresh buffer.
+  size_t size = idx >= 0 ? class_size(idx) : align(nbytes);
+  void *memory = nullptr;
+  if (posix_memalign(&memory, DIRECT_IO_ALIGNMENT, size) != 0) {
+    return nullptr;
+  }
+  return static_cast<char *>(memory);
+}
+
+void AlignedBufferPool::put(char *buffer, size_t nbytes) {
+  if (buffer == nullptr) {
+    return;
+  }
+  int idx = size_class(nbytes);
+  // Keep the buffer for reuse unless the size class is already full.
+  if (idx >= 0 && cached_[idx] < ALIGNED_BUFFER_CACHE_LIMIT) {
+    cached_[idx]++;
+    free_lists_[idx].push(buffer);
+    return;
+  }
+  free(buffer);
+}
+
+bool AlignedBufferPool::is_aligned_io(const void *buffer, size_t nbytes,
+                                      off_t offset) {
+  return is_aligned(buffer) && (nbytes & (DIRECT_IO_ALIGNMENT - 1)) == 0 &&
+         (offset & (DIRECT_IO_ALIGNMENT - 1)) == 0;
+}
+
+ssize_t AlignedBufferPool::direct_pread(int fd, char *buffer, size_t nbytes,
+                                        off_t offset) {
+  if (is_aligned_io(buffer, nbytes, offset)) {
+    return pread(fd, buffer, nbytes, offset);
+  }
+
+  off_t start = offset & ~(off_t)(DIRECT_IO_ALIGNMENT - 1);
+  size_t head = offset - start;
+  size_t length = align(head + nbytes);
+  char *bounce = get(length);
+  if (bounce == nullptr) {
+    errno = ENOMEM;
+    return -1;
+  }
+  ssize_t ret = pread(fd, bounce, length, start);
+  if (ret >= 0) {
+    // Only hand back the bytes the caller asked for.
+    size_t copied = 0;
+    if (static_cast<size_t>(ret) > head) {
+      copied = std::min(static_cast<size_t>(ret) - head, nbytes);
+    }
+    memcpy(buffer, bounce + head, copied);
+    ret = copied;
+  }
+  put(bounce, length);
+  return ret;
+}
+
+ssize_t AlignedBufferPool::direct_pwrite(int fd, const char *buffer,
+                                         size_t nbytes, off_t offset) {
+  if (is_aligned_io(buffer, nbytes, offset)) {
+    return pwrite(fd, buffer, nbytes, offset);
+  }
+
+  /*
+   * Writing back a whole aligned range would race with other writers of
+   * the bytes around the request and with writers extending the file.
+   */
+  int status_flags = fcntl(fd, F_GETFL);
+  if (status_flags < 0) {
+    return -1;
+  }
+  return buffered_write(fd, status_flags, buffer, nbytes, offset);
+}
+
+ssize_t AlignedBufferPool::direct_read(int fd, char *buffer, size_t nbytes) {
+  off_t position = lseek(fd, 0, SEEK_CUR);
+  if (position < 0) {
+    return read(fd, buffer, nbytes);
+  }
+  ssize_t ret = direct_pread(fd, buffer, nbytes, position);
+  if (ret > 0) {
+    lseek(fd, position + ret, SEEK_SET);
+  }
+  return ret;
+}
+
+ssize_t AlignedBufferPool::direct_write(int fd, const char *buffer,
+                                        size_t nbytes) {
+  int status_flags = fcntl(fd, F_GETFL);
+  if (status_flags < 0) {
+    return -1;
+  }
+  off_t position = lseek(fd, 0, SEEK_CUR);
+  if ((status_flags & O_APPEND) != 0 || position < 0) {
+    /*
+     * The kernel picks the offset of an appending write, and files
+     * without a position, such as pipes, take unaligned writes.
+     */
+    if (position < 0 ||
+        (is_aligned(buffer) && (nbytes & (DIRECT_IO_ALIGNMENT - 1)) == 0)) {
+      ssize_t ret = write(fd, buffer, nbytes);
+      if (ret >= 0 || errno != EINVAL) {
+        return ret;
+      }
+    }
+    return buffered_write(fd, status_flags, buffer, nbytes, -1);
+  }
+  ssize_t ret = direct_pwrite(fd, buffer, nbytes, position);
+  if (ret > 0) {
+    lseek(fd, position + ret, SEEK_SET);
+  }
+  return ret;
+}
+
+ssize_t AlignedBufferPool::buffered_write(int fd, int status_flags,
+                                          const char *buffer, size_t nbytes,
+                                          off_t offset) {
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+  // Keep what the flags of fd mean for a write, except O_DIRECT
+  int flags = (status_flags & (O_ACCMODE | O_APPEND | O_SYNC)) | O_CLOEXEC |
+              O_NOCTTY;
+  int private_fd = open(path, flags);
+  if (private_fd < 0) {
+    return -1;
+  }
+  ssize_t ret;
+  if (offset < 0) {
+    ret = write(private_fd, buffer, nbytes);
+    off_t end = ret >= 0 ? lseek(private_fd, 0, SEEK_CUR) : -1;
+    if (end >= 0) {
+      lseek(fd, end, SEEK_SET);
+    }
+  } else {
+    ret = pwrite(private_fd, buffer, nbytes, offset);
+  }
+  int saved_errno = errno;
+  close(private_fd);
+  errno = saved_errno;
+  return ret;
+}
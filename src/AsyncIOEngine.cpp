@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the AsyncIOEngine
+ * header file.
+ *
+ * Read AsyncIOEngine.hpp for more information about this class.
+ */
+
+#include "AsyncIOEngine.hpp"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <utility>
+#include "SystemCallTraceReplayModule.hpp"
+
+AsyncIOEngine::AsyncIOEngine(SystemCallTraceReplayLogger *logger,
+                             unsigned int batch_size)
+    : batch_size_(batch_size == 0 ? 1 : batch_size), logger_(logger) {
+  if (batch_size_ > AIO_QUEUE_DEPTH) {
+    batch_size_ = AIO_QUEUE_DEPTH;
+  }
+}
+
+AsyncIOEngine::~AsyncIOEngine() {
+  for (auto &iter : contexts_) {
+    AsyncIOContext *context = iter.second;
+    if (context == nullptr) {
+      continue;
+    }
+    wait_all(context);
+    io_destroy(context->ctx);
+    delete context;
+  }
+}
+
+AsyncIOContext *AsyncIOEngine::get_context(pid_t pid) {
+  AsyncIOContextMap::accessor acc;
+  if (contexts_.insert(acc, pid)) {
+    auto context = new AsyncIOContext();
+    context->ctx = 0;
+    context->in_flight = 0;
+    int ret = io_setup(AIO_QUEUE_DEPTH, &context->ctx);
+    if (ret < 0) {
+      logger_->log_err("io_setup failed for pid ", pid, ": ", strerror(-ret),
+                       ". Replaying its I/O synchronously.");
+      delete context;
+      context = nullptr;
+    } else {
+      context->pending.reserve(batch_size_);
+    }
+    acc->second = context;
+  }
+  return acc->second;
+}
+
+bool AsyncIOEngine::submit(pid_t pid, SystemCallTraceReplayModule *module,
+                           bool is_write, int fd, char *buffer, size_t nbytes,
+                           off_t offset) {
+  AsyncIOContext *context = get_context(pid);
+  if (context == nullptr) {
+    return false;
+  }
+
+  bool use_file_position = offset < 0;
+  if (use_file_position) {
+    if (position_unsettled(context, is_write, fd)) {
+      wait_all(context);
+    }
+    offset = lseek(fd, 0, SEEK_CUR);
+    if (offset < 0) {
+      return false;
+    }
+  }
+  if (!AlignedBufferPool::is_aligned_io(buffer, nbytes, offset)) {
+    // Unaligned requests go through a bounce buffer synchronously.
+    return false;
+  }
+  if (overlaps(context, is_write, fd, offset, nbytes)) {
+    // Let the earlier request land so that the two complete in order.
+    wait_all(context);
+  }
+  if (use_file_position && lseek(fd, offset + nbytes, SEEK_SET) < 0) {
+    return false;
+  }
+
+  // Make room if the process already has a full queue of requests.
+  if (context->in_flight + context->pending.size() >= AIO_QUEUE_DEPTH) {
+    flush(context);
+    reap(context, 1);
+  }
+
+  auto request = new AsyncIORequest;
+  if (is_write) {
+    io_prep_pwrite(&request->iocb, fd, buffer, nbytes, offset);
+  } else {
+    io_prep_pread(&request->iocb, fd, buffer, nbytes, offset);
+  }
+  request->iocb.data = request;
+  request->module = module;
+  request->file_position = use_file_position;
+  context->pending.push_back(&request->iocb);
+  context->outstanding.push_back(request);
+
+  if (context->pending.size() >= batch_size_) {
+    flush(context);
+  }
+  return true;
+}
+
+bool AsyncIOEngine::position_unsettled(AsyncIOContext *context, bool is_write,
+                                       int fd) {
+  if (context->file_ends.count(fd) != 0) {
+    return true;
+  }
+  if (!is_write) {
+    return false;
+  }
+  for (AsyncIORequest *request : context->outstanding) {
+    if (request->iocb.aio_fildes == fd && request->file_position &&
+        request->iocb.aio_lio_opcode == IO_CMD_PREAD) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AsyncIOEngine::overlaps(AsyncIOContext *context, bool is_write, int fd,
+                             off_t offset, size_t nbytes) {
+  for (AsyncIORequest *request : context->outstanding) {
+    const struct iocb &iocb = request->iocb;
+    if (iocb.aio_fildes != fd ||
+        (!is_write && iocb.aio_lio_opcode != IO_CMD_PWRITE)) {
+      continue;
+    }
+    off_t start = iocb.u.c.offset;
+    if (offset < static_cast<off_t>(start + iocb.u.c.nbytes) &&
+        start < static_cast<off_t>(offset + nbytes)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AsyncIOEngine::submit_read(pid_t pid, SystemCallTraceReplayModule *module,
+                                int fd, char *buffer, size_t nbytes,
+                                off_t offset) {
+  return submit(pid, module, false, fd, buffer, nbytes, offset);
+}
+
+bool AsyncIOEngine::submit_write(pid_t pid, SystemCallTraceReplayModule *module,
+                                 int fd, char *buffer, size_t nbytes,
+                                 off_t offset) {
+  return submit(pid, module, true, fd, buffer, nbytes, offset);
+}
+
+void AsyncIOEngine::flush(AsyncIOContext *context) {
+  size_t submitted = 0;
+  while (submitted < context->pending.size()) {
+    long nr = context->pending.size() - submitted;
+    int ret = io_submit(context->ctx, nr, &context->pending[submitted]);
+    if (ret > 0) {
+      submitted += ret;
+      context->in_flight += ret;
+    } else if (ret == -EAGAIN && context->in_flight > 0) {
+      // The kernel is out of resources, so wait for a completion first.
+      reap(context, 1);
+    } else {
+      /*
+       * The kernel rejected the first remaining request. It is completed
+       * with the error by the next reap, so that the mismatch shows up
+       * like any failed system call, and we carry on with the rest.
+       */
+      if (ret == 0) {
+        ret = -EAGAIN;
+      }
+      auto request =
+          static_cast<AsyncIORequest *>(context->pending[submitted]->data);
+      context->rejected.emplace_back(request, ret);
+      submitted++;
+    }
+  }
+  context->pending.clear();
+}
+
+void AsyncIOEngine::wait_all(AsyncIOContext *context) {
+  flush(context);
+  while (reap(context, context->in_flight) && context->in_flight > 0) {
+  }
+}
+
+bool AsyncIOEngine::reap(AsyncIOContext *context, long min_events) {
+  struct io_event events[AIO_QUEUE_DEPTH];
+  if (!context->rejected.empty()) {
+    std::vector<std::pair<AsyncIORequest *, int64_t>> rejected;
+    rejected.swap(context->rejected);
+    for (auto &entry : rejected) {
+      complete(context, entry.first, entry.second);
+    }
+  }
+  if (min_events > static_cast<long>(context->in_flight)) {
+    min_events = context->in_flight;
+  }
+  if (context->in_flight == 0) {
+    return true;
+  }
+  // Poll without blocking when the caller does not need any completion.
+  struct timespec no_wait = {0, 0};
+  int ret;
+  do {
+    ret = io_getevents(context->ctx, min_events, AIO_QUEUE_DEPTH, events,
+                       min_events == 0 ? &no_wait : nullptr);
+  } while (ret == -EINTR);
+  if (ret < 0) {
+    logger_->log_err("io_getevents failed: ", strerror(-ret));
+    return false;
+  }
+  for (int i = 0; i < ret; i++) {
+    context->in_flight--;
+    /*
+     * res is an unsigned long holding either the number of bytes
+     * transferred or a negated errno value.
+     */
+    complete(context, static_cast<AsyncIORequest *>(events[i].data),
+             static_cast<int64_t>(events[i].res));
+  }
+  return true;
+}
+
+void AsyncIOEngine::complete(AsyncIOContext *context,
+                             AsyncIORequest *request, int64_t result) {
+  std::vector<AsyncIORequest *> &outstanding = context->outstanding;
+  for (size_t i = 0; i < outstanding.size(); i++) {
+    if (outstanding[i] == request) {
+      outstanding[i] = outstanding.back();
+      outstanding.pop_back();
+      break;
+    }
+  }
+
+  int fd = request->iocb.aio_fildes;
+  if (request->file_position &&
+      result < static_cast<int64_t>(request->iocb.u.c.nbytes)) {
+    /*
+     * The kernel would have stopped the file position where the
+     * transfer stopped, e.g. at EOF, and later reads and writes that
+     * use the file position would have started there.
+     */
+    off_t end = request->iocb.u.c.offset + (result > 0 ? result : 0);
+    auto iter = context->file_ends.find(fd);
+    if (iter == context->file_ends.end()) {
+      context->file_ends[fd] = end;
+    } else if (end < iter->second) {
+      iter->second = end;
+    }
+  }
+  auto iter = context->file_ends.find(fd);
+  if (iter != context->file_ends.end()) {
+    bool settled = true;
+    for (AsyncIORequest *other : outstanding) {
+      if (other->iocb.aio_fildes == fd && other->file_position) {
+        settled = false;
+        break;
+      }
+    }
+    if (settled) {
+      lseek(fd, iter->second, SEEK_SET);
+      context->file_ends.erase(iter);
+    }
+  }
+
+  SystemCallTraceReplayModule *module = request->module;
+  delete request;
+  module->complete_async_io(result);
+  context->completed.push_back(module);
+}
+
+void AsyncIOEngine::harvest(
+    pid_t pid, std::vector<SystemCallTraceReplayModule *> &completed) {
+  AsyncIOContextMap::const_accessor acc;
+  if (!contexts_.find(acc, pid) || acc->second == nullptr) {
+    return;
+  }
+  AsyncIOContext *context = acc->second;
+  acc.release();
+  reap(context, 0);
+  completed.insert(completed.end(), context->completed.begin(),
+                   context->completed.end());
+  context->completed.clear();
+}
+
+void AsyncIOEngine::drain(
+    pid_t pid, std::vector<SystemCallTraceReplayModule *> &completed) {
+  AsyncIOContextMap::const_accessor acc;
+  if (!contexts_.find(acc, pid) || acc->second == nullptr) {
+    return;
+  }
+  AsyncIOContext *context = acc->second;
+  acc.release();
+  wait_all(context);
+  completed.insert(completed.end(), context->completed.begin(),
+                   context->completed.end());
+  context->completed.clear();
+}
+
+bool AsyncIOEngine::has_outstanding(pid_t pid) {
+  AsyncIOContextMap::const_accessor acc;
+  if (!contexts_.find(acc, pid) || acc->second == nullptr) {
+    return false;
+  }
+  return acc->second->in_flight > 0 || !acc->second->pending.empty() ||
+         !acc->second->rejected.empty();
+}
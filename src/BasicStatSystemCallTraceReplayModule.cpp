@@ -138,8 +138,10 @@ void BasicStatSystemCallTraceReplayModule::prepareRow() {
   statUID = stat_result_uid_.val();
   statGID = stat_result_gid_.val();
   statRDev = stat_result_rdev_.val();
-  statBlkSize = stat_result_blksize_.val();
-  statBlocks = stat_result_blocks_.val();
+  statBlkSize = stat_result_blksize_.isNull() ? STAT_FIELD_NOT_CAPTURED
+                                              : stat_result_blksize_.val();
+  statBlocks = stat_result_blocks_.isNull() ? STAT_FIELD_NOT_CAPTURED
+                                            : stat_result_blocks_.val();
   statSize = stat_result_size_.val();
   statATime = stat_result_atime_.val();
   statMTime = stat_result_mtime_.val();
@@ -149,6 +151,7 @@ void BasicStatSystemCallTraceReplayModule::prepareRow() {
 
 void BasicStatSystemCallTraceReplayModule::verifyResult(
     struct stat replayed_stat_buf) {
+  ProfileScope scope(profiler_, PROFILE_VERIFY);
   /*
    * Verify stat buffer contents in the trace file are same
    * We are comparing only key fields captured in strace : st_ino,
@@ -164,11 +167,26 @@ void BasicStatSystemCallTraceReplayModule::verifyResult(
       statUID != replayed_stat_buf.st_uid ||
       statGID != replayed_stat_buf.st_gid ||
       statSize != replayed_stat_buf.st_size ||
-      statBlkSize != replayed_stat_buf.st_blksize ||
-      statBlocks != replayed_stat_buf.st_blocks) {
+      (statBlkSize != STAT_FIELD_NOT_CAPTURED &&
+       statBlkSize != replayed_stat_buf.st_blksize) ||
+      (statBlocks != STAT_FIELD_NOT_CAPTURED &&
+       statBlocks != replayed_stat_buf.st_blocks)) {
     // Stat buffers aren't same
     syscall_logger_->log_err("Verification of ", sys_call_name_,
                              " buffer content failed.");
+    // The payload is the compared fields, in the order checked above
+    int64_t traced_fields[] = {statMode, statNLink,   statUID,   statGID,
+                               statSize, statBlkSize, statBlocks};
+    int64_t replayed_fields[] = {
+        replayed_stat_buf.st_mode,
+        static_cast<int64_t>(replayed_stat_buf.st_nlink),
+        replayed_stat_buf.st_uid,
+        replayed_stat_buf.st_gid,
+        replayed_stat_buf.st_size,
+        replayed_stat_buf.st_blksize,
+        replayed_stat_buf.st_blocks};
+    record_mismatch(MISMATCH_DATA, 0, traced_fields, sizeof(traced_fields),
+                    replayed_fields, sizeof(replayed_fields));
     if (!default_mode()) {
       syscall_logger_->log_warn(
           "time called:",
@@ -201,7 +219,7 @@ void BasicStatSystemCallTraceReplayModule::verifyResult(
           "Replayed file blocks: ", replayed_stat_buf.st_blocks);
 
       if (abort_mode()) {
-        abort();
+        abort_replay();
       }
     }
   } else {
@@ -230,7 +248,7 @@ void StatSystemCallTraceReplayModule::processRow() {
   struct stat stat_buf;
 
   // replay the stat system call
-  replayed_ret_val_ = stat(pathname, &stat_buf);
+  replayed_ret_val_ = engine_->stat(pathname, &stat_buf);
 
   if (verify_) {
     BasicStatSystemCallTraceReplayModule::verifyResult(stat_buf);
@@ -262,7 +280,7 @@ void LStatSystemCallTraceReplayModule::print_specific_fields() {
 void LStatSystemCallTraceReplayModule::processRow() {
   struct stat stat_buf;
   // replay the lstat system call
-  replayed_ret_val_ = lstat(pathname, &stat_buf);
+  replayed_ret_val_ = engine_->lstat(pathname, &stat_buf);
 
   if (verify_) {
     BasicStatSystemCallTraceReplayModule::verifyResult(stat_buf);
@@ -305,7 +323,7 @@ void FStatSystemCallTraceReplayModule::processRow() {
   }
 
   // replay the fstat system call
-  replayed_ret_val_ = fstat(fd, &stat_buf);
+  replayed_ret_val_ = engine_->fstat(fd, &stat_buf);
 
   if (verify_) {
     BasicStatSystemCallTraceReplayModule::verifyResult(stat_buf);
@@ -353,7 +371,8 @@ void FStatatSystemCallTraceReplayModule::processRow() {
     return;
   }
   // replay the fstat system call
-  replayed_ret_val_ = fstatat(replayed_fd, pathname, &stat_buf, flag_value);
+  replayed_ret_val_ =
+      engine_->fstatat(replayed_fd, pathname, &stat_buf, flag_value);
 
   if (verify_) {
     BasicStatSystemCallTraceReplayModule::verifyResult(stat_buf);
@@ -69,6 +69,7 @@ void BasicStatfsSystemCallTraceReplayModule::print_specific_fields() {
 
 void BasicStatfsSystemCallTraceReplayModule::verifyResult(
     struct statfs replayed_statfs_buf) {
+  ProfileScope scope(profiler_, PROFILE_VERIFY);
   // Verify statfs buffer contents in the trace file are same
   if (statfsType != replayed_statfs_buf.f_type ||
       statfsBsize != replayed_statfs_buf.f_bsize ||
@@ -120,7 +121,7 @@ void BasicStatfsSystemCallTraceReplayModule::verifyResult(
           "Captured mount flags: ", statfsFlags,
           ", Replayed mount flags: ", replayed_statfs_buf.f_flags);
       if (abort_mode()) {
-        abort();
+        abort_replay();
       }
     }
   } else {
@@ -178,7 +179,7 @@ void StatfsSystemCallTraceReplayModule::print_specific_fields() {
 void StatfsSystemCallTraceReplayModule::processRow() {
   struct statfs statfs_buf;
   // replay the statfs system call
-  replayed_ret_val_ = statfs(pathname, &statfs_buf);
+  replayed_ret_val_ = engine_->statfs(pathname, &statfs_buf);
 
   if (verify_) {
     BasicStatfsSystemCallTraceReplayModule::verifyResult(statfs_buf);
@@ -224,7 +225,7 @@ void FStatfsSystemCallTraceReplayModule::processRow() {
     return;
   }
   // replay the fstatfs system call
-  replayed_ret_val_ = fstatfs(fd, &statfs_buf);
+  replayed_ret_val_ = engine_->fstatfs(fd, &statfs_buf);
 
   if (verify_) {
     BasicStatfsSystemCallTraceReplayModule::verifyResult(statfs_buf);
@@ -47,7 +47,7 @@ void ChdirSystemCallTraceReplayModule::print_specific_fields() {
 }
 
 void ChdirSystemCallTraceReplayModule::processRow() {
-  replayed_ret_val_ = chdir(pathname);
+  replayed_ret_val_ = engine_->chdir(pathname);
   if (!verbose_mode()) {
     delete[] pathname;
   }
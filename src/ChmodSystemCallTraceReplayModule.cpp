@@ -50,7 +50,7 @@ void ChmodSystemCallTraceReplayModule::print_specific_fields() {
 
 void ChmodSystemCallTraceReplayModule::processRow() {
   // Replay the chmod system call
-  replayed_ret_val_ = chmod(pathname, get_mode(modeVal));
+  replayed_ret_val_ = engine_->chmod(pathname, get_mode(modeVal));
   delete[] pathname;
 }
 
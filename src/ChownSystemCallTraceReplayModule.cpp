@@ -50,7 +50,7 @@ void ChownSystemCallTraceReplayModule::print_specific_fields() {
 
 void ChownSystemCallTraceReplayModule::processRow() {
   // Replay the chown system call
-  replayed_ret_val_ = chown(pathname, newOwner, newGroup);
+  replayed_ret_val_ = engine_->chown(pathname, newOwner, newGroup);
   delete[] pathname;
 }
 
@@ -36,6 +36,7 @@
 #include <thread>
 #include "tbb/atomic.h"
 #include "tbb/concurrent_vector.h"
+#include "VirtualAddressSpace.hpp"
 
 extern tbb::concurrent_vector<std::thread> threads;
 extern void executionThread(int64_t threadID);
@@ -69,17 +70,21 @@ void CloneSystemCallTraceReplayModule::processRow() {
    * from that of the parent process. If that flag is set, then the cloned
    * process id will be mapped to the parent process id, and the two processes
    * will share a file descriptor table, as they would in the kernel.
+   * Likewise, CLONE_VM makes the two processes share their mapped regions.
    * NOTE: It is inappropriate to replay clone system call.
    * Hence we do not replay clone system call.
    */
   int flags = flagVal;
-  bool shared_umask = false, shared_files = false;
+  bool shared_umask = false, shared_files = false, shared_vm = false;
   if ((flags & CLONE_FS) != 0 || (flags & CLONE_THREAD) != 0) {
     shared_umask = true;
   }
   if ((flags & CLONE_FILES) != 0 || (flags & CLONE_THREAD) != 0) {
     shared_files = true;
   }
+  if ((flags & CLONE_VM) != 0 || (flags & CLONE_THREAD) != 0) {
+    shared_vm = true;
+  }
 
   pid_t ppid = executing_pid();
   pid_t pid = return_value();
@@ -89,6 +94,7 @@ void CloneSystemCallTraceReplayModule::processRow() {
       ppid, pid, shared_umask);
   SystemCallTraceReplayModule::replayer_resources_manager_.clone_fd_table(
       ppid, pid, shared_files);
+  VM_manager::getInstance()->clone_VM_area(ppid, pid, shared_vm);
 
   nThreads++;
   setRunning(pid, nullptr);
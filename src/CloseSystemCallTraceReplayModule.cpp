@@ -50,7 +50,9 @@ void CloseSystemCallTraceReplayModule::print_specific_fields() {
 
 void CloseSystemCallTraceReplayModule::processRow() {
   // Get actual file descriptor
-  int fd = replayer_resources_manager_.remove_fd(executingPidVal, descVal);
+  bool last_use = true;
+  int fd = replayer_resources_manager_.remove_fd(executingPidVal, descVal,
+                                                 &last_use);
 
   if (fd == SYSCALL_SIMULATED) {
     /*
@@ -61,7 +63,16 @@ void CloseSystemCallTraceReplayModule::processRow() {
     return;
   }
 
-  replayed_ret_val_ = close(fd);
+  if (!last_use) {
+    /*
+     * The table of another process still uses the replayed fd, so it
+     * stays open. The close succeeds, as it does in the traced process.
+     */
+    replayed_ret_val_ = 0;
+    return;
+  }
+
+  replayed_ret_val_ = engine_->close(fd);
 }
 
 void CloseSystemCallTraceReplayModule::prepareRow() {
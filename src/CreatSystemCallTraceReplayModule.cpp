@@ -54,7 +54,7 @@ void CreatSystemCallTraceReplayModule::processRow() {
   int return_value = (int)return_value_.val();
 
   // replay the creat system call
-  replayed_ret_val_ = creat(pathname, mode);
+  replayed_ret_val_ = engine_->creat(pathname, mode);
   // Add a mapping from fd in trace file to actual replayed fd
   pid_t pid = executing_pid();
   // A call to creat() is equivalent to calling open() with flags equal to
@@ -58,7 +58,6 @@ void Dup2SystemCallTraceReplayModule::print_specific_fields() {
 void Dup2SystemCallTraceReplayModule::processRow() {
   // Get actual file descriptor
   pid_t pid = executing_pid();
-  int old_fd = replayer_resources_manager_.get_fd(pid, old_file_descriptor);
   int old_fd_flags =
       replayer_resources_manager_.get_flags(pid, old_file_descriptor);
   int new_fd = new_file_descriptor;
@@ -105,10 +104,26 @@ void Dup2SystemCallTraceReplayModule::processRow() {
    */
 
   // In all 4 actions above, if new_fd exists in fd_map, we remove it.
+  int removed_fd = SYSCALL_SIMULATED;
   if (replayer_resources_manager_.has_fd(pid, new_fd)) {
-    replayed_new_fd = replayer_resources_manager_.get_fd(pid, new_fd);
-    replayer_resources_manager_.remove_fd(pid, new_fd);
+    bool last_use = true;
+    removed_fd = replayer_resources_manager_.remove_fd(pid, new_fd, &last_use);
+    /*
+     * The table of another process may still use the replayed fd, which
+     * dup2 must not close then, so it gets a fresh fd instead.
+     */
+    if (last_use) {
+      replayed_new_fd = removed_fd;
+    }
   }
+  /*
+   * Look old_fd up once remove_fd has made the table private. If old_fd
+   * is new_fd, it is the fd just removed.
+   */
+  int old_fd =
+      old_file_descriptor == new_fd
+          ? removed_fd
+          : replayer_resources_manager_.get_fd(pid, old_file_descriptor);
 
   // The two file descriptors do not share file descriptor flags (the
   // close-on-exec flag).
@@ -129,12 +144,15 @@ void Dup2SystemCallTraceReplayModule::processRow() {
   }
 
   if (replayed_new_fd == SYSCALL_SIMULATED) {
-    // Action: 2, 4
-    replayed_new_fd = replayer_resources_manager_.generate_unused_fd(pid);
+    /*
+     * Action: 2, 4. Let the engine pick the fd: a fd chosen here could
+     * be opened by another thread before dup2 closes and reuses it.
+     */
+    replayed_ret_val_ = engine_->fcntl(old_fd, F_DUPFD, 0L);
+  } else {
+    replayed_ret_val_ = engine_->dup2(old_fd, replayed_new_fd);
   }
 
-  replayed_ret_val_ = dup2(old_fd, replayed_new_fd);
-
   // Map replayed duplicated file descriptor to traced duplicated file
   // descriptor
   replayer_resources_manager_.add_fd(pid, return_value(), replayed_ret_val_,
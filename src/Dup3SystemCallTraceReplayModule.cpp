@@ -59,7 +59,6 @@ void Dup3SystemCallTraceReplayModule::print_specific_fields() {
 void Dup3SystemCallTraceReplayModule::processRow() {
   // Get actual file descriptor
   pid_t pid = executing_pid();
-  int old_fd = replayer_resources_manager_.get_fd(pid, old_file_descriptor);
   int old_fd_flags =
       replayer_resources_manager_.get_flags(pid, old_file_descriptor);
   int new_fd = new_file_descriptor;
@@ -106,10 +105,26 @@ void Dup3SystemCallTraceReplayModule::processRow() {
    */
 
   // In all 4 actions above, if new_fd exists in fd_map, we remove it.
+  int removed_fd = SYSCALL_SIMULATED;
   if (replayer_resources_manager_.has_fd(pid, new_fd)) {
-    replayed_new_fd = replayer_resources_manager_.get_fd(pid, new_fd);
-    replayer_resources_manager_.remove_fd(pid, new_fd);
+    bool last_use = true;
+    removed_fd = replayer_resources_manager_.remove_fd(pid, new_fd, &last_use);
+    /*
+     * The table of another process may still use the replayed fd, which
+     * dup3 must not close then, so it gets a fresh fd instead.
+     */
+    if (last_use) {
+      replayed_new_fd = removed_fd;
+    }
   }
+  /*
+   * Look old_fd up once remove_fd has made the table private. If old_fd
+   * is new_fd, it is the fd just removed.
+   */
+  int old_fd =
+      old_file_descriptor == new_fd
+          ? removed_fd
+          : replayer_resources_manager_.get_fd(pid, old_file_descriptor);
 
   // The two file descriptors do not share file descriptor flags (the
   // close-on-exec flag) in dup2 O_CLOEXEC disables this is the only difference
@@ -129,13 +144,20 @@ void Dup3SystemCallTraceReplayModule::processRow() {
     return;
   }
 
-  if (replayed_new_fd == SYSCALL_SIMULATED) {
-    // Action: 2, 4
-    replayed_new_fd = replayer_resources_manager_.generate_unused_fd(pid);
+  if (replayed_new_fd != SYSCALL_SIMULATED) {
+    replayed_ret_val_ = engine_->dup3(old_fd, replayed_new_fd, flags);
+  } else if ((flags & ~O_CLOEXEC) != 0) {
+    // dup3 rejects the flags with EINVAL before it looks at the fds.
+    replayed_ret_val_ = engine_->dup3(old_fd, old_fd, flags);
+  } else {
+    /*
+     * Action: 2, 4. Let the engine pick the fd: a fd chosen here could
+     * be opened by another thread before dup3 closes and reuses it.
+     */
+    int cmd = (flags & O_CLOEXEC) != 0 ? F_DUPFD_CLOEXEC : F_DUPFD;
+    replayed_ret_val_ = engine_->fcntl(old_fd, cmd, 0L);
   }
 
-  replayed_ret_val_ = dup3(old_fd, replayed_new_fd, flags);
-
   // Map replayed duplicated file descriptor to traced duplicated file
   // descriptor
   replayer_resources_manager_.add_fd(pid, return_value(), replayed_ret_val_,
@@ -68,7 +68,7 @@ void DupSystemCallTraceReplayModule::processRow() {
     replayed_ret_val_ = return_value();
   } else {
     // replay the dup system call
-    replayed_ret_val_ = dup(fd);
+    replayed_ret_val_ = engine_->dup(fd);
   }
   replayer_resources_manager_.add_fd(pid, return_value(), replayed_ret_val_,
                                      new_fd_flags);
@@ -35,6 +35,7 @@
 #include "ExecveSystemCallTraceReplayModule.hpp"
 #include <sys/socket.h>
 #include <sys/types.h>
+#include "VirtualAddressSpace.hpp"
 
 ExecveSystemCallTraceReplayModule::ExecveSystemCallTraceReplayModule(
     DataSeriesModule &source, bool verbose_flag, int warn_level_flag)
@@ -66,9 +67,9 @@ void ExecveSystemCallTraceReplayModule::processRow() {
    * Hence we do not replay execve system call. However, we still need
    * to update fd manager.
    */
-  // Get all traced fds in this process
-  std::unordered_set<int> traced_fds =
-      replayer_resources_manager_.get_all_traced_fds(executingPidVal);
+  // Get the traced fds with O_CLOEXEC in this process
+  std::vector<int> traced_fds =
+      replayer_resources_manager_.get_cloexec_traced_fds(executingPidVal);
   for (int traced_fd : traced_fds) {
     int flags =
         replayer_resources_manager_.get_flags(executingPidVal, traced_fd);
@@ -84,7 +85,17 @@ void ExecveSystemCallTraceReplayModule::processRow() {
      * remain open across an execve(2).
      */
     if (((flags & O_CLOEXEC) != 0) && retVal >= 0) {
-      replayer_resources_manager_.remove_fd(executingPidVal, traced_fd);
+      bool last_use = true;
+      replayed_fd = replayer_resources_manager_.remove_fd(
+          executingPidVal, traced_fd, &last_use);
+      /*
+       * The kernel closes the fd during execve, so the replayer does too,
+       * unless the table of another process still uses it.
+       */
+      if (replayed_fd >= 0 && last_use) {
+        engine_->close(replayed_fd);
+      }
+      continue;
     }
 
     if (replayed_fd == SYSCALL_SIMULATED) {
@@ -94,6 +105,11 @@ void ExecveSystemCallTraceReplayModule::processRow() {
     }
   }
 
+  // A successful execve replaces the address space of the process
+  if (retVal >= 0) {
+    VM_manager::getInstance()->reset_VM_area(executingPidVal);
+  }
+
   return;
 }
 
@@ -34,6 +34,7 @@
 
 #include "ExitSystemCallTraceReplayModule.hpp"
 #include <climits>
+#include "VirtualAddressSpace.hpp"
 
 ExitSystemCallTraceReplayModule::ExitSystemCallTraceReplayModule(
     DataSeriesModule &source, bool verbose_flag, int warn_level_flag)
@@ -60,8 +61,10 @@ void ExitSystemCallTraceReplayModule::processRow() {
   auto fds_to_close =
       replayer_resources_manager_.remove_fd_table(executingPidVal);
   for (auto fd : fds_to_close) {
-    close(fd);
+    engine_->close(fd);
   }
+  // Remove mapped regions
+  VM_manager::getInstance()->remove_VM_area(executingPidVal);
 }
 
 void ExitSystemCallTraceReplayModule::prepareRow() {
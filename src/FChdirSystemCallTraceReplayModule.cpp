@@ -56,7 +56,7 @@ void FChdirSystemCallTraceReplayModule::processRow() {
   if (fd == SYSCALL_SIMULATED) {
     replayed_ret_val_ = return_value();
   } else {
-    replayed_ret_val_ = fchdir(fd);
+    replayed_ret_val_ = engine_->fchdir(fd);
   }
 }
 
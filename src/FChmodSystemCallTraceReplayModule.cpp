@@ -66,7 +66,7 @@ void FChmodSystemCallTraceReplayModule::processRow() {
     return;
   }
   // Replay the fchmod system call
-  replayed_ret_val_ = fchmod(fd, mode);
+  replayed_ret_val_ = engine_->fchmod(fd, mode);
 }
 
 void FChmodSystemCallTraceReplayModule::prepareRow() {
@@ -112,5 +112,5 @@ void FChmodatSystemCallTraceReplayModule::processRow() {
     return;
   }
   // Replay the fchmodat system call
-  replayed_ret_val_ = fchmodat(fd, pathname, mode, flags);
+  replayed_ret_val_ = engine_->fchmodat(fd, pathname, mode, flags);
 }
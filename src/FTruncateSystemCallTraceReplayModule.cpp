@@ -56,7 +56,7 @@ int FTruncateSystemCallTraceReplayModule::getReplayedFD() {
 void FTruncateSystemCallTraceReplayModule::processRow() {
   int fd = getReplayedFD();
   // Replay ftruncate system call
-  replayed_ret_val_ = ftruncate(fd, length);
+  replayed_ret_val_ = engine_->ftruncate(fd, length);
 }
 
 void FTruncateSystemCallTraceReplayModule::prepareRow() {
@@ -67,7 +67,7 @@ void FallocateSystemCallTraceReplayModule::processRow() {
     return;
   }
 
-  replayed_ret_val_ = fallocate(fd, mode_val, offset, length);
+  replayed_ret_val_ = engine_->fallocate(fd, mode_val, offset, length);
 }
 
 void FallocateSystemCallTraceReplayModule::prepareRow() {
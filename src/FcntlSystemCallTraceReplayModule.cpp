@@ -101,17 +101,18 @@ void FcntlSystemCallTraceReplayModule::processRow() {
      */
     if ((lock.l_type == 0) && (lock.l_whence == 0) && (lock.l_start == 0) &&
         (lock.l_len == 0) && (lock.l_pid == 0)) {
-      replayed_ret_val_ = fcntl(fd, command, NULL);
+      replayed_ret_val_ = engine_->fcntl(fd, command,
+                                         static_cast<struct flock *>(NULL));
     } else {
       /*
        * If not, replay it with the corresponding flock structure as
        * the third argument
        */
-      replayed_ret_val_ = fcntl(fd, command, &lock);
+      replayed_ret_val_ = engine_->fcntl(fd, command, &lock);
     }
   } else {
     // Otherwise, pass fcntl the argument value as the third argument.
-    replayed_ret_val_ = fcntl(fd, command, argument);
+    replayed_ret_val_ = engine_->fcntl(fd, command, argument);
   }
 
   /*
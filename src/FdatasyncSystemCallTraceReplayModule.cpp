@@ -63,7 +63,7 @@ void FdatasyncSystemCallTraceReplayModule::processRow() {
     return;
   }
 
-  replayed_ret_val_ = fdatasync(fd);
+  replayed_ret_val_ = engine_->fdatasync(fd);
 }
 
 void FdatasyncSystemCallTraceReplayModule::prepareRow() {
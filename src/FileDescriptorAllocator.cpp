@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the FileDescriptorAllocator
+ * header file
+ *
+ * Read FileDescriptorAllocator.hpp for more information about this class.
+ */
+
+#include "FileDescriptorAllocator.hpp"
+
+#define BITS_PER_WORD 64
+#define FULL_WORD (~static_cast<uint64_t>(0))
+// Number of fds tracked before the first fd is acquired
+#define INITIAL_FD_CAPACITY 1024
+
+FileDescriptorAllocator::FileDescriptorAllocator() {
+  grow(INITIAL_FD_CAPACITY - 1);
+}
+
+void FileDescriptorAllocator::grow(int fd) {
+  if (static_cast<size_t>(fd) < refs_.size()) {
+    return;
+  }
+  size_t capacity = refs_.size() * 2;
+  if (capacity <= static_cast<size_t>(fd)) {
+    capacity = fd + 1;
+  }
+  refs_.resize(capacity, 0);
+
+  // Size level 0 for the new capacity and rebuild the levels above it.
+  levels_.resize(1);
+  levels_[0].resize((capacity + BITS_PER_WORD - 1) / BITS_PER_WORD, 0);
+  while (levels_.back().size() > 1) {
+    const std::vector<uint64_t> &below = levels_.back();
+    std::vector<uint64_t> above((below.size() + BITS_PER_WORD - 1) /
+                                    BITS_PER_WORD,
+                                0);
+    for (size_t word = 0; word < below.size(); word++) {
+      if (below[word] == FULL_WORD) {
+        above[word / BITS_PER_WORD] |= 1ull << (word % BITS_PER_WORD);
+      }
+    }
+    levels_.push_back(above);
+  }
+}
+
+void FileDescriptorAllocator::set_bit(int fd) {
+  size_t index = fd;
+  for (auto &level : levels_) {
+    uint64_t &word = level[index / BITS_PER_WORD];
+    word |= 1ull << (index % BITS_PER_WORD);
+    if (word != FULL_WORD) {
+      return;
+    }
+    // The word filled up, so mark it as full one level up.
+    index /= BITS_PER_WORD;
+  }
+}
+
+void FileDescriptorAllocator::clear_bit(int fd) {
+  size_t index = fd;
+  for (auto &level : levels_) {
+    uint64_t &word = level[index / BITS_PER_WORD];
+    bool was_full = word == FULL_WORD;
+    word &= ~(1ull << (index % BITS_PER_WORD));
+    if (!was_full) {
+      return;
+    }
+    // The word is no longer full, so clear its bit one level up.
+    index /= BITS_PER_WORD;
+  }
+}
+
+void FileDescriptorAllocator::acquire(int fd) {
+  if (fd < 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(lock_);
+  grow(fd);
+  if (refs_[fd]++ == 0) {
+    set_bit(fd);
+  }
+}
+
+void FileDescriptorAllocator::acquire(const std::vector<int> &fds) {
+  std::lock_guard<std::mutex> guard(lock_);
+  for (int fd : fds) {
+    if (fd < 0) {
+      continue;
+    }
+    grow(fd);
+    if (refs_[fd]++ == 0) {
+      set_bit(fd);
+    }
+  }
+}
+
+bool FileDescriptorAllocator::release(int fd) {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (fd < 0 || static_cast<size_t>(fd) >= refs_.size() || refs_[fd] == 0) {
+    return false;
+  }
+  if (--refs_[fd] == 0) {
+    clear_bit(fd);
+    return true;
+  }
+  return false;
+}
+
+std::vector<int> FileDescriptorAllocator::release(const std::vector<int> &fds) {
+  std::lock_guard<std::mutex> guard(lock_);
+  std::vector<int> unused;
+  for (int fd : fds) {
+    if (fd < 0 || static_cast<size_t>(fd) >= refs_.size() || refs_[fd] == 0) {
+      continue;
+    }
+    if (--refs_[fd] == 0) {
+      clear_bit(fd);
+      unused.push_back(fd);
+    }
+  }
+  return unused;
+}
+
+bool FileDescriptorAllocator::is_used(int fd) {
+  std::lock_guard<std::mutex> guard(lock_);
+  return fd >= 0 && static_cast<size_t>(fd) < refs_.size() && refs_[fd] != 0;
+}
+
+int FileDescriptorAllocator::find_lowest_unused() {
+  // Follow the first word that is not full from the top level down.
+  size_t index = 0;
+  for (size_t level = levels_.size(); level-- > 0;) {
+    if (index >= levels_[level].size() ||
+        levels_[level][index] == FULL_WORD) {
+      // Every tracked fd is used.
+      return levels_[0].size() * BITS_PER_WORD;
+    }
+    index = index * BITS_PER_WORD + __builtin_ctzll(~levels_[level][index]);
+  }
+  return index;
+}
+
+int FileDescriptorAllocator::lowest_unused() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return find_lowest_unused();
+}
+
+int FileDescriptorAllocator::acquire_lowest_unused() {
+  std::lock_guard<std::mutex> guard(lock_);
+  int fd = find_lowest_unused();
+  grow(fd);
+  refs_[fd]++;
+  set_bit(fd);
+  return fd;
+}
+
+std::vector<int> FileDescriptorAllocator::used_fds() {
+  std::lock_guard<std::mutex> guard(lock_);
+  std::vector<int> fds;
+  for (size_t word = 0; word < levels_[0].size(); word++) {
+    uint64_t bits = levels_[0][word];
+    while (bits != 0) {
+      fds.push_back(word * BITS_PER_WORD + __builtin_ctzll(bits));
+      // Clear the lowest set bit
+      bits &= bits - 1;
+    }
+  }
+  return fds;
+}
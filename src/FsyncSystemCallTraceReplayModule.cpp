@@ -63,7 +63,7 @@ void FsyncSystemCallTraceReplayModule::processRow() {
     return;
   }
 
-  replayed_ret_val_ = fsync(fd);
+  replayed_ret_val_ = engine_->fsync(fd);
 }
 
 void FsyncSystemCallTraceReplayModule::prepareRow() {
@@ -76,7 +76,7 @@ void GetRLimitSystemCallTraceReplayModule::verifyResult(struct rlimit *rlim) {
           "Captured hard resource limit: ", hard_limit, ", ",
           "Replayed system hard resource limit: ", rlim->rlim_max);
       if (abort_mode()) {
-        abort();
+        abort_replay();
       }
     }
   } else {
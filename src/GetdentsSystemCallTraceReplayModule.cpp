@@ -34,8 +34,6 @@
 
 #include "GetdentsSystemCallTraceReplayModule.hpp"
 
-#define getdents(fd, buffer, count) syscall(SYS_getdents, fd, buffer, count)
-
 GetdentsSystemCallTraceReplayModule::GetdentsSystemCallTraceReplayModule(
     DataSeriesModule &source, bool verbose_flag, bool verify_flag,
     int warn_level_flag)
@@ -113,15 +111,18 @@ void GetdentsSystemCallTraceReplayModule::processRow() {
   if (buffer == nullptr) {
     replayed_ret_val_ = ENOMEM;
   } else {
-    replayed_ret_val_ = (int64_t)getdents(fd, buffer, count);
+    replayed_ret_val_ = (int64_t)engine_->getdents(fd, buffer, count);
   }
 
   if (verify_) {
+    ProfileScope scope(profiler_, PROFILE_VERIFY);
     // Verify dirent buffer data and data in the trace file are same
     if (compareResults(dirent_buffer_val, return_val, buffer,
                        replayed_ret_val_)) {
       // Data aren't same
       syscall_logger_->log_err("Verification of data in getdents failed.");
+      record_mismatch(MISMATCH_DATA, 0, dirent_buffer_val, return_val, buffer,
+                      replayed_ret_val_ > 0 ? replayed_ret_val_ : 0);
       if (!default_mode()) {
         syscall_logger_->log_warn(
             "time called: ",
@@ -131,11 +132,14 @@ void GetdentsSystemCallTraceReplayModule::processRow() {
         syscall_logger_->log_warn("replayed ret val ", replayed_ret_val_,
                                   " ret val ", return_val);
 
-        syscall_logger_->log_warn("Captured dirents");
-        printDirents(dirent_buffer_val);
-        printDirents(buffer);
+        // The mismatch record has digests of the dirents instead
+        if (mismatch_recorder_ == nullptr) {
+          syscall_logger_->log_warn("Captured dirents");
+          printDirents(dirent_buffer_val);
+          printDirents(buffer);
+        }
         if (abort_mode()) {
-          abort();
+          abort_replay();
         }
       }
     } else {
@@ -72,9 +72,9 @@ void IoctlSystemCallTraceReplayModule::processRow() {
   // If there is no buffer data, pass the parameter value as the third argument
   if (buffer == nullptr) {
     parameter = params;
-    replayed_ret_val_ = ioctl(fd, request, parameter);
+    replayed_ret_val_ = engine_->ioctl(fd, request, parameter);
   } else {
-    replayed_ret_val_ = ioctl(fd, request, buffer);
+    replayed_ret_val_ = engine_->ioctl(fd, request, buffer);
     delete[] buffer;
   }
 }
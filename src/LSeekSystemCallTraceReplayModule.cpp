@@ -64,7 +64,7 @@ void LSeekSystemCallTraceReplayModule::processRow() {
     return;
   }
   // Replay the lseek system call
-  replayed_ret_val_ = lseek(replayed_fd, offset, whence);
+  replayed_ret_val_ = engine_->lseek(replayed_fd, offset, whence);
 }
 
 void LSeekSystemCallTraceReplayModule::prepareRow() {
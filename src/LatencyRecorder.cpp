@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the LatencyRecorder header
+ * file.
+ *
+ * Read LatencyRecorder.hpp for more information about this class.
+ */
+
+#include "LatencyRecorder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#define LATENCY_SUB_BUCKETS (1ULL << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_HALF_SUB_BUCKETS (LATENCY_SUB_BUCKETS / 2)
+// Number of buckets needed to count values up to LATENCY_MAX_VALUE
+#define LATENCY_BUCKETS                                   \
+  (LATENCY_SUB_BUCKETS + (LATENCY_MAX_VALUE_BITS -        \
+                          LATENCY_SUB_BUCKET_BITS) *      \
+                             LATENCY_HALF_SUB_BUCKETS)
+
+// Percentiles reported for every system call
+#define REPORT_PERCENTILES 3
+static const double report_percentiles[REPORT_PERCENTILES] = {50.0, 99.0,
+                                                              99.9};
+static const char *const report_percentile_names[REPORT_PERCENTILES] = {
+    "p50", "p99", "p999"};
+// Names of the histograms in the order they are reported
+static const char *const report_sides[] = {"replayed", "traced"};
+
+// Number of chunks needed for LATENCY_BUCKETS buckets
+#define LATENCY_CHUNKS \
+  ((LATENCY_BUCKETS + LATENCY_CHUNK_BUCKETS - 1) / LATENCY_CHUNK_BUCKETS)
+
+LatencyHistogram::LatencyHistogram()
+    : chunks_(LATENCY_CHUNKS), total_(0), min_(UINT64_MAX), max_(0), sum_(0) {}
+
+size_t LatencyHistogram::bucket_index(uint64_t value) {
+  if (value < LATENCY_SUB_BUCKETS) {
+    return value;
+  }
+  // value has at least LATENCY_SUB_BUCKET_BITS + 1 significant bits
+  int shift = 63 - __builtin_clzll(value) - (LATENCY_SUB_BUCKET_BITS - 1);
+  return LATENCY_SUB_BUCKETS + (shift - 1) * LATENCY_HALF_SUB_BUCKETS +
+         ((value >> shift) - LATENCY_HALF_SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::bucket_max(size_t index) {
+  if (index < LATENCY_SUB_BUCKETS) {
+    return index;
+  }
+  index -= LATENCY_SUB_BUCKETS;
+  int shift = index / LATENCY_HALF_SUB_BUCKETS + 1;
+  uint64_t sub_bucket = index % LATENCY_HALF_SUB_BUCKETS +
+                        LATENCY_HALF_SUB_BUCKETS;
+  return (sub_bucket << shift) + (1ULL << shift) - 1;
+}
+
+uint64_t *LatencyHistogram::get_chunk(size_t chunk) {
+  if (!chunks_[chunk]) {
+    // The parentheses zero the counts
+    chunks_[chunk].reset(new uint64_t[LATENCY_CHUNK_BUCKETS]());
+  }
+  return chunks_[chunk].get();
+}
+
+void LatencyHistogram::record(uint64_t value) {
+  value = std::min<uint64_t>(value, LATENCY_MAX_VALUE);
+  size_t index = bucket_index(value);
+  get_chunk(index / LATENCY_CHUNK_BUCKETS)[index % LATENCY_CHUNK_BUCKETS]++;
+  total_++;
+  min_ = std::min(min_, value);
+  max_ = std::max(max_, value);
+  sum_ += value;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+  for (size_t chunk = 0; chunk < chunks_.size(); chunk++) {
+    if (!other.chunks_[chunk]) {
+      continue;
+    }
+    uint64_t *counts = get_chunk(chunk);
+    for (size_t i = 0; i < LATENCY_CHUNK_BUCKETS; i++) {
+      counts[i] += other.chunks_[chunk][i];
+    }
+  }
+  total_ += other.total_;
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+  sum_ += other.sum_;
+}
+
+uint64_t LatencyHistogram::value_at_percentile(double percentile) const {
+  if (total_ == 0) {
+    return 0;
+  }
+  uint64_t target = static_cast<uint64_t>(std::ceil(percentile / 100 * total_));
+  target = std::max<uint64_t>(target, 1);
+  uint64_t seen = 0;
+  for (size_t chunk = 0; chunk < chunks_.size(); chunk++) {
+    if (!chunks_[chunk]) {
+      continue;
+    }
+    for (size_t i = 0; i < LATENCY_CHUNK_BUCKETS; i++) {
+      seen += chunks_[chunk][i];
+      if (seen >= target) {
+        return std::min(bucket_max(chunk * LATENCY_CHUNK_BUCKETS + i), max_);
+      }
+    }
+  }
+  return max_;
+}
+
+// Recorder and table of the calling thread
+static thread_local LatencyRecorder *thread_owner = nullptr;
+static thread_local LatencyRecorder::Table *thread_table_ptr = nullptr;
+
+LatencyRecorder::Table &LatencyRecorder::thread_table() {
+  if (thread_owner != this) {
+    std::lock_guard<std::mutex> lock(tables_lock_);
+    tables_.emplace_back(new Table());
+    thread_table_ptr = tables_.back().get();
+    thread_owner = this;
+  }
+  return *thread_table_ptr;
+}
+
+void LatencyRecorder::record(const std::string &syscall, uint64_t replayed_ns,
+                             uint64_t traced_ns) {
+  Latencies &latencies = thread_table()[syscall];
+  latencies.replayed.record(replayed_ns);
+  latencies.traced.record(traced_ns);
+}
+
+void LatencyRecorder::thread_finished() {
+  if (thread_owner != this) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(tables_lock_);
+  merge_table(*thread_table_ptr, finished_);
+  for (auto iter = tables_.begin(); iter != tables_.end(); ++iter) {
+    if (iter->get() == thread_table_ptr) {
+      tables_.erase(iter);
+      break;
+    }
+  }
+  thread_owner = nullptr;
+  thread_table_ptr = nullptr;
+}
+
+template <typename Map>
+void LatencyRecorder::merge_table(const Table &table, Map &into) {
+  for (auto &entry : table) {
+    Latencies &latencies = into[entry.first];
+    latencies.replayed.merge(entry.second.replayed);
+    latencies.traced.merge(entry.second.traced);
+  }
+}
+
+std::map<std::string, LatencyRecorder::Latencies> LatencyRecorder::merge() {
+  std::map<std::string, Latencies> merged;
+  std::lock_guard<std::mutex> lock(tables_lock_);
+  merge_table(finished_, merged);
+  for (auto &table : tables_) {
+    merge_table(*table, merged);
+  }
+  return merged;
+}
+
+void LatencyRecorder::write_csv(
+    std::ostream &out, const std::map<std::string, Latencies> &merged) {
+  out << "syscall,count";
+  for (const char *side : report_sides) {
+    for (const char *name : report_percentile_names) {
+      out << "," << side << "_" << name << "_ns";
+    }
+    out << "," << side << "_mean_ns," << side << "_max_ns";
+  }
+  out << "\n";
+  for (auto &entry : merged) {
+    out << entry.first << "," << entry.second.replayed.count();
+    const LatencyHistogram *histograms[] = {&entry.second.replayed,
+                                            &entry.second.traced};
+    for (const LatencyHistogram *histogram : histograms) {
+      for (double percentile : report_percentiles) {
+        out << "," << histogram->value_at_percentile(percentile);
+      }
+      out << "," << static_cast<uint64_t>(histogram->mean()) << ","
+          << histogram->max();
+    }
+    out << "\n";
+  }
+}
+
+void LatencyRecorder::write_json(
+    std::ostream &out, const std::map<std::string, Latencies> &merged) {
+  out << "{\n  \"unit\": \"ns\",\n  \"syscalls\": {";
+  bool first = true;
+  for (auto &entry : merged) {
+    out << (first ? "\n" : ",\n") << "    \"" << entry.first
+        << "\": {\"count\": " << entry.second.replayed.count();
+    first = false;
+    const LatencyHistogram *histograms[] = {&entry.second.replayed,
+                                            &entry.second.traced};
+    for (int side = 0; side < 2; side++) {
+      out << ", \"" << report_sides[side] << "\": {";
+      for (size_t i = 0; i < REPORT_PERCENTILES; i++) {
+        out << "\"" << report_percentile_names[i]
+            << "\": " << histograms[side]->value_at_percentile(
+                             report_percentiles[i])
+            << ", ";
+      }
+      out << "\"mean\": " << static_cast<uint64_t>(histograms[side]->mean())
+          << ", \"max\": " << histograms[side]->max() << "}";
+    }
+    out << "}";
+  }
+  out << "\n  }\n}\n";
+}
+
+bool LatencyRecorder::report(const std::string &filename) {
+  std::ofstream out(filename);
+  if (!out) {
+    return false;
+  }
+  std::map<std::string, Latencies> merged = merge();
+  const std::string json_suffix = ".json";
+  if (filename.size() >= json_suffix.size() &&
+      filename.compare(filename.size() - json_suffix.size(),
+                       json_suffix.size(), json_suffix) == 0) {
+    write_json(out, merged);
+  } else {
+    write_csv(out, merged);
+  }
+  return static_cast<bool>(out.flush());
+}
@@ -51,7 +51,7 @@ void LinkSystemCallTraceReplayModule::print_specific_fields() {
 
 void LinkSystemCallTraceReplayModule::processRow() {
   // Replay the link system call
-  replayed_ret_val_ = link(old_pathname, new_pathname);
+  replayed_ret_val_ = engine_->link(old_pathname, new_pathname);
 
   if (!verbose_mode()) {
     delete[] new_pathname;
@@ -116,5 +116,5 @@ void LinkatSystemCallTraceReplayModule::processRow() {
   }
   // Replay the linkat system call
   replayed_ret_val_ =
-      linkat(old_fd, old_path_name, new_fd, new_path_name, flags);
+      engine_->linkat(old_fd, old_path_name, new_fd, new_path_name, flags);
 }
@@ -0,0 +1,1432 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the MemFsSyscallEngine
+ * header file
+ *
+ * Read MemFsSyscallEngine.hpp for more information about this class.
+ */
+
+#include "MemFsSyscallEngine.hpp"
+
+#include <dirent.h>
+#include <linux/magic.h>
+#include <sys/xattr.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+
+/*
+ * Record of getdents, which glibc does not declare. The name is followed
+ * by a NUL byte and the file type is the last byte of the record.
+ */
+struct MemFsDirent {
+  unsigned long d_ino;
+  unsigned long d_off;
+  unsigned short d_reclen;
+  char d_name[1];
+};
+
+static struct timespec now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts;
+}
+
+size_t MemFsSyscallEngine::DentryHashCompare::hash(const Dentry &dentry) {
+  return std::hash<std::string>()(dentry.name) ^
+         (dentry.parent * 0x9e3779b97f4a7c15ULL);
+}
+
+bool MemFsSyscallEngine::DentryHashCompare::equal(const Dentry &d1,
+                                                  const Dentry &d2) {
+  return d1.parent == d2.parent && d1.name == d2.name;
+}
+
+MemFsSyscallEngine::MemFsSyscallEngine()
+    : next_ino_(MEMFS_ROOT_INO + 1),
+      cwd_(MEMFS_ROOT_INO),
+      allocated_extents_(0) {
+  auto root = std::make_shared<MemFsInode>();
+  root->ino = MEMFS_ROOT_INO;
+  root->type = S_IFDIR;
+  root->mode = 0755;
+  root->nlink = 2;
+  root->uid = geteuid();
+  root->gid = getegid();
+  root->atime = root->mtime = root->ctime = now();
+  root->parent = MEMFS_ROOT_INO;
+  inodes_.insert(std::make_pair(root->ino, root));
+
+  for (int fd : {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO}) {
+    auto file = std::make_shared<MemFsOpenFile>();
+    file->flags = fd == STDIN_FILENO ? O_RDONLY : O_WRONLY;
+    install_fd(file, 0, 0, fd);
+  }
+}
+
+int64_t MemFsSyscallEngine::result(int64_t value) {
+  if (value < 0) {
+    errno = static_cast<int>(-value);
+    return -1;
+  }
+  return value;
+}
+
+MemFsSyscallEngine::InodeLocks MemFsSyscallEngine::lock_inodes(
+    std::initializer_list<ino_t> inos) {
+  std::vector<size_t> shards;
+  for (ino_t ino : inos) {
+    shards.push_back(ino % MEMFS_INODE_LOCKS);
+  }
+  std::sort(shards.begin(), shards.end());
+  shards.erase(std::unique(shards.begin(), shards.end()), shards.end());
+  InodeLocks locks;
+  for (size_t shard : shards) {
+    locks.emplace_back(inode_locks_[shard]);
+  }
+  return locks;
+}
+
+MemFsInodePtr MemFsSyscallEngine::get_inode(ino_t ino) {
+  InodeTable::const_accessor inode;
+  if (!inodes_.find(inode, ino)) {
+    return nullptr;
+  }
+  return inode->second;
+}
+
+MemFsInodePtr MemFsSyscallEngine::lookup_entry(ino_t parent,
+                                               const std::string &name) {
+  ino_t ino;
+  {
+    DentryTable::const_accessor dentry;
+    if (!dentries_.find(dentry, Dentry{parent, name})) {
+      return nullptr;
+    }
+    ino = dentry->second;
+  }
+  return get_inode(ino);
+}
+
+MemFsOpenFilePtr MemFsSyscallEngine::get_file(int fd, int *fd_flags) {
+  FdTable::const_accessor entry;
+  if (!fds_.find(entry, fd)) {
+    return nullptr;
+  }
+  if (fd_flags != nullptr) {
+    *fd_flags = entry->second.fd_flags;
+  }
+  return entry->second.file;
+}
+
+int MemFsSyscallEngine::install_fd(const MemFsOpenFilePtr &file, int fd_flags,
+                                   int min_fd, int new_fd) {
+  std::lock_guard<std::mutex> guard(fd_lock_);
+  int fd = new_fd;
+  if (fd < 0) {
+    fd = fd_allocator_.lowest_unused();
+    if (fd < min_fd) {
+      fd = min_fd;
+      while (fd_allocator_.is_used(fd)) {
+        fd++;
+      }
+    }
+    fd_allocator_.acquire(fd);
+  } else if (!fd_allocator_.is_used(fd)) {
+    fd_allocator_.acquire(fd);
+  }
+  // An open fd given as new_fd is closed by replacing its entry
+  FdTable::accessor entry;
+  fds_.insert(entry, fd);
+  entry->second.file = file;
+  entry->second.fd_flags = fd_flags;
+  return fd;
+}
+
+int MemFsSyscallEngine::start_dir(int dirfd, const char *path,
+                                  MemFsInodePtr *dir) {
+  if (path[0] == '/') {
+    *dir = get_inode(MEMFS_ROOT_INO);
+    return 0;
+  }
+  if (dirfd == AT_FDCWD) {
+    // The current directory may have been removed
+    *dir = get_inode(cwd_);
+    return *dir == nullptr ? -ENOENT : 0;
+  }
+  MemFsOpenFilePtr file = get_file(dirfd);
+  if (file == nullptr) {
+    return -EBADF;
+  }
+  if (file->inode == nullptr || !S_ISDIR(file->inode->type)) {
+    return -ENOTDIR;
+  }
+  *dir = file->inode;
+  return 0;
+}
+
+int MemFsSyscallEngine::walk(MemFsInodePtr start, const std::string &path,
+                             bool follow, int depth, MemFsInodePtr *inode) {
+  if (path.empty()) {
+    return -ENOENT;
+  }
+  MemFsInodePtr dir =
+      path[0] == '/' ? get_inode(MEMFS_ROOT_INO) : std::move(start);
+  size_t pos = 0;
+  while (true) {
+    pos = path.find_first_not_of('/', pos);
+    if (pos == std::string::npos) {
+      break;
+    }
+    size_t end = std::min(path.find('/', pos), path.size());
+    std::string name = path.substr(pos, end - pos);
+    pos = end;
+    bool last = path.find_first_not_of('/', end) == std::string::npos;
+    // A trailing slash asks for a directory, following a last symlink
+    bool trailing_slash = last && end < path.size();
+
+    if (!S_ISDIR(dir->type)) {
+      return -ENOTDIR;
+    }
+    if (name == ".") {
+      continue;
+    }
+    if (name == "..") {
+      ino_t parent;
+      {
+        InodeLocks locks = lock_inodes({dir->ino});
+        parent = dir->parent;
+      }
+      dir = get_inode(parent);
+      if (dir == nullptr) {
+        return -ENOENT;
+      }
+      continue;
+    }
+    if (name.size() > NAME_MAX) {
+      return -ENAMETOOLONG;
+    }
+    MemFsInodePtr child = lookup_entry(dir->ino, name);
+    if (child == nullptr) {
+      return -ENOENT;
+    }
+    if (S_ISLNK(child->type) && (!last || follow || trailing_slash)) {
+      if (++depth > MEMFS_MAX_SYMLINKS) {
+        return -ELOOP;
+      }
+      int ret = walk(dir, child->target, true, depth, &child);
+      if (ret < 0) {
+        return ret;
+      }
+    }
+    if (trailing_slash && !S_ISDIR(child->type)) {
+      return -ENOTDIR;
+    }
+    dir = std::move(child);
+  }
+  *inode = std::move(dir);
+  return 0;
+}
+
+int MemFsSyscallEngine::lookup(int dirfd, const char *path, bool follow,
+                               MemFsInodePtr *inode) {
+  if (path == nullptr) {
+    return -EFAULT;
+  }
+  MemFsInodePtr start;
+  int ret = start_dir(dirfd, path, &start);
+  if (ret < 0) {
+    return ret;
+  }
+  return walk(start, path, follow, 0, inode);
+}
+
+int MemFsSyscallEngine::lookup_parent(int dirfd, const char *path,
+                                      int dot_errno, MemFsInodePtr *parent,
+                                      std::string *name) {
+  if (path == nullptr) {
+    return -EFAULT;
+  }
+  std::string full_path(path);
+  if (full_path.empty()) {
+    return -ENOENT;
+  }
+  size_t end = full_path.find_last_not_of('/');
+  if (end == std::string::npos) {
+    return dot_errno;
+  }
+  size_t slash = full_path.rfind('/', end);
+  size_t begin = slash == std::string::npos ? 0 : slash + 1;
+  *name = full_path.substr(begin, end + 1 - begin);
+  if (*name == "." || *name == "..") {
+    return dot_errno;
+  }
+  if (name->size() > NAME_MAX) {
+    return -ENAMETOOLONG;
+  }
+
+  MemFsInodePtr start;
+  int ret = start_dir(dirfd, path, &start);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = walk(start, begin == 0 ? "." : full_path.substr(0, begin), true, 0,
+             parent);
+  if (ret < 0) {
+    return ret;
+  }
+  return S_ISDIR((*parent)->type) ? 0 : -ENOTDIR;
+}
+
+int MemFsSyscallEngine::create(const MemFsInodePtr &parent,
+                               const std::string &name, mode_t mode,
+                               dev_t rdev, const std::string &target,
+                               MemFsInodePtr *inode) {
+  auto node = std::make_shared<MemFsInode>();
+  node->ino = next_ino_++;
+  node->type = mode & S_IFMT;
+  node->mode = mode & ~S_IFMT;
+  node->nlink = S_ISDIR(mode) ? 2 : 1;
+  node->uid = geteuid();
+  node->gid = getegid();
+  node->rdev = rdev;
+  node->size = target.size();
+  node->atime = node->mtime = node->ctime = now();
+  node->parent = parent->ino;
+  node->target = target;
+
+  InodeLocks locks = lock_inodes({parent->ino});
+  // The directory was removed while the path was looked up
+  if (parent->nlink == 0) {
+    return -ENOENT;
+  }
+  if (parent->entries.count(name) != 0u) {
+    return -EEXIST;
+  }
+  inodes_.insert(std::make_pair(node->ino, node));
+  parent->entries[name] = node->ino;
+  dentries_.insert(std::make_pair(Dentry{parent->ino, name}, node->ino));
+  if (S_ISDIR(mode)) {
+    parent->nlink++;
+  }
+  parent->mtime = parent->ctime = node->ctime;
+  *inode = std::move(node);
+  return 0;
+}
+
+void MemFsSyscallEngine::drop_link(const MemFsInodePtr &inode) {
+  inode->ctime = now();
+  if (--inode->nlink == 0) {
+    inodes_.erase(inode->ino);
+    allocated_extents_ -= inode->extents.size();
+  }
+}
+
+int MemFsSyscallEngine::remove(const MemFsInodePtr &parent,
+                               const std::string &name, bool directory) {
+  while (true) {
+    MemFsInodePtr child = lookup_entry(parent->ino, name);
+    if (child == nullptr) {
+      return -ENOENT;
+    }
+    InodeLocks locks = lock_inodes({parent->ino, child->ino});
+    auto entry = parent->entries.find(name);
+    if (entry == parent->entries.end() || entry->second != child->ino) {
+      // The entry changed before it was locked
+      continue;
+    }
+    if (directory) {
+      if (!S_ISDIR(child->type)) {
+        return -ENOTDIR;
+      }
+      if (!child->entries.empty()) {
+        return -ENOTEMPTY;
+      }
+    } else if (S_ISDIR(child->type)) {
+      return -EISDIR;
+    }
+    parent->entries.erase(entry);
+    dentries_.erase(Dentry{parent->ino, name});
+    parent->mtime = parent->ctime = now();
+    if (directory) {
+      // Neither ".." of child nor "." is left
+      parent->nlink--;
+      child->nlink = 1;
+    }
+    drop_link(child);
+    return 0;
+  }
+}
+
+ssize_t MemFsSyscallEngine::read_data(MemFsInode &inode, char *buf,
+                                      size_t count, off_t offset) {
+  if (offset >= inode.size) {
+    return 0;
+  }
+  size_t total = std::min(count, static_cast<size_t>(inode.size - offset));
+  size_t done = 0;
+  while (done < total) {
+    off_t pos = offset + done;
+    size_t in_extent = pos % MEMFS_EXTENT_SIZE;
+    size_t n = std::min(total - done, MEMFS_EXTENT_SIZE - in_extent);
+    auto extent = inode.extents.find(pos / MEMFS_EXTENT_SIZE);
+    if (extent == inode.extents.end()) {
+      std::memset(buf + done, 0, n);
+    } else {
+      std::memcpy(buf + done, extent->second.data() + in_extent, n);
+    }
+    done += n;
+  }
+  return total;
+}
+
+ssize_t MemFsSyscallEngine::write_data(MemFsInode &inode, const char *buf,
+                                       size_t count, off_t offset) {
+  size_t done = 0;
+  while (done < count) {
+    off_t pos = offset + done;
+    size_t in_extent = pos % MEMFS_EXTENT_SIZE;
+    size_t n = std::min(count - done, MEMFS_EXTENT_SIZE - in_extent);
+    std::vector<char> &extent = inode.extents[pos / MEMFS_EXTENT_SIZE];
+    if (extent.empty()) {
+      extent.resize(MEMFS_EXTENT_SIZE);
+      allocated_extents_++;
+    }
+    std::memcpy(extent.data() + in_extent, buf + done, n);
+    done += n;
+  }
+  inode.size = std::max(inode.size, static_cast<off_t>(offset + count));
+  return count;
+}
+
+void MemFsSyscallEngine::truncate_data(MemFsInode &inode, off_t length) {
+  auto extent = inode.extents.lower_bound(
+      (length + MEMFS_EXTENT_SIZE - 1) / MEMFS_EXTENT_SIZE);
+  while (extent != inode.extents.end()) {
+    extent = inode.extents.erase(extent);
+    allocated_extents_--;
+  }
+  // Growing the file again must read zeros past length
+  size_t in_extent = length % MEMFS_EXTENT_SIZE;
+  if (in_extent != 0) {
+    auto last = inode.extents.find(length / MEMFS_EXTENT_SIZE);
+    if (last != inode.extents.end()) {
+      std::memset(last->second.data() + in_extent, 0,
+                  MEMFS_EXTENT_SIZE - in_extent);
+    }
+  }
+  inode.size = length;
+}
+
+ssize_t MemFsSyscallEngine::transfer(int fd, const struct iovec *iov,
+                                     int iovcnt, off_t offset, bool write) {
+  MemFsOpenFilePtr file = get_file(fd);
+  if (file == nullptr) {
+    return result(-EBADF);
+  }
+  MemFsInode *inode = file->inode.get();
+  if (inode == nullptr || S_ISFIFO(inode->type)) {
+    // Standard fds and pipes have nothing to model
+    return traced_result();
+  }
+  int access_mode = file->flags & O_ACCMODE;
+  if (access_mode == (write ? O_RDONLY : O_WRONLY)) {
+    return result(-EBADF);
+  }
+  if (S_ISDIR(inode->type)) {
+    return result(-EISDIR);
+  }
+
+  bool use_file_position = offset < 0;
+  std::unique_lock<std::mutex> position_lock(file->lock, std::defer_lock);
+  if (use_file_position) {
+    position_lock.lock();
+    offset = file->offset;
+  }
+  InodeLocks locks = lock_inodes({inode->ino});
+  if (write && (file->flags & O_APPEND) != 0) {
+    offset = inode->size;
+  }
+  ssize_t done = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    auto base = static_cast<char *>(iov[i].iov_base);
+    size_t len = iov[i].iov_len;
+    ssize_t n = write ? write_data(*inode, base, len, offset + done)
+                      : read_data(*inode, base, len, offset + done);
+    done += n;
+    if (static_cast<size_t>(n) < len) {
+      break;
+    }
+  }
+  if (write && done > 0) {
+    inode->mtime = inode->ctime = now();
+  }
+  if (use_file_position) {
+    file->offset = offset + done;
+  }
+  return done;
+}
+
+void MemFsSyscallEngine::fill_stat(const MemFsInodePtr &inode,
+                                   struct stat *buf) {
+  std::memset(buf, 0, sizeof(*buf));
+  InodeLocks locks = lock_inodes({inode->ino});
+  buf->st_ino = inode->ino;
+  buf->st_mode = inode->type | inode->mode;
+  buf->st_nlink = inode->nlink;
+  buf->st_uid = inode->uid;
+  buf->st_gid = inode->gid;
+  buf->st_rdev = inode->rdev;
+  buf->st_size = inode->size;
+  buf->st_blksize = MEMFS_EXTENT_SIZE;
+  buf->st_blocks = inode->extents.size() * (MEMFS_EXTENT_SIZE / 512);
+  buf->st_atim = inode->atime;
+  buf->st_mtim = inode->mtime;
+  buf->st_ctim = inode->ctime;
+}
+
+int MemFsSyscallEngine::set_times(const MemFsInodePtr &inode,
+                                  const struct timespec times[2]) {
+  struct timespec ts[2] = {{0, UTIME_NOW}, {0, UTIME_NOW}};
+  if (times != nullptr) {
+    ts[0] = times[0];
+    ts[1] = times[1];
+  }
+  struct timespec current = now();
+  for (auto &t : ts) {
+    if (t.tv_nsec == UTIME_NOW) {
+      t = current;
+    } else if (t.tv_nsec != UTIME_OMIT &&
+               (t.tv_nsec < 0 || t.tv_nsec >= 1000000000L)) {
+      return -EINVAL;
+    }
+  }
+  InodeLocks locks = lock_inodes({inode->ino});
+  if (ts[0].tv_nsec != UTIME_OMIT) {
+    inode->atime = ts[0];
+  }
+  if (ts[1].tv_nsec != UTIME_OMIT) {
+    inode->mtime = ts[1];
+  }
+  inode->ctime = current;
+  return 0;
+}
+
+int MemFsSyscallEngine::set_xattr(const MemFsInodePtr &inode,
+                                  const char *name, const void *value,
+                                  size_t size, int flags) {
+  if ((flags & ~(XATTR_CREATE | XATTR_REPLACE)) != 0) {
+    return -EINVAL;
+  }
+  size_t name_length = name == nullptr ? 0 : std::strlen(name);
+  if (name_length == 0 || name_length > XATTR_NAME_MAX) {
+    return -ERANGE;
+  }
+  InodeLocks locks = lock_inodes({inode->ino});
+  bool exists = inode->xattrs.count(name) != 0u;
+  if ((flags & XATTR_CREATE) != 0 && exists) {
+    return -EEXIST;
+  }
+  if ((flags & XATTR_REPLACE) != 0 && !exists) {
+    return -ENODATA;
+  }
+  if (value == nullptr) {
+    inode->xattrs[name].clear();
+  } else {
+    inode->xattrs[name].assign(static_cast<const char *>(value), size);
+  }
+  inode->ctime = now();
+  return 0;
+}
+
+int MemFsSyscallEngine::access(const char *path, int mode) {
+  return faccessat(AT_FDCWD, path, mode, 0);
+}
+
+int MemFsSyscallEngine::faccessat(int dirfd, const char *path, int mode,
+                                  int flags) {
+  MemFsInodePtr inode;
+  int ret = lookup(dirfd, path, (flags & AT_SYMLINK_NOFOLLOW) == 0, &inode);
+  if (ret < 0) {
+    return result(ret);
+  }
+  // The replayer runs as root, which may only be refused execution
+  if ((mode & X_OK) != 0 && S_ISREG(inode->type)) {
+    InodeLocks locks = lock_inodes({inode->ino});
+    if ((inode->mode & 0111) == 0) {
+      return result(-EACCES);
+    }
+  }
+  return 0;
+}
+
+int MemFsSyscallEngine::stat(const char *path, struct stat *buf) {
+  return fstatat(AT_FDCWD, path, buf, 0);
+}
+
+int MemFsSyscallEngine::lstat(const char *path, struct stat *buf) {
+  return fstatat(AT_FDCWD, path, buf, AT_SYMLINK_NOFOLLOW);
+}
+
+int MemFsSyscallEngine::fstat(int fd, struct stat *buf) {
+  MemFsOpenFilePtr file = get_file(fd);
+  if (file == nullptr) {
+    return result(-EBADF);
+  }
+  if (file->inode == nullptr) {
+    return NullSyscallEngine::fstat(fd, buf);
+  }
+  fill_stat(file->inode, buf);
+  return 0;
+}
+
+int MemFsSyscallEngine::fstatat(int dirfd, const char *path, struct stat *buf,
+                                int flags) {
+  if ((flags & AT_EMPTY_PATH) != 0 && path != nullptr && path[0] == '\0') {
+    return fstat(dirfd, buf);
+  }
+  MemFsInodePtr inode;
+  int ret = lookup(dirfd, path, (flags & AT_SYMLINK_NOFOLLOW) == 0, &inode);
+  if (ret < 0) {
+    return result(ret);
+  }
+  fill_stat(inode, buf);
+  return 0;
+}
+
+int MemFsSyscallEngine::statfs(const char *path, struct statfs *buf) {
+  MemFsInodePtr inode;
+  int ret = lookup(AT_FDCWD, path, true, &inode);
+  if (ret < 0) {
+    return result(ret);
+  }
+  // The file system can grow as big as the memory of the machine
+  std::memset(buf, 0, sizeof(*buf));
+  int64_t extents = sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) /
+                    MEMFS_EXTENT_SIZE;
+  int64_t allocated = allocated_extents_;
+  buf->f_type = TMPFS_MAGIC;
+  buf->f_bsize = MEMFS_EXTENT_SIZE;
+  buf->f_frsize = MEMFS_EXTENT_SIZE;
+  buf->f_blocks = extents;
+  buf->f_bfree = buf->f_bavail = std::max<int64_t>(extents - allocated, 0);
+  buf->f_files = extents;
+  buf->f_ffree =
+      std::max<int64_t>(extents - static_cast<int64_t>(inodes_.size()), 0);
+  buf->f_namelen = NAME_MAX;
+  return 0;
+}
+
+int MemFsSyscallEngine::fstatfs(int fd, struct statfs *buf) {
+  MemFsOpenFilePtr file = get_file(fd);
+  if (file == nullptr) {
+    return result(-EBADF);
+  }
+  if (file->inode == nullptr) {
+    return NullSyscallEngine::fstatfs(fd, buf);
+  }
+  return statfs("/", buf);
+}
+
+int MemFsSyscallEngine::chdir(const char *path) {
+  MemFsInodePtr inode;
+  int ret = lookup(AT_FDCWD, path, true, &inode);
+  if (ret < 0) {
+    return result(ret);
+  }
+  if (!S_ISDIR(inode->type)) {
+    return result(-ENOTDIR);
+  }
+  cwd_ = inode->ino;
+  return 0;
+}
+
+int MemFsSyscallEngine::fchdir(int fd) {
+  MemFsOpenFilePtr file = get_file(fd);
+  if (file == nullptr) {
+    return result(-EBADF);
+  }
+  if (file->inode == nullptr || !S_ISDIR(file->inode->type)) {
+    return result(-ENOTDIR);
+  }
+  cwd_ = file->inode->ino;
+  return 0;
+}
+
+int MemFsSyscallEngine::chmod(const char *path, mode_t mode) {
+  return fchmodat(AT_FDCWD, path, mode, 0);
+}
+
+int MemFsSyscallEngine::fchmod(int fd, mode_t mode) {
+  MemFsOpenFilePtr file = get_file(fd);
+  if (file == nullptr) {
+    return result(-EBADF);
+  }
+  if (file->inode == nullptr) {
+    return NullSyscallEngine::fchmod(fd, mode);
+  }
+  InodeLocks locks = lock_inodes({file->inode->ino});
+  file->inode->mode = mode & 07777;
+  file->inode->ctime = now();
+  return 0;
+}
+
+int MemFsSyscallEngine::fchmodat(int dirfd, const char *path, mode_t mode,
+                                 int flags) {
+  // Symbolic links have no mode of their own on Linux
+  if ((flags & AT_SYMLINK_NOFOLLOW) != 0) {
+    return result(-EOPNOTSUPP);
+  }
+  MemFsInodePtr inode;
+  int ret = lookup(dirfd, path, true, &inode);
+  if (ret < 0) {
+    return result(ret);
+  }
+  InodeLocks locks = lock_inodes({inode->ino});
+  inode->mode = mode & 07777;
+  inode->ctime = now();
+  return 0;
+}
+
+int MemFsSyscallEngine::chown(const char *path, uid_t owner, gid_t group) {
+  MemFsInodePtr inode;
+  int ret = lookup(AT_FDCWD, path, true, &inode);
+  if (ret < 0) {
+    return result(ret);
+  }
+  InodeLocks locks = lock_inodes({inode->ino});
+  if (owner != static_cast<uid_t>(-1)) {
+    inode->uid = owner;
+  }
+  if (group != static_cast<gid_t>(-1)) {
+    inode->gid = group;
+  }
+  inode->ctime = now();
+  return 0;
+}
+
+int MemFsSyscallEngine::openat(int dirfd, const char *path, int flags,
+                               mode_t mode) {
+  MemFsInodePtr inode;
+  int ret;
+  if ((flags & O_CREAT) != 0) {
+    MemFsInodePtr parent;
+    std::string name;
+    ret = lookup_parent(dirfd, path, -EISDIR, &parent, &name);
+    if (ret < 0) {
+      return result(ret);
+    }
+    inode = lookup_entry(parent->ino, name);
+    if (inode == nullptr) {
+      ret = create(parent, name, S_IFREG | (mode & 07777), 0, "", &inode);
+      if (ret == -EEXIST && (flags & O_EXCL) == 0) {
+        // Another thread created it first
+        inode = lookup_entry(parent->ino, name);
+        ret = inode == nullptr ? -ENOENT : 0;
+      }
+      if (ret < 0) {
+        return result(ret);
+      }
+    } else if ((flags & O_EXCL) != 0) {
+      return result(-EEXIST);
+    }
+  }
+  if (inode == nullptr || S_ISLNK(inode->type)) {
+    ret = lookup(dirfd, path, (flags & O_NOFOLLOW) == 0, &inode);
+    if (ret < 0) {
+      return result(ret);
+    }
+    if (S_ISLNK(inode->type) && (flags & O_PATH) == 0) {
+      return result(-ELOOP);
+    }
+  }
+
+  int access_mode = flags & O_ACCMODE;
+  if (S_ISDIR(inode->type)) {
+    if (access_mode != O_RDONLY || (flags & O_CREAT) != 0) {
+      return result(-EISDIR);
+    }
+  } else if ((flags & O_DIRECTORY) != 0) {
+    return result(-ENOTDIR);
+  }
+  if ((flags & O_TRUNC) != 0 && access_mode != O_RDONLY &&
+      S_ISREG(inode->type)) {
+    InodeLocks locks = lock_inodes({inode->ino});
+    truncate_data(*inode, 0);
+    inode->mtime = inode->ctime = now();
+  }
+
+  auto file = std::make_shared<MemFsOpenFile>();
+  file->inode = inode;
+  file->flags = flags & ~(O_CREAT | O_EXCL | O_NOCTTY | O_TRUNC | O_CLOEXEC);
+  return install_fd(file, (flags & O_CLOEXEC) != 0 ? FD_CLOEXEC : 0);
+}
+
+int MemFsSyscallEngine::creat(const char *path, mode_t mode) {
+  return openat(AT_FDCWD, path, O_CREAT | O_WRONLY | O_TRUNC, mode);
+}
+
+int MemFsSyscallEngine::close(int fd) {
+  std::lock_guard<std::mutex> guard(fd_lock_);
+  if (!fds_.erase(fd)) {
+    return result(-EBADF);
+  }
+  fd_allocator_.release(fd);
+  return 0;
+}
+
+int MemFsSyscallEngine::dup(int fd) {
+  MemFsOpenFilePtr file = get_file(fd);
+  if (file == nullptr) {
+    return result(-EBADF);
+  }
+  return install_fd(file, 0);
+}
+
+int MemFsSyscallEngine::dup2(int old_fd, int new_fd) {
+  MemFsOpenFilePtr file = get_file(old_fd);
+  if (file == nullptr || new_fd < 0) {
+    return result(-EBADF);
+  }
+  if (old_fd == new_fd) {
+    return new_fd;
+  }
+  return install_fd(file, 0, 0, new_fd);
+}
+
+int MemFsSyscallEngine::dup3(int old_fd, int new_fd, int flags) {
+  if ((flags & ~O_CLOEXEC) != 0 || old_fd == new_fd) {
+    return result(-EINVAL);
+  }
+  MemFsOpenFilePtr file = get_file(old_fd);
+  if (file == nullptr || new_fd < 0) {
+    return result(-EBADF);
+  }
+  return install_fd(file, (flags & O_CLOEXEC) != 0 ? FD_CLOEXEC : 0, 0,
+                    new_fd);
+}
+
+int MemFsSyscallEngine::fcntl(int fd, int cmd, long arg) {
+  int fd_flags;
+  MemFsOpenFilePtr file = get_file(fd, &fd_flags);
+  if (file == nullptr) {
+    return result(-EBADF);
+  }
+  // The flags of the open file that F_SETFL can change
+  const int settable_flags = O_APPEND | O_ASYNC | O_DIRECT | O_NOATIME |
+                             O_NONBLOCK;
+  switch (cmd) {
+    case F_DUPFD:
+    case F_DUPFD_CLOEXEC:
+      if (arg < 0 || arg > INT_MAX) {
+        return result(-EINVAL);
+      }
+      return install_fd(file, cmd == F_DUPFD_CLOEXEC ? FD_CLOEXEC : 0,
+                        static_cast<int>(arg));
+    case F_GETFD:
+      return fd_flags;
+    case F_SETFD: {
+      FdTable::accessor entry;
+      if (fds_.find(entry, fd)) {
+        entry->second.fd_flags = arg & FD_CLOEXEC;
+      }
+      return 0;
+    }
+    case F_GETFL:
+      return file->flags;
+    case F_SETFL: {
+      int flags = file->flags;
+      while (!file->flags.compare_exchange_weak(
+          flags, (flags & ~settable_flags) | (arg & settable_flags))) {
+      }
+      return 0;
+    }
+    default:
+      return NullSyscallEngine::fcntl(fd, cmd, arg);
+  }
+}
+
+int MemFsSyscallEngine::pipe(int fds[2]) {
+  if (fds == nullptr) {
+    return result(-EFAULT);
+  }
+  // The pipe has an inode for fstat, but no entry and no data
+  auto inode = std::make_shared<MemFsInode>();
+  inode->ino = next_ino_++;
+  inode->type = S_IFIFO;
+  inode->mode = 0600;
+  inode->nlink = 1;
+  inode->uid = geteuid();
+  inode->gid = getegid();
+  inode->atime = inode->mtime = inode->ctime = now();
+  for (int end : {0, 1}) {
+    auto file = std::make_shared<MemFsOpenFile>();
+    file->inode = inode;
+    file->flags = end == 0 ? O_RDONLY : O_WRONLY;
+    fds[end] = install_fd(file, 0);
+  }
+  return 0;
+}
+
+ssize_t MemFsSyscallEngine::read(int fd, void *buf, size_t count) {
+  struct iovec iov = {buf, count};
+  return transfer(fd, &iov, 1, -1, false);
+}
+
+ssize_t MemFsSyscallEngine::pread(int fd, void *buf, size_t count,
+                                  off_t offset) {
+  if (offset < 0) {
+    return result(-EINVAL);
+  }
+  struct iovec iov = {buf, count};
+  return transfer(fd, &iov, 1, offset, false);
+}
+
+ssize_t MemFsSyscallEngine::readv(int fd, const struct iovec *iov,
+                                  int iovcnt) {
+  return transfer(fd, iov, iovcnt, -1, false);
+}
+
+ssize_t MemFsSyscallEngine::write(int fd, const void *buf, size_t count) {
+  struct iovec iov = {const_cast<void *>(buf), count};
+  return transfer(fd, &iov, 1, -1, true);
+}
+
+ssize_t MemFsSyscallEngine::pwrite(int fd, const void *buf, size_t count,
+                                   off_t offset) {
+  if (offset < 0) {
+    return result(-EINVAL);
+  }
+  struct iovec iov = {const_cast<void *>(buf), count};
+  return transfer(fd, &iov, 1, offset, true);
+}
+
+ssize_t MemFsSyscallEngine::writev(int fd, const struct iovec *iov,
+                                   int iovcnt) {
+  return transfer(fd, iov, iovcnt, -1, true);
+}
+
+off_t MemFsSyscallEngine::lseek(int fd, off_t offset, int whence) {
+  MemFsOpenFilePtr file = get_file(fd);
+  if (file == nullptr) {
+    return result(-EBADF);
+  }
+  MemFsInode *inode = file->inode.get();
+  if (inode == nullptr || S_ISFIFO(inode->type)) {
+    return traced_result();
+  }
+  std::lock_guard<std::mutex> guard(file->lock);
+  off_t position;
+  switch (whence) {
+    case SEEK_SET:
+      position = offset;
+      break;
+    case SEEK_CUR:
+      position = file->offset + offset;
+      break;
+    case SEEK_END:
+    case SEEK_DATA:
+    case SEEK_HOLE: {
+      InodeLocks locks = lock_inodes({inode->ino});
+      if (whence == SEEK_END) {
+        position = inode->size + offset;
+      } else if (offset < 0 || offset >= inode->size) {
+        return result(-ENXIO);
+      } else {
+        // Holes inside the file are reported as data, as tmpfs once did
+        position = whence == SEEK_DATA ? offset : inode->size;
+      }
+      break;
+    }
+    default:
+      return result(-EINVAL);
+  }
+  if (position < 0) {
+    return result(-EINVAL);
+  }
+  file->offset = position;
+  if (position == 0) {
+    // Rewinding a directory restarts getdents
+    file->dir_position.clear();
+  }
+  return position;
+}
+
+ssize_t MemFsSyscallEngine::readahead(int fd, off64_t offset, size_t count) {
+  MemFsOpenFilePtr file = get_file(fd);
+  if (file == nullptr) {
+    return result(-EBADF);
+  }
+  if (file->inode == nullptr) {
+    return traced_result();
+  }
+  return S_ISREG(file->inode->type) ? 0 : result(-EINVAL);
+}
+
+int MemFsSyscallEngine::fallocate(int fd, int mode, off_t offset, off_t len) {
+  MemFsOpenFilePtr file = get_file(fd);
+  if (file == nullptr) {
+    return result(-EBADF);
+  }
+  MemFsInode *inode = file->inode.get();
+  // Punching holes and the other modes are not modeled
+  if (inode == nullptr || (mode & ~FALLOC_FL_KEEP_SIZE) != 0) {
+    return traced_result();
+  }
+  if (offset < 0 || len <= 0) {
+    return result(-EINVAL);
+  }
+  if ((file->flags & O_ACCMODE) == O_RDONLY) {
+    return result(-EBADF);
+  }
+  if (!S_ISREG(inode->type)) {
+    return result(S_ISDIR(inode->type) ? -EISDIR : -ENODEV);
+  }
+  InodeLocks locks = lock_inodes({inode->ino});
+  for (off_t index = offset / MEMFS_EXTENT_SIZE;
+       index <= (offset + len - 1) / MEMFS_EXTENT_SIZE; index++) {
+    std::vector<char> &extent = inode->extents[index];
+    if (extent.empty()) {
+      extent.resize(MEMFS_EXTENT_SIZE);
+      allocated_extents_++;
+    }
+  }
+  if (mode == 0 && offset + len > inode->size) {
+    inode->size = offset + len;
+    inode->mtime = inode->ctime = now();
+  }
+  return 0;
+}
+
+int MemFsSyscallEngine::fsync(int fd) {
+  MemFsOpenFilePtr file = get_file(fd);
+  if (file == nullptr) {
+    return result(-EBADF);
+  }
+  return file->inode == nullptr ? traced_result() : 0;
+}
+
+int MemFsSyscallEngine::fdatasync(int fd) { return fsync(fd); }
+
+int MemFsSyscallEngine::truncate(const char *path, off_t length) {
+  if (length < 0) {
+    return result(-EINVAL);
+  }
+  MemFsInodePtr inode;
+  int ret = lookup(AT_FDCWD, path, true, &inode);
+  if (ret < 0) {
+    return result(ret);
+  }
+  if (!S_ISREG(inode->type)) {
+    return result(S_ISDIR(inode->type) ? -EISDIR : -EINVAL);
+  }
+  InodeLocks locks = lock_inodes({inode->ino});
+  truncate_data(*inode, length);
+  inode->mtime = inode->ctime = now();
+  return 0;
+}
+
+int MemFsSyscallEngine::ftruncate(int fd, off_t length) {
+  MemFsOpenFilePtr file = get_file(fd);
+  if (file == nullptr) {
+    return result(-EBADF);
+  }
+  MemFsInode *inode = file->inode.get();
+  if (inode == nullptr) {
+    return traced_result();
+  }
+  if (length < 0 || !S_ISREG(inode->type) ||
+      (file->flags & O_ACCMODE) == O_RDONLY) {
+    return result(-EINVAL);
+  }
+  InodeLocks locks = lock_inodes({inode->ino});
+  truncate_data(*inode, length);
+  inode->mtime = inode->ctime = now();
+  return 0;
+}
+
+long MemFsSyscallEngine::getdents(int fd, void *buf, unsigned int count) {
+  MemFsOpenFilePtr file = get_file(fd);
+  if (file == nullptr) {
+    return result(-EBADF);
+  }
+  MemFsInode *dir = file->inode.get();
+  if (dir == nullptr) {
+    return traced_result();
+  }
+  if (!S_ISDIR(dir->type)) {
+    return result(-ENOTDIR);
+  }
+
+  std::lock_guard<std::mutex> guard(file->lock);
+  InodeLocks locks = lock_inodes({dir->ino});
+  auto out = static_cast<char *>(buf);
+  size_t used = 0;
+  bool full = false;
+  // Append an entry, or return false if buf has no room left for it
+  auto emit = [&](ino_t ino, const std::string &name, mode_t type) -> bool {
+    size_t reclen =
+        (offsetof(MemFsDirent, d_name) + name.size() + 2 + 7) & ~size_t(7);
+    if (used + reclen > count) {
+      full = true;
+      return false;
+    }
+    auto dirent = reinterpret_cast<MemFsDirent *>(out + used);
+    dirent->d_ino = ino;
+    dirent->d_off = ++file->offset;
+    dirent->d_reclen = reclen;
+    std::memcpy(dirent->d_name, name.c_str(), name.size() + 1);
+    out[used + reclen - 1] = static_cast<char>(type >> 12);
+    used += reclen;
+    return true;
+  };
+
+  if (file->offset == 0 && !emit(dir->ino, ".", S_IFDIR)) {
+    return result(-EINVAL);
+  }
+  if (file->offset == 1 && !emit(dir->parent, "..", S_IFDIR)) {
+    return used == 0 ? result(-EINVAL) : used;
+  }
+  auto entry = file->dir_position.empty()
+                   ? dir->entries.begin()
+                   : dir->entries.upper_bound(file->dir_position);
+  for (; entry != dir->entries.end(); ++entry) {
+    MemFsInodePtr child = get_inode(entry->second);
+    if (!emit(entry->second, entry->first,
+              child == nullptr ? 0 : child->type)) {
+      break;
+    }
+    file->dir_position = entry->first;
+  }
+  return used == 0 && full ? result(-EINVAL) : used;
+}
+
+int MemFsSyscallEngine::mkdir(const char *path, mode_t mode) {
+  return mkdirat(AT_FDCWD, path, mode);
+}
+
+int MemFsSyscallEngine::mkdirat(int dirfd, const char *path, mode_t mode) {
+  MemFsInodePtr parent;
+  std::string name;
+  int ret = lookup_parent(dirfd, path, -EEXIST, &parent, &name);
+  if (ret < 0) {
+    return result(ret);
+  }
+  MemFsInodePtr inode;
+  return result(create(parent, name, S_IFDIR | (mode & 07777), 0, "", &inode));
+}
+
+int MemFsSyscallEngine::mknod(const char *path, mode_t mode, dev_t dev) {
+  mode_t type = mode & S_IFMT;
+  if (type == 0) {
+    type = S_IFREG;
+  } else if (type == S_IFDIR) {
+    return result(-EPERM);
+  }
+  MemFsInodePtr parent;
+  std::string name;
+  int ret = lookup_parent(AT_FDCWD, path, -EEXIST, &parent, &name);
+  if (ret < 0) {
+    return result(ret);
+  }
+  MemFsInodePtr inode;
+  return result(create(parent, name, type | (mode & 07777), dev, "", &inode));
+}
+
+int MemFsSyscallEngine::rmdir(const char *path) {
+  return unlinkat(AT_FDCWD, path, AT_REMOVEDIR);
+}
+
+int MemFsSyscallEngine::link(const char *old_path, const char *new_path) {
+  return linkat(AT_FDCWD, old_path, AT_FDCWD, new_path, 0);
+}
+
+int MemFsSyscallEngine::linkat(int old_dirfd, const char *old_path,
+                               int new_dirfd, const char *new_path,
+                               int flags) {
+  MemFsInodePtr inode;
+  int ret = lookup(old_dirfd, old_path, (flags & AT_SYMLINK_FOLLOW) != 0,
+                   &inode);
+  if (ret < 0) {
+    return result(ret);
+  }
+  if (S_ISDIR(inode->type)) {
+    return result(-EPERM);
+  }
+  MemFsInodePtr parent;
+  std::string name;
+  ret = lookup_parent(new_dirfd, new_path, -EEXIST, &parent, &name);
+  if (ret < 0) {
+    return result(ret);
+  }
+
+  InodeLocks locks = lock_inodes({parent->ino, inode->ino});
+  if (parent->nlink == 0 || inode->nlink == 0) {
+    return result(-ENOENT);
+  }
+  if (parent->entries.count(name) != 0u) {
+    return result(-EEXIST);
+  }
+  parent->entries[name] = inode->ino;
+  dentries_.insert(std::make_pair(Dentry{parent->ino, name}, inode->ino));
+  inode->nlink++;
+  parent->mtime = parent->ctime = inode->ctime = now();
+  return 0;
+}
+
+int MemFsSyscallEngine::symlink(const char *target, const char *link_path) {
+  if (target == nullptr || target[0] == '\0') {
+    return result(target == nullptr ? -EFAULT : -ENOENT);
+  }
+  MemFsInodePtr parent;
+  std::string name;
+  int ret = lookup_parent(AT_FDCWD, link_path, -EEXIST, &parent, &name);
+  if (ret < 0) {
+    return result(ret);
+  }
+  MemFsInodePtr inode;
+  return result(create(parent, name, S_IFLNK | 0777, 0, target, &inode));
+}
+
+ssize_t MemFsSyscallEngine::readlink(const char *path, char *buf,
+                                     size_t size) {
+  if (size == 0) {
+    return result(-EINVAL);
+  }
+  MemFsInodePtr inode;
+  int ret = lookup(AT_FDCWD, path, false, &inode);
+  if (ret < 0) {
+    return result(ret);
+  }
+  if (!S_ISLNK(inode->type)) {
+    return result(-EINVAL);
+  }
+  // Unlike the kernel's, the result is not terminated
+  size_t length = std::min(size, inode->target.size());
+  std::memcpy(buf, inode->target.data(), length);
+  return length;
+}
+
+int MemFsSyscallEngine::rename(const char *old_path, const char *new_path) {
+  MemFsInodePtr old_parent, new_parent;
+  std::string old_name, new_name;
+  int ret = lookup_parent(AT_FDCWD, old_path, -EBUSY, &old_parent, &old_name);
+  if (ret < 0) {
+    return result(ret);
+  }
+  ret = lookup_parent(AT_FDCWD, new_path, -EBUSY, &new_parent, &new_name);
+  if (ret < 0) {
+    return result(ret);
+  }
+
+  while (true) {
+    MemFsInodePtr source = lookup_entry(old_parent->ino, old_name);
+    if (source == nullptr) {
+      return result(-ENOENT);
+    }
+    MemFsInodePtr target = lookup_entry(new_parent->ino, new_name);
+    bool moves_dir = S_ISDIR(source->type) && old_parent != new_parent;
+    std::unique_lock<std::mutex> rename_guard(rename_lock_, std::defer_lock);
+    if (moves_dir) {
+      rename_guard.lock();
+    }
+    InodeLocks locks =
+        lock_inodes({old_parent->ino, new_parent->ino, source->ino,
+                     target == nullptr ? source->ino : target->ino});
+    auto source_entry = old_parent->entries.find(old_name);
+    auto target_entry = new_parent->entries.find(new_name);
+    if (source_entry == old_parent->entries.end() ||
+        source_entry->second != source->ino ||
+        (target_entry == new_parent->entries.end()
+             ? target != nullptr
+             : target == nullptr || target_entry->second != target->ino)) {
+      // The entries changed before they were locked
+      continue;
+    }
+
+    if (target == source) {
+      return 0;
+    }
+    if (old_parent->nlink == 0 || new_parent->nlink == 0) {
+      return result(-ENOENT);
+    }
+    if (S_ISDIR(source->type)) {
+      if (target != nullptr && !S_ISDIR(target->type)) {
+        return result(-ENOTDIR);
+      }
+      if (target != nullptr && !target->entries.empty()) {
+        return result(-ENOTEMPTY);
+      }
+      /*
+       * A directory cannot move under itself. The parents of directories
+       * only change with rename_lock_ held, so they can be read here.
+       */
+      for (ino_t ino = new_parent->ino; moves_dir && ino != MEMFS_ROOT_INO;) {
+        if (ino == source->ino) {
+          return result(-EINVAL);
+        }
+        MemFsInodePtr dir = get_inode(ino);
+        if (dir == nullptr) {
+          break;
+        }
+        ino = dir->parent;
+      }
+    } else if (target != nullptr && S_ISDIR(target->type)) {
+      return result(-EISDIR);
+    }
+
+    if (target != nullptr) {
+      if (S_ISDIR(target->type)) {
+        new_parent->nlink--;
+        target->nlink = 1;
+      }
+      drop_link(target);
+    }
+    old_parent->entries.erase(source_entry);
+    dentries_.erase(Dentry{old_parent->ino, old_name});
+    new_parent->entries[new_name] = source->ino;
+    {
+      DentryTable::accessor dentry;
+      dentries_.insert(dentry, Dentry{new_parent->ino, new_name});
+      dentry->second = source->ino;
+    }
+    if (moves_dir) {
+      source->parent = new_parent->ino;
+      old_parent->nlink--;
+      new_parent->nlink++;
+    }
+    struct timespec current = now();
+    old_parent->mtime = old_parent->ctime = current;
+    new_parent->mtime = new_parent->ctime = current;
+    source->ctime = current;
+    return 0;
+  }
+}
+
+int MemFsSyscallEngine::unlink(const char *path) {
+  return unlinkat(AT_FDCWD, path, 0);
+}
+
+int MemFsSyscallEngine::unlinkat(int dirfd, const char *path, int flags) {
+  if ((flags & ~AT_REMOVEDIR) != 0) {
+    return result(-EINVAL);
+  }
+  bool directory = (flags & AT_REMOVEDIR) != 0;
+  MemFsInodePtr parent;
+  std::string name;
+  int ret = lookup_parent(dirfd, path, directory ? -EINVAL : -EISDIR, &parent,
+                          &name);
+  if (ret < 0) {
+    return result(ret);
+  }
+  return result(remove(parent, name, directory));
+}
+
+int MemFsSyscallEngine::utime(const char *path, const struct utimbuf *times) {
+  if (times == nullptr) {
+    return utimensat(AT_FDCWD, path, nullptr, 0);
+  }
+  struct timespec ts[2] = {{times->actime, 0}, {times->modtime, 0}};
+  return utimensat(AT_FDCWD, path, ts, 0);
+}
+
+int MemFsSyscallEngine::utimes(const char *path,
+                               const struct timeval times[2]) {
+  if (times == nullptr) {
+    return utimensat(AT_FDCWD, path, nullptr, 0);
+  }
+  struct timespec ts[2];
+  for (int i = 0; i < 2; i++) {
+    if (times[i].tv_usec < 0 || times[i].tv_usec >= 1000000) {
+      return result(-EINVAL);
+    }
+    ts[i].tv_sec = times[i].tv_sec;
+    ts[i].tv_nsec = times[i].tv_usec * 1000;
+  }
+  return utimensat(AT_FDCWD, path, ts, 0);
+}
+
+int MemFsSyscallEngine::utimensat(int dirfd, const char *path,
+                                  const struct timespec times[2], int flags) {
+  MemFsInodePtr inode;
+  if (path == nullptr) {
+    // The system call sets the times of dirfd itself
+    MemFsOpenFilePtr file = get_file(dirfd);
+    if (file == nullptr) {
+      return result(-EBADF);
+    }
+    if (file->inode == nullptr) {
+      return traced_result();
+    }
+    inode = file->inode;
+  } else {
+    int ret =
+        lookup(dirfd, path, (flags & AT_SYMLINK_NOFOLLOW) == 0, &inode);
+    if (ret < 0) {
+      return result(ret);
+    }
+  }
+  return result(set_times(inode, times));
+}
+
+int MemFsSyscallEngine::setxattr(const char *path, const char *name,
+                                 const void *value, size_t size, int flags) {
+  MemFsInodePtr inode;
+  int ret = lookup(AT_FDCWD, path, true, &inode);
+  if (ret < 0) {
+    return result(ret);
+  }
+  return result(set_xattr(inode, name, value, size, flags));
+}
+
+int MemFsSyscallEngine::lsetxattr(const char *path, const char *name,
+                                  const void *value, size_t size, int flags) {
+  MemFsInodePtr inode;
+  int ret = lookup(AT_FDCWD, path, false, &inode);
+  if (ret < 0) {
+    return result(ret);
+  }
+  return result(set_xattr(inode, name, value, size, flags));
+}
+
+int MemFsSyscallEngine::fsetxattr(int fd, const char *name, const void *value,
+                                  size_t size, int flags) {
+  MemFsOpenFilePtr file = get_file(fd);
+  if (file == nullptr) {
+    return result(-EBADF);
+  }
+  if (file->inode == nullptr) {
+    return traced_result();
+  }
+  return result(set_xattr(file->inode, name, value, size, flags));
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the MicroBenchmark header
+ * file
+ *
+ * Read MicroBenchmark.hpp for more information about this class.
+ */
+
+#include "MicroBenchmark.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+// Iterations of a run are never grown past this
+#define MAX_BENCHMARK_ITERATIONS 1000000000ULL
+
+BenchmarkState::BenchmarkState(int64_t arg, int thread_index, int threads,
+                               uint64_t iterations)
+    : arg_(arg),
+      thread_index_(thread_index),
+      threads_(threads),
+      iterations_(iterations),
+      remaining_(iterations),
+      elapsed_(0),
+      items_(0),
+      bytes_(0) {}
+
+void MicroBenchmarks::add(const std::string &name,
+                          std::function<void(BenchmarkState &)> function,
+                          int64_t arg, int threads) {
+  std::ostringstream full_name;
+  full_name << name;
+  if (arg >= 0) {
+    full_name << "/" << arg;
+  }
+  if (threads > 1) {
+    full_name << "/threads:" << threads;
+  }
+  benchmarks_.push_back({full_name.str(), function, arg, threads});
+}
+
+double MicroBenchmarks::run_once(const Benchmark &benchmark,
+                                 uint64_t iterations, uint64_t &items,
+                                 uint64_t &bytes) {
+  std::vector<BenchmarkState> states;
+  for (int i = 0; i < benchmark.threads; i++) {
+    states.push_back(
+        BenchmarkState(benchmark.arg, i, benchmark.threads, iterations));
+  }
+  if (benchmark.threads == 1) {
+    benchmark.function(states[0]);
+  } else {
+    std::vector<std::thread> threads;
+    for (auto &state : states) {
+      threads.emplace_back(benchmark.function, std::ref(state));
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  std::chrono::nanoseconds elapsed(0);
+  items = 0;
+  bytes = 0;
+  for (auto &state : states) {
+    elapsed += state.elapsed_;
+    items += state.items_;
+    bytes += state.bytes_;
+  }
+  return std::chrono::duration<double>(elapsed).count() / benchmark.threads;
+}
+
+int MicroBenchmarks::run(const std::string &filter, double min_time) {
+  int run = 0;
+  std::cout << std::left << std::setw(44) << "Benchmark" << std::right
+            << std::setw(14) << "Time" << std::setw(14) << "Iterations"
+            << "  Throughput" << std::endl;
+  for (auto &benchmark : benchmarks_) {
+    if (benchmark.name.find(filter) == std::string::npos) {
+      continue;
+    }
+    uint64_t iterations = 1;
+    uint64_t items;
+    uint64_t bytes;
+    double seconds;
+    while (true) {
+      seconds = run_once(benchmark, iterations, items, bytes);
+      if (seconds >= min_time || iterations >= MAX_BENCHMARK_ITERATIONS) {
+        break;
+      }
+      // Aim a little past min_time, growing at most tenfold per run
+      double growth = seconds > 0 ? min_time * 1.4 / seconds : 10;
+      growth = std::min(10.0, std::max(2.0, growth));
+      iterations = std::min<uint64_t>(MAX_BENCHMARK_ITERATIONS,
+                                      iterations * growth);
+    }
+
+    std::ostringstream time;
+    time << std::fixed << std::setprecision(1)
+         << seconds * 1e9 / iterations << " ns";
+    std::ostringstream throughput;
+    throughput << std::fixed << std::setprecision(1);
+    if (bytes != 0) {
+      throughput << bytes / seconds / (1 << 20) << " MiB/s";
+    } else if (items != 0) {
+      throughput << items / seconds / 1e6 << " M items/s";
+    }
+    std::cout << std::left << std::setw(44) << benchmark.name << std::right
+              << std::setw(14) << time.str() << std::setw(14) << iterations
+              << "  " << throughput.str() << std::endl;
+    run++;
+  }
+  return run;
+}
+
+void MicroBenchmarks::list() const {
+  for (auto &benchmark : benchmarks_) {
+    std::cout << benchmark.name << std::endl;
+  }
+}
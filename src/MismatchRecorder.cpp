@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the MismatchRecorder header
+ * file
+ *
+ * Read MismatchRecorder.hpp for more information about this class.
+ */
+
+#include "MismatchRecorder.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// Records per extent are limited to about this many bytes
+#define MISMATCH_EXTENT_SIZE (64 * 1024)
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+static const std::string mismatch_type_xml =
+    "<ExtentType name=\"" MISMATCH_EXTENT_TYPE
+    "\" version=\"1.0\" pack_null_compact=\"non_bool\">\n"
+    "  <field type=\"int64\" name=\"unique_id\" />\n"
+    "  <field type=\"int64\" name=\"time_called\" units=\"2^-32 seconds\" "
+    "epoch=\"unix\" />\n"
+    "  <field type=\"int32\" name=\"executing_pid\" />\n"
+    "  <field type=\"variable32\" name=\"syscall\" pack_unique=\"yes\" />\n"
+    "  <field type=\"byte\" name=\"kind\" comment=\"0 return value, "
+    "1 errno, 2 data\" />\n"
+    "  <field type=\"int64\" name=\"traced_return_value\" />\n"
+    "  <field type=\"int64\" name=\"replayed_return_value\" />\n"
+    "  <field type=\"int32\" name=\"traced_errno\" />\n"
+    "  <field type=\"int32\" name=\"replayed_errno\" />\n"
+    "  <field type=\"int64\" name=\"traced_digest\" opt_nullable=\"yes\" "
+    "comment=\"FNV-1a hash of the traced payload\" />\n"
+    "  <field type=\"int64\" name=\"replayed_digest\" opt_nullable=\"yes\" "
+    "comment=\"FNV-1a hash of the replayed payload\" />\n"
+    "  <field type=\"int64\" name=\"first_difference\" "
+    "opt_nullable=\"yes\" />\n"
+    "</ExtentType>\n";
+
+MismatchRecorder::MismatchRecorder(const std::string &filename)
+    : closed_(false),
+      sink_(filename),
+      type_(library_.registerTypePtr(mismatch_type_xml)),
+      series_(type_),
+      unique_id_(series_, "unique_id"),
+      time_called_(series_, "time_called"),
+      executing_pid_(series_, "executing_pid"),
+      syscall_(series_, "syscall"),
+      kind_(series_, "kind"),
+      traced_return_value_(series_, "traced_return_value"),
+      replayed_return_value_(series_, "replayed_return_value"),
+      traced_errno_(series_, "traced_errno"),
+      replayed_errno_(series_, "replayed_errno"),
+      traced_digest_(series_, "traced_digest", Field::flag_nullable),
+      replayed_digest_(series_, "replayed_digest", Field::flag_nullable),
+      first_difference_(series_, "first_difference", Field::flag_nullable) {
+  sink_.writeExtentLibrary(library_);
+  output_.reset(
+      new OutputModule(sink_, series_, type_, MISMATCH_EXTENT_SIZE));
+}
+
+void MismatchRecorder::record(const Mismatch &mismatch) {
+  std::lock_guard<std::mutex> lock(lock_);
+  if (closed_) {
+    return;
+  }
+  output_->newRecord();
+  unique_id_.set(mismatch.unique_id);
+  time_called_.set(mismatch.time_called);
+  executing_pid_.set(mismatch.executing_pid);
+  syscall_.set(mismatch.syscall);
+  kind_.set(mismatch.kind);
+  traced_return_value_.set(mismatch.traced_return_value);
+  replayed_return_value_.set(mismatch.replayed_return_value);
+  traced_errno_.set(mismatch.traced_errno);
+  replayed_errno_.set(mismatch.replayed_errno);
+  if (mismatch.has_payload) {
+    traced_digest_.set(mismatch.traced_digest);
+    replayed_digest_.set(mismatch.replayed_digest);
+    first_difference_.set(mismatch.first_difference);
+  } else {
+    traced_digest_.setNull();
+    replayed_digest_.setNull();
+    first_difference_.setNull();
+  }
+}
+
+void MismatchRecorder::close() {
+  std::lock_guard<std::mutex> lock(lock_);
+  if (closed_) {
+    return;
+  }
+  closed_ = true;
+  // Deleting the output module writes the last extent
+  output_.reset();
+  sink_.close();
+}
+
+uint64_t MismatchRecorder::digest(const void *data, size_t size) {
+  auto bytes = static_cast<const unsigned char *>(data);
+  uint64_t hash = FNV_OFFSET_BASIS;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+void MismatchRecorder::set_payload(Mismatch &mismatch,
+                                   const void *traced_data,
+                                   size_t traced_size,
+                                   const void *replayed_data,
+                                   size_t replayed_size) {
+  mismatch.has_payload = true;
+  mismatch.traced_digest = digest(traced_data, traced_size);
+  mismatch.replayed_digest = digest(replayed_data, replayed_size);
+
+  auto traced = static_cast<const char *>(traced_data);
+  auto replayed = static_cast<const char *>(replayed_data);
+  size_t size = std::min(traced_size, replayed_size);
+  auto difference = std::mismatch(traced, traced + size, replayed);
+  mismatch.first_difference =
+      difference.first != traced + size ? difference.first - traced : -1;
+}
+
+MismatchRecorder::~MismatchRecorder() { close(); }
@@ -0,0 +1,448 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * mismatch-report reads the mismatch records that system-call-replayer
+ * writes with --mismatch-log, and either prints every record (--dump) or
+ * counts them by system call, kind, errno numbers and path.
+ *
+ * The records do not carry paths, so that recording a mismatch stays
+ * cheap. When the traces that were replayed are given with --trace, the
+ * paths are looked up there by unique id. System calls on a descriptor
+ * get the path it was opened with, found by following the open, creat,
+ * close, dup and clone records of the trace. Descriptors the traced
+ * processes did not open themselves, like the standard ones, keep no
+ * path, and a cloned process is given a copy of the table of its parent
+ * even if it shared it.
+ *
+ * USAGE
+ * mismatch-report [--dump] [--trace trace.ds ...] mismatches.ds ...
+ */
+
+#include <DataSeries/ByteField.hpp>
+#include <DataSeries/Int32Field.hpp>
+#include <DataSeries/Int64Field.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+#include <DataSeries/Variable32Field.hpp>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include "MismatchRecorder.hpp"
+
+// Prefix of the extent types of the traced system calls
+#define TRACE_EXTENT_TYPE_PREFIX "IOTTAFSL::Trace::Syscall::"
+
+static const char *kind_names[] = {"retval", "errno", "data"};
+
+// <syscall, kind, traced errno, replayed errno, path>
+typedef std::tuple<std::string, int, int, int, std::string> SummaryKey;
+
+// How a traced record changes or reads the fd table of its process
+enum FdOp {
+  // fd was opened with path
+  FD_OPEN,
+  FD_CLOSE,
+  // new_fd was made a copy of fd
+  FD_DUP,
+  // Process new_fd was cloned from the process
+  FD_CLONE,
+  // The mismatch with the unique id was a system call on fd
+  FD_LOOKUP
+};
+
+struct FdEvent {
+  int64_t unique_id;
+  FdOp op;
+  int32_t pid;
+  int32_t fd;
+  int32_t new_fd;
+  std::string path;
+};
+
+/*
+ * Read every mismatch record in files, calling visit on each of them.
+ */
+template <typename Visitor>
+void read_mismatches(const std::vector<std::string> &files, Visitor visit) {
+  TypeIndexModule source(MISMATCH_EXTENT_TYPE);
+  for (auto &file : files) {
+    source.addSource(file);
+  }
+  ExtentSeries series;
+  Int64Field unique_id(series, "unique_id");
+  Int64Field time_called(series, "time_called");
+  Int32Field executing_pid(series, "executing_pid");
+  Variable32Field syscall(series, "syscall");
+  ByteField kind(series, "kind");
+  Int64Field traced_return_value(series, "traced_return_value");
+  Int64Field replayed_return_value(series, "replayed_return_value");
+  Int32Field traced_errno(series, "traced_errno");
+  Int32Field replayed_errno(series, "replayed_errno");
+  Int64Field traced_digest(series, "traced_digest", Field::flag_nullable);
+  Int64Field replayed_digest(series, "replayed_digest", Field::flag_nullable);
+  Int64Field first_difference(series, "first_difference",
+                              Field::flag_nullable);
+
+  Mismatch mismatch;
+  for (Extent::Ptr extent = source.getSharedExtent(); extent != nullptr;
+       extent = source.getSharedExtent()) {
+    for (series.setExtent(extent); series.morerecords(); ++series) {
+      mismatch.unique_id = unique_id.val();
+      mismatch.time_called = time_called.val();
+      mismatch.executing_pid = executing_pid.val();
+      mismatch.syscall = syscall.stringval();
+      mismatch.kind = static_cast<MismatchKind>(kind.val());
+      mismatch.traced_return_value = traced_return_value.val();
+      mismatch.replayed_return_value = replayed_return_value.val();
+      mismatch.traced_errno = traced_errno.val();
+      mismatch.replayed_errno = replayed_errno.val();
+      mismatch.has_payload = !traced_digest.isNull();
+      mismatch.traced_digest = traced_digest.val();
+      mismatch.replayed_digest = replayed_digest.val();
+      mismatch.first_difference = first_difference.val();
+      visit(mismatch);
+    }
+  }
+}
+
+/*
+ * Append an event of kind op for every successful record of the traced
+ * system call syscall to events. fd_column and new_fd_column name the
+ * fields of fd and new_fd, which are the return value if nullptr. Opens
+ * take the path from given_pathname.
+ */
+void read_fd_events(const std::vector<std::string> &trace_files,
+                    const std::string &syscall, FdOp op,
+                    const char *fd_column, const char *new_fd_column,
+                    std::vector<FdEvent> &events) {
+  TypeIndexModule source(TRACE_EXTENT_TYPE_PREFIX + syscall);
+  for (auto &file : trace_files) {
+    source.addSource(file);
+  }
+  ExtentSeries series;
+  Int64Field unique_id(series, "unique_id");
+  Int32Field executing_pid(series, "executing_pid");
+  Int64Field return_value(series, "return_value");
+  std::unique_ptr<Int32Field> fd;
+  std::unique_ptr<Int32Field> new_fd;
+  std::unique_ptr<Variable32Field> given_pathname;
+  if (fd_column != nullptr) {
+    fd.reset(new Int32Field(series, fd_column, Field::flag_nullable));
+  }
+  if (new_fd_column != nullptr) {
+    new_fd.reset(new Int32Field(series, new_fd_column, Field::flag_nullable));
+  }
+  if (op == FD_OPEN) {
+    given_pathname.reset(
+        new Variable32Field(series, "given_pathname", Field::flag_nullable));
+  }
+
+  FdEvent event;
+  event.op = op;
+  for (Extent::Ptr extent = source.getSharedExtent(); extent != nullptr;
+       extent = source.getSharedExtent()) {
+    for (series.setExtent(extent); series.morerecords(); ++series) {
+      // A clone returns 0 in the child, which has no record of its own
+      if (return_value.val() < 0 ||
+          (op == FD_CLONE && return_value.val() == 0)) {
+        continue;
+      }
+      if ((fd != nullptr && fd->isNull()) ||
+          (new_fd != nullptr && new_fd->isNull()) ||
+          (given_pathname != nullptr && given_pathname->isNull())) {
+        continue;
+      }
+      event.unique_id = unique_id.val();
+      event.pid = executing_pid.val();
+      event.fd = fd != nullptr ? fd->val() : return_value.val();
+      event.new_fd = new_fd != nullptr ? new_fd->val() : return_value.val();
+      if (given_pathname != nullptr) {
+        event.path = given_pathname->stringval();
+      }
+      events.push_back(event);
+    }
+  }
+}
+
+/*
+ * Follow the fd tables of the traced processes through events and set
+ * the path of every FD_LOOKUP whose descriptor was opened in the trace.
+ */
+void resolve_descriptors(std::vector<FdEvent> &events,
+                         std::unordered_map<int64_t, std::string> &paths) {
+  // Records of one call are applied in the order they were added
+  std::stable_sort(events.begin(), events.end(),
+                   [](const FdEvent &a, const FdEvent &b) {
+                     return a.unique_id < b.unique_id;
+                   });
+  std::unordered_map<int32_t, std::unordered_map<int32_t, std::string>>
+      tables;
+  for (auto &event : events) {
+    auto &table = tables[event.pid];
+    switch (event.op) {
+      case FD_OPEN:
+        table[event.fd] = event.path;
+        break;
+      case FD_CLOSE:
+        table.erase(event.fd);
+        break;
+      case FD_DUP: {
+        auto source = table.find(event.fd);
+        if (source != table.end()) {
+          table[event.new_fd] = source->second;
+        } else {
+          table.erase(event.new_fd);
+        }
+        break;
+      }
+      case FD_CLONE: {
+        // Copied first, as adding the child may rehash the tables
+        std::unordered_map<int32_t, std::string> parent = table;
+        tables[event.new_fd] = std::move(parent);
+        break;
+      }
+      case FD_LOOKUP: {
+        auto path = table.find(event.fd);
+        if (path != table.end()) {
+          paths[event.unique_id] = path->second;
+        }
+        break;
+      }
+    }
+  }
+}
+
+/*
+ * Find the traced paths of the records whose unique ids are in
+ * unique_ids, which maps each system call to the ids of its records.
+ * System calls with neither a given_pathname nor a descriptor field are
+ * skipped.
+ */
+std::unordered_map<int64_t, std::string> find_paths(
+    const std::vector<std::string> &trace_files,
+    const std::map<std::string, std::set<int64_t>> &unique_ids) {
+  std::unordered_map<int64_t, std::string> paths;
+  std::vector<FdEvent> lookups;
+  for (auto &syscall_ids : unique_ids) {
+    TypeIndexModule source(TRACE_EXTENT_TYPE_PREFIX + syscall_ids.first);
+    for (auto &file : trace_files) {
+      source.addSource(file);
+    }
+    Extent::Ptr extent = source.getSharedExtent();
+    if (extent == nullptr) {
+      continue;
+    }
+    bool by_path = extent->getTypePtr()->hasColumn("given_pathname");
+    if (!by_path && !extent->getTypePtr()->hasColumn("descriptor")) {
+      continue;
+    }
+
+    ExtentSeries series;
+    Int64Field unique_id(series, "unique_id");
+    Int32Field executing_pid(series, "executing_pid");
+    std::unique_ptr<Variable32Field> given_pathname;
+    std::unique_ptr<Int32Field> descriptor;
+    if (by_path) {
+      given_pathname.reset(
+          new Variable32Field(series, "given_pathname", Field::flag_nullable));
+    } else {
+      descriptor.reset(
+          new Int32Field(series, "descriptor", Field::flag_nullable));
+    }
+    FdEvent lookup;
+    lookup.op = FD_LOOKUP;
+    lookup.new_fd = -1;
+    for (; extent != nullptr; extent = source.getSharedExtent()) {
+      for (series.setExtent(extent); series.morerecords(); ++series) {
+        if (syscall_ids.second.count(unique_id.val()) == 0) {
+          continue;
+        }
+        if (by_path && !given_pathname->isNull()) {
+          paths[unique_id.val()] = given_pathname->stringval();
+        } else if (!by_path && !descriptor->isNull()) {
+          lookup.unique_id = unique_id.val();
+          lookup.pid = executing_pid.val();
+          lookup.fd = descriptor->val();
+          lookups.push_back(lookup);
+        }
+      }
+    }
+  }
+
+  if (!lookups.empty()) {
+    std::vector<FdEvent> events;
+    read_fd_events(trace_files, "open", FD_OPEN, nullptr, nullptr, events);
+    read_fd_events(trace_files, "openat", FD_OPEN, nullptr, nullptr, events);
+    read_fd_events(trace_files, "creat", FD_OPEN, nullptr, nullptr, events);
+    read_fd_events(trace_files, "close", FD_CLOSE, "descriptor", nullptr,
+                   events);
+    read_fd_events(trace_files, "dup", FD_DUP, "descriptor", nullptr, events);
+    read_fd_events(trace_files, "dup2", FD_DUP, "old_descriptor",
+                   "new_descriptor", events);
+    read_fd_events(trace_files, "dup3", FD_DUP, "old_descriptor",
+                   "new_descriptor", events);
+    read_fd_events(trace_files, "clone", FD_CLONE, nullptr, nullptr, events);
+    read_fd_events(trace_files, "vfork", FD_CLONE, nullptr, nullptr, events);
+    events.insert(events.end(), lookups.begin(), lookups.end());
+    resolve_descriptors(events, paths);
+  }
+  return paths;
+}
+
+void dump(const std::vector<std::string> &files) {
+  std::cout << "unique_id pid syscall kind traced_retval replayed_retval "
+            << "traced_errno replayed_errno traced_digest replayed_digest "
+            << "first_difference\n";
+  read_mismatches(files, [](const Mismatch &mismatch) {
+    std::cout << mismatch.unique_id << " " << mismatch.executing_pid << " "
+              << mismatch.syscall << " " << kind_names[mismatch.kind] << " "
+              << mismatch.traced_return_value << " "
+              << mismatch.replayed_return_value << " " << mismatch.traced_errno
+              << " " << mismatch.replayed_errno;
+    if (mismatch.has_payload) {
+      std::cout << " " << boost::format("%016x") % mismatch.traced_digest
+                << " " << boost::format("%016x") % mismatch.replayed_digest
+                << " " << mismatch.first_difference;
+    } else {
+      std::cout << " - - -";
+    }
+    std::cout << "\n";
+  });
+}
+
+void summarize(const std::vector<std::string> &files,
+               const std::vector<std::string> &trace_files) {
+  std::map<std::string, std::set<int64_t>> unique_ids;
+  std::vector<std::pair<int64_t, SummaryKey>> records;
+  read_mismatches(files, [&](const Mismatch &mismatch) {
+    records.emplace_back(
+        mismatch.unique_id,
+        SummaryKey(mismatch.syscall, mismatch.kind, mismatch.traced_errno,
+                   mismatch.replayed_errno, "-"));
+    if (!trace_files.empty()) {
+      unique_ids[mismatch.syscall].insert(mismatch.unique_id);
+    }
+  });
+
+  std::unordered_map<int64_t, std::string> paths =
+      find_paths(trace_files, unique_ids);
+  std::map<SummaryKey, uint64_t> counts;
+  std::map<std::string, uint64_t> syscall_counts;
+  for (auto &record : records) {
+    auto path = paths.find(record.first);
+    if (path != paths.end()) {
+      std::get<4>(record.second) = path->second;
+    }
+    counts[record.second]++;
+    syscall_counts[std::get<0>(record.second)]++;
+  }
+
+  std::cout << records.size() << " mismatches\n\n";
+  std::cout << boost::format("%12s  %s\n") % "count" % "syscall";
+  for (auto &syscall_count : syscall_counts) {
+    std::cout << boost::format("%12d  %s\n") % syscall_count.second %
+                     syscall_count.first;
+  }
+
+  std::vector<std::pair<uint64_t, SummaryKey>> sorted;
+  for (auto &count : counts) {
+    sorted.emplace_back(count.second, count.first);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const std::pair<uint64_t, SummaryKey> &a,
+               const std::pair<uint64_t, SummaryKey> &b) {
+              return a.first > b.first ||
+                     (a.first == b.first && a.second < b.second);
+            });
+
+  std::cout << "\n"
+            << boost::format("%12s  %-12s %-6s %12s %14s  %s\n") % "count" %
+                   "syscall" % "kind" % "traced_errno" % "replayed_errno" %
+                   "path";
+  for (auto &entry : sorted) {
+    const SummaryKey &key = entry.second;
+    std::cout << boost::format("%12d  %-12s %-6s %12d %14d  %s\n") %
+                     entry.first % std::get<0>(key) %
+                     kind_names[std::get<1>(key)] % std::get<2>(key) %
+                     std::get<3>(key) % std::get<4>(key);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  namespace po = boost::program_options;
+  po::options_description options("Options");
+  options.add_options()("help,h", "produce help message")(
+      "dump", "print every mismatch record instead of a summary")(
+      "trace", po::value<std::vector<std::string>>(),
+      "replayed DataSeries trace, to look up the paths of the mismatches")(
+      "input-files", po::value<std::vector<std::string>>(),
+      "mismatch files");
+  po::positional_options_description positional;
+  positional.add("input-files", -1);
+
+  po::variables_map options_vm;
+  try {
+    po::store(po::command_line_parser(argc, argv)
+                  .options(options)
+                  .positional(positional)
+                  .run(),
+              options_vm);
+    po::notify(options_vm);
+  } catch (po::error &e) {
+    std::cerr << e.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (options_vm.count("help") != 0u ||
+      options_vm.count("input-files") == 0u) {
+    std::cout << "Usage: mismatch-report [options] mismatches.ds ...\n"
+              << options << std::endl;
+    exit(options_vm.count("help") != 0u ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  std::vector<std::string> files =
+      options_vm["input-files"].as<std::vector<std::string>>();
+  std::vector<std::string> trace_files;
+  if (options_vm.count("trace") != 0u) {
+    trace_files = options_vm["trace"].as<std::vector<std::string>>();
+  }
+
+  if (options_vm.count("dump") != 0u) {
+    dump(files);
+  } else {
+    summarize(files, trace_files);
+  }
+  return EXIT_SUCCESS;
+}
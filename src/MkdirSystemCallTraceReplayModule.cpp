@@ -50,7 +50,7 @@ void MkdirSystemCallTraceReplayModule::print_specific_fields() {
 
 void MkdirSystemCallTraceReplayModule::processRow() {
   // Replay the mkdir system call
-  replayed_ret_val_ = mkdir(pathname, get_mode(modeVal));
+  replayed_ret_val_ = engine_->mkdir(pathname, get_mode(modeVal));
   delete[] pathname;
 }
 
@@ -96,5 +96,5 @@ void MkdiratSystemCallTraceReplayModule::processRow() {
     return;
   }
   // Replay the mkdirat system call
-  replayed_ret_val_ = mkdirat(dirfd, pathname, mode);
+  replayed_ret_val_ = engine_->mkdirat(dirfd, pathname, mode);
 }
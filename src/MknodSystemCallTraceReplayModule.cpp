@@ -77,5 +77,5 @@ void MknodSystemCallTraceReplayModule::processRow() {
   dev_t dev = dev_.val();
 
   // replay the mknod system call
-  replayed_ret_val_ = mknod(pathname, mode, dev);
+  replayed_ret_val_ = engine_->mknod(pathname, mode, dev);
 }
@@ -66,30 +66,40 @@ void MmapSystemCallTraceReplayModule::processRow() {
   void* replayed_addr;
   int64_t traced_addr = mmapReturnVal;
 
-  replayed_addr = mmap(reinterpret_cast<void*>(startAddress), sizeOfMap,
-                       protectionVal, flagsVal, fd, offsetVal);
+  replayed_addr = engine_->mmap(reinterpret_cast<void*>(startAddress),
+                                sizeOfMap, protectionVal, flagsVal, fd,
+                                offsetVal);
 
   int64_t replayed_addr_int = reinterpret_cast<int64_t>(replayed_addr);
-  if (startAddress != 0 && replayed_addr_int != traced_addr) return;
+  if (startAddress != 0 && replayed_addr_int != traced_addr) {
+    // The region is not tracked, so nothing would ever unmap it
+    if (replayed_addr != MAP_FAILED) {
+      munmap(replayed_addr, sizeOfMap);
+    }
+    return;
+  }
 
-  // add the traced mmap to vm manager
-  VM_area* area = VM_manager::getInstance()->get_VM_area(pid);
-  VM_node* node = new VM_node(reinterpret_cast<void*>(traced_addr),
-                              replayed_addr, sizeOfMap, descriptorVal, fd);
+  // add the traced mmap to vm manager, which unmaps it once unused
+  std::shared_ptr<ReplayedMapping> mapping;
+  if (replayed_addr != MAP_FAILED) {
+    mapping = std::make_shared<ReplayedMapping>(replayed_addr, sizeOfMap);
+  }
+  auto area = VM_manager::getInstance()->get_VM_area(pid);
+  area->insert_VM_node(VM_node(reinterpret_cast<void*>(traced_addr),
+                               replayed_addr, sizeOfMap, descriptorVal, fd,
+                               mapping));
+  LOGGER_INFO(syscall_logger_, "pid(", pid, "), traced_address(",
+              boost::format("%02x") % (uint64_t)traced_addr, "), ",
+              "replayed_address(", boost::format("%02x") % replayed_addr,
+              "), ", "length(", std::dec, sizeOfMap, "), ",
+              "protection_value(", protectionVal, "), ", "flags_value(",
+              flagsVal, "), ", "traced fd(", descriptorVal, "), ",
+              "replayed_fd fd(", fd, "), ", "offset(",
+              boost::format("%02x") % offsetVal, ")");
 
-  area->insert_VM_node(node);
-  syscall_logger_->log_info(
-      "pid(", pid,
-      "), "
-      "traced_address(",
-      boost::format("%02x") % (uint64_t)traced_addr, "), ", "replayed_address(",
-      boost::format("%02x") % replayed_addr, "), ", "length(", std::dec,
-      sizeOfMap, "), ", "protection_value(", protectionVal, "), ",
-      "flags_value(", flagsVal, "), ", "traced fd(", descriptorVal, "), ",
-      "replayed_fd fd(", fd, "), ", "offset(",
-      boost::format("%02x") % offsetVal, ")");
-
-  area->list();
+  if (LOGGER_ENABLED(syscall_logger_, LOG_DEBUG)) {
+    area->list();
+  }
 }
 
 void MmapSystemCallTraceReplayModule::prepareRow() {
@@ -40,8 +40,10 @@ static char path_print[256];
 // #define WEBSERVER_TESTING
 
 OpenSystemCallTraceReplayModule::OpenSystemCallTraceReplayModule(
-    DataSeriesModule &source, bool verbose_flag, int warn_level_flag)
+    DataSeriesModule &source, bool verbose_flag, int warn_level_flag,
+    bool direct_flag)
     : SystemCallTraceReplayModule(source, verbose_flag, warn_level_flag),
+      direct_(direct_flag),
       given_pathname_(series, "given_pathname", Field::flag_nullable),
       open_value_(series, "open_value", Field::flag_nullable),
       mode_value_(series, "mode_value", Field::flag_nullable) {
@@ -54,15 +56,37 @@ void OpenSystemCallTraceReplayModule::print_specific_fields() {
                             get_mode(modeVal), ")");
 }
 
+int OpenSystemCallTraceReplayModule::replay_open(int dirfd, const char *path,
+                                                 int traced_flags, mode_t mode,
+                                                 int &open_flags) {
+  open_flags = traced_flags;
+  if (direct_ && (traced_flags & (O_DIRECTORY | O_PATH)) == 0) {
+    open_flags |= O_DIRECT;
+  }
+  int fd = engine_->openat(dirfd, path, open_flags, mode);
+  if (fd == -1 && errno == EINVAL && open_flags != traced_flags) {
+    /*
+     * The file system does not support O_DIRECT. The file may have been
+     * created by the failed open, so a retry must not insist on O_EXCL.
+     */
+    open_flags = traced_flags & ~O_EXCL;
+    fd = engine_->openat(dirfd, path, open_flags, mode);
+    open_flags = traced_flags;
+  }
+  return fd;
+}
+
 void OpenSystemCallTraceReplayModule::processRow() {
+  int open_flags;
   // replay the open system call
-  replayed_ret_val_ = open(pathname, flags, get_mode(modeVal));
+  replayed_ret_val_ =
+      replay_open(AT_FDCWD, pathname, flags, get_mode(modeVal), open_flags);
   if (traced_fd <= -1 && replayed_ret_val_ != -1) {
     /*
      * Original system open failed, but replay system succeeds.
      * Therefore, we will close the replayed fd.
      */
-    close(replayed_ret_val_);
+    engine_->close(replayed_ret_val_);
   } else {
 #ifdef WEBSERVER_TESTING
     if (replayer_resources_manager_.has_fd(executingPidVal, traced_fd)) {
@@ -75,7 +99,7 @@ void OpenSystemCallTraceReplayModule::processRow() {
      * Add a mapping from fd in trace file to actual replayed fd
      */
     replayer_resources_manager_.add_fd(executingPidVal, traced_fd,
-                                       replayed_ret_val_, flags);
+                                       replayed_ret_val_, open_flags);
   }
   if (verbose_mode()) {
     strcpy(path_print, pathname);
@@ -93,8 +117,10 @@ void OpenSystemCallTraceReplayModule::prepareRow() {
 }
 
 OpenatSystemCallTraceReplayModule::OpenatSystemCallTraceReplayModule(
-    DataSeriesModule &source, bool verbose_flag, int warn_level_flag)
-    : OpenSystemCallTraceReplayModule(source, verbose_flag, warn_level_flag),
+    DataSeriesModule &source, bool verbose_flag, int warn_level_flag,
+    bool direct_flag)
+    : OpenSystemCallTraceReplayModule(source, verbose_flag, warn_level_flag,
+                                      direct_flag),
       descriptor_(series, "descriptor") {
   sys_call_name_ = "openat";
 }
@@ -128,14 +154,15 @@ void OpenatSystemCallTraceReplayModule::processRow() {
     return;
   }
 
+  int open_flags;
   // replay the openat system call
-  replayed_ret_val_ = openat(dirfd, pathname, flags, mode);
+  replayed_ret_val_ = replay_open(dirfd, pathname, flags, mode, open_flags);
   if (traced_fd == -1 && replayed_ret_val_ != -1) {
     /*
      * Original system open failed, but replay system succeeds.
      * Therefore, we will close the replayed fd.
      */
-    close(replayed_ret_val_);
+    engine_->close(replayed_ret_val_);
   } else {
     /*
      * Even if traced fd is valid, but replayed fd is -1,
@@ -143,6 +170,6 @@ void OpenatSystemCallTraceReplayModule::processRow() {
      * Add a mapping from fd in trace file to actual replayed fd
      */
     replayer_resources_manager_.add_fd(pid, traced_fd, replayed_ret_val_,
-                                       flags);
+                                       open_flags);
   }
 }
@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the PageCacheManager header
+ * file
+ *
+ * Read PageCacheManager.hpp for more information about this class.
+ */
+
+#include "PageCacheManager.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <climits>
+#include <memory>
+
+#include <DataSeries/ExtentSeries.hpp>
+#include <DataSeries/Int32Field.hpp>
+#include <DataSeries/Int64Field.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+#include <DataSeries/Variable32Field.hpp>
+
+/**
+ * Call function once for every record of the given system call in
+ * input_files, with series positioned on the record.
+ */
+template <typename Function>
+static void for_each_record(const std::string &system_call,
+                            const std::vector<std::string> &input_files,
+                            ExtentSeries &series, Function function) {
+  TypeIndexModule type_index_module("IOTTAFSL::Trace::Syscall::" +
+                                    system_call);
+  for (auto &input_file : input_files) {
+    type_index_module.addSource(input_file);
+  }
+  for (Extent::Ptr extent = type_index_module.getSharedExtent();
+       extent != nullptr; extent = type_index_module.getSharedExtent()) {
+    for (series.setExtent(extent); series.morerecords(); ++series) {
+      function();
+    }
+  }
+  series.clearExtent();
+}
+
+PageCacheManager::PageCacheManager(SystemCallTraceReplayLogger *logger)
+    : logger_(logger) {}
+
+int64_t PageCacheManager::intern(const std::string &path) {
+  auto found = path_ids_.find(path);
+  if (found != path_ids_.end()) {
+    return found->second;
+  }
+  int64_t id = paths_.size();
+  paths_.push_back(path);
+  read_ranges_.emplace_back();
+  path_ids_[path] = id;
+  return id;
+}
+
+std::vector<PageCacheManager::Event> PageCacheManager::load_events(
+    const std::vector<std::string> &input_files) {
+  std::vector<Event> events;
+
+  // open and openat
+  for (const char *system_call : {"open", "openat"}) {
+    bool has_dirfd = std::string(system_call) == "openat";
+    ExtentSeries series;
+    Int64Field unique_id(series, "unique_id");
+    Int32Field executing_pid(series, "executing_pid", Field::flag_nullable);
+    Int64Field return_value(series, "return_value", Field::flag_nullable);
+    Variable32Field given_pathname(series, "given_pathname",
+                                   Field::flag_nullable);
+    // Only openat records have a directory fd
+    std::unique_ptr<Int32Field> descriptor;
+    if (has_dirfd) {
+      descriptor.reset(new Int32Field(series, "descriptor"));
+    }
+    for_each_record(system_call, input_files, series, [&]() {
+      if (return_value.val() < 0 || given_pathname.isNull()) {
+        return;
+      }
+      Event event;
+      event.unique_id = unique_id.val();
+      event.type = OPEN;
+      event.pid = executing_pid.val();
+      event.fd = return_value.val();
+      event.dirfd = has_dirfd ? descriptor->val() : AT_FDCWD;
+      event.path = reinterpret_cast<const char *>(given_pathname.val());
+      events.push_back(event);
+    });
+  }
+
+  // read and pread
+  for (const char *system_call : {"read", "pread"}) {
+    bool has_offset = std::string(system_call) == "pread";
+    ExtentSeries series;
+    Int64Field unique_id(series, "unique_id");
+    Int32Field executing_pid(series, "executing_pid", Field::flag_nullable);
+    Int64Field return_value(series, "return_value", Field::flag_nullable);
+    Int32Field descriptor(series, "descriptor");
+    // Only pread records have an offset
+    std::unique_ptr<Int64Field> offset;
+    if (has_offset) {
+      offset.reset(new Int64Field(series, "offset"));
+    }
+    for_each_record(system_call, input_files, series, [&]() {
+      if (return_value.val() <= 0) {
+        return;
+      }
+      Event event;
+      event.unique_id = unique_id.val();
+      event.type = has_offset ? PREAD : READ;
+      event.pid = executing_pid.val();
+      event.fd = descriptor.val();
+      event.offset = has_offset ? offset->val() : 0;
+      event.length = return_value.val();
+      events.push_back(event);
+    });
+  }
+
+  // lseek and close
+  for (const char *system_call : {"lseek", "close"}) {
+    bool is_lseek = std::string(system_call) == "lseek";
+    ExtentSeries series;
+    Int64Field unique_id(series, "unique_id");
+    Int32Field executing_pid(series, "executing_pid", Field::flag_nullable);
+    Int64Field return_value(series, "return_value", Field::flag_nullable);
+    Int32Field descriptor(series, "descriptor");
+    for_each_record(system_call, input_files, series, [&]() {
+      if (return_value.val() < 0) {
+        return;
+      }
+      Event event;
+      event.unique_id = unique_id.val();
+      event.type = is_lseek ? LSEEK : CLOSE;
+      event.pid = executing_pid.val();
+      event.fd = descriptor.val();
+      // lseek returns the new file position
+      event.offset = return_value.val();
+      events.push_back(event);
+    });
+  }
+
+  std::sort(events.begin(), events.end(),
+            [](const Event &e1, const Event &e2) -> bool {
+              return e1.unique_id < e2.unique_id;
+            });
+  return events;
+}
+
+void PageCacheManager::scan(const std::vector<std::string> &input_files) {
+  std::vector<Event> events = load_events(input_files);
+
+  char cwd[PATH_MAX];
+  if (getcwd(cwd, sizeof(cwd)) == nullptr) {
+    cwd[0] = '\0';
+  }
+
+  std::unordered_map<pid_t, FdTable> fd_tables;
+  /*
+   * Threads share the descriptors of their process, but the trace does not
+   * say which processes share a table. A descriptor a process never opened
+   * is looked up among the descriptors most recently opened by any process.
+   */
+  FdTable recent;
+  auto lookup = [&](pid_t pid, int fd) -> OpenFile * {
+    FdTable &table = fd_tables[pid];
+    auto file = table.find(fd);
+    if (file != table.end()) {
+      return &file->second;
+    }
+    file = recent.find(fd);
+    return file == recent.end() ? nullptr : &file->second;
+  };
+
+  uint64_t bytes_read = 0;
+  for (auto &event : events) {
+    switch (event.type) {
+      case OPEN: {
+        std::string path = event.path;
+        if (path.empty() || path[0] != '/') {
+          // Relative paths are resolved against the directory fd or cwd.
+          OpenFile *dir = nullptr;
+          if (event.dirfd != AT_FDCWD) {
+            dir = lookup(event.pid, event.dirfd);
+          }
+          path = (dir != nullptr ? paths_[dir->path] : std::string(cwd)) +
+                 "/" + path;
+        }
+        OpenFile file = {intern(path), 0};
+        fd_tables[event.pid][event.fd] = file;
+        recent[event.fd] = file;
+        break;
+      }
+      case READ:
+      case PREAD: {
+        OpenFile *file = lookup(event.pid, event.fd);
+        if (file == nullptr) {
+          break;
+        }
+        int64_t offset = event.type == READ ? file->position : event.offset;
+        read_ranges_[file->path].emplace_back(offset, offset + event.length);
+        if (event.type == READ) {
+          file->position += event.length;
+        }
+        bytes_read += event.length;
+        break;
+      }
+      case LSEEK: {
+        OpenFile *file = lookup(event.pid, event.fd);
+        if (file != nullptr) {
+          file->position = event.offset;
+        }
+        break;
+      }
+      case CLOSE:
+        fd_tables[event.pid].erase(event.fd);
+        break;
+    }
+  }
+
+  logger_->log_info("Page cache working set: ", paths_.size(),
+                    " files opened, ", bytes_read, " bytes read");
+}
+
+void PageCacheManager::merge_ranges(RangeList &ranges) {
+  std::sort(ranges.begin(), ranges.end());
+  size_t merged = 0;
+  for (size_t i = 1; i < ranges.size(); i++) {
+    if (ranges[i].first <= ranges[merged].second) {
+      ranges[merged].second = std::max(ranges[merged].second, ranges[i].second);
+    } else {
+      ranges[++merged] = ranges[i];
+    }
+  }
+  if (!ranges.empty()) {
+    ranges.resize(merged + 1);
+  }
+}
+
+void PageCacheManager::drop() {
+  size_t dropped = 0;
+  for (auto &path : paths_) {
+    // O_NONBLOCK keeps FIFOs in the working set from blocking the open.
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+    if (fd < 0) {
+      // The file is created by the trace and does not exist yet.
+      continue;
+    }
+    // Dirty pages are only evicted once they have been written back.
+    fdatasync(fd);
+    if (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0) {
+      dropped++;
+    }
+    close(fd);
+  }
+  logger_->log_info("Dropped ", dropped, " of ", paths_.size(),
+                    " files from the page cache");
+}
+
+void PageCacheManager::warm() {
+  std::vector<char> buffer(PAGE_CACHE_WARM_BUFFER_SIZE);
+  uint64_t warmed = 0;
+  for (size_t id = 0; id < paths_.size(); id++) {
+    RangeList &ranges = read_ranges_[id];
+    if (ranges.empty()) {
+      continue;
+    }
+    merge_ranges(ranges);
+    int fd = open(paths_[id].c_str(), O_RDONLY | O_NONBLOCK);
+    if (fd < 0) {
+      continue;
+    }
+    for (auto &range : ranges) {
+      posix_fadvise(fd, range.first, range.second - range.first,
+                    POSIX_FADV_WILLNEED);
+      int64_t offset = range.first;
+      while (offset < range.second) {
+        size_t length = std::min(static_cast<int64_t>(buffer.size()),
+                                 range.second - offset);
+        ssize_t ret = pread(fd, buffer.data(), length, offset);
+        if (ret <= 0) {
+          break;
+        }
+        offset += ret;
+        warmed += ret;
+      }
+    }
+    close(fd);
+  }
+  logger_->log_info("Read ", warmed, " bytes of the working set into the ",
+                    "page cache");
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the PatternGenerator header
+ * file
+ *
+ * Read PatternGenerator.hpp for more information about this class.
+ */
+
+#include "PatternGenerator.hpp"
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define PATTERN_GENERATOR_AVX2
+#endif
+
+// Philox4x32 multipliers and Weyl sequence key increments
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+PatternGenerator::PatternGenerator(uint64_t seed) : seed_(seed) {
+#ifdef PATTERN_GENERATOR_AVX2
+  use_avx2_ = __builtin_cpu_supports("avx2");
+#else
+  use_avx2_ = false;
+#endif
+}
+
+void PatternGenerator::set_seed(uint64_t seed) { seed_ = seed; }
+
+uint64_t PatternGenerator::seed() const { return seed_; }
+
+void PatternGenerator::generate_block(uint64_t stream, uint64_t block,
+                                      uint32_t out[4]) const {
+  uint32_t x0 = block, x1 = block >> 32;
+  uint32_t x2 = stream, x3 = stream >> 32;
+  uint32_t k0 = seed_, k1 = seed_ >> 32;
+  for (int round = 0; round < PHILOX_ROUNDS; round++) {
+    uint64_t p0 = static_cast<uint64_t>(PHILOX_M0) * x0;
+    uint64_t p1 = static_cast<uint64_t>(PHILOX_M1) * x2;
+    x0 = (p1 >> 32) ^ x1 ^ k0;
+    x1 = p1;
+    x2 = (p0 >> 32) ^ x3 ^ k1;
+    x3 = p0;
+    k0 += PHILOX_W0;
+    k1 += PHILOX_W1;
+  }
+  out[0] = x0;
+  out[1] = x1;
+  out[2] = x2;
+  out[3] = x3;
+}
+
+#ifdef PATTERN_GENERATOR_AVX2
+/**
+ * Multiply the eight 32-bit lanes of x by m, returning the low and high
+ * halves of the 64-bit products.
+ */
+__attribute__((target("avx2"))) static inline void mulhilo_avx2(
+    __m256i x, __m256i m, __m256i *lo, __m256i *hi) {
+  __m256i even = _mm256_mul_epu32(x, m);
+  __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), m);
+  *lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+  *hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+__attribute__((target("avx2"))) void PatternGenerator::generate_blocks_avx2(
+    char *buffer, uint64_t stream, uint64_t first, size_t nblocks) const {
+  const __m256i m0 = _mm256_set1_epi32(PHILOX_M0);
+  const __m256i m1 = _mm256_set1_epi32(PHILOX_M1);
+  const __m256i x2_init = _mm256_set1_epi32(static_cast<uint32_t>(stream));
+  const __m256i x3_init = _mm256_set1_epi32(static_cast<uint32_t>(stream >> 32));
+  alignas(32) uint32_t lo_words[8], hi_words[8];
+
+  for (size_t done = 0; done + 8 <= nblocks; done += 8) {
+    // Each lane holds the counter of one of the next eight blocks.
+    for (int lane = 0; lane < 8; lane++) {
+      uint64_t block = first + done + lane;
+      lo_words[lane] = block;
+      hi_words[lane] = block >> 32;
+    }
+    __m256i x0 = _mm256_load_si256(reinterpret_cast<__m256i *>(lo_words));
+    __m256i x1 = _mm256_load_si256(reinterpret_cast<__m256i *>(hi_words));
+    __m256i x2 = x2_init;
+    __m256i x3 = x3_init;
+    uint32_t k0 = seed_, k1 = seed_ >> 32;
+    for (int round = 0; round < PHILOX_ROUNDS; round++) {
+      __m256i lo0, hi0, lo1, hi1;
+      mulhilo_avx2(x0, m0, &lo0, &hi0);
+      mulhilo_avx2(x2, m1, &lo1, &hi1);
+      x0 = _mm256_xor_si256(_mm256_xor_si256(hi1, x1), _mm256_set1_epi32(k0));
+      x1 = lo1;
+      x2 = _mm256_xor_si256(_mm256_xor_si256(hi0, x3), _mm256_set1_epi32(k1));
+      x3 = lo0;
+      k0 += PHILOX_W0;
+      k1 += PHILOX_W1;
+    }
+
+    // Transpose the lanes so that every block is stored contiguously.
+    __m256i t0 = _mm256_unpacklo_epi32(x0, x1);
+    __m256i t1 = _mm256_unpackhi_epi32(x0, x1);
+    __m256i t2 = _mm256_unpacklo_epi32(x2, x3);
+    __m256i t3 = _mm256_unpackhi_epi32(x2, x3);
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i *out = reinterpret_cast<__m256i *>(
+        buffer + done * PATTERN_BLOCK_SIZE);
+    _mm256_storeu_si256(out, _mm256_permute2x128_si256(u0, u1, 0x20));
+    _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(u2, u3, 0x20));
+    _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(u0, u1, 0x31));
+    _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(u2, u3, 0x31));
+  }
+}
+#else
+void PatternGenerator::generate_blocks_avx2(char *buffer, uint64_t stream,
+                                            uint64_t first,
+                                            size_t nblocks) const {}
+#endif
+
+void PatternGenerator::fill(char *buffer, size_t nbytes, uint64_t stream,
+                            uint64_t offset) const {
+  uint32_t words[4];
+  uint64_t block = offset / PATTERN_BLOCK_SIZE;
+
+  // Finish the block that offset falls in.
+  size_t skip = offset % PATTERN_BLOCK_SIZE;
+  if (skip != 0 && nbytes > 0) {
+    generate_block(stream, block++, words);
+    size_t length = PATTERN_BLOCK_SIZE - skip;
+    if (length > nbytes) {
+      length = nbytes;
+    }
+    memcpy(buffer, reinterpret_cast<char *>(words) + skip, length);
+    buffer += length;
+    nbytes -= length;
+  }
+
+  size_t nblocks = nbytes / PATTERN_BLOCK_SIZE;
+  size_t done = 0;
+  if (use_avx2_) {
+    done = nblocks & ~static_cast<size_t>(7);
+    generate_blocks_avx2(buffer, stream, block, done);
+  }
+  for (; done < nblocks; done++) {
+    generate_block(stream, block + done, words);
+    memcpy(buffer + done * PATTERN_BLOCK_SIZE, words, PATTERN_BLOCK_SIZE);
+  }
+
+  size_t tail = nbytes % PATTERN_BLOCK_SIZE;
+  if (tail != 0) {
+    generate_block(stream, block + nblocks, words);
+    memcpy(buffer + nblocks * PATTERN_BLOCK_SIZE, words, tail);
+  }
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the PayloadBlockPool header
+ * file
+ *
+ * Read PayloadBlockPool.hpp for more information about this class.
+ */
+
+#include "PayloadBlockPool.hpp"
+#include <string.h>
+#include <cstdlib>
+#include <sstream>
+
+/**
+ * SplitMix64 finalizer, used to pick a pool block for every payload block.
+ */
+static inline uint64_t mix64(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+PayloadBlockPool::PayloadBlockPool()
+    : compress_(1.0),
+      dedup_(0.0),
+      block_size_(PAYLOAD_DEFAULT_BLOCK_SIZE),
+      seed_(0),
+      pool_(nullptr) {}
+
+PayloadBlockPool::~PayloadBlockPool() { delete[] pool_; }
+
+size_t PayloadBlockPool::parse_size(const std::string &size) {
+  char *end;
+  unsigned long long value = strtoull(size.c_str(), &end, 10);
+  if (end == size.c_str()) {
+    return 0;
+  }
+  std::string suffix(end);
+  if (suffix == "k" || suffix == "K") {
+    value *= 1024;
+  } else if (suffix == "m" || suffix == "M") {
+    value *= 1024 * 1024;
+  } else if (!suffix.empty()) {
+    return 0;
+  }
+  return value;
+}
+
+bool PayloadBlockPool::configure(const std::string &spec) {
+  std::stringstream settings(spec);
+  std::string setting;
+  while (std::getline(settings, setting, ',')) {
+    size_t equals = setting.find('=');
+    if (equals == std::string::npos) {
+      return false;
+    }
+    std::string key = setting.substr(0, equals);
+    std::string value = setting.substr(equals + 1);
+    char *end;
+    if (key == "compress") {
+      compress_ = strtod(value.c_str(), &end);
+      if (*end != '\0' || value.empty() || compress_ < 1.0) {
+        return false;
+      }
+    } else if (key == "dedup") {
+      dedup_ = strtod(value.c_str(), &end);
+      if (*end != '\0' || value.empty() || dedup_ < 0.0 || dedup_ > 1.0) {
+        return false;
+      }
+    } else if (key == "block") {
+      block_size_ = parse_size(value);
+      if (block_size_ < PAYLOAD_TAG_SIZE ||
+          block_size_ > PAYLOAD_MAX_BLOCK_SIZE) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+void PayloadBlockPool::build(uint64_t seed) {
+  seed_ = seed;
+  generator_.set_seed(seed);
+  delete[] pool_;
+  pool_ = new char[PAYLOAD_POOL_BLOCKS * block_size_];
+
+  // The random part never shrinks below the tag of a unique block.
+  size_t random_bytes = block_size_ / compress_;
+  if (random_bytes < PAYLOAD_TAG_SIZE) {
+    random_bytes = PAYLOAD_TAG_SIZE;
+  }
+  for (uint64_t block = 0; block < PAYLOAD_POOL_BLOCKS; block++) {
+    char *data = pool_ + block * block_size_;
+    // Pool blocks use streams that unique ids of records never reach.
+    generator_.fill(data, random_bytes, UINT64_MAX - block);
+    memset(data + random_bytes, 0, block_size_ - random_bytes);
+  }
+}
+
+void PayloadBlockPool::copy_block(char *buffer, uint64_t stream,
+                                  uint64_t block, size_t skip,
+                                  size_t length) const {
+  uint64_t choice = mix64(seed_ ^ mix64(stream) ^ block);
+  // The top 53 bits give a uniform number in [0, 1).
+  double draw = (choice >> 11) * (1.0 / 9007199254740992.0);
+  if (draw < dedup_) {
+    // A duplicate block, shared by every payload that picks it
+    memcpy(buffer, pool_ + (choice % PAYLOAD_DEDUP_BLOCKS) * block_size_ + skip,
+           length);
+    return;
+  }
+  const char *data = pool_ + (choice % PAYLOAD_POOL_BLOCKS) * block_size_;
+  if (skip < PAYLOAD_TAG_SIZE) {
+    // Stamp the block with a tag that only this position of stream has.
+    char tag[PAYLOAD_TAG_SIZE];
+    generator_.fill(tag, PAYLOAD_TAG_SIZE, stream, block * PAYLOAD_TAG_SIZE);
+    size_t tag_length = PAYLOAD_TAG_SIZE - skip;
+    if (tag_length > length) {
+      tag_length = length;
+    }
+    memcpy(buffer, tag + skip, tag_length);
+    memcpy(buffer + tag_length, data + skip + tag_length,
+           length - tag_length);
+  } else {
+    memcpy(buffer, data + skip, length);
+  }
+}
+
+void PayloadBlockPool::fill(char *buffer, size_t nbytes, uint64_t stream,
+                            uint64_t offset) const {
+  uint64_t block = offset / block_size_;
+  size_t skip = offset % block_size_;
+  while (nbytes > 0) {
+    size_t length = block_size_ - skip;
+    if (length > nbytes) {
+      length = nbytes;
+    }
+    copy_block(buffer, stream, block++, skip, length);
+    buffer += length;
+    nbytes -= length;
+    skip = 0;
+  }
+}
@@ -50,7 +50,8 @@ void PipeSystemCallTraceReplayModule::print_specific_fields() {
 }
 
 void PipeSystemCallTraceReplayModule::processRow() {
-  int pipefd[2];
+  // Engines that do not create fds, like null, keep the traced ones
+  int pipefd[2] = {read_fd, write_fd};
 
   // replay the pipe system call
   if ((read_fd == 0) && (write_fd == 0)) {
@@ -59,12 +60,13 @@ void PipeSystemCallTraceReplayModule::processRow() {
       syscall_logger_->log_info(
           "Pipe was passed NULL instead of an integer array.");
     }
-    replayed_ret_val_ = pipe(nullptr);
+    replayed_ret_val_ = engine_->pipe(nullptr);
   } else {
-    replayed_ret_val_ = pipe(pipefd);
+    replayed_ret_val_ = engine_->pipe(pipefd);
   }
 
   if (verify_) {
+    ProfileScope scope(profiler_, PROFILE_VERIFY);
     /*
      * Verify that the file descriptors returned by pipe are the same as
      * in the trace.
@@ -79,7 +81,7 @@ void PipeSystemCallTraceReplayModule::processRow() {
                                   ", Replayed write descriptor: ", pipefd[1]);
       }
       if (abort_mode()) {
-        abort();
+        abort_replay();
       }
     }
   }
@@ -33,6 +33,7 @@
  */
 
 #include "ReadSystemCallTraceReplayModule.hpp"
+#include "AsyncIOEngine.hpp"
 #include "VirtualAddressSpace.hpp"
 
 ReadSystemCallTraceReplayModule::ReadSystemCallTraceReplayModule(
@@ -42,7 +43,8 @@ ReadSystemCallTraceReplayModule::ReadSystemCallTraceReplayModule(
       verify_(verify_flag),
       descriptor_(series, "descriptor"),
       data_read_(series, "data_read", Field::flag_nullable),
-      bytes_requested_(series, "bytes_requested") {
+      bytes_requested_(series, "bytes_requested"),
+      aligned_buffer_(false) {
   sys_call_name_ = "read";
 }
 
@@ -57,6 +59,7 @@ void ReadSystemCallTraceReplayModule::print_specific_fields() {
 
 void ReadSystemCallTraceReplayModule::verifyRow() {
   if (verify_) {
+    ProfileScope scope(profiler_, PROFILE_VERIFY);
     if (dataReadBuf == nullptr) {
       if (replayed_ret_val_ == return_value()) {
         syscall_logger_->log_info(
@@ -70,15 +73,21 @@ void ReadSystemCallTraceReplayModule::verifyRow() {
       // Data aren't same
       syscall_logger_->log_info("Verification of data in read failed. retval:",
                                 replayed_ret_val_);
+      record_mismatch(MISMATCH_DATA, 0, dataReadBuf, replayed_ret_val_, buffer,
+                      replayed_ret_val_);
       if (verbose_mode()) {
         syscall_logger_->log_info(
             "time called:",
             boost::format(DEC_PRECISION) % Tfrac_to_sec(time_called()),
             " Captured read data is different from replayed read data");
-        syscall_logger_->log_info("Captured read data: ", dataReadBuf, ", ",
-                                  "Replayed read data: ", std::string(buffer));
+        // The mismatch record has digests of the data instead
+        if (mismatch_recorder_ == nullptr) {
+          syscall_logger_->log_info(
+              "Captured read data: ", dataReadBuf, ", ",
+              "Replayed read data: ", std::string(buffer));
+        }
         if (abort_mode()) {
-          abort();
+          abort_replay();
         }
       }
     } else {
@@ -90,7 +99,54 @@ void ReadSystemCallTraceReplayModule::verifyRow() {
     delete[] dataReadBuf;
   }
 
+  release_buffer();
+}
+
+void ReadSystemCallTraceReplayModule::use_aligned_buffer() {
+  if (aligned_buffer_) {
+    return;
+  }
+  char *aligned = aligned_buffer_pool_.get(nbytes);
+  if (aligned == nullptr) {
+    syscall_logger_->log_warn("Unable to allocate an aligned buffer of ",
+                              nbytes, " bytes for ", sys_call_name_);
+    return;
+  }
   delete[] buffer;
+  buffer = aligned;
+  aligned_buffer_ = true;
+}
+
+void ReadSystemCallTraceReplayModule::release_buffer() {
+  if (aligned_buffer_) {
+    aligned_buffer_pool_.put(buffer, nbytes);
+    aligned_buffer_ = false;
+  } else {
+    delete[] buffer;
+  }
+  buffer = nullptr;
+}
+
+bool ReadSystemCallTraceReplayModule::submit_direct_io(int fd, off_t offset) {
+  use_aligned_buffer();
+  if (aio_engine_ == nullptr || !aligned_buffer_) {
+    return false;
+  }
+
+  // The engine turns down unaligned requests, which go through a bounce
+  // buffer synchronously.
+  async_pending_ = true;
+  if (!aio_engine_->submit_read(executingPidVal, this, fd, buffer, nbytes,
+                                offset)) {
+    async_pending_ = false;
+  }
+  return async_pending_;
+}
+
+void ReadSystemCallTraceReplayModule::complete_async_io(int64_t result) {
+  set_async_result(result);
+  verifyRow();
+  completeProcessing();
 }
 
 void ReadSystemCallTraceReplayModule::processRow() {
@@ -104,8 +160,17 @@ void ReadSystemCallTraceReplayModule::processRow() {
      */
     return;
   }
-  // Replay read system call as normal.
-  replayed_ret_val_ = read(replayed_fd, buffer, nbytes);
+  if (is_direct_io(executingPidVal, traced_fd)) {
+    if (submit_direct_io(replayed_fd, -1)) {
+      // Verification happens once the request completes.
+      return;
+    }
+    replayed_ret_val_ =
+        aligned_buffer_pool_.direct_read(replayed_fd, buffer, nbytes);
+  } else {
+    // Replay read system call as normal.
+    replayed_ret_val_ = engine_->read(replayed_fd, buffer, nbytes);
+  }
 
   verifyRow();
 }
@@ -117,7 +182,8 @@ void ReadSystemCallTraceReplayModule::prepareRow() {
   buffer = new char[nbytes];
 
   if (verify_) {
-    if (replayed_ret_val_ > 0) {
+    // Data that was not captured is not verified
+    if (replayed_ret_val_ > 0 && !data_read_.isNull()) {
       auto dataBuf = reinterpret_cast<const char *>(data_read_.val());
       dataReadBuf = new char[replayed_ret_val_];
       std::memcpy(dataReadBuf, dataBuf, replayed_ret_val_);
@@ -161,7 +227,16 @@ void PReadSystemCallTraceReplayModule::processRow() {
     return;
   }
 
-  replayed_ret_val_ = pread(fd, buffer, nbytes, off);
+  if (is_direct_io(pid, traced_fd)) {
+    if (submit_direct_io(fd, off)) {
+      // Verification happens once the request completes.
+      return;
+    }
+    replayed_ret_val_ =
+        aligned_buffer_pool_.direct_pread(fd, buffer, nbytes, off);
+  } else {
+    replayed_ret_val_ = engine_->pread(fd, buffer, nbytes, off);
+  }
 
   verifyRow();
 }
@@ -210,25 +285,42 @@ void MmapPReadSystemCallTraceReplayModule::processRow() {
     return;
   }
 
-  auto areas = VM_manager::getInstance()->get_VM_area(pid)->find_VM_node(
-      reinterpret_cast<void *>(ptr), 8);
-
-  for (auto vnode : *areas) {
-    if (vnode == NULL) continue;
+  /*
+   * Work on a copy of the region, so that the copy and the verification
+   * happen once and without holding the lock of the address space. Its
+   * memory is read through the mapping, which cannot be unmapped
+   * meanwhile.
+   */
+  VM_node vnode(nullptr, nullptr, 0, -1, -1);
+  uint64_t probe;
+  bool mapped = VM_manager::getInstance()->get_VM_area(pid)->get_VM_node(
+                    reinterpret_cast<void *>(ptr), 8, &vnode) &&
+                vnode.mapping != nullptr;
+  if (mapped) {
     auto offset_ptr =
-        ptr - reinterpret_cast<uint64_t>(vnode->traced_start_address);
-    syscall_logger_->log_info(
-        "trace start addr (",
-        boost::format("0x%02x") % vnode->traced_start_address, ") ptr (",
-        boost::format("0x%02x") % ptr, ") offset_ptr(", offset_ptr, ")");
+        ptr - reinterpret_cast<uint64_t>(vnode.traced_start_address);
+    LOGGER_DEBUG(syscall_logger_, "trace start addr (",
+                 boost::format("0x%02x") % vnode.traced_start_address,
+                 ") ptr (", boost::format("0x%02x") % ptr, ") offset_ptr(",
+                 offset_ptr, ")");
     auto replayed_ptr =
-        reinterpret_cast<uint64_t>(vnode->replayed_start_address) + offset_ptr;
-    auto read_ptr = reinterpret_cast<uint64_t *>(replayed_ptr);
-    __attribute__((unused)) auto test = *read_ptr;
+        reinterpret_cast<uint64_t>(vnode.replayed_start_address) + offset_ptr;
     auto verify_ptr =
-        reinterpret_cast<uint64_t>(vnode->replayed_start_address) + off;
-    std::memcpy(buffer, reinterpret_cast<void *>(verify_ptr),
-                replayed_ret_val_);
+        reinterpret_cast<uint64_t>(vnode.replayed_start_address) + off;
+    mapped = vnode.mapping->read(reinterpret_cast<void *>(replayed_ptr),
+                                 sizeof(probe), &probe) &&
+             vnode.mapping->read(reinterpret_cast<void *>(verify_ptr),
+                                 replayed_ret_val_, buffer);
+  }
+  if (!mapped) {
+    syscall_logger_->log_warn("No mapped region at address (",
+                              boost::format("0x%02x") % ptr, ") for ",
+                              sys_call_name_);
+    replayed_ret_val_ = -1;
     verifyRow();
+    // As for an access outside of every mapping
+    errno = EFAULT;
+    return;
   }
+  verifyRow();
 }
@@ -66,7 +66,7 @@ void ReadaheadSystemCallTraceReplayModule::processRow() {
     return;
   }
 
-  replayed_ret_val_ = readahead(fd, offset, size);
+  replayed_ret_val_ = engine_->readahead(fd, offset, size);
 }
 
 void ReadaheadSystemCallTraceReplayModule::prepareRow() {
@@ -52,9 +52,10 @@ void ReadlinkSystemCallTraceReplayModule::print_specific_fields() {
 
 void ReadlinkSystemCallTraceReplayModule::processRow() {
   // replay the readlink system call
-  replayed_ret_val_ = readlink(pathname, buffer, nbytes);
+  replayed_ret_val_ = engine_->readlink(pathname, buffer, nbytes);
 
   if (verify_) {
+    ProfileScope scope(profiler_, PROFILE_VERIFY);
     // Verify readlink buffer and buffer in the trace file are same
     if (dataReadBuf != nullptr && memcmp(dataReadBuf, buffer, returnVal) != 0) {
       // Target path aren't same
@@ -68,7 +69,7 @@ void ReadlinkSystemCallTraceReplayModule::processRow() {
         syscall_logger_->log_warn("Captured readlink path: ", dataReadBuf, ", ",
                                   "Replayed readlink path: ", buffer);
         if (abort_mode()) {
-          abort();
+          abort_replay();
         }
       }
     } else {
@@ -33,6 +33,7 @@
  */
 
 #include "ReadvSystemCallTraceReplayModule.hpp"
+#include <algorithm>
 
 ReadvSystemCallTraceReplayModule::ReadvSystemCallTraceReplayModule(
     DataSeriesModule &source, bool verbose_flag, bool verify_flag,
@@ -43,50 +44,101 @@ ReadvSystemCallTraceReplayModule::ReadvSystemCallTraceReplayModule(
       count_(series, "count", Field::flag_nullable),
       iov_number_(series, "iov_number"),
       data_read_(series, "iov_data_read", Field::flag_nullable),
-      bytes_requested_(series, "bytes_requested") {
+      bytes_requested_(series, "bytes_requested"),
+      traced_fd(-1),
+      iovcnt(0),
+      nbytes(0),
+      arena(nullptr) {
   sys_call_name_ = "readv";
 }
 
 void ReadvSystemCallTraceReplayModule::print_specific_fields() {
-  // Save the postion of first record.
-  const void *first_record_pos = series.getCurPos();
-
   /*
    * Print the descriptor value, number of iovec and total
-   * number of bytes read from the first record of dataseries file.
+   * number of bytes requested by the readv call.
    */
   pid_t pid = executing_pid();
-  int replayed_fd = replayer_resources_manager_.get_fd(pid, descriptor_.val());
-  syscall_logger_->log_info("traced fd(", descriptor_.val(), "), ",
-                            "replayed fd(", replayed_fd, "), ", "count:(",
-                            count_.val(), "), ", "bytes requested:(",
-                            bytes_requested_.val(), ")");
-
-  int count = count_.val();
+  int replayed_fd = replayer_resources_manager_.get_fd(pid, traced_fd);
+  syscall_logger_->log_info("traced fd(", traced_fd, "), ", "replayed fd(",
+                            replayed_fd, "), ", "count:(", iovcnt, "), ",
+                            "bytes requested:(", nbytes, ")");
+}
 
-  /*
-   * Iteratively fetch the new record to print the iov_number
-   * and data read for each iovec buffers.
-   */
-  while (count > 0 && series.morerecords()) {
-    ++series;
-    syscall_logger_->log_info("iov_number:(", iov_number_.val(), "), ",
-                              "data_read:(", data_read_.val(), ")");
-    count--;
+void ReadvSystemCallTraceReplayModule::verifyRow() {
+  ProfileScope scope(profiler_, PROFILE_VERIFY);
+  size_t remaining = replayed_ret_val_ > 0 ? replayed_ret_val_ : 0;
+
+  // Verify each iovec read data and data in the trace file
+  for (int iov_num = 0; iov_num < iovcnt && remaining > 0; iov_num++) {
+    size_t length = std::min(iov()[iov_num].iov_len, remaining);
+    remaining -= length;
+    // Data that was not captured is not verified
+    length = std::min(length, captured()[iov_num]);
+    if (length == 0) {
+      continue;
+    }
+    char *replayed_data = static_cast<char *>(iov()[iov_num].iov_base);
+    // The traced data of an iovec lies nbytes after its buffer.
+    char *traced_data = replayed_data + nbytes;
+    if (memcmp(traced_data, replayed_data, length) != 0) {
+      // Data aren't same
+      syscall_logger_->log_err("Verification of data for iov number: ",
+                               iov_num, " in readv failed.");
+      record_mismatch(MISMATCH_DATA, 0, traced_data, length, replayed_data,
+                      length);
+      if (!default_mode()) {
+        syscall_logger_->log_warn(
+            "time called:",
+            boost::format(DEC_PRECISION) % Tfrac_to_sec(time_called()),
+            ", Captured readv data is different from", " replayed read data");
+        // The mismatch record has digests of the data instead
+        if (mismatch_recorder_ == nullptr) {
+          syscall_logger_->log_warn(
+              "Captured readv data: ", std::string(traced_data, length),
+              ", Replayed readv data: ", std::string(replayed_data, length));
+        }
+        if (abort_mode()) {
+          abort_replay();
+        }
+      }
+    } else if (verbose_mode()) {
+      syscall_logger_->log_info("Verification of data for iov number: ",
+                                iov_num, " in readv succeeded.");
+    }
   }
-
-  // Again, set the pointer to the first record.
-  series.setCurPos(first_record_pos);
 }
 
 void ReadvSystemCallTraceReplayModule::processRow() {
   // Get replaying file descriptor.
   pid_t pid = executing_pid();
-  int fd = replayer_resources_manager_.get_fd(pid, descriptor_.val());
-  int count = count_.val(); /* Number of read io vectors */
-  int iov_number = iov_number_.val();
-  auto traced_buffer = new char *[count];
-  auto replayed_buffer = new char *[count];
+  int fd = replayer_resources_manager_.get_fd(pid, traced_fd);
+
+  if (fd == SYSCALL_SIMULATED) {
+    /*
+     * FD for the readv call originated from a socket().
+     * The system call will not be replayed.
+     * Original return value and data will be returned.
+     */
+    replayed_ret_val_ = return_value();
+  } else {
+    //  Replay the readv system call.
+    replayed_ret_val_ = engine_->readv(fd, iov(), iovcnt);
+
+    // If replayer runs in verify mode.
+    if (verify_) {
+      verifyRow();
+    }
+  }
+
+  // Free the iovec array and buffers.
+  delete[] arena;
+  arena = nullptr;
+}
+
+void ReadvSystemCallTraceReplayModule::prepareRow() {
+  traced_fd = descriptor_.val();
+  int count = std::max(count_.val(), 0); /* Number of read io vectors */
+  bool first_record = iov_number_.val() == -1;
 
   /*
    * The total number of rows processed by single readv system
@@ -98,101 +150,58 @@ void ReadvSystemCallTraceReplayModule::processRow() {
 
   // Save the position of the first record in the Extent Series.
   const void *first_record_pos = series.getCurPos();
-  int iovcnt = count;
-
-  struct iovec iov[count];
-
-  if (fd == SYSCALL_SIMULATED) {
-    /*
-     * FD for the readv call originated from a socket().
-     * The system call will not be replayed.
-     * Original return value and data will be returned.
-     */
-    replayed_ret_val_ = return_value_.val();
-    return;
-  }
 
   /*
-   * If iov number is equal to '-1', this means it is first record of
-   * single readv system call.
+   * If iov number is equal to '-1', this is the first record of a
+   * single readv system call and the iovec records follow it.
+   * Sum their sizes so that a single arena can hold every buffer.
    */
-  if (iov_number == -1) {
-    /*
-     * Iteratively fetch the records and save the bytes_requested, iov
-     * number and actual buffer for each record of single readv system
-     * call.
-     */
-    while (iovcnt > 0 && series.morerecords()) {
-      // This moves the pointer in extent series to next record
-      ++series;
-
-      int iov_num = iov_number_.val();
-      size_t bytes_requested = bytes_requested_.val();
-
-      /*
-       * Allocate memory and copy the actual buffer.
-       * XXX NOTE: *****FUTURE WORK *****
-       * Instead of allocating individual buffer, we can allocate
-       * one single buffer.
-       */
-      traced_buffer[iov_num] = new char[bytes_requested];
-      memcpy(traced_buffer[iov_num], data_read_.val(), bytes_requested);
-
-      /*
-       * Allocate memory for replaying buffers and construct the
-       * struct iovec from each record.
-       */
-      replayed_buffer[iov_num] = new char[bytes_requested];
-      iov[iov_num].iov_base = replayed_buffer[iov_num];
-      iov[iov_num].iov_len = bytes_requested;
-
-      iovcnt--;
-    }
+  iovcnt = first_record ? count : 0;
+  nbytes = 0;
+  for (int rows = 0; rows < iovcnt && series.morerecords(); rows++) {
+    // This moves the pointer in extent series to next record
+    ++series;
+    nbytes += bytes_requested_.val();
   }
 
-  //  Replay the readv system call.
-  replayed_ret_val_ = readv(fd, iov, count);
-
-  // If replayer runs in verify mode.
+  size_t iov_bytes = iovcnt * sizeof(struct iovec);
   if (verify_) {
-    // Verify each iovec read data and data in the trace file
-    for (int iovcnt_ = 0; iovcnt_ < count; iovcnt_++) {
-      if (memcmp(traced_buffer[iovcnt_], replayed_buffer[iovcnt_],
-                 iov[iovcnt_].iov_len) != 0) {
-        // Data aren't same
-        syscall_logger_->log_err("Verification of data for iov number: ",
-                                 iovcnt_, " in readv failed.");
-        if (!default_mode()) {
-          syscall_logger_->log_warn(
-              "time called:",
-              boost::format(DEC_PRECISION) % Tfrac_to_sec(time_called()),
-              ", Captured readv data is different from", " replayed read data");
-          syscall_logger_->log_warn(
-              "Captured readv data: ", traced_buffer[iovcnt_],
-              ", Replayed readv data: ", replayed_buffer[iovcnt_]);
-          if (abort_mode()) {
-            abort();
-          }
-        }
-      } else if (verbose_mode()) {
-        syscall_logger_->log_info("Verification of data for iov number: ",
-                                  iovcnt_, " in readv succeeded.");
-      }
+    iov_bytes += iovcnt * sizeof(size_t);
+  }
+  arena = new char[iov_bytes + (verify_ ? 2 * nbytes : nbytes)];
+  char *traced_data = arena + iov_bytes + nbytes;
+  for (int iov_num = 0; iov_num < iovcnt; iov_num++) {
+    iov()[iov_num].iov_base = nullptr;
+    iov()[iov_num].iov_len = 0;
+    if (verify_) {
+      captured()[iov_num] = 0;
     }
   }
 
-  // Free both traced and replayed buffers.
-  for (int iovcnt_ = 0; iovcnt_ < count; iovcnt_++) {
-    delete[] replayed_buffer[iovcnt_];
-    delete[] traced_buffer[iovcnt_];
+  // Lay out the buffers in the arena and keep a copy of the traced data.
+  series.setCurPos(first_record_pos);
+  size_t offset = 0;
+  for (int rows = 0; rows < iovcnt && series.morerecords(); rows++) {
+    ++series;
+    int iov_num = iov_number_.val();
+    size_t bytes_requested = bytes_requested_.val();
+    if (iov_num < 0 || iov_num >= iovcnt || offset + bytes_requested > nbytes) {
+      continue;
+    }
+    iov()[iov_num].iov_base = arena + iov_bytes + offset;
+    iov()[iov_num].iov_len = bytes_requested;
+    if (verify_) {
+      size_t traced_bytes = data_read_.isNull() ? 0 : data_read_.size();
+      traced_bytes = std::min(traced_bytes, bytes_requested);
+      if (traced_bytes > 0) {
+        memcpy(traced_data + offset, data_read_.val(), traced_bytes);
+      }
+      captured()[iov_num] = traced_bytes;
+    }
+    offset += bytes_requested;
   }
 
-  /*
-   * After executing a single readv system call, set the
-   * pointer in the Extent Series to the first record.
-   */
+  // Set the pointer to the first record again before moving past the call.
   series.setCurPos(first_record_pos);
-
-  delete[] traced_buffer;
-  delete[] replayed_buffer;
+  SystemCallTraceReplayModule::prepareRow();
 }
@@ -49,7 +49,7 @@ void RenameSystemCallTraceReplayModule::print_specific_fields() {
 
 void RenameSystemCallTraceReplayModule::processRow() {
   // Replay the rename system call
-  replayed_ret_val_ = rename(old_pathname, new_pathname);
+  replayed_ret_val_ = engine_->rename(old_pathname, new_pathname);
   delete[] old_pathname;
   delete[] new_pathname;
 }
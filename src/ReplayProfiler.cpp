@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the ReplayProfiler header
+ * file.
+ *
+ * Read ReplayProfiler.hpp for more information about this class.
+ */
+
+#include "ReplayProfiler.hpp"
+
+#include <boost/format.hpp>
+
+static const char *const profile_stage_names[PROFILE_STAGES] = {
+    "ingest decode",     "move/enqueue", "heap pop", "scheduler wait",
+    "syscall execution", "verification", "logging",  "reclamation",
+    "reader wait"};
+
+bool ProfileScope::time_verification = false;
+thread_local uint64_t ProfileScope::verify_nanoseconds = 0;
+
+ReplayProfiler::ThreadCounters::ThreadCounters() {
+  for (int stage = 0; stage < PROFILE_STAGES; stage++) {
+    count[stage] = 0;
+    nanoseconds[stage] = 0;
+  }
+}
+
+ReplayProfiler::ReplayProfiler(unsigned int interval, std::ostream &out)
+    : started_(std::chrono::steady_clock::now()),
+      interval_(interval),
+      out_(out),
+      stop_(false) {
+  if (interval_ > 0) {
+    reporter_ = std::thread(&ReplayProfiler::report_periodically, this);
+  }
+}
+
+ReplayProfiler::ThreadCounters &ReplayProfiler::thread_counters() {
+  static thread_local ReplayProfiler *owner = nullptr;
+  static thread_local ThreadCounters *counters = nullptr;
+  if (owner != this) {
+    std::lock_guard<std::mutex> lock(counters_lock_);
+    counters_.emplace_back(new ThreadCounters());
+    counters = counters_.back().get();
+    owner = this;
+  }
+  return *counters;
+}
+
+void ReplayProfiler::add(ProfileStage stage, uint64_t nanoseconds) {
+  ThreadCounters &counters = thread_counters();
+  // Only this thread writes its counters, so no read-modify-write needed.
+  counters.count[stage].store(
+      counters.count[stage].load(std::memory_order_relaxed) + 1,
+      std::memory_order_relaxed);
+  counters.nanoseconds[stage].store(
+      counters.nanoseconds[stage].load(std::memory_order_relaxed) +
+          nanoseconds,
+      std::memory_order_relaxed);
+}
+
+void ReplayProfiler::report() {
+  uint64_t count[PROFILE_STAGES] = {0};
+  uint64_t nanoseconds[PROFILE_STAGES] = {0};
+  size_t threads;
+  {
+    std::lock_guard<std::mutex> lock(counters_lock_);
+    threads = counters_.size();
+    for (auto &counters : counters_) {
+      for (int stage = 0; stage < PROFILE_STAGES; stage++) {
+        count[stage] += counters->count[stage].load(std::memory_order_relaxed);
+        nanoseconds[stage] +=
+            counters->nanoseconds[stage].load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - started_)
+                       .count();
+  out_ << boost::format("profile after %.1f s, %u threads:\n") % elapsed %
+              threads;
+  out_ << boost::format("  %-18s %14s %14s %12s\n") % "stage" % "count" %
+              "total ms" % "mean ns";
+  for (int stage = 0; stage < PROFILE_STAGES; stage++) {
+    uint64_t mean = count[stage] == 0 ? 0 : nanoseconds[stage] / count[stage];
+    out_ << boost::format("  %-18s %14u %14.1f %12u\n") %
+                profile_stage_names[stage] % count[stage] %
+                (nanoseconds[stage] / 1e6) % mean;
+  }
+  out_.flush();
+}
+
+void ReplayProfiler::report_periodically() {
+  std::unique_lock<std::mutex> lock(counters_lock_);
+  while (!stop_cv_.wait_for(lock, std::chrono::seconds(interval_),
+                            [this] { return stop_; })) {
+    lock.unlock();
+    report();
+    lock.lock();
+  }
+}
+
+void ReplayProfiler::stop() {
+  {
+    std::lock_guard<std::mutex> lock(counters_lock_);
+    if (stop_) {
+      return;
+    }
+    stop_ = true;
+  }
+  stop_cv_.notify_all();
+  if (reporter_.joinable()) {
+    reporter_.join();
+  }
+  report();
+}
+
+ReplayProfiler::~ReplayProfiler() { stop(); }
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the ReplayRecorder header
+ * file.
+ *
+ * Read ReplayRecorder.hpp for more information about this class.
+ */
+
+#include "ReplayRecorder.hpp"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utility>
+
+// Records per extent are limited to about this many bytes
+#define REPLAY_EXTENT_SIZE (1024 * 1024)
+
+// Recorder and batch of the calling thread, set by thread_batch()
+static thread_local ReplayRecorder *batch_owner = nullptr;
+static thread_local std::vector<ReplayedCall> *owned_batch = nullptr;
+
+static const std::string replay_type_xml =
+    "<ExtentType name=\"" REPLAY_EXTENT_TYPE
+    "\" version=\"1.0\" pack_null_compact=\"non_bool\">\n"
+    "  <field type=\"int64\" name=\"unique_id\" comment=\"unique_id of "
+    "the traced record\" />\n"
+    "  <field type=\"variable32\" name=\"syscall\" pack_unique=\"yes\" />\n"
+    "  <field type=\"int64\" name=\"time_called\" units=\"2^-32 seconds\" "
+    "epoch=\"unix\" />\n"
+    "  <field type=\"int64\" name=\"time_returned\" units=\"2^-32 seconds\" "
+    "epoch=\"unix\" />\n"
+    "  <field type=\"int64\" name=\"time_recorded\" units=\"2^-32 seconds\" "
+    "epoch=\"unix\" />\n"
+    "  <field type=\"int64\" name=\"return_value\" />\n"
+    "  <field type=\"int32\" name=\"errno_number\" />\n"
+    "  <field type=\"int32\" name=\"executing_pid\" comment=\"traced "
+    "process\" />\n"
+    "  <field type=\"int32\" name=\"executing_tid\" comment=\"replayer "
+    "thread\" />\n"
+    "</ExtentType>\n";
+
+ReplayRecorder::ReplayRecorder(const std::string &filename,
+                               std::vector<std::string> syscall_names)
+    : syscall_names_(std::move(syscall_names)),
+      steady_start_(std::chrono::steady_clock::now()),
+      sink_(filename),
+      type_(library_.registerTypePtr(replay_type_xml)),
+      series_(type_),
+      unique_id_(series_, "unique_id"),
+      syscall_(series_, "syscall"),
+      time_called_(series_, "time_called"),
+      time_returned_(series_, "time_returned"),
+      time_recorded_(series_, "time_recorded"),
+      return_value_(series_, "return_value"),
+      errno_number_(series_, "errno_number"),
+      executing_pid_(series_, "executing_pid"),
+      executing_tid_(series_, "executing_tid"),
+      closed_(false) {
+  uint64_t wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+  wall_start_ = ((wall_ns / 1000000000ULL) << 32) +
+                (((wall_ns % 1000000000ULL) << 32) / 1000000000ULL);
+  sink_.writeExtentLibrary(library_);
+  output_.reset(new OutputModule(sink_, series_, type_, REPLAY_EXTENT_SIZE));
+  writer_ = std::thread(&ReplayRecorder::write_batches, this);
+}
+
+ReplayRecorder::Batch &ReplayRecorder::thread_batch() {
+  if (batch_owner != this) {
+    std::lock_guard<std::mutex> lock(lock_);
+    thread_batches_.emplace_back(new Batch());
+    owned_batch = thread_batches_.back().get();
+    owned_batch->reserve(REPLAY_BATCH_SIZE);
+    batch_owner = this;
+  }
+  return *owned_batch;
+}
+
+void ReplayRecorder::thread_finished() {
+  if (batch_owner != this) {
+    // The thread recorded nothing
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (!owned_batch->empty()) {
+      full_batches_.push_back(std::move(*owned_batch));
+    }
+    for (auto it = thread_batches_.begin(); it != thread_batches_.end();
+         ++it) {
+      if (it->get() == owned_batch) {
+        thread_batches_.erase(it);
+        break;
+      }
+    }
+  }
+  full_cv_.notify_one();
+  batch_owner = nullptr;
+  owned_batch = nullptr;
+}
+
+int64_t ReplayRecorder::to_tfracs(
+    std::chrono::steady_clock::time_point time) const {
+  int64_t ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(time - steady_start_)
+          .count();
+  // Times before steady_start_ (none in practice) are clamped to it
+  uint64_t elapsed = ns > 0 ? ns : 0;
+  return wall_start_ + ((elapsed / 1000000000ULL) << 32) +
+         (((elapsed % 1000000000ULL) << 32) / 1000000000ULL);
+}
+
+void ReplayRecorder::record(ReplayedCall call) {
+  static thread_local int32_t tid = syscall(SYS_gettid);
+  call.executing_tid = tid;
+  Batch &batch = thread_batch();
+  batch.push_back(call);
+  if (batch.size() >= REPLAY_BATCH_SIZE) {
+    Batch full;
+    full.reserve(REPLAY_BATCH_SIZE);
+    full.swap(batch);
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      full_batches_.push_back(std::move(full));
+    }
+    full_cv_.notify_one();
+  }
+}
+
+void ReplayRecorder::write(const Batch &batch) {
+  for (const ReplayedCall &call : batch) {
+    output_->newRecord();
+    unique_id_.set(call.unique_id);
+    if (call.syscall >= 0 &&
+        static_cast<size_t>(call.syscall) < syscall_names_.size()) {
+      syscall_.set(syscall_names_[call.syscall]);
+    } else {
+      syscall_.set("");
+    }
+    time_called_.set(to_tfracs(call.called));
+    int64_t returned = to_tfracs(call.returned);
+    time_returned_.set(returned);
+    // The replayer records a call as soon as it returns
+    time_recorded_.set(returned);
+    return_value_.set(call.return_value);
+    errno_number_.set(call.errno_number);
+    executing_pid_.set(call.executing_pid);
+    executing_tid_.set(call.executing_tid);
+  }
+}
+
+void ReplayRecorder::write_batches() {
+  std::unique_lock<std::mutex> lock(lock_);
+  while (true) {
+    full_cv_.wait(lock, [this] { return closed_ || !full_batches_.empty(); });
+    if (full_batches_.empty()) {
+      // closed_ is set and everything is written
+      return;
+    }
+    Batch batch = std::move(full_batches_.front());
+    full_batches_.pop_front();
+    lock.unlock();
+    write(batch);
+    lock.lock();
+  }
+}
+
+void ReplayRecorder::close() {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (closed_) {
+      return;
+    }
+    // Every executor is done, so their partial batches can be taken
+    for (auto &batch : thread_batches_) {
+      if (!batch->empty()) {
+        full_batches_.push_back(std::move(*batch));
+        batch->clear();
+      }
+    }
+    closed_ = true;
+  }
+  full_cv_.notify_one();
+  writer_.join();
+  // Deleting the output module writes the last extent
+  output_.reset();
+  sink_.close();
+}
+
+ReplayRecorder::~ReplayRecorder() { close(); }
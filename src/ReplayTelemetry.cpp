@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the ReplayTelemetry header
+ * file.
+ *
+ * Read ReplayTelemetry.hpp for more information about this class.
+ */
+
+#include "ReplayTelemetry.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <utility>
+
+static const char *const mismatch_kind_names[MISMATCH_KINDS] = {
+    "return_value", "errno", "data"};
+
+/*
+ * Store value + delta in counter, which only the calling thread writes,
+ * without the cost of an atomic read-modify-write.
+ */
+template <typename T>
+static inline void add_own(std::atomic<T> &counter, T delta) {
+  counter.store(counter.load(std::memory_order_relaxed) + delta,
+                std::memory_order_relaxed);
+}
+
+ReplayTelemetry::ThreadCounters::ThreadCounters(size_t syscalls)
+    : syscalls(new SyscallCounters[syscalls]),
+      last_unique_id(0),
+      last_time_called(0),
+      first_time_called(0) {
+  for (size_t i = 0; i < syscalls; i++) {
+    this->syscalls[i].calls = 0;
+    this->syscalls[i].bytes = 0;
+  }
+  for (int kind = 0; kind < MISMATCH_KINDS; kind++) {
+    mismatches[kind] = 0;
+  }
+}
+
+ReplayTelemetry::ReplayTelemetry(const std::string &filename,
+                                 std::vector<std::string> syscall_names,
+                                 unsigned int interval,
+                                 QueueSampler sample_queues)
+    : filename_(filename),
+      syscall_names_(std::move(syscall_names)),
+      interval_(std::max(interval, 1u)),
+      sample_queues_(std::move(sample_queues)),
+      started_(std::chrono::steady_clock::now()),
+      executors_(0),
+      reader_stall_ns_(0),
+      queues_due_(true),
+      stop_(false) {
+  reporter_ = std::thread(&ReplayTelemetry::report_periodically, this);
+}
+
+ReplayTelemetry::ThreadCounters &ReplayTelemetry::thread_counters() {
+  static thread_local ReplayTelemetry *owner = nullptr;
+  static thread_local ThreadCounters *counters = nullptr;
+  if (owner != this) {
+    std::lock_guard<std::mutex> lock(counters_lock_);
+    counters_.emplace_back(new ThreadCounters(syscall_names_.size()));
+    counters = counters_.back().get();
+    owner = this;
+  }
+  return *counters;
+}
+
+void ReplayTelemetry::count_call(int64_t syscall, uint64_t bytes,
+                                 int64_t unique_id, uint64_t time_called) {
+  ThreadCounters &counters = thread_counters();
+  if (syscall >= 0 && static_cast<size_t>(syscall) < syscall_names_.size()) {
+    add_own(counters.syscalls[syscall].calls, static_cast<uint64_t>(1));
+    add_own(counters.syscalls[syscall].bytes, bytes);
+  }
+  counters.last_unique_id.store(unique_id, std::memory_order_relaxed);
+  counters.last_time_called.store(time_called, std::memory_order_relaxed);
+  if (counters.first_time_called.load(std::memory_order_relaxed) == 0) {
+    counters.first_time_called.store(time_called, std::memory_order_relaxed);
+  }
+}
+
+void ReplayTelemetry::count_mismatch(MismatchKind kind) {
+  add_own(thread_counters().mismatches[kind], static_cast<uint64_t>(1));
+}
+
+ReplayTelemetry::Totals ReplayTelemetry::sum() {
+  Totals totals;
+  totals.calls.assign(syscall_names_.size(), 0);
+  totals.bytes.assign(syscall_names_.size(), 0);
+  totals.last_unique_id = 0;
+  totals.last_time_called = 0;
+  totals.first_time_called = 0;
+  std::fill_n(totals.mismatches, MISMATCH_KINDS, 0);
+
+  std::lock_guard<std::mutex> lock(counters_lock_);
+  for (auto &counters : counters_) {
+    for (size_t i = 0; i < syscall_names_.size(); i++) {
+      totals.calls[i] +=
+          counters->syscalls[i].calls.load(std::memory_order_relaxed);
+      totals.bytes[i] +=
+          counters->syscalls[i].bytes.load(std::memory_order_relaxed);
+    }
+    totals.last_unique_id =
+        std::max(totals.last_unique_id,
+                 counters->last_unique_id.load(std::memory_order_relaxed));
+    totals.last_time_called =
+        std::max(totals.last_time_called,
+                 counters->last_time_called.load(std::memory_order_relaxed));
+    uint64_t first =
+        counters->first_time_called.load(std::memory_order_relaxed);
+    if (first != 0 &&
+        (totals.first_time_called == 0 || first < totals.first_time_called)) {
+      totals.first_time_called = first;
+    }
+    for (int kind = 0; kind < MISMATCH_KINDS; kind++) {
+      totals.mismatches[kind] +=
+          counters->mismatches[kind].load(std::memory_order_relaxed);
+    }
+  }
+  return totals;
+}
+
+void ReplayTelemetry::update_queues() {
+  QueueDepths queues;
+  sample_queues_(queues);
+  std::lock_guard<std::mutex> lock(counters_lock_);
+  queues_ = std::move(queues);
+  queues_due_.store(false, std::memory_order_relaxed);
+}
+
+void ReplayTelemetry::write(const Totals &totals, const Totals &previous,
+                            const QueueDepths &queues,
+                            double interval_seconds) {
+  double wall_seconds = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - started_)
+                            .count();
+  // time_called is in Tfracs, 2^-32 seconds
+  double traced_seconds =
+      totals.first_time_called == 0
+          ? 0
+          : std::ldexp(static_cast<double>(totals.last_time_called -
+                                           totals.first_time_called),
+                       -32);
+
+  std::string tmp_filename = filename_ + ".tmp";
+  std::ofstream out(tmp_filename);
+  out << "{\n  \"wall_seconds\": " << wall_seconds
+      << ",\n  \"unique_id\": " << totals.last_unique_id
+      << ",\n  \"traced_seconds\": " << traced_seconds
+      << ",\n  \"speedup\": "
+      << (wall_seconds > 0 ? traced_seconds / wall_seconds : 0)
+      << ",\n  \"executors\": " << executors_.load()
+      << ",\n  \"reader_stall_seconds\": "
+      << reader_stall_ns_.load(std::memory_order_relaxed) / 1e9
+      << ",\n  \"mismatches\": {";
+  for (int kind = 0; kind < MISMATCH_KINDS; kind++) {
+    out << (kind == 0 ? "" : ", ") << "\"" << mismatch_kind_names[kind]
+        << "\": " << totals.mismatches[kind];
+  }
+  out << "},\n  \"queues\": {";
+  bool first = true;
+  for (auto &queue : queues.per_pid) {
+    out << (first ? "" : ", ") << "\"" << queue.first << "\": " << queue.second;
+    first = false;
+  }
+  out << "},\n  \"syscalls\": {";
+  first = true;
+  for (size_t i = 0; i < syscall_names_.size(); i++) {
+    uint64_t queued = i < queues.per_syscall.size() ? queues.per_syscall[i] : 0;
+    out << (first ? "\n" : ",\n") << "    \"" << syscall_names_[i]
+        << "\": {\"calls\": " << totals.calls[i]
+        << ", \"bytes\": " << totals.bytes[i] << ", \"calls_per_sec\": "
+        << (totals.calls[i] - previous.calls[i]) / interval_seconds
+        << ", \"bytes_per_sec\": "
+        << (totals.bytes[i] - previous.bytes[i]) / interval_seconds
+        << ", \"queued\": " << queued << "}";
+    first = false;
+  }
+  out << "\n  }\n}\n";
+  out.close();
+  if (out) {
+    std::rename(tmp_filename.c_str(), filename_.c_str());
+  }
+}
+
+void ReplayTelemetry::report_periodically() {
+  Totals previous = sum();
+  auto previous_time = std::chrono::steady_clock::now();
+  bool stopping = false;
+  while (!stopping) {
+    QueueDepths queues;
+    {
+      std::unique_lock<std::mutex> lock(counters_lock_);
+      stopping = stop_cv_.wait_for(lock, std::chrono::seconds(interval_),
+                                   [this] { return stop_; });
+      queues = queues_;
+    }
+    Totals totals = sum();
+    auto now = std::chrono::steady_clock::now();
+    double interval_seconds =
+        std::chrono::duration<double>(now - previous_time).count();
+    write(totals, previous, queues, std::max(interval_seconds, 1e-3));
+    queues_due_.store(true, std::memory_order_relaxed);
+    previous = std::move(totals);
+    previous_time = now;
+  }
+}
+
+void ReplayTelemetry::stop() {
+  update_queues();
+  {
+    std::lock_guard<std::mutex> lock(counters_lock_);
+    stop_ = true;
+  }
+  stop_cv_.notify_all();
+  if (reporter_.joinable()) {
+    reporter_.join();
+  }
+}
+
+ReplayTelemetry::~ReplayTelemetry() { stop(); }
@@ -0,0 +1,472 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * replayer-benchmarks times the hot paths of the replayer in isolation:
+ * preparing and moving records, the execution heap, the fd tables, the
+ * lookup of mapped regions, the logger and the payload generator. It
+ * needs no trace files; the records come from a small trace generated
+ * by TraceSynthesizer into a temporary file.
+ *
+ * USAGE
+ * replayer-benchmarks [--filter NAME] [--min-time SECONDS] [--list]
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <boost/program_options.hpp>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "MicroBenchmark.hpp"
+#include "SystemCallTraceReplayer.hpp"
+#include "TraceSynthesizer.hpp"
+#include "VirtualAddressSpace.hpp"
+
+// Pid and fd of the only thread of the synthetic trace
+#define BENCHMARK_PID 1000
+#define BENCHMARK_TRACED_FD 3
+// Moved records whose buffers are freed together, outside the timing
+#define MOVE_BATCH 256
+// Records kept in the execution heap
+#define HEAP_RECORDS 1024
+
+/*
+ * Source of a module that returns the same extents over and over, so
+ * that a benchmark never runs out of records.
+ */
+class ExtentLoop : public DataSeriesModule {
+ private:
+  const std::vector<Extent::Ptr> &extents_;
+  size_t next_;
+
+ public:
+  explicit ExtentLoop(const std::vector<Extent::Ptr> &extents)
+      : extents_(extents), next_(0) {}
+
+  Extent::Ptr getSharedExtent() override {
+    return extents_[next_++ % extents_.size()];
+  }
+};
+
+typedef std::function<SystemCallTraceReplayModule *(DataSeriesModule &)>
+    ModuleFactory;
+
+// Extents of the synthetic trace, by system call
+static std::map<std::string, std::vector<Extent::Ptr>> trace_extents;
+
+/**
+ * Generate a trace of one thread calling every system call a module
+ * benchmark needs, and keep its extents in trace_extents.
+ */
+static void load_trace_extents() {
+  char filename[] = "/tmp/replayer-benchmarks-XXXXXX";
+  int fd = mkstemp(filename);
+  if (fd < 0) {
+    perror("Unable to create the benchmark trace");
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+
+  WorkloadSpec spec;
+  std::string error;
+  spec.set("records", "20000", error);
+  spec.set("files", "1", error);
+  spec.set("mix", "read,write,pread,pwrite,lseek", error);
+  spec.set("fsync_every", "4", error);
+  spec.set("io_size", "4k", error);
+  TraceSynthesizer(spec, filename, 1).generate();
+
+  for (auto &syscall :
+       {"read", "write", "pread", "pwrite", "lseek", "close", "fsync"}) {
+    TypeIndexModule source(std::string("IOTTAFSL::Trace::Syscall::") +
+                           syscall);
+    source.addSource(filename);
+    for (Extent::Ptr extent = source.getSharedExtent(); extent != nullptr;
+         extent = source.getSharedExtent()) {
+      trace_extents[syscall].push_back(extent);
+    }
+    if (trace_extents[syscall].empty()) {
+      std::cerr << "The benchmark trace has no " << syscall << " records"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  unlink(filename);
+}
+
+/**
+ * Time prepareRow() and move() of the module made by factory, which
+ * reads the records of syscall. The copies are executed against
+ * /dev/zero outside the timing if they own a buffer, which only
+ * execute() frees.
+ */
+static void move_benchmark(BenchmarkState &state, const std::string &syscall,
+                           ModuleFactory factory, bool owns_buffer) {
+  ExtentLoop source(trace_extents[syscall]);
+  std::unique_ptr<SystemCallTraceReplayModule> module(factory(source));
+  module->getSharedExtent();
+  std::vector<SystemCallTraceReplayModule *> copies;
+  copies.reserve(MOVE_BATCH);
+  while (state.running()) {
+    if (!module->cur_extent_has_more_record()) {
+      module->getSharedExtent();
+    }
+    module->prepareRow();
+    copies.push_back(module->move());
+    if (copies.size() == MOVE_BATCH) {
+      state.pause();
+      for (auto copy : copies) {
+        if (owns_buffer) {
+          copy->execute();
+        }
+        delete copy;
+      }
+      copies.clear();
+      state.resume();
+    }
+  }
+  for (auto copy : copies) {
+    if (owns_buffer) {
+      copy->execute();
+    }
+    delete copy;
+  }
+  state.set_items_processed(state.iterations());
+}
+
+static void add_move_benchmarks(MicroBenchmarks &benchmarks) {
+  struct {
+    const char *syscall;
+    ModuleFactory factory;
+    bool owns_buffer;
+  } modules[] = {
+      {"read",
+       [](DataSeriesModule &source) {
+         return new ReadSystemCallTraceReplayModule(source, false, false,
+                                                    DEFAULT_MODE);
+       },
+       true},
+      {"write",
+       [](DataSeriesModule &source) {
+         return new WriteSystemCallTraceReplayModule(source, false, false,
+                                                     DEFAULT_MODE, "");
+       },
+       true},
+      {"pread",
+       [](DataSeriesModule &source) {
+         return new PReadSystemCallTraceReplayModule(source, false, false,
+                                                     DEFAULT_MODE);
+       },
+       true},
+      {"pwrite",
+       [](DataSeriesModule &source) {
+         return new PWriteSystemCallTraceReplayModule(source, false, false,
+                                                      DEFAULT_MODE, "");
+       },
+       true},
+      {"lseek",
+       [](DataSeriesModule &source) {
+         return new LSeekSystemCallTraceReplayModule(source, false,
+                                                     DEFAULT_MODE);
+       },
+       false},
+      {"close",
+       [](DataSeriesModule &source) {
+         return new CloseSystemCallTraceReplayModule(source, false,
+                                                     DEFAULT_MODE);
+       },
+       false},
+      {"fsync",
+       [](DataSeriesModule &source) {
+         return new FsyncSystemCallTraceReplayModule(source, false,
+                                                     DEFAULT_MODE);
+       },
+       false}};
+  for (auto &module : modules) {
+    std::string syscall = module.syscall;
+    ModuleFactory factory = module.factory;
+    bool owns_buffer = module.owns_buffer;
+    benchmarks.add("prepare_row_move/" + syscall,
+                   [syscall, factory, owns_buffer](BenchmarkState &state) {
+                     move_benchmark(state, syscall, factory, owns_buffer);
+                   });
+  }
+}
+
+// Shared by the threads of the heap benchmarks
+static ExecutionHeap execution_heap;
+static std::vector<std::unique_ptr<SystemCallTraceReplayModule>> heap_records;
+
+/**
+ * Fill execution_heap with copies of lseek records with distinct unique
+ * ids.
+ */
+static void fill_execution_heap() {
+  ExtentLoop source(trace_extents["lseek"]);
+  LSeekSystemCallTraceReplayModule module(source, false, DEFAULT_MODE);
+  module.getSharedExtent();
+  for (int i = 0; i < HEAP_RECORDS; i++) {
+    if (!module.cur_extent_has_more_record()) {
+      module.getSharedExtent();
+    }
+    module.prepareRow();
+    SystemCallTraceReplayModule *copy = module.move();
+    copy->setCommon(i, 0, 0, 0, BENCHMARK_PID, 0, 0, 0);
+    heap_records.emplace_back(copy);
+    execution_heap.push(copy);
+  }
+}
+
+/**
+ * Pop the record with the lowest unique id and push it back, as the
+ * execution threads and the loader do.
+ */
+static void heap_benchmark(BenchmarkState &state) {
+  SystemCallTraceReplayModule *module;
+  while (state.running()) {
+    if (execution_heap.try_pop(module)) {
+      execution_heap.push(module);
+    }
+  }
+  state.set_items_processed(state.iterations());
+}
+
+// Fd tables by number of open fds, where traced fd i is replayed fd i
+static std::map<int64_t, std::unique_ptr<ReplayerResourcesManager>>
+    resources_managers;
+
+static void create_resources_managers(SystemCallTraceReplayLogger *logger) {
+  for (int64_t fds : {16, 1024, 65536}) {
+    std::unique_ptr<ReplayerResourcesManager> manager(
+        new ReplayerResourcesManager());
+    std::map<int, int> fd_map;
+    manager->initialize(logger, BENCHMARK_PID, fd_map);
+    for (int fd = 0; fd < fds; fd++) {
+      manager->add_fd(BENCHMARK_PID, fd, fd, 0);
+    }
+    resources_managers[fds] = std::move(manager);
+  }
+}
+
+static void get_fd_benchmark(BenchmarkState &state) {
+  ReplayerResourcesManager &manager = *resources_managers[state.arg()];
+  std::mt19937 random(state.thread_index());
+  std::uniform_int_distribution<int> traced_fd(0, state.arg() - 1);
+  int sum = 0;
+  while (state.running()) {
+    sum += manager.get_fd(BENCHMARK_PID, traced_fd(random));
+  }
+  // Keep the lookups from being optimized away
+  if (sum == -1) {
+    std::cerr << sum << std::endl;
+  }
+  state.set_items_processed(state.iterations());
+}
+
+static void add_remove_fd_benchmark(BenchmarkState &state) {
+  ReplayerResourcesManager &manager = *resources_managers[state.arg()];
+  int fd = state.arg();
+  while (state.running()) {
+    manager.add_fd(BENCHMARK_PID, fd, fd, 0);
+    manager.remove_fd(BENCHMARK_PID, fd);
+  }
+  state.set_items_processed(state.iterations());
+}
+
+static void generate_unused_fd_benchmark(BenchmarkState &state) {
+  ReplayerResourcesManager &manager = *resources_managers[state.arg()];
+  int sum = 0;
+  while (state.running()) {
+    int fd = manager.generate_unused_fd(BENCHMARK_PID);
+    manager.release_generated_fd(fd);
+    sum += fd;
+  }
+  if (sum == -1) {
+    std::cerr << sum << std::endl;
+  }
+  state.set_items_processed(state.iterations());
+}
+
+// Address spaces by number of mapped regions
+static std::map<int64_t, std::unique_ptr<VM_area>> vm_areas;
+// Size of each region, which is followed by a hole of the same size
+#define VM_REGION_SIZE 4096
+
+static void create_vm_areas() {
+  for (int64_t regions : {16, 1024, 65536}) {
+    std::unique_ptr<VM_area> area(new VM_area());
+    for (int64_t i = 0; i < regions; i++) {
+      auto address = reinterpret_cast<void *>((i + 1) * 2 * VM_REGION_SIZE);
+      area->insert_VM_node(VM_node(address, address, VM_REGION_SIZE, 3, 3));
+    }
+    vm_areas[regions] = std::move(area);
+  }
+}
+
+static void find_vm_node_benchmark(BenchmarkState &state) {
+  VM_area &area = *vm_areas[state.arg()];
+  std::mt19937 random(state.thread_index());
+  std::uniform_int_distribution<uint64_t> region(1, state.arg());
+  uint64_t found = 0;
+  while (state.running()) {
+    auto address =
+        reinterpret_cast<void *>(region(random) * 2 * VM_REGION_SIZE + 64);
+    area.find_VM_node(address, 64, [&found](VM_node &node) { found++; });
+  }
+  if (found != state.iterations()) {
+    std::cerr << "find_VM_node missed " << state.iterations() - found
+              << " regions" << std::endl;
+  }
+  state.set_items_processed(state.iterations());
+}
+
+// Loggers writing to /dev/null, by LogMode
+static std::unique_ptr<SystemCallTraceReplayLogger> loggers[3];
+
+static void logger_benchmark(BenchmarkState &state, LogMode mode) {
+  SystemCallTraceReplayLogger &logger = *loggers[mode];
+  uint64_t id = 0;
+  while (state.running()) {
+    logger.log_info("unique id(", id++, "), pid(", BENCHMARK_PID,
+                    "), return value(", 4096, ")");
+  }
+  logger.flush();
+  state.set_items_processed(state.iterations());
+}
+
+static void random_fill_buffer_benchmark(BenchmarkState &state) {
+  size_t nbytes = state.arg();
+  std::unique_ptr<char[]> buffer(new char[nbytes]);
+  // Any record will do, random_fill_buffer() only uses its unique id
+  ExtentLoop source(trace_extents["lseek"]);
+  LSeekSystemCallTraceReplayModule module(source, false, DEFAULT_MODE);
+  module.setCommon(1, 0, 0, 0, BENCHMARK_PID, 0, 0, 0);
+  uint64_t offset = 0;
+  while (state.running()) {
+    module.random_fill_buffer(buffer.get(), nbytes, offset);
+    offset += nbytes;
+  }
+  state.set_bytes_processed(state.iterations() * nbytes);
+}
+
+int main(int argc, char *argv[]) {
+  namespace po = boost::program_options;
+  po::options_description options("Options");
+  options.add_options()("help,h", "produce help message")(
+      "filter", po::value<std::string>()->default_value(""),
+      "run only the benchmarks whose name contains this")(
+      "min-time", po::value<double>()->default_value(0.5),
+      "seconds each benchmark runs at least")("list",
+                                              "list the benchmarks and exit");
+
+  po::variables_map options_vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, options), options_vm);
+    po::notify(options_vm);
+  } catch (po::error &e) {
+    std::cerr << e.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (options_vm.count("help") != 0u) {
+    std::cout << "Usage: replayer-benchmarks [options]\n"
+              << options << std::endl;
+    exit(EXIT_SUCCESS);
+  }
+
+  MicroBenchmarks benchmarks;
+  add_move_benchmarks(benchmarks);
+  for (int threads : {1, 2, 4, 8}) {
+    benchmarks.add("execution_heap_pop_push", heap_benchmark, -1, threads);
+  }
+  for (int64_t fds : {16, 1024, 65536}) {
+    benchmarks.add("get_fd", get_fd_benchmark, fds);
+    benchmarks.add("get_fd", get_fd_benchmark, fds, 4);
+    benchmarks.add("add_remove_fd", add_remove_fd_benchmark, fds);
+    benchmarks.add("generate_unused_fd", generate_unused_fd_benchmark, fds);
+  }
+  for (int64_t regions : {16, 1024, 65536}) {
+    benchmarks.add("find_VM_node", find_vm_node_benchmark, regions);
+  }
+  std::pair<const char *, LogMode> log_modes[] = {
+      {"sync", LOG_SYNC},
+      {"async_block", LOG_ASYNC_BLOCK},
+      {"async_drop", LOG_ASYNC_DROP}};
+  for (auto &log_mode : log_modes) {
+    LogMode mode = log_mode.second;
+    auto benchmark = [mode](BenchmarkState &state) {
+      logger_benchmark(state, mode);
+    };
+    benchmarks.add(std::string("log_info/") + log_mode.first, benchmark);
+    benchmarks.add(std::string("log_info/") + log_mode.first, benchmark, -1,
+                   4);
+  }
+  for (int64_t nbytes : {4 << 10, 64 << 10, 1 << 20}) {
+    benchmarks.add("random_fill_buffer", random_fill_buffer_benchmark,
+                   nbytes);
+  }
+  if (options_vm.count("list") != 0u) {
+    benchmarks.list();
+    exit(EXIT_SUCCESS);
+  }
+
+  SystemCallTraceReplayModule::syscall_logger_ =
+      new SystemCallTraceReplayLogger("/dev/null");
+  for (int mode : {LOG_SYNC, LOG_ASYNC_BLOCK, LOG_ASYNC_DROP}) {
+    loggers[mode].reset(new SystemCallTraceReplayLogger(
+        "/dev/null", static_cast<LogMode>(mode)));
+  }
+
+  // The records make their system calls, as in a replay
+  SystemCallTraceReplayModule::engine_ = new KernelSyscallEngine();
+
+  // The traced fd of the records is replayed on /dev/zero
+  int zero_fd = open("/dev/zero", O_RDWR);
+  if (zero_fd < 0) {
+    perror("Unable to open /dev/zero");
+    exit(EXIT_FAILURE);
+  }
+  std::map<int, int> fd_map = {{BENCHMARK_TRACED_FD, zero_fd}};
+  SystemCallTraceReplayModule::replayer_resources_manager_.initialize(
+      SystemCallTraceReplayModule::syscall_logger_, BENCHMARK_PID, fd_map);
+
+  load_trace_extents();
+  fill_execution_heap();
+  create_resources_managers(SystemCallTraceReplayModule::syscall_logger_);
+  create_vm_areas();
+
+  int run = benchmarks.run(options_vm["filter"].as<std::string>(),
+                           options_vm["min-time"].as<double>());
+  if (run == 0) {
+    std::cerr << "No benchmark matches the filter" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return EXIT_SUCCESS;
+}
@@ -32,24 +32,43 @@
  */
 
 #include "ReplayerResourcesManager.hpp"
+#include <dirent.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
 #include <iostream>
 
-// #define WEBSERVER_TESTING
+// Number of slots of a new fd table
+#define INITIAL_FD_TABLE_SIZE 64
 
-ReplayerResourcesManager::ReplayerResourcesManager() {}
+// No replayed fd is INT_MIN, so it marks a slot without an entry
+static const uint64_t EMPTY_SLOT = static_cast<uint32_t>(INT_MIN);
+
+static inline uint64_t pack_slot(int fd, int flags) {
+  return static_cast<uint64_t>(static_cast<uint32_t>(flags)) << 32 |
+         static_cast<uint32_t>(fd);
+}
+
+static inline int slot_fd(uint64_t slot) { return static_cast<int32_t>(slot); }
+
+static inline int slot_flags(uint64_t slot) {
+  return static_cast<int32_t>(slot >> 32);
+}
+
+ReplayerResourcesManager::ReplayerResourcesManager()
+    : consistency_check_(CONSISTENCY_CHECK_SAMPLED) {}
 
 void ReplayerResourcesManager::initialize(SystemCallTraceReplayLogger *logger,
                                           pid_t pid,
                                           std::map<int, int> &fd_map) {
   logger_ = logger;
   // Create a new UmaskEntry for trace application
-  fd_table_map_lock.lock();
-  umask_table_[pid] = new UmaskEntry(0);
-  fd_table_map_[pid] = new FileDescriptorTableEntry();
-  fd_table_map_lock.unlock();
+  umask_table_.insert(std::make_pair(pid, new UmaskEntry(0)));
+  auto fd_table_pid = new FileDescriptorTableEntry(&used_fds_);
+  fd_table_map_.insert(std::make_pair(pid, fd_table_pid));
   for (auto &iter : fd_map) {
     int traced_fd = iter.first;
     int replayed_fd = iter.second;
@@ -60,34 +79,16 @@ void ReplayerResourcesManager::initialize(SystemCallTraceReplayLogger *logger,
    * We have to scan for the open fds once, at startup time.
    * This is necessary because we need it to genereate correct
    * unused fds since dup2 needs an unused fd in replayer.
-   * This will be a very fast scan because lseek is a purely in-kernel call
-   * it looks up the fd (failing right then if the fd is closed, which will be
-   * true for over 90% of the scanned values)
-   * and then accesses the file table entry associated with the descriptor
-   * (following a couple of pointers).
-   * The time will be dominated by the cost of entering and exiting the kernel.
-   * To be safe, we scan all the way to MAX_FDs.
    */
-  struct rlimit rlim;
-  int result;
-  // If getrlimit fails, we will scan only first 100 fds.
-  int max_fds = 100;
-  // Get the limit on open files
-  result = getrlimit(RLIMIT_NOFILE, &rlim);
-  if (result >= 0) {
-    // getrlimit succeeds, sow we will scan all fds.
-    max_fds = rlim.rlim_cur;
-  }
-  fd_table_map_lock.lock();
-  auto fd_table_pid = fd_table_map_[pid];
-  fd_table_map_lock.unlock();
   std::unordered_set<int> known_fds = fd_table_pid->get_all_replayed_fds();
   logger_->log_info(
       "Start initial fd scan. Cache all fds that are not known "
       "to the resource manager.");
-  for (int fd = 0; fd <= max_fds; fd++) {
-    if (is_fd_in_use(fd) && known_fds.find(fd) == known_fds.end()) {
+  std::lock_guard<std::mutex> guard(replayer_used_fds_lock_);
+  for (int fd : list_open_fds()) {
+    if (known_fds.find(fd) == known_fds.end()) {
       replayer_used_fds_.insert(fd);
+      used_fds_.acquire(fd);
     }
   }
   if (replayer_used_fds_.size() > 1) {
@@ -102,137 +103,146 @@ void ReplayerResourcesManager::initialize(SystemCallTraceReplayLogger *logger,
 
 void ReplayerResourcesManager::add_fd(pid_t pid, int traced_fd, int replayed_fd,
                                       int flags) {
-  assert(fd_table_map_.find(pid) != fd_table_map_.end());
-  fd_table_map_[pid]->add_fd_entry(traced_fd, replayed_fd, flags);
+  PerPidFileDescriptorTableMap::const_accessor table;
+  if (fd_table(pid, table)->add_fd_entry(traced_fd, replayed_fd, flags)) {
+    acquire_fd(replayed_fd);
+  }
 }
 
 int ReplayerResourcesManager::get_fd(pid_t pid, int traced_fd) {
-  assert(fd_table_map_.find(pid) != fd_table_map_.end());
-  return fd_table_map_[pid]->get_fd(traced_fd);
+  PerPidFileDescriptorTableMap::const_accessor table;
+  return fd_table(pid, table)->get_fd(traced_fd);
 }
 
 std::unordered_set<int> ReplayerResourcesManager::get_all_traced_fds(
     pid_t pid) {
-  assert(fd_table_map_.find(pid) != fd_table_map_.end());
-  return fd_table_map_[pid]->get_all_traced_fds();
+  PerPidFileDescriptorTableMap::const_accessor table;
+  return fd_table(pid, table)->get_all_traced_fds();
+}
+
+std::vector<int> ReplayerResourcesManager::get_cloexec_traced_fds(pid_t pid) {
+  PerPidFileDescriptorTableMap::const_accessor table;
+  return fd_table(pid, table)->get_cloexec_traced_fds();
 }
 
 bool ReplayerResourcesManager::has_fd(pid_t pid, int traced_fd) {
-  assert(fd_table_map_.find(pid) != fd_table_map_.end());
-  return fd_table_map_[pid]->has_fd(traced_fd);
+  PerPidFileDescriptorTableMap::const_accessor table;
+  return fd_table(pid, table)->has_fd(traced_fd);
 }
 
 int ReplayerResourcesManager::generate_unused_fd(pid_t pid) {
-  assert(fd_table_map_.find(pid) != fd_table_map_.end());
-  std::unordered_set<int> used_fds;
-
-  for (auto fds : fd_table_map_) {
-    auto fd_table = fds.second->get_all_replayed_fds();
-    used_fds.insert(fd_table.begin(), fd_table.end());
-  }
-  // Add cached replayer fds to used fds (ex. logger fd)
-  used_fds.insert(replayer_used_fds_.begin(), replayer_used_fds_.end());
-  int unused = 0;
-  while (used_fds.find(unused) != used_fds.end()) {
-    // Keep incrementing unused until we find a fd that is not used.
-    unused++;
+  int unused = used_fds_.acquire_lowest_unused();
+  while (is_fd_in_use(unused)) {
+    /*
+     * The fd was opened after the initial scan without going through
+     * this manager. Remember it as a replayer fd, which keeps the
+     * reference just taken, and keep looking.
+     */
+    replayer_used_fds_lock_.lock();
+    replayer_used_fds_.insert(unused);
+    replayer_used_fds_lock_.unlock();
+    unused = used_fds_.acquire_lowest_unused();
   }
   return unused;
 }
 
+void ReplayerResourcesManager::release_generated_fd(int fd) {
+  used_fds_.release(fd);
+}
+
 void ReplayerResourcesManager::update_fd(pid_t pid, int traced_fd,
                                          int replayed_fd) {
-  assert(fd_table_map_.find(pid) != fd_table_map_.end());
-  fd_table_map_[pid]->update_fd(traced_fd, replayed_fd);
+  PerPidFileDescriptorTableMap::const_accessor table;
+  int old_fd = fd_table(pid, table)->update_fd(traced_fd, replayed_fd);
+  acquire_fd(replayed_fd);
+  release_fd(old_fd);
 }
 
 int ReplayerResourcesManager::get_flags(pid_t pid, int traced_fd) {
-  assert(fd_table_map_.find(pid) != fd_table_map_.end());
-  return fd_table_map_[pid]->get_flags(traced_fd);
+  PerPidFileDescriptorTableMap::const_accessor table;
+  return fd_table(pid, table)->get_flags(traced_fd);
 }
 
 void ReplayerResourcesManager::set_flags(pid_t pid, int traced_fd, int flags) {
-  assert(fd_table_map_.find(pid) != fd_table_map_.end());
-  fd_table_map_[pid]->set_flags(traced_fd, flags);
+  PerPidFileDescriptorTableMap::const_accessor table;
+  fd_table(pid, table)->set_flags(traced_fd, flags);
 }
 
 void ReplayerResourcesManager::add_flags(pid_t pid, int traced_fd, int flags) {
-  assert(fd_table_map_.find(pid) != fd_table_map_.end());
-  int cur_flags = get_flags(pid, traced_fd);
+  PerPidFileDescriptorTableMap::const_accessor table;
+  FileDescriptorTableEntry *fd_table_ptr = fd_table(pid, table);
+  int cur_flags = fd_table_ptr->get_flags(traced_fd);
   cur_flags |= flags;
-  fd_table_map_[pid]->set_flags(traced_fd, cur_flags);
-}
-
-int ReplayerResourcesManager::remove_fd(pid_t pid, int traced_fd) {
-  assert(fd_table_map_.find(pid) != fd_table_map_.end());
-  FileDescriptorTableEntry *fd_table_ptr = fd_table_map_[pid];
-  return fd_table_ptr->remove_fd_entry(traced_fd);
+  fd_table_ptr->set_flags(traced_fd, cur_flags);
+}
+
+int ReplayerResourcesManager::remove_fd(pid_t pid, int traced_fd,
+                                        bool *last_use) {
+  PerPidFileDescriptorTableMap::const_accessor table;
+  FileDescriptorTableEntry *fd_table_ptr = fd_table(pid, table);
+  int replayed_fd = fd_table_ptr->remove_fd_entry(traced_fd);
+  bool unused = release_fd(replayed_fd);
+  if (last_use != nullptr) {
+    // A negative fd is not shared, so its close is replayed as usual
+    *last_use = unused || replayed_fd < 0;
+  }
+  return replayed_fd;
 }
 
 void ReplayerResourcesManager::clone_fd_table(pid_t ppid, pid_t pid,
                                               bool shared) {
-  assert(fd_table_map_.find(ppid) != fd_table_map_.end());
-  FileDescriptorTableEntry *p_fd_table_ptr = fd_table_map_[ppid];
+  FileDescriptorTableEntry *clone_fd_table_ptr;
   if (shared) {
-    fd_table_map_lock.lock();
-    fd_table_map_[pid] = p_fd_table_ptr;
-    p_fd_table_ptr->increment_rc();
-    fd_table_map_lock.unlock();
+    PerPidFileDescriptorTableMap::const_accessor p_table;
+    clone_fd_table_ptr = fd_table(ppid, p_table);
+    clone_fd_table_ptr->increment_rc();
   } else {
-    //  We need to create new FD mapping for every FD in the old table.
-    std::map<int, FileDescriptorEntry *> &p_fd_table =
-        p_fd_table_ptr->get_fd_table();
-    auto clone_fd_table_ptr = new FileDescriptorTableEntry();
-    int old_fd, new_fd, traced_fd, flags;
-    for (const auto &entry : p_fd_table) {
-      old_fd = entry.second->get_fd();
-
-      /*
-       * If old_fd is valid, use dup on the old_fd to get another reference
-       * to old_fd.
-       * If old_fd in invalid, (either SYSCALL_FAILURE or SYSCALL_SIMULATED)
-       * reuse old_fd.
-       */
-      if (old_fd > 0) {
-        new_fd = dup(old_fd);
-        if (new_fd == -1) {
-          // dup failed
-          logger_->log_err(
-              "Cloning fd_table failed"
-              " for pid: %d, fd %d\n",
-              pid, new_fd);
-        }
-      } else {
-        new_fd = old_fd;
-      }
-
-      traced_fd = entry.first;
-      flags = entry.second->get_flags();
-      clone_fd_table_ptr->add_fd_entry(traced_fd, new_fd, flags);
-    }
-    fd_table_map_lock.lock();
-    fd_table_map_[pid] = clone_fd_table_ptr;
-    fd_table_map_lock.unlock();
+    // The new table shares the entries of ppid until either one changes.
+    PerPidFileDescriptorTableMap::const_accessor p_table;
+    clone_fd_table_ptr = new FileDescriptorTableEntry(*fd_table(ppid, p_table));
   }
+  // The accessor of ppid is released first, so that locks never nest.
+  PerPidFileDescriptorTableMap::accessor table;
+  fd_table_map_.insert(table, pid);
+  table->second = clone_fd_table_ptr;
 }
 
 std::unordered_set<int> ReplayerResourcesManager::remove_fd_table(pid_t pid) {
-  assert(fd_table_map_.find(pid) != fd_table_map_.end());
-  fd_table_map_lock.lock();
-  FileDescriptorTableEntry *fd_table_ptr = fd_table_map_[pid];
+  FileDescriptorTableEntry *fd_table_ptr;
+  {
+    /*
+     * Erasing waits for every other accessor of pid to be released, so
+     * no one can use the table through pid once it is erased.
+     */
+    PerPidFileDescriptorTableMap::accessor table;
+    bool found = fd_table_map_.find(table, pid);
+    assert(found);
+    (void)found;
+    fd_table_ptr = table->second;
+    // Remove the entry for pid.
+    fd_table_map_.erase(table);
+  }
   // Decrement the reference count for this process's fd table.
   unsigned int rc = fd_table_ptr->decrement_rc();
   // If reference count reaches 0, we will destroy the fd table.
   std::unordered_set<int> fds;
   if (rc <= 0) {
-    // Need to ask replayer to close all those fds
-    fds = fd_table_ptr->get_all_replayed_fds();
+    /*
+     * Need to ask replayer to close all those fds, unless the table still
+     * shares them copy-on-write with the table of another process, or
+     * another table still uses some of them.
+     */
+    if (fd_table_ptr->detach()) {
+      for (auto &entry : fd_table_ptr->get_entries()) {
+        int replayed_fd = entry.second.get_fd();
+        if (release_fd(replayed_fd)) {
+          fds.insert(replayed_fd);
+        }
+      }
+    }
     // Free the memory that is used by fd table
     delete fd_table_ptr;
   }
-  // Remove the entry for pid.
-  fd_table_map_.erase(pid);
-  fd_table_map_lock.unlock();
   return fds;
 }
 
@@ -251,125 +261,205 @@ void ReplayerResourcesManager::print_fd_manager() {
 }
 
 mode_t ReplayerResourcesManager::get_umask(pid_t pid) {
-  assert(umask_table_.find(pid) != umask_table_.end());
-  return umask_table_[pid]->get_umask();
+  UmaskTable::const_accessor entry;
+  return umask_entry(pid, entry)->get_umask();
 }
 
 void ReplayerResourcesManager::set_umask(pid_t pid, mode_t mode) {
-  assert(umask_table_.find(pid) != umask_table_.end());
-  umask_table_[pid]->set_umask(mode);
+  UmaskTable::const_accessor entry;
+  umask_entry(pid, entry)->set_umask(mode);
 }
 
 void ReplayerResourcesManager::clone_umask(pid_t ppid, pid_t pid, bool shared) {
-  fd_table_map_lock.lock();
-  assert(umask_table_.find(ppid) != umask_table_.end());
-  // Check if two processes share same umask
-  if (shared) {
-    // Make pid points to same umask
-    umask_table_[pid] = umask_table_[ppid];
-    // Increment rc.
-    umask_table_[pid]->increment_rc();
-  } else {
-    // Create a new UmaskEntry since they don't share umask.
-    UmaskEntry *p_umask = umask_table_[ppid];
-    umask_table_[pid] = new UmaskEntry(p_umask->get_umask());
+  UmaskEntry *umask_ptr;
+  {
+    UmaskTable::const_accessor p_entry;
+    UmaskEntry *p_umask = umask_entry(ppid, p_entry);
+    // Check if two processes share same umask
+    if (shared) {
+      // Make pid points to same umask and increment rc.
+      umask_ptr = p_umask;
+      umask_ptr->increment_rc();
+    } else {
+      // Create a new UmaskEntry since they don't share umask.
+      umask_ptr = new UmaskEntry(p_umask->get_umask());
+    }
   }
-  fd_table_map_lock.unlock();
+  UmaskTable::accessor entry;
+  umask_table_.insert(entry, pid);
+  entry->second = umask_ptr;
 }
 
 void ReplayerResourcesManager::remove_umask(pid_t pid) {
-  fd_table_map_lock.lock();
-  assert(umask_table_.find(pid) != umask_table_.end());
+  UmaskEntry *umask_ptr;
+  {
+    UmaskTable::accessor entry;
+    bool found = umask_table_.find(entry, pid);
+    assert(found);
+    (void)found;
+    umask_ptr = entry->second;
+    // Remove the entry from umask table.
+    umask_table_.erase(entry);
+  }
   // Decrement the reference count for this process's umask.
-  unsigned int rc = umask_table_[pid]->decrement_rc();
+  unsigned int rc = umask_ptr->decrement_rc();
   // If reference count reaches 0, we will remove the entry from the table.
   if (rc <= 0) {
     // Free the memory that is used by UmaskEntry
-    delete umask_table_[pid];
+    delete umask_ptr;
   }
-  // Remove the entry from umask table.
-  umask_table_.erase(pid);
-  fd_table_map_lock.unlock();
 }
 
-void ReplayerResourcesManager::validate_consistency() {
+void ReplayerResourcesManager::set_consistency_check(
+    ConsistencyCheckMode mode) {
+  consistency_check_ = mode;
+}
+
+void ReplayerResourcesManager::acquire_fd(int fd) {
+  used_fds_.acquire(fd);
+  if (consistency_check_ == CONSISTENCY_CHECK_SAMPLED && fd >= 0) {
+    std::lock_guard<std::mutex> guard(changed_fds_lock_);
+    changed_fds_.insert(fd);
+  }
+}
+
+bool ReplayerResourcesManager::release_fd(int fd) {
+  bool unused = used_fds_.release(fd);
+  if (consistency_check_ == CONSISTENCY_CHECK_SAMPLED && fd >= 0) {
+    std::lock_guard<std::mutex> guard(changed_fds_lock_);
+    changed_fds_.insert(fd);
+  }
+  return unused;
+}
+
+std::vector<int> ReplayerResourcesManager::list_open_fds() {
+  std::vector<int> fds;
+  DIR *dir = opendir("/proc/self/fd");
+  if (dir != nullptr) {
+    // Reading the directory costs one system call per batch of open fds.
+    int dir_fd = dirfd(dir);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      if (entry->d_name[0] == '.') {
+        continue;
+      }
+      int fd = atoi(entry->d_name);
+      if (fd != dir_fd) {
+        fds.push_back(fd);
+      }
+    }
+    closedir(dir);
+    std::sort(fds.begin(), fds.end());
+    return fds;
+  }
+
   /*
-   * This will be a very fast scan because lseek is a purely in-kernel call
-   * it looks up the fd (failing right then if the fd is closed, which will be
-   * true for over 90% of
-   * the scanned values) and then accesses the file table entry associated with
-   * the descriptor
-   * (following a couple of pointers). The time will be dominated by the cost of
-   * entering
-   * and exiting the kernel. To be safe, we scan all the way to MAX_FDs.
+   * /proc is not mounted, so probe every fd with lseek, which is a purely
+   * in-kernel call: it looks up the fd (failing right then if the fd is
+   * closed) and accesses the file table entry associated with the
+   * descriptor. The time will be dominated by the cost of entering and
+   * exiting the kernel. To be safe, we scan all the way to MAX_FDs.
    */
   struct rlimit rlim;
-  int result;
   int max_fds;
   // Get the limit on open files
-  result = getrlimit(RLIMIT_NOFILE, &rlim);
-  if (result >= 0) {
+  if (getrlimit(RLIMIT_NOFILE, &rlim) >= 0) {
     // getrlimit succeeds, so we will scan all fds.
     max_fds = rlim.rlim_cur;
   } else {
     // If getrlimit fails, we will scan only first MAX_FD_TO_SCAN fds.
     max_fds = MAX_FD_TO_SCAN;
   }
-
-  // Hold all fds that resource manager knows
-  std::unordered_set<int> used_fds;
-  // Add cached replayer fds to used fds (ex. logger fd)
-  used_fds.insert(replayer_used_fds_.begin(), replayer_used_fds_.end());
-
-  for (auto &iter : fd_table_map_) {
-    pid_t pid = iter.first;
-    std::unordered_set<int> process_used_fds =
-        fd_table_map_[pid]->get_all_replayed_fds();
-    used_fds.insert(process_used_fds.begin(), process_used_fds.end());
-  }
-
   for (int fd = 0; fd < max_fds; fd++) {
-    bool fd_used = is_fd_in_use(fd);
-    // Make every fd that is open is known to this resource manager.
-    if (fd_used && used_fds.find(fd) == used_fds.end()) {
-      /*
-       * This fd is in use, but the resource manager doesn't know about that.
-       * Let's print a warning message to warn the user about this situation.
-       * This is caused by some code that creates a fd by opening
-       * a file without the resource manager knowing it. This could
-       * cause serious problems in replaying.
-       */
-      logger_->log_warn(
-          "Unknown and currently in used file descriptor to the resource "
-          "manager is found: fd #",
-          fd);
-    } else if (!fd_used && used_fds.find(fd) != used_fds.end()) {
-      /*
-       * This fd is NOT in use, but the resource manager thinks that
-       * this fd is in use. Let's print a warning message to warn the user
-       * about this situation. This is caused by some code that closes a fd
-       * without the
-       * resource manager knowing it. This could
-       * cause serious problems in replaying.
-       */
-      logger_->log_err(
-          "Unused file descriptor, but the resource manager "
-          "thinks it is in used: fd #",
-          fd);
+    if (is_fd_in_use(fd)) {
+      fds.push_back(fd);
     }
+  }
+  return fds;
+}
 
+void ReplayerResourcesManager::report_inconsistency(int fd, bool fd_used,
+                                                    bool known) {
+  if (fd_used && !known) {
+    /*
+     * This fd is in use, but the resource manager doesn't know about that.
+     * Let's print a warning message to warn the user about this situation.
+     * This is caused by some code that creates a fd by opening
+     * a file without the resource manager knowing it. This could
+     * cause serious problems in replaying.
+     */
+    logger_->log_warn(
+        "Unknown and currently in used file descriptor to the resource "
+        "manager is found: fd #",
+        fd);
+  } else if (!fd_used && known) {
     /*
-     * Note that fd_used && used_fds.find(unused) != used_fds.end() is
-     * okay because this condition indicates that fd is used and resource
-     * manager knows about it.
-     * !fd_used && used_fds.find(unused) == used_fds.end() is also
-     * okay because this condition indicates that fd is not used and the
-     * resource
-     * manager doesn't know about it.
+     * This fd is NOT in use, but the resource manager thinks that
+     * this fd is in use. Let's print a warning message to warn the user
+     * about this situation. This is caused by some code that closes a fd
+     * without the resource manager knowing it. This could
+     * cause serious problems in replaying.
      */
+    logger_->log_err(
+        "Unused file descriptor, but the resource manager "
+        "thinks it is in used: fd #",
+        fd);
   }
 }
 
+void ReplayerResourcesManager::validate_consistency() {
+  switch (consistency_check_) {
+    case CONSISTENCY_CHECK_OFF:
+      break;
+    case CONSISTENCY_CHECK_SAMPLED: {
+      // Only the fds that changed since the last check can be inconsistent.
+      std::unordered_set<int> changed_fds;
+      changed_fds_lock_.lock();
+      changed_fds.swap(changed_fds_);
+      changed_fds_lock_.unlock();
+      for (int fd : changed_fds) {
+        report_inconsistency(fd, is_fd_in_use(fd), used_fds_.is_used(fd));
+      }
+      break;
+    }
+    case CONSISTENCY_CHECK_FULL: {
+      // Both lists are sorted, so walk them side by side.
+      std::vector<int> open_fds = list_open_fds();
+      std::vector<int> known_fds = used_fds_.used_fds();
+      auto open_iter = open_fds.begin();
+      auto known_iter = known_fds.begin();
+      while (open_iter != open_fds.end() || known_iter != known_fds.end()) {
+        if (known_iter == known_fds.end() ||
+            (open_iter != open_fds.end() && *open_iter < *known_iter)) {
+          report_inconsistency(*open_iter++, true, false);
+        } else if (open_iter == open_fds.end() || *known_iter < *open_iter) {
+          report_inconsistency(*known_iter++, false, true);
+        } else {
+          ++open_iter;
+          ++known_iter;
+        }
+      }
+      break;
+    }
+  }
+}
+
+FileDescriptorTableEntry *ReplayerResourcesManager::fd_table(
+    pid_t pid, PerPidFileDescriptorTableMap::const_accessor &table) {
+  bool found = fd_table_map_.find(table, pid);
+  assert(found);
+  (void)found;
+  return table->second;
+}
+
+UmaskEntry *ReplayerResourcesManager::umask_entry(
+    pid_t pid, UmaskTable::const_accessor &entry) {
+  bool found = umask_table_.find(entry, pid);
+  assert(found);
+  (void)found;
+  return entry->second;
+}
+
 bool ReplayerResourcesManager::is_fd_in_use(int fd) {
   int result = lseek(fd, 0, SEEK_CUR);
   return result >= 0 || EBADF != errno;
@@ -382,9 +472,9 @@ BasicEntry::BasicEntry() : rc_(1) {}
 void BasicEntry::increment_rc() { rc_++; }
 
 unsigned int BasicEntry::decrement_rc() {
-  assert(rc_ != 0);
-  rc_--;
-  return rc_;
+  unsigned int rc = --rc_;
+  assert(rc != UINT_MAX);
+  return rc;
 }
 
 // =========================== UmaskEntry Implementation
@@ -400,10 +490,8 @@ void UmaskEntry::set_umask(mode_t m) { umask_ = m; }
 FileDescriptorEntry::FileDescriptorEntry(int fd, int flags)
     : fd_(fd), flags_(flags) {}
 
-FileDescriptorEntry::FileDescriptorEntry(FileDescriptorEntry &fd_entry) {
-  fd_ = fd_entry.get_fd();
-  flags_ = fd_entry.get_flags();
-}
+FileDescriptorEntry::FileDescriptorEntry(const FileDescriptorEntry &fd_entry)
+    : fd_(fd_entry.fd_), flags_(fd_entry.flags_) {}
 
 int FileDescriptorEntry::get_fd() { return fd_; }
 
@@ -421,38 +509,160 @@ std::string FileDescriptorEntry::to_string() {
 
 // =========================== FileDescriptorTableEntry Implementation
 // ==========================
-FileDescriptorTableEntry::FileDescriptorTableEntry() : BasicEntry() {}
+FileDescriptorTableEntry::FileDescriptorTableEntry(
+    FileDescriptorAllocator *used_fds)
+    : BasicEntry(), used_fds_(used_fds), generation_(0) {
+  auto slots = new FileDescriptorSlots(INITIAL_FD_TABLE_SIZE);
+  for (size_t index = 0; index < slots->size; index++) {
+    slots->slots[index].store(EMPTY_SLOT, std::memory_order_relaxed);
+  }
+  slot_arrays_.emplace_back(slots);
+  slots_.store(slots, std::memory_order_release);
+}
 
 FileDescriptorTableEntry::FileDescriptorTableEntry(
     FileDescriptorTableEntry &fd_table_entry)
-    : BasicEntry() {
-  std::map<int, FileDescriptorEntry *> &fd_table_copy =
-      fd_table_entry.get_fd_table();
-  for (auto &iter : fd_table_copy) {
-    int traced_fd = iter.first;
-    FileDescriptorEntry *fd_ptr = iter.second;
-    add_fd_entry(traced_fd, fd_ptr->get_fd(), fd_ptr->get_flags());
+    : BasicEntry(), used_fds_(fd_table_entry.used_fds_), generation_(0) {
+  // Share the current array of fd_table_entry instead of copying it.
+  std::lock_guard<std::mutex> guard(fd_table_entry.write_lock_);
+  const std::shared_ptr<FileDescriptorSlots> &slots =
+      fd_table_entry.slot_arrays_.back();
+  slots->sharers++;
+  slot_arrays_.push_back(slots);
+  slots_.store(slots.get(), std::memory_order_release);
+}
+
+bool FileDescriptorTableEntry::detach() {
+  std::lock_guard<std::mutex> guard(write_lock_);
+  FileDescriptorSlots *slots = slots_.load(std::memory_order_relaxed);
+  return slots->sharers.fetch_sub(1, std::memory_order_acq_rel) == 1;
+}
+
+uint64_t FileDescriptorTableEntry::load_slot(int traced_fd) {
+  FileDescriptorSlots *slots = slots_.load(std::memory_order_acquire);
+  size_t index = traced_fd + 1;
+  if (traced_fd < -1 || index >= slots->size) {
+    return EMPTY_SLOT;
   }
+  return slots->slots[index].load(std::memory_order_acquire);
 }
 
-FileDescriptorTableEntry::~FileDescriptorTableEntry() {
-  for (auto &iter : fd_table_) {
-    FileDescriptorEntry *fd_ptr = iter.second;
-    delete fd_ptr;
+void FileDescriptorTableEntry::copy_slots(FileDescriptorSlots *from,
+                                          FileDescriptorSlots *to) {
+  for (size_t index = 0; index < to->size; index++) {
+    uint64_t slot = EMPTY_SLOT;
+    if (index < from->size) {
+      slot = from->slots[index].load(std::memory_order_relaxed);
+    }
+    to->slots[index].store(slot, std::memory_order_relaxed);
+  }
+  size_t words = std::min(from->cloexec.size(), to->cloexec.size());
+  std::copy(from->cloexec.begin(), from->cloexec.begin() + words,
+            to->cloexec.begin());
+}
+
+std::vector<int> FileDescriptorTableEntry::replayed_fds(
+    FileDescriptorSlots *slots) {
+  std::vector<int> fds;
+  for (size_t index = 0; index < slots->size; index++) {
+    uint64_t slot = slots->slots[index].load(std::memory_order_relaxed);
+    if (slot != EMPTY_SLOT && slot_fd(slot) >= 0) {
+      fds.push_back(slot_fd(slot));
+    }
+  }
+  return fds;
+}
+
+void FileDescriptorTableEntry::make_private() {
+  FileDescriptorSlots *slots = slots_.load(std::memory_order_relaxed);
+  unsigned int sharers = slots->sharers.load(std::memory_order_acquire);
+  if (sharers <= 1) {
+    return;
+  }
+  /*
+   * No sharer changes the array in place while we still count as one
+   * of its sharers, so it is safe to copy it first. The copy takes its
+   * references before we leave, because the last sharer may drop the
+   * references of the array, and close its fds, as soon as we are gone.
+   */
+  std::shared_ptr<FileDescriptorSlots> copy(
+      new FileDescriptorSlots(slots->size));
+  copy_slots(slots, copy.get());
+  std::vector<int> fds = replayed_fds(copy.get());
+  used_fds_->acquire(fds);
+  while (!slots->sharers.compare_exchange_weak(sharers, sharers - 1,
+                                               std::memory_order_acq_rel)) {
+    if (sharers == 1) {
+      // Every other table stopped sharing meanwhile, so keep the array.
+      used_fds_->release(fds);
+      return;
+    }
   }
+  slot_arrays_.push_back(copy);
+  slots_.store(copy.get(), std::memory_order_release);
 }
 
-std::map<int, FileDescriptorEntry *> &FileDescriptorTableEntry::get_fd_table() {
-  return fd_table_;
+void FileDescriptorTableEntry::store_slot(int traced_fd, uint64_t slot) {
+  if (traced_fd < -1) {
+    return;
+  }
+  FileDescriptorSlots *slots = slots_.load(std::memory_order_relaxed);
+  size_t index = traced_fd + 1;
+  if (index >= slots->size) {
+    if (slot == EMPTY_SLOT) {
+      return;
+    }
+    // Publish a bigger copy; lookups keep reading the old one until then.
+    size_t size = std::max(slots->size * 2, index + 1);
+    std::shared_ptr<FileDescriptorSlots> new_slots(
+        new FileDescriptorSlots(size));
+    copy_slots(slots, new_slots.get());
+    slot_arrays_.push_back(new_slots);
+    slots_.store(new_slots.get(), std::memory_order_release);
+    slots = new_slots.get();
+  }
+  uint64_t &cloexec = slots->cloexec[index / 64];
+  uint64_t cloexec_bit = 1ull << (index % 64);
+  if (slot != EMPTY_SLOT && (slot_flags(slot) & O_CLOEXEC) != 0) {
+    cloexec |= cloexec_bit;
+  } else {
+    cloexec &= ~cloexec_bit;
+  }
+  uint64_t generation = generation_.load(std::memory_order_relaxed);
+  generation_.store(generation + 1, std::memory_order_relaxed);
+  // The release store makes the odd generation visible before the slot.
+  slots->slots[index].store(slot, std::memory_order_release);
+  generation_.store(generation + 2, std::memory_order_release);
+}
+
+std::vector<std::pair<int, FileDescriptorEntry>>
+FileDescriptorTableEntry::get_entries() {
+  std::vector<std::pair<int, FileDescriptorEntry>> entries;
+  uint64_t before, after;
+  do {
+    entries.clear();
+    before = generation_.load(std::memory_order_acquire);
+    FileDescriptorSlots *slots = slots_.load(std::memory_order_acquire);
+    for (size_t index = 0; index < slots->size; index++) {
+      // Acquire keeps the second generation load after the slot loads.
+      uint64_t slot = slots->slots[index].load(std::memory_order_acquire);
+      if (slot != EMPTY_SLOT) {
+        entries.emplace_back(
+            static_cast<int>(index) - 1,
+            FileDescriptorEntry(slot_fd(slot), slot_flags(slot)));
+      }
+    }
+    after = generation_.load(std::memory_order_acquire);
+    // Retry if a writer changed a slot while we were copying them.
+  } while (before != after || (before & 1) != 0);
+  return entries;
 }
 
-void FileDescriptorTableEntry::add_fd_entry(int traced_fd, int replayed_fd,
+bool FileDescriptorTableEntry::add_fd_entry(int traced_fd, int replayed_fd,
                                             int flags) {
-#ifdef WEBSERVER_TESTING
-  fd_table_entry_mutex.lock();
-#endif
+  std::lock_guard<std::mutex> guard(write_lock_);
   // fd_table_ shouldn't have an entry for traced_fd if traced_fd is NOT -1
-  assert(traced_fd == -1 || fd_table_.find(traced_fd) == fd_table_.end());
+  assert(traced_fd == -1 || !has_fd(traced_fd));
   /*
    * Because an application can call open system call with invalid
    * file path many times and get -1 as its return value, this function
@@ -460,99 +670,112 @@ void FileDescriptorTableEntry::add_fd_entry(int traced_fd, int replayed_fd,
    * to have a memory leak problem where we keep creating a entry
    * for traced_fd=-1
    */
-  if (traced_fd != -1 || !has_fd(traced_fd)) {
-    // Create a FileDescriptorEntry
-    fd_table_[traced_fd] = new FileDescriptorEntry(replayed_fd, flags);
+  bool added = traced_fd >= 0 || (traced_fd == -1 && !has_fd(traced_fd));
+  if (added) {
+    make_private();
+    store_slot(traced_fd, pack_slot(replayed_fd, flags));
   }
-#ifdef WEBSERVER_TESTING
-  fd_table_entry_mutex.unlock();
-#endif
+  return added;
 }
 
 int FileDescriptorTableEntry::remove_fd_entry(int traced_fd) {
+  std::lock_guard<std::mutex> guard(write_lock_);
+  uint64_t slot = load_slot(traced_fd);
   /*
    * fd_table_ may not have an entry for traced_fd because
    * traced_fd is invalid.
    */
-  if (!has_fd(traced_fd)) {
+  if (slot == EMPTY_SLOT) {
     return -1;
   }
-#ifdef WEBSERVER_TESTING
-  fd_table_entry_mutex.lock();
-#endif
-  int replayed_fd = fd_table_[traced_fd]->get_fd();
-  // Free the memory
-  delete fd_table_[traced_fd];
-  // Erase the entry
-  fd_table_.erase(traced_fd);
-#ifdef WEBSERVER_TESTING
-  fd_table_entry_mutex.unlock();
-#endif
-  return replayed_fd;
+  // Only this table stops using the replayed fd.
+  make_private();
+  slot = load_slot(traced_fd);
+  store_slot(traced_fd, EMPTY_SLOT);
+  return slot_fd(slot);
 }
 
 int FileDescriptorTableEntry::get_fd(int traced_fd) {
+  uint64_t slot = load_slot(traced_fd);
   /*
    * fd_table_ may not have an entry for traced_fd because
    * traced_fd is invalid.
    */
-  if (!has_fd(traced_fd)) {
+  if (slot == EMPTY_SLOT) {
     return -1;
   }
   // Return replayed fd corresponding to traced_fd
-  return fd_table_[traced_fd]->get_fd();
+  return slot_fd(slot);
 }
 
 bool FileDescriptorTableEntry::has_fd(int traced_fd) {
-  return fd_table_.find(traced_fd) != fd_table_.end();
+  return load_slot(traced_fd) != EMPTY_SLOT;
 }
 
 std::unordered_set<int> FileDescriptorTableEntry::get_all_traced_fds() {
   std::unordered_set<int> fds;
-  for (auto &iter : fd_table_) {
-    fds.insert(iter.first);
+  for (auto &entry : get_entries()) {
+    fds.insert(entry.first);
   }
   return fds;
 }
 
 std::unordered_set<int> FileDescriptorTableEntry::get_all_replayed_fds() {
   std::unordered_set<int> fds;
-  for (auto &iter : fd_table_) {
-    FileDescriptorEntry *fd_ptr = iter.second;
-    fds.insert(fd_ptr->get_fd());
+  for (auto &entry : get_entries()) {
+    fds.insert(entry.second.get_fd());
+  }
+  return fds;
+}
+
+std::vector<int> FileDescriptorTableEntry::get_cloexec_traced_fds() {
+  std::lock_guard<std::mutex> guard(write_lock_);
+  FileDescriptorSlots *slots = slots_.load(std::memory_order_relaxed);
+  std::vector<int> fds;
+  for (size_t word = 0; word < slots->cloexec.size(); word++) {
+    uint64_t bits = slots->cloexec[word];
+    while (bits != 0) {
+      // Slot index - 1 is the traced fd
+      fds.push_back(word * 64 + __builtin_ctzll(bits) - 1);
+      // Clear the lowest set bit
+      bits &= bits - 1;
+    }
   }
   return fds;
 }
 
-void FileDescriptorTableEntry::update_fd(int traced_fd, int replayed_fd) {
+int FileDescriptorTableEntry::update_fd(int traced_fd, int replayed_fd) {
+  std::lock_guard<std::mutex> guard(write_lock_);
+  make_private();
+  uint64_t slot = load_slot(traced_fd);
   // fd_table_ should have an entry for traced_fd
-  assert(fd_table_.find(traced_fd) != fd_table_.end());
-  // Create a FileDescriptorEntry
-  fd_table_[traced_fd]->set_fd(replayed_fd);
+  assert(slot != EMPTY_SLOT);
+  store_slot(traced_fd, pack_slot(replayed_fd, slot_flags(slot)));
+  return slot_fd(slot);
 }
 
 int FileDescriptorTableEntry::get_flags(int traced_fd) {
+  uint64_t slot = load_slot(traced_fd);
   // fd_table_ should have an entry for traced_fd
-  assert(fd_table_.find(traced_fd) != fd_table_.end());
-  // Create a FileDescriptorEntry
-  return fd_table_[traced_fd]->get_flags();
+  assert(slot != EMPTY_SLOT);
+  return slot_flags(slot);
 }
 
 void FileDescriptorTableEntry::set_flags(int traced_fd, int flags) {
+  std::lock_guard<std::mutex> guard(write_lock_);
+  make_private();
+  uint64_t slot = load_slot(traced_fd);
   // fd_table_ should have an entry for traced_fd
-  assert(fd_table_.find(traced_fd) != fd_table_.end());
-  // Create a FileDescriptorEntry
-  fd_table_[traced_fd]->set_flags(flags);
+  assert(slot != EMPTY_SLOT);
+  store_slot(traced_fd, pack_slot(slot_fd(slot), flags));
 }
 
 std::string FileDescriptorTableEntry::to_string() {
   std::stringstream ss;
-  ss << "Reference count: " << rc_ << std::endl;
-  for (auto &table_iter : fd_table_) {
-    int traced_fd = table_iter.first;
-    FileDescriptorEntry *fd_entry = table_iter.second;
-    ss << "Traced fd: " << traced_fd << " -> ";
-    ss << fd_entry->to_string() << std::endl;
+  ss << "Reference count: " << rc_.load() << std::endl;
+  for (auto &entry : get_entries()) {
+    ss << "Traced fd: " << entry.first << " -> ";
+    ss << entry.second.to_string() << std::endl;
   }
   return ss.str();
 }
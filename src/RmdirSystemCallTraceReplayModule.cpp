@@ -47,7 +47,7 @@ void RmdirSystemCallTraceReplayModule::print_specific_fields() {
 
 void RmdirSystemCallTraceReplayModule::processRow() {
   // Replay rmdir sys call.
-  replayed_ret_val_ = rmdir(pathname);
+  replayed_ret_val_ = engine_->rmdir(pathname);
   delete[] pathname;
 }
 
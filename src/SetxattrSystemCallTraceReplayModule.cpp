@@ -72,30 +72,16 @@ void SetxattrSystemCallTraceReplayModule::processRow() {
   // Check to see if user wants to use pattern
   if (!pattern_data_.empty()) {
     value = new char[size];
-    if (pattern_data_ == "random") {
-      // Fill value buffer using rand()
-      value = random_fill_buffer(value, size);
-    } else if (pattern_data_ == "urandom") {
-      // Fill value buffer using data generated from /dev/urandom
-      SystemCallTraceReplayModule::random_file_.read(value, size);
-    } else {
-      // Write zeros or pattern specified in pattern_data
-      unsigned char pattern = pattern_data_[0];
-
-      /*
-       * XXX FUTURE WORK: Currently we support pattern of one byte
-       * For multi byte pattern data, we have to modify the
-       * implementation of filling value.
-       */
-      memset(value, pattern, size);
-    }
+    fill_pattern_buffer(pattern_data_, value, size);
     // replay the setxattr system call
-    replayed_ret_val_ = setxattr(pathname, xattr_name, value, size, flags);
+    replayed_ret_val_ =
+        engine_->setxattr(pathname, xattr_name, value, size, flags);
   } else {
     // Use the traced data
     auto value = reinterpret_cast<const char *>(value_written_.val());
     // replay the setxattr system call
-    replayed_ret_val_ = setxattr(pathname, xattr_name, value, size, flags);
+    replayed_ret_val_ =
+        engine_->setxattr(pathname, xattr_name, value, size, flags);
   }
 
   // Free the buffer
@@ -134,30 +120,16 @@ void LSetxattrSystemCallTraceReplayModule::processRow() {
   // Check to see if user wants to use pattern
   if (!pattern_data_.empty()) {
     value = new char[size];
-    if (pattern_data_ == "random") {
-      // Fill value buffer using rand()
-      value = random_fill_buffer(value, size);
-    } else if (pattern_data_ == "urandom") {
-      // Fill value buffer using data generated from /dev/urandom
-      SystemCallTraceReplayModule::random_file_.read(value, size);
-    } else {
-      // Write zeros or pattern specified in pattern_data
-      unsigned char pattern = pattern_data_[0];
-
-      /*
-       * XXX FUTURE WORK: Currently we support pattern of one byte
-       * For multi byte pattern data, we have to modify the
-       * implementation of filling value.
-       */
-      memset(value, pattern, size);
-    }
+    fill_pattern_buffer(pattern_data_, value, size);
     // replay the setxattr system call
-    replayed_ret_val_ = lsetxattr(pathname, xattr_name, value, size, flags);
+    replayed_ret_val_ =
+        engine_->lsetxattr(pathname, xattr_name, value, size, flags);
   } else {
     // Use the traced data
     auto value = reinterpret_cast<const char *>(value_written_.val());
     // replay the setxattr system call
-    replayed_ret_val_ = lsetxattr(pathname, xattr_name, value, size, flags);
+    replayed_ret_val_ =
+        engine_->lsetxattr(pathname, xattr_name, value, size, flags);
   }
 
   // Free the buffer
@@ -210,30 +182,14 @@ void FSetxattrSystemCallTraceReplayModule::processRow() {
   // Check to see if user wants to use pattern
   if (!pattern_data_.empty()) {
     value = new char[size];
-    if (pattern_data_ == "random") {
-      // Fill value buffer using rand()
-      value = random_fill_buffer(value, size);
-    } else if (pattern_data_ == "urandom") {
-      // Fill value buffer using data generated from /dev/urandom
-      SystemCallTraceReplayModule::random_file_.read(value, size);
-    } else {
-      // Write zeros or pattern specified in pattern_data
-      unsigned char pattern = pattern_data_[0];
-
-      /*
-       * XXX FUTURE WORK: Currently we support pattern of one byte
-       * For multi byte pattern data, we have to modify the
-       * implementation of filling value.
-       */
-      memset(value, pattern, size);
-    }
+    fill_pattern_buffer(pattern_data_, value, size);
     // replay the fsetxattr system call
-    replayed_ret_val_ = fsetxattr(fd, xattr_name, value, size, flags);
+    replayed_ret_val_ = engine_->fsetxattr(fd, xattr_name, value, size, flags);
   } else {
     // Use the traced data
     auto value = reinterpret_cast<const char *>(value_written_.val());
     // replay the fsetxattr system call
-    replayed_ret_val_ = fsetxattr(fd, xattr_name, value, size, flags);
+    replayed_ret_val_ = engine_->fsetxattr(fd, xattr_name, value, size, flags);
   }
 
   // Free the buffer
@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the StallAnalyzer header
+ * file.
+ *
+ * Read StallAnalyzer.hpp for more information about this class.
+ */
+
+#include "StallAnalyzer.hpp"
+
+#include <algorithm>
+#include <boost/format.hpp>
+#include <utility>
+#include <vector>
+
+// System calls listed in the critical path breakdown
+#define CRITICAL_PATH_TOP_SYSCALLS 10
+
+static const char *const activity_names[REPLAY_ACTIVITIES] = {
+    "execute", "reader",       "window",
+    "blocked", "backpressure", "scheduling"};
+
+// What would shorten a critical path dominated by each activity
+static const char *const activity_advice[REPLAY_ACTIVITIES] = {
+    "executing system calls bounds the replay: a faster device or I/O "
+    "engine would help, more threads would not",
+    "the reader bounds the replay: decoding records faster would help",
+    "the ordering window bounds the replay: records wait for earlier "
+    "ones, so neither more threads nor a faster device would help much",
+    "dependencies between threads bound the replay: records wait for "
+    "records on other threads, so more threads would not help",
+    "asynchronous I/O completion bounds the replay: a faster device "
+    "would help",
+    "scheduling overhead bounds the replay: the executors spend their "
+    "time between records"};
+
+static uint64_t nanoseconds_between(std::chrono::steady_clock::time_point from,
+                                    std::chrono::steady_clock::time_point to) {
+  return to > from ? std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         to - from)
+                         .count()
+                   : 0;
+}
+
+StallAnalyzer::CriticalPath::CriticalPath() : records(0), handoffs(0) {
+  std::fill_n(nanoseconds, REPLAY_ACTIVITIES, 0);
+}
+
+uint64_t StallAnalyzer::CriticalPath::total() const {
+  uint64_t total = 0;
+  for (int activity = 0; activity < REPLAY_ACTIVITIES; activity++) {
+    total += nanoseconds[activity];
+  }
+  return total;
+}
+
+StallAnalyzer::Executor::Executor(StallAnalyzer *analyzer, int64_t thread_id)
+    : analyzer_(analyzer),
+      thread_id_(thread_id),
+      mark_(std::chrono::steady_clock::now()),
+      blocker_(-1),
+      records_(0) {
+  std::fill_n(pending_, REPLAY_ACTIVITIES, 0);
+  std::fill_n(nanoseconds_, REPLAY_ACTIVITIES, 0);
+  std::fill_n(stalled_records_, REPLAY_ACTIVITIES, 0);
+  path_.end = mark_;
+}
+
+void StallAnalyzer::Executor::account(ReplayActivity activity,
+                                      int64_t blocker) {
+  auto now = std::chrono::steady_clock::now();
+  pending_[activity] += nanoseconds_between(mark_, now);
+  mark_ = now;
+  if (blocker >= 0) {
+    blocker_ = blocker;
+  }
+}
+
+void StallAnalyzer::Executor::finish_record(const std::string &syscall,
+                                            int64_t pid) {
+  // The record waited for the thread that blocked it last, if that
+  // thread's chain ends later than this one's.
+  CriticalPath blocker_path;
+  bool handoff = false;
+  if (blocker_ >= 0 && blocker_ != thread_id_) {
+    Executor *blocker = analyzer_->find(blocker_);
+    if (blocker != nullptr) {
+      std::lock_guard<std::mutex> lock(blocker->path_lock_);
+      if (blocker->path_.end > path_.end) {
+        blocker_path = blocker->path_;
+        handoff = true;
+      }
+    }
+  }
+
+  uint64_t waited = 0;
+  for (int activity = 0; activity < REPLAY_ACTIVITIES; activity++) {
+    nanoseconds_[activity] += pending_[activity];
+    if (activity != ACTIVITY_EXECUTE) {
+      waited += pending_[activity];
+      if (activity != ACTIVITY_SCHEDULING && pending_[activity] > 0) {
+        stalled_records_[activity]++;
+      }
+    }
+  }
+  records_++;
+
+  std::lock_guard<std::mutex> lock(path_lock_);
+  if (handoff) {
+    path_ = std::move(blocker_path);
+    path_.handoffs++;
+  }
+  /*
+   * Only the time after the predecessor on the path ended is on the
+   * path. Execution comes last; the waits share the rest.
+   */
+  uint64_t on_path = nanoseconds_between(path_.end, mark_);
+  uint64_t executed = std::min(on_path, pending_[ACTIVITY_EXECUTE]);
+  uint64_t rest = on_path - executed;
+  path_.nanoseconds[ACTIVITY_EXECUTE] += executed;
+  if (waited == 0) {
+    path_.nanoseconds[ACTIVITY_SCHEDULING] += rest;
+  } else {
+    for (int activity = 0; activity < REPLAY_ACTIVITIES; activity++) {
+      if (activity != ACTIVITY_EXECUTE) {
+        path_.nanoseconds[activity] += static_cast<uint64_t>(
+            static_cast<double>(rest) * pending_[activity] / waited);
+      }
+    }
+  }
+  path_.per_pid[pid] += on_path;
+  path_.per_syscall[syscall] += executed;
+  path_.records++;
+  path_.end = mark_;
+
+  std::fill_n(pending_, REPLAY_ACTIVITIES, 0);
+  blocker_ = -1;
+}
+
+StallAnalyzer::StallAnalyzer() : started_(std::chrono::steady_clock::now()) {}
+
+StallAnalyzer::Executor *StallAnalyzer::find(int64_t thread_id) {
+  std::lock_guard<std::mutex> lock(executors_lock_);
+  auto executor = executors_.find(thread_id);
+  return executor != executors_.end() ? executor->second.get() : nullptr;
+}
+
+StallAnalyzer::Executor *StallAnalyzer::executor_started(int64_t thread_id) {
+  std::lock_guard<std::mutex> lock(executors_lock_);
+  /*
+   * A process replayed again reuses its executor, which other executors
+   * may still look up, without the time in between.
+   */
+  std::unique_ptr<Executor> &executor = executors_[thread_id];
+  if (executor == nullptr) {
+    executor.reset(new Executor(this, thread_id));
+  } else {
+    executor->mark_ = std::chrono::steady_clock::now();
+  }
+  return executor.get();
+}
+
+void StallAnalyzer::report(std::ostream &out) {
+  std::lock_guard<std::mutex> lock(executors_lock_);
+  double elapsed = nanoseconds_between(started_,
+                                       std::chrono::steady_clock::now()) /
+                   1e9;
+
+  // Time of all executors by activity
+  uint64_t nanoseconds[REPLAY_ACTIVITIES] = {0};
+  uint64_t stalled_records[REPLAY_ACTIVITIES] = {0};
+  uint64_t records = 0;
+  uint64_t total = 0;
+  const CriticalPath *critical = nullptr;
+  for (auto &entry : executors_) {
+    Executor &executor = *entry.second;
+    for (int activity = 0; activity < REPLAY_ACTIVITIES; activity++) {
+      nanoseconds[activity] += executor.nanoseconds_[activity];
+      stalled_records[activity] += executor.stalled_records_[activity];
+      total += executor.nanoseconds_[activity];
+    }
+    records += executor.records_;
+    if (critical == nullptr || executor.path_.end > critical->end) {
+      critical = &executor.path_;
+    }
+  }
+
+  out << boost::format("Replay of %u records by %u executors in %.3f s\n\n") %
+             records % executors_.size() % elapsed;
+  out << "Executor time by activity:\n";
+  out << boost::format("  %-14s %12s %8s %16s\n") % "activity" % "seconds" %
+             "share" % "records waiting";
+  for (int activity = 0; activity < REPLAY_ACTIVITIES; activity++) {
+    out << boost::format("  %-14s %12.3f %7.1f%% %16u\n") %
+               activity_names[activity] % (nanoseconds[activity] / 1e9) %
+               (total == 0 ? 0.0 : 100.0 * nanoseconds[activity] / total) %
+               stalled_records[activity];
+  }
+
+  out << "\nEach executor, in seconds:\n  " << boost::format("%-10s %10s") %
+                                                   "thread" % "records";
+  for (int activity = 0; activity < REPLAY_ACTIVITIES; activity++) {
+    out << boost::format(" %12s") % activity_names[activity];
+  }
+  out << "\n";
+  for (auto &entry : executors_) {
+    Executor &executor = *entry.second;
+    out << boost::format("  %-10d %10u") % entry.first % executor.records_;
+    for (int activity = 0; activity < REPLAY_ACTIVITIES; activity++) {
+      out << boost::format(" %12.3f") % (executor.nanoseconds_[activity] / 1e9);
+    }
+    out << "\n";
+  }
+
+  if (critical == nullptr || critical->records == 0) {
+    out << "\nNo record was executed, so there is no critical path.\n";
+    return;
+  }
+  uint64_t path_total = critical->total();
+  out << boost::format(
+             "\nCritical path: %u records, %u moves between threads, "
+             "%.3f s ending %.3f s into the replay\n") %
+             critical->records % critical->handoffs % (path_total / 1e9) %
+             (nanoseconds_between(started_, critical->end) / 1e9);
+  int dominant = ACTIVITY_EXECUTE;
+  for (int activity = 0; activity < REPLAY_ACTIVITIES; activity++) {
+    out << boost::format("  %-14s %12.3f %7.1f%%\n") %
+               activity_names[activity] %
+               (critical->nanoseconds[activity] / 1e9) %
+               (100.0 * critical->nanoseconds[activity] / path_total);
+    if (critical->nanoseconds[activity] > critical->nanoseconds[dominant]) {
+      dominant = activity;
+    }
+  }
+
+  out << "\nCritical path by traced process, in seconds:\n";
+  for (auto &pid : critical->per_pid) {
+    out << boost::format("  %-10d %12.3f\n") % pid.first % (pid.second / 1e9);
+  }
+
+  std::vector<std::pair<uint64_t, std::string>> syscalls;
+  for (auto &syscall : critical->per_syscall) {
+    syscalls.emplace_back(syscall.second, syscall.first);
+  }
+  std::sort(syscalls.rbegin(), syscalls.rend());
+  if (syscalls.size() > CRITICAL_PATH_TOP_SYSCALLS) {
+    syscalls.resize(CRITICAL_PATH_TOP_SYSCALLS);
+  }
+  out << "\nSystem calls executing longest on the critical path, in "
+         "seconds:\n";
+  for (auto &syscall : syscalls) {
+    out << boost::format("  %-14s %12.3f\n") % syscall.second %
+               (syscall.first / 1e9);
+  }
+
+  out << "\nVerdict: " << activity_advice[dominant] << ".\n";
+}
@@ -52,5 +52,5 @@ void SymlinkSystemCallTraceReplayModule::processRow() {
   char *link_path = (char *)given_pathname_.val();
 
   // Replay symlink system call
-  replayed_ret_val_ = symlink(target_path, link_path);
+  replayed_ret_val_ = engine_->symlink(target_path, link_path);
 }
@@ -0,0 +1,537 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the SyscallEngine header file
+ *
+ * Read SyscallEngine.hpp for more information about these classes.
+ */
+
+#include "SyscallEngine.hpp"
+#include "MemFsSyscallEngine.hpp"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+SyscallEngine *SyscallEngine::create(const std::string &name) {
+  if (name == "kernel") {
+    return new KernelSyscallEngine();
+  }
+  if (name == "null") {
+    return new NullSyscallEngine();
+  }
+  if (name == "memfs") {
+    return new MemFsSyscallEngine();
+  }
+  return nullptr;
+}
+
+int KernelSyscallEngine::access(const char *path, int mode) {
+  return ::access(path, mode);
+}
+
+int KernelSyscallEngine::faccessat(int dirfd, const char *path, int mode,
+                                   int flags) {
+  return ::faccessat(dirfd, path, mode, flags);
+}
+
+int KernelSyscallEngine::stat(const char *path, struct stat *buf) {
+  return ::stat(path, buf);
+}
+
+int KernelSyscallEngine::lstat(const char *path, struct stat *buf) {
+  return ::lstat(path, buf);
+}
+
+int KernelSyscallEngine::fstat(int fd, struct stat *buf) {
+  return ::fstat(fd, buf);
+}
+
+int KernelSyscallEngine::fstatat(int dirfd, const char *path,
+                                 struct stat *buf, int flags) {
+  return ::fstatat(dirfd, path, buf, flags);
+}
+
+int KernelSyscallEngine::statfs(const char *path, struct statfs *buf) {
+  return ::statfs(path, buf);
+}
+
+int KernelSyscallEngine::fstatfs(int fd, struct statfs *buf) {
+  return ::fstatfs(fd, buf);
+}
+
+int KernelSyscallEngine::chdir(const char *path) { return ::chdir(path); }
+
+int KernelSyscallEngine::fchdir(int fd) { return ::fchdir(fd); }
+
+int KernelSyscallEngine::chmod(const char *path, mode_t mode) {
+  return ::chmod(path, mode);
+}
+
+int KernelSyscallEngine::fchmod(int fd, mode_t mode) {
+  return ::fchmod(fd, mode);
+}
+
+int KernelSyscallEngine::fchmodat(int dirfd, const char *path, mode_t mode,
+                                  int flags) {
+  return ::fchmodat(dirfd, path, mode, flags);
+}
+
+int KernelSyscallEngine::chown(const char *path, uid_t owner, gid_t group) {
+  return ::chown(path, owner, group);
+}
+
+int KernelSyscallEngine::openat(int dirfd, const char *path, int flags,
+                                mode_t mode) {
+  return ::openat(dirfd, path, flags, mode);
+}
+
+int KernelSyscallEngine::creat(const char *path, mode_t mode) {
+  return ::creat(path, mode);
+}
+
+int KernelSyscallEngine::close(int fd) { return ::close(fd); }
+
+int KernelSyscallEngine::dup(int fd) { return ::dup(fd); }
+
+int KernelSyscallEngine::dup2(int old_fd, int new_fd) {
+  return ::dup2(old_fd, new_fd);
+}
+
+int KernelSyscallEngine::dup3(int old_fd, int new_fd, int flags) {
+  return ::dup3(old_fd, new_fd, flags);
+}
+
+int KernelSyscallEngine::fcntl(int fd, int cmd, long arg) {
+  return ::fcntl(fd, cmd, arg);
+}
+
+int KernelSyscallEngine::fcntl(int fd, int cmd, struct flock *lock) {
+  return ::fcntl(fd, cmd, lock);
+}
+
+int KernelSyscallEngine::ioctl(int fd, unsigned long request, long arg) {
+  return ::ioctl(fd, request, arg);
+}
+
+int KernelSyscallEngine::ioctl(int fd, unsigned long request, void *arg) {
+  return ::ioctl(fd, request, arg);
+}
+
+int KernelSyscallEngine::pipe(int fds[2]) { return ::pipe(fds); }
+
+ssize_t KernelSyscallEngine::read(int fd, void *buf, size_t count) {
+  return ::read(fd, buf, count);
+}
+
+ssize_t KernelSyscallEngine::pread(int fd, void *buf, size_t count,
+                                   off_t offset) {
+  return ::pread(fd, buf, count, offset);
+}
+
+ssize_t KernelSyscallEngine::readv(int fd, const struct iovec *iov,
+                                   int iovcnt) {
+  return ::readv(fd, iov, iovcnt);
+}
+
+ssize_t KernelSyscallEngine::write(int fd, const void *buf, size_t count) {
+  return ::write(fd, buf, count);
+}
+
+ssize_t KernelSyscallEngine::pwrite(int fd, const void *buf, size_t count,
+                                    off_t offset) {
+  return ::pwrite(fd, buf, count, offset);
+}
+
+ssize_t KernelSyscallEngine::writev(int fd, const struct iovec *iov,
+                                    int iovcnt) {
+  return ::writev(fd, iov, iovcnt);
+}
+
+off_t KernelSyscallEngine::lseek(int fd, off_t offset, int whence) {
+  return ::lseek(fd, offset, whence);
+}
+
+ssize_t KernelSyscallEngine::readahead(int fd, off64_t offset, size_t count) {
+  return ::readahead(fd, offset, count);
+}
+
+int KernelSyscallEngine::fallocate(int fd, int mode, off_t offset,
+                                   off_t len) {
+  return ::fallocate(fd, mode, offset, len);
+}
+
+int KernelSyscallEngine::fsync(int fd) { return ::fsync(fd); }
+
+int KernelSyscallEngine::fdatasync(int fd) { return ::fdatasync(fd); }
+
+int KernelSyscallEngine::truncate(const char *path, off_t length) {
+  return ::truncate(path, length);
+}
+
+int KernelSyscallEngine::ftruncate(int fd, off_t length) {
+  return ::ftruncate(fd, length);
+}
+
+long KernelSyscallEngine::getdents(int fd, void *buf, unsigned int count) {
+  // glibc has no wrapper for getdents
+  return syscall(SYS_getdents, fd, buf, count);
+}
+
+int KernelSyscallEngine::mkdir(const char *path, mode_t mode) {
+  return ::mkdir(path, mode);
+}
+
+int KernelSyscallEngine::mkdirat(int dirfd, const char *path, mode_t mode) {
+  return ::mkdirat(dirfd, path, mode);
+}
+
+int KernelSyscallEngine::mknod(const char *path, mode_t mode, dev_t dev) {
+  return ::mknod(path, mode, dev);
+}
+
+int KernelSyscallEngine::rmdir(const char *path) { return ::rmdir(path); }
+
+int KernelSyscallEngine::link(const char *old_path, const char *new_path) {
+  return ::link(old_path, new_path);
+}
+
+int KernelSyscallEngine::linkat(int old_dirfd, const char *old_path,
+                                int new_dirfd, const char *new_path,
+                                int flags) {
+  return ::linkat(old_dirfd, old_path, new_dirfd, new_path, flags);
+}
+
+int KernelSyscallEngine::symlink(const char *target, const char *link_path) {
+  return ::symlink(target, link_path);
+}
+
+ssize_t KernelSyscallEngine::readlink(const char *path, char *buf,
+                                      size_t size) {
+  return ::readlink(path, buf, size);
+}
+
+int KernelSyscallEngine::rename(const char *old_path, const char *new_path) {
+  return ::rename(old_path, new_path);
+}
+
+int KernelSyscallEngine::unlink(const char *path) { return ::unlink(path); }
+
+int KernelSyscallEngine::unlinkat(int dirfd, const char *path, int flags) {
+  return ::unlinkat(dirfd, path, flags);
+}
+
+int KernelSyscallEngine::utime(const char *path, const struct utimbuf *times) {
+  return ::utime(path, times);
+}
+
+int KernelSyscallEngine::utimes(const char *path,
+                                const struct timeval times[2]) {
+  return ::utimes(path, times);
+}
+
+int KernelSyscallEngine::utimensat(int dirfd, const char *path,
+                                   const struct timespec times[2], int flags) {
+  // The glibc wrapper rejects a NULL path, which traces may have
+  return syscall(SYS_utimensat, dirfd, path, times, flags);
+}
+
+int KernelSyscallEngine::setxattr(const char *path, const char *name,
+                                  const void *value, size_t size, int flags) {
+  return ::setxattr(path, name, value, size, flags);
+}
+
+int KernelSyscallEngine::lsetxattr(const char *path, const char *name,
+                                   const void *value, size_t size,
+                                   int flags) {
+  return ::lsetxattr(path, name, value, size, flags);
+}
+
+int KernelSyscallEngine::fsetxattr(int fd, const char *name, const void *value,
+                                   size_t size, int flags) {
+  return ::fsetxattr(fd, name, value, size, flags);
+}
+
+void *KernelSyscallEngine::mmap(void *addr, size_t length, int prot,
+                                int flags, int fd, off_t offset) {
+  return ::mmap(addr, length, prot, flags, fd, offset);
+}
+
+thread_local int64_t NullSyscallEngine::traced_return_value_ = 0;
+thread_local int NullSyscallEngine::traced_errno_ = 0;
+
+void NullSyscallEngine::begin_call(int64_t traced_return_value,
+                                   int traced_errno) {
+  traced_return_value_ = traced_return_value;
+  traced_errno_ = traced_errno;
+}
+
+int64_t NullSyscallEngine::traced_result() const {
+  if (traced_return_value_ < 0) {
+    errno = traced_errno_;
+  }
+  return traced_return_value_;
+}
+
+int NullSyscallEngine::access(const char *path, int mode) {
+  return traced_result();
+}
+
+int NullSyscallEngine::faccessat(int dirfd, const char *path, int mode,
+                                 int flags) {
+  return traced_result();
+}
+
+int NullSyscallEngine::stat(const char *path, struct stat *buf) {
+  std::memset(buf, 0, sizeof(*buf));
+  return traced_result();
+}
+
+int NullSyscallEngine::lstat(const char *path, struct stat *buf) {
+  std::memset(buf, 0, sizeof(*buf));
+  return traced_result();
+}
+
+int NullSyscallEngine::fstat(int fd, struct stat *buf) {
+  std::memset(buf, 0, sizeof(*buf));
+  return traced_result();
+}
+
+int NullSyscallEngine::fstatat(int dirfd, const char *path, struct stat *buf,
+                               int flags) {
+  std::memset(buf, 0, sizeof(*buf));
+  return traced_result();
+}
+
+int NullSyscallEngine::statfs(const char *path, struct statfs *buf) {
+  std::memset(buf, 0, sizeof(*buf));
+  return traced_result();
+}
+
+int NullSyscallEngine::fstatfs(int fd, struct statfs *buf) {
+  std::memset(buf, 0, sizeof(*buf));
+  return traced_result();
+}
+
+int NullSyscallEngine::chdir(const char *path) { return traced_result(); }
+
+int NullSyscallEngine::fchdir(int fd) { return traced_result(); }
+
+int NullSyscallEngine::chmod(const char *path, mode_t mode) {
+  return traced_result();
+}
+
+int NullSyscallEngine::fchmod(int fd, mode_t mode) { return traced_result(); }
+
+int NullSyscallEngine::fchmodat(int dirfd, const char *path, mode_t mode,
+                                int flags) {
+  return traced_result();
+}
+
+int NullSyscallEngine::chown(const char *path, uid_t owner, gid_t group) {
+  return traced_result();
+}
+
+int NullSyscallEngine::openat(int dirfd, const char *path, int flags,
+                              mode_t mode) {
+  return traced_result();
+}
+
+int NullSyscallEngine::creat(const char *path, mode_t mode) {
+  return traced_result();
+}
+
+int NullSyscallEngine::close(int fd) { return traced_result(); }
+
+int NullSyscallEngine::dup(int fd) { return traced_result(); }
+
+int NullSyscallEngine::dup2(int old_fd, int new_fd) { return traced_result(); }
+
+int NullSyscallEngine::dup3(int old_fd, int new_fd, int flags) {
+  return traced_result();
+}
+
+int NullSyscallEngine::fcntl(int fd, int cmd, long arg) {
+  return traced_result();
+}
+
+int NullSyscallEngine::fcntl(int fd, int cmd, struct flock *lock) {
+  return traced_result();
+}
+
+int NullSyscallEngine::ioctl(int fd, unsigned long request, long arg) {
+  return traced_result();
+}
+
+int NullSyscallEngine::ioctl(int fd, unsigned long request, void *arg) {
+  return traced_result();
+}
+
+int NullSyscallEngine::pipe(int fds[2]) {
+  // fds already hold the traced fds, which become the replayed ones
+  return traced_result();
+}
+
+ssize_t NullSyscallEngine::read(int fd, void *buf, size_t count) {
+  return traced_result();
+}
+
+ssize_t NullSyscallEngine::pread(int fd, void *buf, size_t count,
+                                 off_t offset) {
+  return traced_result();
+}
+
+ssize_t NullSyscallEngine::readv(int fd, const struct iovec *iov, int iovcnt) {
+  return traced_result();
+}
+
+ssize_t NullSyscallEngine::write(int fd, const void *buf, size_t count) {
+  return traced_result();
+}
+
+ssize_t NullSyscallEngine::pwrite(int fd, const void *buf, size_t count,
+                                  off_t offset) {
+  return traced_result();
+}
+
+ssize_t NullSyscallEngine::writev(int fd, const struct iovec *iov,
+                                  int iovcnt) {
+  return traced_result();
+}
+
+off_t NullSyscallEngine::lseek(int fd, off_t offset, int whence) {
+  return traced_result();
+}
+
+ssize_t NullSyscallEngine::readahead(int fd, off64_t offset, size_t count) {
+  return traced_result();
+}
+
+int NullSyscallEngine::fallocate(int fd, int mode, off_t offset, off_t len) {
+  return traced_result();
+}
+
+int NullSyscallEngine::fsync(int fd) { return traced_result(); }
+
+int NullSyscallEngine::fdatasync(int fd) { return traced_result(); }
+
+int NullSyscallEngine::truncate(const char *path, off_t length) {
+  return traced_result();
+}
+
+int NullSyscallEngine::ftruncate(int fd, off_t length) {
+  return traced_result();
+}
+
+long NullSyscallEngine::getdents(int fd, void *buf, unsigned int count) {
+  return traced_result();
+}
+
+int NullSyscallEngine::mkdir(const char *path, mode_t mode) {
+  return traced_result();
+}
+
+int NullSyscallEngine::mkdirat(int dirfd, const char *path, mode_t mode) {
+  return traced_result();
+}
+
+int NullSyscallEngine::mknod(const char *path, mode_t mode, dev_t dev) {
+  return traced_result();
+}
+
+int NullSyscallEngine::rmdir(const char *path) { return traced_result(); }
+
+int NullSyscallEngine::link(const char *old_path, const char *new_path) {
+  return traced_result();
+}
+
+int NullSyscallEngine::linkat(int old_dirfd, const char *old_path,
+                              int new_dirfd, const char *new_path,
+                              int flags) {
+  return traced_result();
+}
+
+int NullSyscallEngine::symlink(const char *target, const char *link_path) {
+  return traced_result();
+}
+
+ssize_t NullSyscallEngine::readlink(const char *path, char *buf,
+                                    size_t size) {
+  return traced_result();
+}
+
+int NullSyscallEngine::rename(const char *old_path, const char *new_path) {
+  return traced_result();
+}
+
+int NullSyscallEngine::unlink(const char *path) { return traced_result(); }
+
+int NullSyscallEngine::unlinkat(int dirfd, const char *path, int flags) {
+  return traced_result();
+}
+
+int NullSyscallEngine::utime(const char *path, const struct utimbuf *times) {
+  return traced_result();
+}
+
+int NullSyscallEngine::utimes(const char *path,
+                              const struct timeval times[2]) {
+  return traced_result();
+}
+
+int NullSyscallEngine::utimensat(int dirfd, const char *path,
+                                 const struct timespec times[2], int flags) {
+  return traced_result();
+}
+
+int NullSyscallEngine::setxattr(const char *path, const char *name,
+                                const void *value, size_t size, int flags) {
+  return traced_result();
+}
+
+int NullSyscallEngine::lsetxattr(const char *path, const char *name,
+                                 const void *value, size_t size, int flags) {
+  return traced_result();
+}
+
+int NullSyscallEngine::fsetxattr(int fd, const char *name, const void *value,
+                                 size_t size, int flags) {
+  return traced_result();
+}
+
+void *NullSyscallEngine::mmap(void *addr, size_t length, int prot, int flags,
+                              int fd, off_t offset) {
+  if (traced_result() < 0) {
+    return MAP_FAILED;
+  }
+  return ::mmap(nullptr, length, prot | PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+}
@@ -33,8 +33,78 @@
 
 #include "SystemCallTraceReplayLogger.hpp"
 
+#include <algorithm>
+#include <chrono>
+
+/*
+ * An encoded record starts with its size in bytes, its level and the
+ * time it was logged, followed by the encoded arguments.
+ */
+#define LOG_RECORD_SIZE_OFFSET 0
+#define LOG_RECORD_LEVEL_OFFSET 4
+#define LOG_RECORD_TIME_OFFSET 8
+#define LOG_RECORD_HEADER_SIZE 16
+
+std::atomic<uint64_t> SystemCallTraceReplayLogger::next_id_(1);
+
+SystemCallTraceReplayLogger::LogRing::LogRing(size_t ring_size)
+    : buffer(new char[ring_size]),
+      size(ring_size),
+      head(0),
+      tail(0),
+      dropped(0),
+      retired(false) {}
+
+bool SystemCallTraceReplayLogger::LogRing::push(const std::string &record) {
+  uint64_t h = head.load(std::memory_order_relaxed);
+  uint64_t t = tail.load(std::memory_order_acquire);
+  if (size - (h - t) < record.size()) {
+    return false;
+  }
+  size_t start = h % size;
+  size_t first = std::min(record.size(), size - start);
+  std::memcpy(buffer.get() + start, record.data(), first);
+  std::memcpy(buffer.get(), record.data() + first, record.size() - first);
+  head.store(h + record.size(), std::memory_order_release);
+  return true;
+}
+
+bool SystemCallTraceReplayLogger::LogRing::pop(std::string &record) {
+  uint64_t t = tail.load(std::memory_order_relaxed);
+  uint64_t h = head.load(std::memory_order_acquire);
+  if (h == t) {
+    return false;
+  }
+  size_t start = t % size;
+  // Records are at least as long as the header, so the size is complete
+  uint32_t record_size;
+  for (size_t i = 0; i < sizeof(record_size); i++) {
+    reinterpret_cast<char *>(&record_size)[i] =
+        buffer[(start + LOG_RECORD_SIZE_OFFSET + i) % size];
+  }
+  size_t first = std::min<size_t>(record_size, size - start);
+  record.assign(buffer.get() + start, first);
+  record.append(buffer.get(), record_size - first);
+  tail.store(t + record_size, std::memory_order_release);
+  return true;
+}
+
+bool SystemCallTraceReplayLogger::LogRing::empty() const {
+  return head.load(std::memory_order_acquire) ==
+         tail.load(std::memory_order_acquire);
+}
+
 SystemCallTraceReplayLogger::SystemCallTraceReplayLogger(
-    std::string log_filename) {
+    std::string log_filename, LogMode mode, size_t ring_size)
+    : id_(next_id_++),
+      enabled_(false),
+      mode_(mode),
+      ring_size_(std::max<size_t>(ring_size, LOG_RING_MIN_SIZE)),
+      level_(LOG_INFO),
+      stop_(false),
+      passes_(0),
+      coarse_time_(time(nullptr)),
+      formatted_time_(-1) {
   // Open log file in append mode
   this->logger_file_.open(log_filename.c_str(),
                           std::ios_base::app | std::ios_base::out);
@@ -42,25 +112,244 @@ SystemCallTraceReplayLogger::SystemCallTraceReplayLogger(
     std::cerr << "Unable to open log file" << std::endl;
     exit(EXIT_FAILURE);
   }
+  // Without a log file, every log call returns right away
+  enabled_ = this->logger_file_.is_open();
+  if (enabled_ && mode_ != LOG_SYNC) {
+    writer_ = std::thread(&SystemCallTraceReplayLogger::drain, this);
+  }
+}
+
+std::string &SystemCallTraceReplayLogger::begin_record(LogLevel level) {
+  static thread_local std::string record;
+  record.resize(LOG_RECORD_HEADER_SIZE);
+  uint32_t level_val = level;
+  int64_t now = mode_ == LOG_SYNC
+                    ? time(nullptr)
+                    : coarse_time_.load(std::memory_order_relaxed);
+  std::memcpy(&record[LOG_RECORD_LEVEL_OFFSET], &level_val, sizeof(level_val));
+  std::memcpy(&record[LOG_RECORD_TIME_OFFSET], &now, sizeof(now));
+  return record;
+}
+
+void SystemCallTraceReplayLogger::commit_record(std::string &record) {
+  uint32_t size = record.size();
+  std::memcpy(&record[LOG_RECORD_SIZE_OFFSET], &size, sizeof(size));
+
+  if (mode_ == LOG_SYNC) {
+    std::lock_guard<std::mutex> lock(sync_lock_);
+    write_record(record);
+    logger_file_.flush();
+    return;
+  }
+
+  LogRing *ring = thread_ring();
+  while (!ring->push(record)) {
+    if (mode_ == LOG_ASYNC_DROP) {
+      ring->dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    wake_cv_.notify_one();
+    std::this_thread::yield();
+  }
+}
+
+SystemCallTraceReplayLogger::LogRing *
+SystemCallTraceReplayLogger::thread_ring() {
+  /*
+   * The ring of a thread is retired when the thread exits, and the
+   * background thread frees it once it has written what is left in it.
+   */
+  struct ThreadRing {
+    uint64_t logger_id = 0;
+    std::shared_ptr<LogRing> ring;
+    ~ThreadRing() {
+      if (ring) {
+        ring->retired.store(true, std::memory_order_release);
+      }
+    }
+  };
+  static thread_local ThreadRing thread_ring;
+
+  if (thread_ring.logger_id != id_) {
+    if (thread_ring.ring) {
+      thread_ring.ring->retired.store(true, std::memory_order_release);
+    }
+    thread_ring.ring = std::make_shared<LogRing>(ring_size_);
+    thread_ring.logger_id = id_;
+    std::lock_guard<std::mutex> lock(rings_lock_);
+    rings_.push_back(thread_ring.ring);
+  }
+  return thread_ring.ring.get();
 }
 
-void SystemCallTraceReplayLogger::print_logs(std::stringstream &&log_stream) {
-  this->logger_file_ << log_stream.str();
+void SystemCallTraceReplayLogger::drain() {
+  std::vector<std::shared_ptr<LogRing>> rings;
+  std::string record;
+
+  while (true) {
+    coarse_time_.store(time(nullptr), std::memory_order_relaxed);
+    // Everything pushed before stop_ was set is written by this pass
+    bool stopping = stop_.load(std::memory_order_acquire);
+
+    {
+      std::lock_guard<std::mutex> lock(rings_lock_);
+      auto retired = std::remove_if(
+          rings_.begin(), rings_.end(), [](const std::shared_ptr<LogRing> &r) {
+            return r->retired.load(std::memory_order_acquire) && r->empty() &&
+                   r->dropped.load(std::memory_order_relaxed) == 0;
+          });
+      rings_.erase(retired, rings_.end());
+      rings = rings_;
+    }
+
+    size_t written = 0;
+    for (auto &ring : rings) {
+      while (ring->pop(record)) {
+        write_record(record);
+        written++;
+      }
+      uint64_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+      if (dropped != 0) {
+        std::string &note = begin_record(LOG_WARN);
+        encode_args(note, dropped,
+                    " log messages were dropped because the log buffer "
+                    "was full");
+        write_record(note);
+        written++;
+      }
+    }
+    if (written != 0) {
+      logger_file_.flush();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(flush_lock_);
+      passes_++;
+    }
+    flushed_cv_.notify_all();
+
+    if (stopping) {
+      break;
+    }
+    if (written == 0) {
+      std::unique_lock<std::mutex> lock(wake_lock_);
+      wake_cv_.wait_for(lock, std::chrono::milliseconds(1));
+    }
+  }
 }
 
-std::string SystemCallTraceReplayLogger::format_time() {
-  static char buffer[TIMESTAMP_BUFFER_SIZE];
-  time_t rawtime;
-  struct tm *curr_time;
+void SystemCallTraceReplayLogger::flush() {
+  if (!enabled_ || mode_ == LOG_SYNC) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(flush_lock_);
+  // The second pass from now starts after the records were pushed
+  uint64_t target = passes_ + 2;
+  wake_cv_.notify_one();
+  flushed_cv_.wait(lock, [&] { return passes_ >= target; });
+}
 
-  time(&rawtime);
-  curr_time = localtime(&rawtime);
+void SystemCallTraceReplayLogger::encode_string(std::string &record,
+                                                const char *data,
+                                                size_t size) {
+  size_t room = LOG_RECORD_MAX_SIZE - 1 - sizeof(uint32_t);
+  room = record.size() < room ? room - record.size() : 0;
+  uint32_t length = std::min(size, room);
+  record.push_back(static_cast<char>(LOG_ARG_STRING));
+  record.append(reinterpret_cast<const char *>(&length), sizeof(length));
+  record.append(data, length);
+}
 
-  strftime(buffer, TIMESTAMP_BUFFER_SIZE, "%Y-%m-%d %H:%M:%S", curr_time);
-  return std::string(buffer);
+std::ostringstream &SystemCallTraceReplayLogger::fallback_stream() {
+  static thread_local std::ostringstream stream;
+  stream.str("");
+  stream.clear();
+  return stream;
+}
+
+/*
+ * Read a value of type T from the record at pos and advance pos.
+ */
+template <typename T>
+static T decode_raw(const std::string &record, size_t &pos) {
+  T value;
+  std::memcpy(&value, record.data() + pos, sizeof(value));
+  pos += sizeof(value);
+  return value;
+}
+
+void SystemCallTraceReplayLogger::write_record(const std::string &record) {
+  static const char *level_names[] = {"[ERROR] ", "[WARN] ", "[INFO] ",
+                                      "[DEBUG] "};
+  size_t pos = LOG_RECORD_LEVEL_OFFSET;
+  uint32_t level = decode_raw<uint32_t>(record, pos);
+  time_t logged_time = decode_raw<int64_t>(record, pos);
+
+  // Timestamps only change once a second, so reuse the last one
+  if (logged_time != formatted_time_) {
+    char buffer[TIMESTAMP_BUFFER_SIZE];
+    struct tm curr_time;
+    localtime_r(&logged_time, &curr_time);
+    strftime(buffer, TIMESTAMP_BUFFER_SIZE, "%Y-%m-%d %H:%M:%S", &curr_time);
+    formatted_time_ = logged_time;
+    formatted_time_str_ = buffer;
+  }
+
+  // Manipulators only apply to the record they were logged with
+  format_stream_.str("");
+  format_stream_.clear();
+  format_stream_.flags(std::ios_base::dec | std::ios_base::skipws);
+  format_stream_.fill(' ');
+  format_stream_.precision(6);
+  format_stream_.width(0);
+
+  while (pos < record.size()) {
+    auto type = static_cast<LogArgType>(record[pos++]);
+    switch (type) {
+      case LOG_ARG_CHAR:
+        format_stream_ << decode_raw<char>(record, pos);
+        break;
+      case LOG_ARG_INT:
+        format_stream_ << decode_raw<int64_t>(record, pos);
+        break;
+      case LOG_ARG_UINT:
+        format_stream_ << decode_raw<uint64_t>(record, pos);
+        break;
+      case LOG_ARG_DOUBLE:
+        format_stream_ << decode_raw<double>(record, pos);
+        break;
+      case LOG_ARG_STRING: {
+        uint32_t length = decode_raw<uint32_t>(record, pos);
+        format_stream_.write(record.data() + pos, length);
+        pos += length;
+        break;
+      }
+      case LOG_ARG_POINTER:
+        format_stream_ << decode_raw<const void *>(record, pos);
+        break;
+      case LOG_ARG_IOS_MANIPULATOR:
+        format_stream_ << decode_raw<IosManipulator>(record, pos);
+        break;
+      case LOG_ARG_OSTREAM_MANIPULATOR:
+        format_stream_ << decode_raw<OstreamManipulator>(record, pos);
+        break;
+      default:
+        pos = record.size();
+        break;
+    }
+  }
+
+  const char *level_name = level < 4 ? level_names[level] : "";
+  logger_file_ << formatted_time_str_ << level_name << format_stream_.str()
+               << '\n';
 }
 
 SystemCallTraceReplayLogger::~SystemCallTraceReplayLogger() {
-  // Close the log file
+  // Write out what is still buffered, then close the log file
+  if (writer_.joinable()) {
+    stop_.store(true, std::memory_order_release);
+    wake_cv_.notify_one();
+    writer_.join();
+  }
   logger_file_.close();
 }
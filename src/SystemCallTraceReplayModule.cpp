@@ -46,7 +46,9 @@ SystemCallTraceReplayModule::SystemCallTraceReplayModule(
       return_value_(series, "return_value", Field::flag_nullable),
       unique_id_(series, "unique_id"),
       rows_per_call_(1),
-      replayed_ret_val_(0) {}
+      replayed_ret_val_(0),
+      async_pending_(false),
+      verify_started_(0) {}
 
 bool SystemCallTraceReplayModule::verbose_mode() const { return verbose_; }
 
@@ -138,7 +140,87 @@ void SystemCallTraceReplayModule::prepareRow() {
 }
 
 void SystemCallTraceReplayModule::execute() {
-  processRow();
+  if (latency_recorder_ != nullptr || replay_recorder_ != nullptr) {
+    replay_started_ = std::chrono::steady_clock::now();
+    verify_started_ = ProfileScope::verify_nanoseconds;
+  }
+  {
+    ProfileScope scope(profiler_, PROFILE_EXECUTE);
+    engine_->begin_call(returnVal, errorNoVal);
+    processRow();
+  }
+  // Asynchronous records are completed by complete_async_io() instead.
+  if (!async_pending_) {
+    // processRow() verifies the data after the call returned
+    record_replayed_call(std::chrono::nanoseconds(
+        ProfileScope::verify_nanoseconds - verify_started_));
+    completeProcessing();
+  }
+}
+
+bool SystemCallTraceReplayModule::async_pending() const {
+  return async_pending_;
+}
+
+void SystemCallTraceReplayModule::set_async_result(int64_t result) {
+  async_pending_ = false;
+  if (result < 0) {
+    replayed_ret_val_ = -1;
+    errno = static_cast<int>(-result);
+  } else {
+    replayed_ret_val_ = result;
+  }
+  // The data is verified after this
+  record_replayed_call(std::chrono::nanoseconds(0));
+}
+
+void SystemCallTraceReplayModule::record_replayed_call(
+    std::chrono::nanoseconds verifying) {
+  if (telemetry_ != nullptr) {
+    uint64_t bytes =
+        transfers_data() && replayed_ret_val_ > 0 ? replayed_ret_val_ : 0;
+    telemetry_->count_call(replayerIndex, bytes, uniqueIdVal, timeCalledVal);
+  }
+  if (latency_recorder_ == nullptr && replay_recorder_ == nullptr) {
+    return;
+  }
+  // compare_retval_and_errno() still needs the errno of the replayed call
+  int replayed_errno = errno;
+  auto replay_finished = std::chrono::steady_clock::now() - verifying;
+
+  if (replay_recorder_ != nullptr) {
+    ReplayedCall call;
+    call.unique_id = uniqueIdVal;
+    call.syscall = replayerIndex;
+    call.called = replay_started_;
+    call.returned = replay_finished;
+    call.return_value = replayed_ret_val_;
+    call.errno_number = replayed_ret_val_ < 0 ? replayed_errno : 0;
+    call.executing_pid = executingPidVal;
+    replay_recorder_->record(call);
+  }
+
+  if (latency_recorder_ != nullptr) {
+    // Tfracs are 2^-32 seconds; convert whole seconds separately so that
+    // long calls do not overflow.
+    uint64_t traced_tfracs = timeReturnedVal > timeCalledVal
+                                 ? timeReturnedVal - timeCalledVal
+                                 : 0;
+    uint64_t traced_ns =
+        (traced_tfracs >> 32) * 1000000000ULL +
+        (((traced_tfracs & 0xffffffffULL) * 1000000000ULL) >> 32);
+    latency_recorder_->record(
+        sys_call_name_,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(replay_finished -
+                                                             replay_started_)
+            .count(),
+        traced_ns);
+  }
+  errno = replayed_errno;
+}
+
+void SystemCallTraceReplayModule::complete_async_io(int64_t result) {
+  set_async_result(result);
   completeProcessing();
 }
 
@@ -151,9 +233,11 @@ void SystemCallTraceReplayModule::after_sys_call() {
    * else skip comparing them.
    */
   if (isReplayable()) {
+    ProfileScope scope(profiler_, PROFILE_VERIFY);
     compare_retval_and_errno();
   }
-  if (verbose_mode()) {
+  if (verbose_mode() && LOGGER_ENABLED(syscall_logger_, LOG_INFO)) {
+    ProfileScope scope(profiler_, PROFILE_LOGGING);
     syscall_logger_->log_info(
         "System call '", sys_call_name_,
         "' was executed with following arguments:", sys_call_name_, ": ");
@@ -187,27 +271,74 @@ void SystemCallTraceReplayModule::compare_retval_and_errno() {
     return;
   }
 
+  int replayed_errno = errno;
   if (return_value() != replayed_ret_val_) {
     syscall_logger_->log_warn(sys_call_name_,
                               " syscall has different return values");
-    print_sys_call_fields();
-    syscall_logger_->log_warn("Return values are different.");
+    record_mismatch(MISMATCH_RETURN_VALUE, replayed_errno);
+    if (mismatch_recorder_ == nullptr) {
+      if (LOGGER_ENABLED(syscall_logger_, LOG_INFO)) {
+        print_sys_call_fields();
+      }
+      syscall_logger_->log_warn("Return values are different.");
+    }
     if (abort_mode()) {
-      abort();
+      abort_replay();
     }
   } else if (replayed_ret_val_ == -1) {
-    if (errno != errno_number()) {
+    if (replayed_errno != errno_number()) {
       syscall_logger_->log_warn(sys_call_name_,
                                 " syscall has different errno number");
-      print_sys_call_fields();
-      syscall_logger_->log_warn("Errno numbers are different.");
+      record_mismatch(MISMATCH_ERRNO, replayed_errno);
+      if (mismatch_recorder_ == nullptr) {
+        if (LOGGER_ENABLED(syscall_logger_, LOG_INFO)) {
+          print_sys_call_fields();
+        }
+        syscall_logger_->log_warn("Errno numbers are different.");
+      }
       if (abort_mode()) {
-        abort();
+        abort_replay();
       }
     }
   }
 }
 
+void SystemCallTraceReplayModule::record_mismatch(
+    MismatchKind kind, int replayed_errno, const void *traced_data,
+    size_t traced_size, const void *replayed_data, size_t replayed_size) {
+  if (telemetry_ != nullptr) {
+    telemetry_->count_mismatch(kind);
+  }
+  if (mismatch_recorder_ == nullptr) {
+    return;
+  }
+  Mismatch mismatch;
+  mismatch.unique_id = unique_id();
+  mismatch.time_called = time_called();
+  mismatch.executing_pid = executing_pid();
+  mismatch.syscall = sys_call_name_;
+  mismatch.kind = kind;
+  mismatch.traced_return_value = return_value();
+  mismatch.replayed_return_value = replayed_ret_val_;
+  mismatch.traced_errno = errno_number();
+  mismatch.replayed_errno = replayed_ret_val_ < 0 ? replayed_errno : 0;
+  mismatch.has_payload = false;
+  if (kind == MISMATCH_DATA) {
+    MismatchRecorder::set_payload(mismatch, traced_data, traced_size,
+                                  replayed_data, replayed_size);
+  }
+  mismatch_recorder_->record(mismatch);
+}
+
+void SystemCallTraceReplayModule::abort_replay() {
+  // Write out what abort() would otherwise lose
+  syscall_logger_->flush();
+  if (mismatch_recorder_ != nullptr) {
+    mismatch_recorder_->close();
+  }
+  abort();
+}
+
 double SystemCallTraceReplayModule::Tfrac_to_sec(uint64_t time) {
   double time_in_secs = static_cast<double>(time * pow(2.0, -32));
   return time_in_secs;
@@ -242,26 +373,47 @@ mode_t SystemCallTraceReplayModule::get_mode(mode_t mode) {
   return mode & ~umask;
 }
 
+bool SystemCallTraceReplayModule::is_direct_io(pid_t pid, int traced_fd) {
+  if (!engine_->uses_kernel_fds() ||
+      !replayer_resources_manager_.has_fd(pid, traced_fd)) {
+    return false;
+  }
+  return (replayer_resources_manager_.get_flags(pid, traced_fd) & O_DIRECT) !=
+         0;
+}
+
 /**
- * This function will be used to fill buffer with randomly
- * generated bytes using rand() and srand().
+ * This function will be used to fill buffer with pseudo-random
+ * bytes that depend only on the run seed, the unique id and offset.
  */
 char *SystemCallTraceReplayModule::random_fill_buffer(char *buffer,
-                                                      size_t nbytes) {
-  size_t size = sizeof(size_t);
-  size_t remaining = nbytes % size;
-  size_t bytes = nbytes - remaining;
-  size_t i, num;
-  srand(time(nullptr));
-  num = rand();
-  memcpy(buffer, &num, remaining);
-  for (i = remaining; i < bytes; i += size) {
-    num = rand();
-    memcpy(buffer + i, &num, size);
-  }
+                                                      size_t nbytes,
+                                                      uint64_t offset) {
+  pattern_generator_.fill(buffer, nbytes, unique_id(), offset);
   return buffer;
 }
 
+void SystemCallTraceReplayModule::fill_pattern_buffer(
+    const std::string &pattern_data, char *buffer, size_t nbytes,
+    uint64_t offset) {
+  if (payload_block_pool_ != nullptr) {
+    // Blocks with the requested compression and dedup ratio
+    payload_block_pool_->fill(buffer, nbytes, unique_id(), offset);
+  } else if (pattern_data == "random" || pattern_data == "urandom") {
+    random_fill_buffer(buffer, nbytes, offset);
+  } else {
+    // Write zeros or pattern specified in pattern_data
+    unsigned char pattern = pattern_data[0];
+
+    /*
+     * XXX FUTURE WORK: Currently we support pattern of one byte.
+     * For multi byte pattern data, we have to modify the
+     * implementation of filling buffer.
+     */
+    memset(buffer, pattern, nbytes);
+  }
+}
+
 /**
  * Some system calls such as _exit, execve, mmap and munmap are not
  * appropriate to replay. So we do not replay in our replayer.
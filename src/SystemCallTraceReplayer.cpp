@@ -49,46 +49,11 @@
 #include "tbb/concurrent_vector.h"
 #include "tbb/task_group.h"
 
-// #define PROFILE_ENABLE
-
-#ifdef PROFILE_ENABLE
-#define PROFILE_START(start_id)                                \
-  std::chrono::high_resolution_clock::time_point t##start_id = \
-      std::chrono::high_resolution_clock::now();
-
-#define PROFILE_END(start_id, end_id, acc)                                 \
-  std::chrono::high_resolution_clock::time_point t##end_id =               \
-      std::chrono::high_resolution_clock::now();                           \
-  acc += std::chrono::duration_cast<std::chrono::nanoseconds>(t##end_id -  \
-                                                              t##start_id) \
-             .count();
-
-#define PROFILE_SAMPLE(id) t##id = std::chrono::high_resolution_clock::now();
-
-#define PROFILE_PRINT(str, acc) std::cerr << str << acc / 1000000 << "\n";
-#else
-#define PROFILE_START(start_id)
-#define PROFILE_END(start_id, end_id, acc)
-#define PROFILE_SAMPLE(id)
-#define PROFILE_PRINT(str, acc)
-#endif
-
-/**
- * min heap uses this function to sort elements in the tree.
- * The sorting key is unique id.
- */
-struct CompareByUniqueID {
-  bool operator()(SystemCallTraceReplayModule *m1,
-                  SystemCallTraceReplayModule *m2) const {
-    return (m1->unique_id() >= m2->unique_id());
-  }
-};
-
 typedef tbb::concurrent_hash_map<int64_t, SystemCallTraceReplayModule *>
     RunningSyscallTable;
-typedef tbb::concurrent_priority_queue<SystemCallTraceReplayModule *,
-                                       CompareByUniqueID>
-    ExecutionHeap;
+// <record whose async I/O is in flight, thread that submitted it>
+typedef tbb::concurrent_hash_map<SystemCallTraceReplayModule *, int64_t>
+    InFlightSyscallTable;
 
 tbb::atomic<uint64_t> *numberOfSyscalls;
 tbb::atomic<bool> *finishedModules;
@@ -110,15 +75,13 @@ int64_t mainThreadID = 0;
 std::unordered_map<std::string, SystemCallTraceReplayModule *> syscallMapLast;
 tbb::concurrent_queue<SystemCallTraceReplayModule *> allocationQueue;
 
-int64_t fileReading_Batch_file = 0;
-int64_t fileReading_Batch_push = 0;
-int64_t fileReading_Batch_map = 0;
-int64_t fileReading_Batch_move = 0;
 bool isFirstBatch = true;
 
 int64_t replayerIdx = 0;
 tbb::atomic<uint64_t> nThreads = 1;
 tbb::atomic<uint64_t> lastExecutedSyscallID = 1;
+// Records executed by every executor, for the rate of the null engine
+tbb::atomic<uint64_t> totalSyscallsProcessed = 0;
 
 RunningSyscallTable currentExecutions;
 std::function<void(int64_t, SystemCallTraceReplayModule *)> setRunning = [](
@@ -127,15 +90,12 @@ std::function<void(int64_t, SystemCallTraceReplayModule *)> setRunning = [](
   currentExecutions.insert(acc, tid);
   acc->second = syscall;
 };
-
-#ifdef PROFILE_ENABLE
-int64_t duration = 0;
-int64_t fileReading = 0;
-int64_t gettingRecord = 0;
-int64_t loop = 0;
-int64_t destroy = 0;
-int64_t executionSpinning = 0;
-#endif
+/*
+ * Records stay here from their execute() until their async I/O completes,
+ * so that records of other threads that depend on them wait as they would
+ * for a running record.
+ */
+InFlightSyscallTable inFlightExecutions;
 
 /**
  * This function declares a group of options that will
@@ -165,9 +125,67 @@ boost::program_options::variables_map get_options(int argc, char *argv[]) {
       "exactly what was used originally")("warn,w", po::value<int>(),
                                           "system call replays in warn mode")(
       "pattern,p", po::value<std::string>(),
-      "write repeated pattern data in write system call")(
+      "write repeated pattern data in write system call, or generated "
+      "blocks with gen:compress=R,dedup=F,block=SIZE")(
+      "seed", po::value<uint64_t>(),
+      "seed of the payloads written with pattern random, urandom or gen "
+      "(default 0 for random, read from /dev/urandom for urandom)")(
       "logger,l", po::value<std::string>(),
-      "write the replayer logs in specified filename");
+      "write the replayer logs in specified filename")(
+      "aio", po::value<unsigned int>()->implicit_value(AIO_DEFAULT_BATCH_SIZE),
+      "replay I/O on O_DIRECT file descriptors asynchronously with libaio, "
+      "submitting up to arg requests per process at once")(
+      "cache", po::value<std::string>(),
+      "page cache state before replay: 'cold' evicts every file the trace "
+      "opens, 'warm' reads in every byte range the trace reads")(
+      "direct", "open files with O_DIRECT to bypass the page cache")(
+      "consistency-check", po::value<std::string>(),
+      "how often the open fds are compared with the replayed fds: 'off', "
+      "'sampled' checks the fds changed since the last check, 'full' "
+      "checks every open fd (default sampled)")(
+      "log-mode", po::value<std::string>(),
+      "how log messages are written: 'block' and 'drop' format them on a "
+      "background thread, waiting for or dropping messages when the "
+      "buffer is full, 'sync' writes each before going on (default "
+      "block)")(
+      "log-buffer", po::value<unsigned int>(),
+      "size in KiB of the log buffer of each replaying process, used "
+      "unless log-mode is 'sync' (default 64)")(
+      "log-level", po::value<std::string>(),
+      "most verbose messages to log: 'error', 'warn', 'info' or 'debug' "
+      "(default info)")(
+      "mismatch-log", po::value<std::string>(),
+      "write a DataSeries record for each mismatching system call to the "
+      "specified filename, with digests instead of the data, to be read "
+      "with mismatch-report")(
+      "latency-report", po::value<std::string>(),
+      "write p50, p99 and p99.9 of the replayed and traced latency of "
+      "each system call to the specified filename, as JSON if it ends "
+      "in .json and CSV otherwise")(
+      "profile",
+      po::value<unsigned int>()->implicit_value(PROFILE_DEFAULT_INTERVAL),
+      "count and time the stages of the replay in every thread, and print "
+      "the totals to stderr every arg seconds (default 10, 0 for only at "
+      "exit) and at exit")(
+      "stats-file", po::value<std::string>(),
+      "rewrite the specified file with live stats of the replay in JSON: "
+      "calls and bytes per system call, position in the trace, queue "
+      "depths, executors, reader stalls and mismatches")(
+      "stats-interval", po::value<unsigned int>(),
+      "seconds between the updates of the stats file (default 1)")(
+      "record-replay", po::value<std::string>(),
+      "write the replayed timestamps, return values and errno numbers and "
+      "the replaying thread of every record to the specified DataSeries "
+      "file, keyed by the traced unique id")(
+      "stall-report", po::value<std::string>(),
+      "write to the specified filename how long the executors ran records "
+      "and waited for the reader, the window, other threads and async I/O, "
+      "and the chain of records that bounded the replay time")(
+      "engine", po::value<std::string>(),
+      "what makes the system calls: 'kernel' replays them, 'null' returns "
+      "the traced results without entering the kernel to measure the "
+      "replayer itself, 'memfs' replays them on a file system in memory; "
+      "the last two print the calls per second (default kernel)");
 
   /*
    * Hidden options, will be allowed both on command line and
@@ -218,12 +236,49 @@ boost::program_options::variables_map get_options(int argc, char *argv[]) {
  * @param verify: whether to verify data read that is from replaying
  *                is same as data in read sys call in the trace file.
  * @param warn_level: replaying warning level
+ * @param pattern_seed: seed of the random and urandom patterns, set only
+ *                      if it is given on the command line
+ * @param aio_batch_size: number of O_DIRECT requests per process submitted
+ *                        together, 0 if the async I/O engine is disabled
+ * @param cache_mode: page cache state to set up before replay, "cold",
+ *                    "warm" or empty to leave the page cache alone
+ * @param direct: whether files are opened with O_DIRECT
+ * @param consistency_check: how the resource manager checks the open fds
+ * @param log_mode: whether log messages are written synchronously, and
+ *                  what to do when the asynchronous log buffer is full
+ * @param log_buffer_size: size in bytes of the asynchronous log buffer of
+ *                         each replaying thread
+ * @param log_level: most verbose level of the messages that are logged
+ * @param mismatch_filename: DataSeries file to record mismatches in, or
+ *                           empty to only log them
+ * @param latency_filename: file to write the latency report to, or
+ *                          empty to not measure latencies
+ * @param profile: whether the stages of the replay are counted and timed
+ * @param profile_interval: seconds between the profile reports, 0 to
+ *                          report only at exit
+ * @param stats_filename: file to rewrite with live stats, or empty
+ * @param stats_interval: seconds between the updates of stats_filename
+ * @param record_filename: DataSeries file to record the replay in, or
+ *                         empty
+ * @param stall_filename: file to write the stall report to, or empty
+ * @param engine_name: engine that makes the system calls, "kernel",
+ *                    "null" or "memfs"
  * @param input_files: DataSeries files that contain system call
  *                     traces
  */
 void process_options(int argc, char *argv[], bool &verbose, bool &verify,
                      int &warn_level, std::string &pattern_data,
-                     std::string &log_filename,
+                     bool &has_pattern_seed, uint64_t &pattern_seed,
+                     std::string &log_filename, unsigned int &aio_batch_size,
+                     std::string &cache_mode, bool &direct,
+                     ConsistencyCheckMode &consistency_check,
+                     LogMode &log_mode, size_t &log_buffer_size,
+                     LogLevel &log_level, std::string &mismatch_filename,
+                     std::string &latency_filename, bool &profile,
+                     unsigned int &profile_interval,
+                     std::string &stats_filename, unsigned int &stats_interval,
+                     std::string &record_filename,
+                     std::string &stall_filename, std::string &engine_name,
                      std::vector<std::string> &input_files) {
   boost::program_options::variables_map options_vm = get_options(argc, argv);
 
@@ -252,10 +307,157 @@ void process_options(int argc, char *argv[], bool &verbose, bool &verify,
     pattern_data = options_vm["pattern"].as<std::string>();
   }
 
+  if (options_vm.count("seed") != 0u) {
+    has_pattern_seed = true;
+    pattern_seed = options_vm["seed"].as<uint64_t>();
+  }
+
   if (options_vm.count("logger") != 0u) {
     log_filename = options_vm["logger"].as<std::string>();
   }
 
+  if (options_vm.count("aio") != 0u) {
+    aio_batch_size = options_vm["aio"].as<unsigned int>();
+    if (aio_batch_size == 0 || aio_batch_size > AIO_QUEUE_DEPTH) {
+      std::cerr << "Wrong value for aio option, it must be between 1 and "
+                << AIO_QUEUE_DEPTH << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (options_vm.count("cache") != 0u) {
+    cache_mode = options_vm["cache"].as<std::string>();
+    if (cache_mode != "cold" && cache_mode != "warm") {
+      std::cerr << "Wrong value for cache option, it must be cold or warm"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (options_vm.count("direct") != 0u) {
+    direct = true;
+  }
+
+  if (options_vm.count("consistency-check") != 0u) {
+    std::string mode = options_vm["consistency-check"].as<std::string>();
+    if (mode == "off") {
+      consistency_check = CONSISTENCY_CHECK_OFF;
+    } else if (mode == "sampled") {
+      consistency_check = CONSISTENCY_CHECK_SAMPLED;
+    } else if (mode == "full") {
+      consistency_check = CONSISTENCY_CHECK_FULL;
+    } else {
+      std::cerr << "Wrong value for consistency-check option, it must be "
+                << "off, sampled or full" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (options_vm.count("log-mode") != 0u) {
+    std::string mode = options_vm["log-mode"].as<std::string>();
+    if (mode == "block") {
+      log_mode = LOG_ASYNC_BLOCK;
+    } else if (mode == "drop") {
+      log_mode = LOG_ASYNC_DROP;
+    } else if (mode == "sync") {
+      log_mode = LOG_SYNC;
+    } else {
+      std::cerr << "Wrong value for log-mode option, it must be "
+                << "block, drop or sync" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (options_vm.count("log-buffer") != 0u) {
+    log_buffer_size = options_vm["log-buffer"].as<unsigned int>() * 1024ULL;
+    if (log_buffer_size < LOG_RING_MIN_SIZE) {
+      std::cerr << "Wrong value for log-buffer option, it must be at least "
+                << LOG_RING_MIN_SIZE / 1024 << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (options_vm.count("log-level") != 0u) {
+    std::string level = options_vm["log-level"].as<std::string>();
+    if (level == "error") {
+      log_level = LOG_ERROR;
+    } else if (level == "warn") {
+      log_level = LOG_WARN;
+    } else if (level == "info") {
+      log_level = LOG_INFO;
+    } else if (level == "debug") {
+      log_level = LOG_DEBUG;
+    } else {
+      std::cerr << "Wrong value for log-level option, it must be "
+                << "error, warn, info or debug" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (options_vm.count("mismatch-log") != 0u) {
+    mismatch_filename = options_vm["mismatch-log"].as<std::string>();
+  }
+
+  if (options_vm.count("latency-report") != 0u) {
+    latency_filename = options_vm["latency-report"].as<std::string>();
+  }
+
+  if (options_vm.count("profile") != 0u) {
+    profile = true;
+    profile_interval = options_vm["profile"].as<unsigned int>();
+  }
+
+  if (options_vm.count("stats-file") != 0u) {
+    stats_filename = options_vm["stats-file"].as<std::string>();
+  }
+
+  if (options_vm.count("stats-interval") != 0u) {
+    stats_interval = options_vm["stats-interval"].as<unsigned int>();
+    if (stats_interval == 0) {
+      std::cerr << "Wrong value for stats-interval option, it must be at "
+                << "least 1" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (options_vm.count("record-replay") != 0u) {
+    record_filename = options_vm["record-replay"].as<std::string>();
+  }
+
+  if (options_vm.count("stall-report") != 0u) {
+    stall_filename = options_vm["stall-report"].as<std::string>();
+  }
+
+  if (options_vm.count("engine") != 0u) {
+    engine_name = options_vm["engine"].as<std::string>();
+    if (engine_name != "kernel" && engine_name != "null" &&
+        engine_name != "memfs") {
+      std::cerr << "Wrong value for engine option, it must be kernel, null "
+                << "or memfs" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /*
+   * Only the kernel engine opens files of the replayer, so there is no
+   * page cache or O_DIRECT for the other engines, and the null engine
+   * moves no data to verify.
+   */
+  if (engine_name != "kernel") {
+    if (aio_batch_size > 0 || direct || !cache_mode.empty()) {
+      std::cerr << "The aio, direct and cache options can only be used "
+                << "with the kernel engine" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (verify && engine_name == "null") {
+      std::cerr << "The verify option cannot be used with the null engine"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    // The replayed fds are not fds of the replayer to compare with
+    consistency_check = CONSISTENCY_CHECK_OFF;
+  }
+
   /*
    * In case of verify, verbose or warn mode, user must specify the
    * log filename in order to save replayer log messages.
@@ -404,12 +606,12 @@ std::vector<PrefetchBufferModule *> create_prefetch_buffer_modules(
 std::vector<SystemCallTraceReplayModule *>
 create_system_call_trace_replay_modules(
     std::vector<PrefetchBufferModule *> prefetch_buffer_modules, bool verbose,
-    bool verify, int warn_level, std::string &pattern_data) {
+    bool verify, int warn_level, std::string &pattern_data, bool direct) {
   int module_index = 0;
   auto open_module = new OpenSystemCallTraceReplayModule(
-      *prefetch_buffer_modules[module_index++], verbose, warn_level);
+      *prefetch_buffer_modules[module_index++], verbose, warn_level, direct);
   auto openat_module = new OpenatSystemCallTraceReplayModule(
-      *prefetch_buffer_modules[module_index++], verbose, warn_level);
+      *prefetch_buffer_modules[module_index++], verbose, warn_level, direct);
   auto close_module = new CloseSystemCallTraceReplayModule(
       *prefetch_buffer_modules[module_index++], verbose, warn_level);
   auto read_module = new ReadSystemCallTraceReplayModule(
@@ -746,6 +948,7 @@ inline void batch_syscall_modules(SystemCallTraceReplayModule *module = nullptr,
   current = syscallMapLast[module->sys_call_name()];
 
   bool endOfRecord = false;
+  ReplayProfiler *profiler = SystemCallTraceReplayModule::profiler_;
   auto copy = current->move();
   auto readMod = current;
 
@@ -757,19 +960,15 @@ inline void batch_syscall_modules(SystemCallTraceReplayModule *module = nullptr,
   while (--count != 0) {
     if (readMod->cur_extent_has_more_record() ||
         readMod->getSharedExtent() != nullptr) {
-      PROFILE_START(1)
-      readMod->prepareRow();
-      PROFILE_END(1, 2, fileReading_Batch_file)
+      {
+        ProfileScope scope(profiler, PROFILE_DECODE);
+        readMod->prepareRow();
+      }
 
       if (count != 1) {
-        PROFILE_START(5)
+        ProfileScope scope(profiler, PROFILE_ENQUEUE);
         auto ptr = readMod->move();
-        PROFILE_END(5, 6, fileReading_Batch_move)
-
-        PROFILE_START(3)
         executionHeaps[ptr->executing_pid()].push(ptr);
-        PROFILE_END(3, 4, fileReading_Batch_push)
-
         numberOfSyscalls[ptr->getReplayerIndex()]++;
       }
 
@@ -816,12 +1015,22 @@ auto checkSequential = [](SystemCallTraceReplayModule *check) -> bool {
   return (uint64_t)check->unique_id() <= lastExecutedSyscallID + 150;
 };
 
-auto checkExecutionValidation = [](SystemCallTraceReplayModule *check) -> bool {
+/*
+ * On false, reason tells what check waits for and blocker the thread of
+ * the running or in flight record it waits for, if any. Records that
+ * threadID itself has in flight are ordered by the async I/O engine.
+ */
+auto checkExecutionValidation = [](SystemCallTraceReplayModule *check,
+                                   int64_t threadID, ReplayActivity &reason,
+                                   int64_t &blocker) -> bool {
   if (!checkSequential(check)) {
+    reason = ACTIVITY_WAIT_WINDOW;
     return false;
   }
+  reason = ACTIVITY_WAIT_BLOCKED;
   for (auto running : currentExecutions) {
     auto compare = running.second;
+    blocker = running.first;
     if (compare == nullptr) {
       return false;
     }
@@ -836,88 +1045,201 @@ auto checkExecutionValidation = [](SystemCallTraceReplayModule *check) -> bool {
       }
     }
   }
+  reason = ACTIVITY_WAIT_BACKPRESSURE;
+  for (auto in_flight : inFlightExecutions) {
+    blocker = in_flight.second;
+    if (blocker != threadID &&
+        check->time_called() > in_flight.first->time_returned()) {
+      return false;
+    }
+  }
   return true;
 };
 
+/*
+ * Let the records from first on in completed, whose async I/O the engine
+ * just handed back, stop holding back the records of other threads.
+ */
+void settleInFlight(const std::vector<SystemCallTraceReplayModule *> &completed,
+                    size_t first) {
+  for (size_t i = first; i < completed.size(); i++) {
+    inFlightExecutions.erase(completed[i]);
+  }
+}
+
 void readerThread() {
+  ReplayTelemetry *telemetry = SystemCallTraceReplayModule::telemetry_;
+  ReplayProfiler *profiler = SystemCallTraceReplayModule::profiler_;
+  bool timed = telemetry != nullptr || profiler != nullptr;
   while (!checkModulesFinished()) {
-    PROFILE_START(3)
+    // The reader stalls while the executors have enough records queued
+    bool stalled = false;
+    std::chrono::steady_clock::time_point stall_started;
     while (getMinSyscall() > (100 * nThreads)) {
+      if (!stalled && timed) {
+        stall_started = std::chrono::steady_clock::now();
+      }
+      stalled = true;
       SystemCallTraceReplayModule *execute_replayer = nullptr;
-      while (allocationQueue.try_pop(execute_replayer)) {
-        delete execute_replayer;
+      if (allocationQueue.try_pop(execute_replayer)) {
+        ProfileScope scope(profiler, PROFILE_RECLAIM);
+        do {
+          delete execute_replayer;
+        } while (allocationQueue.try_pop(execute_replayer));
+      }
+    }
+    if (stalled && timed) {
+      uint64_t stall_ns =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              std::chrono::steady_clock::now() - stall_started)
+              .count();
+      if (telemetry != nullptr) {
+        telemetry->add_reader_stall(stall_ns);
+      }
+      if (profiler != nullptr) {
+        profiler->add(PROFILE_READER_WAIT, stall_ns);
       }
     }
     batch_for_all_syscalls(150 * nThreads);
-    PROFILE_END(3, 4, fileReading)
+    if (telemetry != nullptr) {
+      telemetry->sample_queues();
+    }
   }
 }
 
 void executionThread(int64_t threadID) {
   SystemCallTraceReplayModule *execute_replayer = nullptr;
   SystemCallTraceReplayModule *prev_replayer = nullptr;
+  /*
+   * Records whose async I/O completed. The current record can be among
+   * them, so they are reclaimed only once setRunning() replaced it.
+   */
+  std::vector<SystemCallTraceReplayModule *> completed;
   tbb::atomic<uint64_t> num_syscalls_processed = 0;
+  ReplayProfiler *profiler = SystemCallTraceReplayModule::profiler_;
+  ReplayTelemetry *telemetry = SystemCallTraceReplayModule::telemetry_;
+  if (telemetry != nullptr) {
+    telemetry->executor_started();
+  }
+  StallAnalyzer::Executor *stalls = nullptr;
+  if (SystemCallTraceReplayModule::stall_analyzer_ != nullptr) {
+    stalls = SystemCallTraceReplayModule::stall_analyzer_->executor_started(
+        threadID);
+  }
+  auto pop_record = [&]() -> bool {
+    ProfileScope scope(profiler, PROFILE_HEAP_POP);
+    return executionHeaps[threadID].try_pop(execute_replayer);
+  };
 
-  PROFILE_START(10)
-
-  while (executionHeaps[threadID].try_pop(execute_replayer)) {
-    PROFILE_END(10, 11, gettingRecord)
-
+  while (pop_record()) {
     numberOfSyscalls[execute_replayer->getReplayerIndex()]--;
+    STALL_ACCOUNT(stalls, ACTIVITY_SCHEDULING);
 
-    PROFILE_START(12)
-
-    PROFILE_START(20)
-    while (getMinSyscall() < (10 * nThreads) && !checkModulesFinished()) {
+    {
+      ProfileScope scope(profiler, PROFILE_SCHEDULER_WAIT);
+      while (getMinSyscall() < (10 * nThreads) && !checkModulesFinished()) {
+      }
     }
-    PROFILE_END(20, 21, executionSpinning)
+    STALL_ACCOUNT(stalls, ACTIVITY_WAIT_READER);
 
     setRunning(threadID, execute_replayer);
     allocationQueue.push(prev_replayer);
+    for (auto module : completed) {
+      allocationQueue.push(module);
+    }
+    completed.clear();
 
-    PROFILE_START(1)
     if (nThreads > 1) {
-      if (!checkExecutionValidation(execute_replayer)) {
+      bool runnable;
+      ReplayActivity reason;
+      int64_t blocker = -1;
+      {
+        ProfileScope scope(profiler, PROFILE_SCHEDULER_WAIT);
+        runnable = checkExecutionValidation(execute_replayer, threadID, reason,
+                                            blocker);
+      }
+      if (!runnable) {
         setRunning(threadID, nullptr);
         executionHeaps[threadID].push(execute_replayer);
         numberOfSyscalls[execute_replayer->getReplayerIndex()]++;
         prev_replayer = nullptr;
+        // Other threads may be waiting for the I/O of this one to land
+        AsyncIOEngine *aio_engine = SystemCallTraceReplayModule::aio_engine_;
+        if (aio_engine != nullptr) {
+          size_t first = completed.size();
+          aio_engine->harvest(threadID, completed);
+          settleInFlight(completed, first);
+        }
+        // The record is retried, so the whole round was spent waiting
+        STALL_ACCOUNT(stalls, reason, blocker);
         continue;
       }
+      STALL_ACCOUNT(stalls, ACTIVITY_SCHEDULING);
+    }
+
+    AsyncIOEngine *aio_engine = SystemCallTraceReplayModule::aio_engine_;
+    if (aio_engine != nullptr && !execute_replayer->supports_async_io()) {
+      // Let every outstanding request of this process land first.
+      size_t first = completed.size();
+      aio_engine->drain(threadID, completed);
+      settleInFlight(completed, first);
+      STALL_ACCOUNT(stalls, ACTIVITY_WAIT_BACKPRESSURE);
     }
 
     execute_replayer->execute();
+    if (stalls != nullptr) {
+      stalls->account(ACTIVITY_EXECUTE);
+      stalls->finish_record(execute_replayer->sys_call_name(),
+                            execute_replayer->executing_pid());
+    }
     lastExecutedSyscallID =
         std::max((int64_t)lastExecutedSyscallID, execute_replayer->unique_id());
-    PROFILE_END(1, 2, duration)
+
+    /*
+     * A record that is still in flight is reclaimed once the async I/O
+     * engine hands it back through completed.
+     */
+    bool in_flight = execute_replayer->async_pending();
+    if (in_flight) {
+      InFlightSyscallTable::accessor acc;
+      inFlightExecutions.insert(acc, execute_replayer);
+      acc->second = threadID;
+    }
+    if (aio_engine != nullptr) {
+      size_t first = completed.size();
+      aio_engine->harvest(threadID, completed);
+      settleInFlight(completed, first);
+    }
 
     num_syscalls_processed++;
 
     // Verify that the state of resources manager is consistent for every
-    // SCAN_FD_FREQUENCY sys calls.
+    // SCAN_FD_FREQUENCY sys calls, as --consistency-check asks.
     if (num_syscalls_processed % SCAN_FD_FREQUENCY == 0) {
       SystemCallTraceReplayModule::replayer_resources_manager_
           .validate_consistency();
     }
-
-    if ((num_syscalls_processed % 1000000) == 0u) {
-      PROFILE_PRINT("total syscall execution time: ", duration)
-      PROFILE_PRINT("total spinning over I/O wait time: ", executionSpinning)
-      PROFILE_PRINT("total file reading time: ", fileReading)
-      PROFILE_PRINT("total loop over syscall time: ", loop)
-      PROFILE_PRINT("total DS file batch reading time: ",
-                    fileReading_Batch_file)
-      PROFILE_PRINT("total syscall record push to PQ time: ",
-                    fileReading_Batch_push)
-      PROFILE_PRINT("total syscall record move to PQ time: ",
-                    fileReading_Batch_move)
-      PROFILE_PRINT("total syscall record try_pop to PQ time: ", gettingRecord)
-    }
-    PROFILE_END(12, 13, loop)
-    prev_replayer = execute_replayer;
-    PROFILE_SAMPLE(10)
+    prev_replayer = in_flight ? nullptr : execute_replayer;
+  }
+  totalSyscallsProcessed.fetch_and_add(num_syscalls_processed);
+  if (SystemCallTraceReplayModule::aio_engine_ != nullptr) {
+    SystemCallTraceReplayModule::aio_engine_->drain(threadID, completed);
+    settleInFlight(completed, 0);
+  }
+  if (SystemCallTraceReplayModule::latency_recorder_ != nullptr) {
+    // Free the histograms of this executor, which can be one of many
+    SystemCallTraceReplayModule::latency_recorder_->thread_finished();
+  }
+  if (SystemCallTraceReplayModule::replay_recorder_ != nullptr) {
+    SystemCallTraceReplayModule::replay_recorder_->thread_finished();
+  }
+  if (telemetry != nullptr) {
+    telemetry->executor_finished();
   }
   currentExecutions.erase(threadID);
+  for (auto module : completed) {
+    allocationQueue.push(module);
+  }
 }
 
 int main(int argc, char *argv[]) {
@@ -926,28 +1248,111 @@ int main(int argc, char *argv[]) {
   bool verify = false;
   int warn_level = DEFAULT_MODE;
   std::string pattern_data = "";
+  bool has_pattern_seed = false;
+  uint64_t pattern_seed = 0;
   std::string log_filename = "";
+  unsigned int aio_batch_size = 0;
+  std::string cache_mode = "";
+  bool direct = false;
+  ConsistencyCheckMode consistency_check = CONSISTENCY_CHECK_SAMPLED;
+  LogMode log_mode = LOG_ASYNC_BLOCK;
+  size_t log_buffer_size = LOG_RING_DEFAULT_SIZE;
+  LogLevel log_level = LOG_INFO;
+  std::string mismatch_filename = "";
+  std::string latency_filename = "";
+  bool profile = false;
+  unsigned int profile_interval = PROFILE_DEFAULT_INTERVAL;
+  std::string stats_filename = "";
+  unsigned int stats_interval = 1;
+  std::string record_filename = "";
+  std::string stall_filename = "";
+  std::string engine_name = "kernel";
   std::vector<std::string> input_files;
-#ifdef PROFILE_ENABLE
-  int64_t warmup = 0;
-#endif
-  PROFILE_START(5)
 
   // Process options found on the command line.
   process_options(argc, argv, verbose, verify, warn_level, pattern_data,
-                  log_filename, input_files);
+                  has_pattern_seed, pattern_seed, log_filename, aio_batch_size,
+                  cache_mode, direct, consistency_check, log_mode,
+                  log_buffer_size, log_level, mismatch_filename,
+                  latency_filename, profile, profile_interval, stats_filename,
+                  stats_interval, record_filename, stall_filename, engine_name,
+                  input_files);
   // Create an instance of logger class and open log file to write replayer logs
   SystemCallTraceReplayModule::syscall_logger_ =
-      new SystemCallTraceReplayLogger(log_filename);
-  // If pattern data is equal to urandom, then open /dev/urandom file
-  if (pattern_data == "urandom") {
-    SystemCallTraceReplayModule::random_file_.open("/dev/urandom");
-    if (!SystemCallTraceReplayModule::random_file_.is_open()) {
-      std::cerr << "Unable to open file '/dev/urandom'.\n";
+      new SystemCallTraceReplayLogger(log_filename, log_mode, log_buffer_size);
+  SystemCallTraceReplayModule::syscall_logger_->set_level(log_level);
+  // If pattern data is equal to urandom, then seed from /dev/urandom file
+  if (pattern_data == "urandom" && !has_pattern_seed) {
+    std::ifstream random_file("/dev/urandom");
+    if (!random_file.read(reinterpret_cast<char *>(&pattern_seed),
+                          sizeof(pattern_seed))) {
+      std::cerr << "Unable to read file '/dev/urandom'.\n";
+      // Delete the instance of logger class and close the log file
+      delete SystemCallTraceReplayModule::syscall_logger_;
+      exit(EXIT_FAILURE);
+    }
+  }
+  // Build the block pool of generated payloads
+  bool generated_pattern = pattern_data.compare(0, 4, "gen:") == 0;
+  if (generated_pattern) {
+    auto payload_block_pool = new PayloadBlockPool();
+    if (!payload_block_pool->configure(pattern_data.substr(4))) {
+      std::cerr << "Wrong value for pattern option, expected "
+                << "gen:compress=R,dedup=F,block=SIZE with R >= 1, "
+                << "0 <= F <= 1 and " << PAYLOAD_TAG_SIZE << " <= SIZE <= "
+                << PAYLOAD_MAX_BLOCK_SIZE << std::endl;
+      delete payload_block_pool;
       // Delete the instance of logger class and close the log file
       delete SystemCallTraceReplayModule::syscall_logger_;
       exit(EXIT_FAILURE);
     }
+    payload_block_pool->build(pattern_seed);
+    SystemCallTraceReplayModule::payload_block_pool_ = payload_block_pool;
+  }
+  if (pattern_data == "random" || pattern_data == "urandom" ||
+      generated_pattern) {
+    SystemCallTraceReplayModule::pattern_generator_.set_seed(pattern_seed);
+    // Logged so that the payloads of the run can be reproduced with --seed
+    SystemCallTraceReplayModule::syscall_logger_->log_info("Pattern seed: ",
+                                                           pattern_seed);
+  }
+
+  // Record mismatches in binary if requested
+  if (!mismatch_filename.empty()) {
+    SystemCallTraceReplayModule::mismatch_recorder_ =
+        new MismatchRecorder(mismatch_filename);
+  }
+
+  // Time every replayed call if a latency report is requested
+  if (!latency_filename.empty()) {
+    SystemCallTraceReplayModule::latency_recorder_ = new LatencyRecorder();
+  }
+
+  // Make the system calls with the requested engine
+  SystemCallTraceReplayModule::engine_ = SyscallEngine::create(engine_name);
+
+  // Count and time the stages of the replay if requested
+  if (profile) {
+    SystemCallTraceReplayModule::profiler_ =
+        new ReplayProfiler(profile_interval, std::cerr);
+  }
+
+  // Replay O_DIRECT I/O through libaio if requested
+  if (aio_batch_size > 0) {
+    SystemCallTraceReplayModule::aio_engine_ = new AsyncIOEngine(
+        SystemCallTraceReplayModule::syscall_logger_, aio_batch_size);
+  }
+
+  // Put the page cache into the requested state before replaying anything
+  if (!cache_mode.empty()) {
+    PageCacheManager page_cache_manager(
+        SystemCallTraceReplayModule::syscall_logger_);
+    page_cache_manager.scan(input_files);
+    if (cache_mode == "cold") {
+      page_cache_manager.drop();
+    } else {
+      page_cache_manager.warm();
+    }
   }
 
   std::vector<PrefetchBufferModule *> prefetch_buffer_modules =
@@ -955,7 +1360,8 @@ int main(int argc, char *argv[]) {
 
   std::vector<SystemCallTraceReplayModule *> system_call_trace_replay_modules =
       create_system_call_trace_replay_modules(prefetch_buffer_modules, verbose,
-                                              verify, warn_level, pattern_data);
+                                              verify, warn_level, pattern_data,
+                                              direct);
 
   // Double check to make sure all replaying modules are loaded.
   if (system_call_trace_replay_modules.size() !=
@@ -968,12 +1374,49 @@ int main(int argc, char *argv[]) {
   }
 
   load_syscall_modules(system_call_trace_replay_modules);
+
+  // Names of the system calls by replayer index
+  std::vector<std::string> syscall_names(replayerIdx);
+  for (auto &module_pair : syscallMapLast) {
+    syscall_names[module_pair.second->getReplayerIndex()] = module_pair.first;
+  }
+
+  // Record the replay if requested
+  if (!record_filename.empty()) {
+    SystemCallTraceReplayModule::replay_recorder_ =
+        new ReplayRecorder(record_filename, syscall_names);
+  }
+
+  // Leave verification out of the recorded replay times
+  ProfileScope::time_verification =
+      SystemCallTraceReplayModule::latency_recorder_ != nullptr ||
+      SystemCallTraceReplayModule::replay_recorder_ != nullptr;
+
+  // Attribute the stalls of the executors if requested
+  if (!stall_filename.empty()) {
+    SystemCallTraceReplayModule::stall_analyzer_ = new StallAnalyzer();
+  }
+
+  // Publish live stats if requested
+  if (!stats_filename.empty()) {
+    SystemCallTraceReplayModule::telemetry_ = new ReplayTelemetry(
+        stats_filename, syscall_names, stats_interval, [](QueueDepths &queues) {
+          for (auto &heap : executionHeaps) {
+            queues.per_pid[heap.first] = heap.second.size();
+          }
+          for (int64_t i = 0; i < replayerIdx; i++) {
+            // Finished system calls are marked with LLONG_MAX
+            uint64_t queued = numberOfSyscalls[i];
+            queues.per_syscall.push_back(queued >= LLONG_MAX ? 0 : queued);
+          }
+        });
+  }
+  SystemCallTraceReplayModule::replayer_resources_manager_
+      .set_consistency_check(consistency_check);
   prepare_replay();
   batch_for_all_syscalls(1000);
 
-  PROFILE_END(5, 6, warmup)
-  PROFILE_PRINT("warmup: ", warmup)
-
+  auto replay_started = std::chrono::steady_clock::now();
   std::thread reader(readerThread);
   std::thread executor(executionThread, mainThreadID);
   reader.join();
@@ -982,12 +1425,64 @@ int main(int argc, char *argv[]) {
   for (auto &thread : threads) {
     thread.join();
   }
+  std::chrono::duration<double> replay_time =
+      std::chrono::steady_clock::now() - replay_started;
+
+  // Without the kernel, the rate is bound by the replayer itself
+  if (engine_name != "kernel") {
+    double seconds = replay_time.count();
+    std::cout << "Replayed " << totalSyscallsProcessed << " system calls in "
+              << boost::format("%.3f") % seconds << " s ("
+              << boost::format("%.0f") %
+                     (seconds > 0 ? totalSyscallsProcessed / seconds : 0)
+              << " calls/s)" << std::endl;
+  }
 
-  // Close /dev/urandom file
-  if (pattern_data == "urandom") {
-    SystemCallTraceReplayModule::random_file_.close();
+  // Every executor is done, so the stalls can be reported
+  if (SystemCallTraceReplayModule::stall_analyzer_ != nullptr) {
+    std::ofstream stall_report(stall_filename);
+    SystemCallTraceReplayModule::stall_analyzer_->report(stall_report);
+    if (!stall_report) {
+      std::cerr << "Unable to write the stall report to " << stall_filename
+                << std::endl;
+      ret = EXIT_FAILURE;
+    }
+    delete SystemCallTraceReplayModule::stall_analyzer_;
+    SystemCallTraceReplayModule::stall_analyzer_ = nullptr;
+  }
+  // Write the last replayed records once every thread is done
+  delete SystemCallTraceReplayModule::replay_recorder_;
+  SystemCallTraceReplayModule::replay_recorder_ = nullptr;
+  // Write the final stats once every thread is done
+  delete SystemCallTraceReplayModule::telemetry_;
+  SystemCallTraceReplayModule::telemetry_ = nullptr;
+  // Write the final profile report once every thread is done
+  delete SystemCallTraceReplayModule::profiler_;
+  SystemCallTraceReplayModule::profiler_ = nullptr;
+
+  // Every executor drained its requests, so the engine can go away.
+  delete SystemCallTraceReplayModule::aio_engine_;
+  SystemCallTraceReplayModule::aio_engine_ = nullptr;
+  delete SystemCallTraceReplayModule::payload_block_pool_;
+  SystemCallTraceReplayModule::payload_block_pool_ = nullptr;
+  // Close the mismatch log so that it can be read
+  delete SystemCallTraceReplayModule::mismatch_recorder_;
+  SystemCallTraceReplayModule::mismatch_recorder_ = nullptr;
+  // Every executor is done, so the latencies can be merged and reported
+  if (SystemCallTraceReplayModule::latency_recorder_ != nullptr) {
+    if (!SystemCallTraceReplayModule::latency_recorder_->report(
+            latency_filename)) {
+      std::cerr << "Unable to write the latency report to "
+                << latency_filename << std::endl;
+      ret = EXIT_FAILURE;
+    }
+    delete SystemCallTraceReplayModule::latency_recorder_;
+    SystemCallTraceReplayModule::latency_recorder_ = nullptr;
   }
 
+  delete SystemCallTraceReplayModule::engine_;
+  SystemCallTraceReplayModule::engine_ = nullptr;
+
   // Delete the instance of logger class and close the log file
   delete SystemCallTraceReplayModule::syscall_logger_;
 
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * trace-synth generates a synthetic system call trace that
+ * system-call-replayer can replay, from a workload spec, so that
+ * replayers and storage can be benchmarked without sharing real traces
+ * and at any scale.
+ *
+ * The spec is a file with one key = value per line; --set overrides
+ * single keys. The keys are listed by --help.
+ *
+ * USAGE
+ * trace-synth [--spec workload.spec] [--set key=value ...] [--jobs N]
+ *             trace.ds
+ */
+
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TraceSynthesizer.hpp"
+
+static const char *spec_help =
+    "Keys of the workload spec (defaults in brackets):\n"
+    "  processes = N      traced processes [1]\n"
+    "  threads = N        threads of each process [1]\n"
+    "  records = N        records after the setup, about [1000000]\n"
+    "  files = N          files in the file set [100]\n"
+    "  file_size = SIZE   size of each file, such as 64k or 1g [1m]\n"
+    "  directory = PATH   directory of the file set [trace-synth]\n"
+    "  mix = CALL:W,...   weights of read, write, pread, pwrite, lseek,\n"
+    "                     fsync, stat and fstat [read:1,write:1]\n"
+    "  io_size = SIZE:W,... or MIN-MAX\n"
+    "                     weighted I/O sizes, or a uniform range [4k]\n"
+    "  sequential = F     fraction of I/O that continues where the\n"
+    "                     previous one ended, the rest is random [1]\n"
+    "  ops_per_open = N   calls between the open and close of a file [100]\n"
+    "  fsync_every = N    writes between fsyncs of a file, 0 for never [0]\n"
+    "  syscall_time = US  microseconds each call takes [10]\n"
+    "  think_time = US    mean microseconds between the calls of a\n"
+    "                     thread, exponentially distributed [0]\n"
+    "  start_time = SECS  time of the first record since the epoch\n"
+    "                     [1577836800]\n"
+    "  seed = N           seed of the random choices [0]\n";
+
+int main(int argc, char *argv[]) {
+  namespace po = boost::program_options;
+  po::options_description options("Options");
+  options.add_options()("help,h", "produce help message")(
+      "spec", po::value<std::string>(), "workload spec file")(
+      "set", po::value<std::vector<std::string>>(),
+      "set a key of the workload spec, as key=value")(
+      "jobs,j", po::value<unsigned int>(),
+      "threads generating records (default: number of cores)")(
+      "output-file", po::value<std::string>(), "trace file to write");
+  po::positional_options_description positional;
+  positional.add("output-file", 1);
+
+  po::variables_map options_vm;
+  try {
+    po::store(po::command_line_parser(argc, argv)
+                  .options(options)
+                  .positional(positional)
+                  .run(),
+              options_vm);
+    po::notify(options_vm);
+  } catch (po::error &e) {
+    std::cerr << e.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  if (options_vm.count("help") != 0u ||
+      options_vm.count("output-file") == 0u) {
+    std::cout << "Usage: trace-synth [options] trace.ds\n"
+              << options << "\n"
+              << spec_help << std::endl;
+    exit(options_vm.count("help") != 0u ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  WorkloadSpec spec;
+  std::string error;
+  if (options_vm.count("spec") != 0u) {
+    std::string spec_filename = options_vm["spec"].as<std::string>();
+    std::ifstream spec_file(spec_filename);
+    if (!spec_file) {
+      std::cerr << "Unable to read the spec file " << spec_filename
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (!spec.load(spec_file, error)) {
+      std::cerr << spec_filename << ": " << error << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (options_vm.count("set") != 0u) {
+    for (auto &setting : options_vm["set"].as<std::vector<std::string>>()) {
+      size_t equals = setting.find('=');
+      if (equals == std::string::npos ||
+          !spec.set(setting.substr(0, equals), setting.substr(equals + 1),
+                    error)) {
+        std::cerr << "Wrong value for set option '" << setting << "'"
+                  << (error.empty() ? "" : ": " + error) << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  unsigned int jobs = std::thread::hardware_concurrency();
+  if (options_vm.count("jobs") != 0u) {
+    jobs = options_vm["jobs"].as<unsigned int>();
+  }
+
+  auto started = std::chrono::steady_clock::now();
+  TraceSynthesizer synthesizer(spec,
+                               options_vm["output-file"].as<std::string>(),
+                               jobs);
+  uint64_t records = synthesizer.generate();
+  double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(
+                       std::chrono::steady_clock::now() - started)
+                       .count();
+  std::cerr << "Wrote " << records << " records in " << seconds << " s"
+            << std::endl;
+  return EXIT_SUCCESS;
+}
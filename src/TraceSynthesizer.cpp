@@ -0,0 +1,1002 @@
+/*
+ * Copyright (c) 2017      Darshan Godhia
+ * Copyright (c) 2016-2019 Erez Zadok
+ * Copyright (c) 2011      Jack Ma
+ * Copyright (c) 2019      Jatin Sood
+ * Copyright (c) 2017-2018 Kevin Sun
+ * Copyright (c) 2015-2017 Leixiang Wu
+ * Copyright (c) 2020      Lukas Velikov
+ * Copyright (c) 2017-2018 Maryia Maskaliova
+ * Copyright (c) 2017      Mayur Jadhav
+ * Copyright (c) 2016      Ming Chen
+ * Copyright (c) 2017      Nehil Shah
+ * Copyright (c) 2016      Nina Brown
+ * Copyright (c) 2011-2012 Santhosh Kumar
+ * Copyright (c) 2015-2016 Shubhi Rani
+ * Copyright (c) 2018      Siddesh Shinde
+ * Copyright (c) 2014      Sonam Mandal
+ * Copyright (c) 2012      Sudhir Kasanavesi
+ * Copyright (c) 2020      Thomas Fleming
+ * Copyright (c) 2018-2020 Ibrahim Umit Akgun
+ * Copyright (c) 2011-2012 Vasily Tarasov
+ * Copyright (c) 2019      Yinuo Zhang
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file implements all the functions in the TraceSynthesizer header
+ * file.
+ *
+ * Read TraceSynthesizer.hpp for more information about this class.
+ */
+
+#include "TraceSynthesizer.hpp"
+
+#include <DataSeries/ByteField.hpp>
+#include <DataSeries/DataSeriesFile.hpp>
+#include <DataSeries/ExtentType.hpp>
+#include <DataSeries/Int32Field.hpp>
+#include <DataSeries/Int64Field.hpp>
+#include <DataSeries/OutputModule.hpp>
+#include <DataSeries/Variable32Field.hpp>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <thread>
+
+// Prefix of the extent types of the traced system calls
+#define SYNTH_EXTENT_TYPE_PREFIX "IOTTAFSL::Trace::Syscall::"
+// Records per extent are limited to about this many bytes
+#define SYNTH_EXTENT_SIZE (1024 * 1024)
+// Records generated by all threads before they are merged and written
+#define SYNTH_WINDOW_RECORDS (1024 * 1024)
+// Random offsets are aligned to this many bytes
+#define SYNTH_ALIGNMENT 4096
+// Pid of the first process, the others follow with one pid per thread
+#define SYNTH_FIRST_PID 1000
+// Descriptor of the file a thread has open is this plus its index
+#define SYNTH_FIRST_DESCRIPTOR 3
+
+// Flags of the clone calls that create a thread
+#define SYNTH_THREAD_CLONE_FLAGS                                     \
+  (CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD | \
+   CLONE_SYSVSEM | CLONE_SETTLS | CLONE_PARENT_SETTID |               \
+   CLONE_CHILD_CLEARTID)
+
+static const char *const synth_syscall_names[SYNTH_SYSCALLS] = {
+    "umask", "mkdir",  "open",  "ftruncate", "clone", "close", "read",
+    "write", "pread",  "pwrite", "lseek",    "fsync", "stat",  "fstat"};
+
+// A field of a system call extent type
+struct SynthField {
+  const char *type;
+  const char *name;
+  bool nullable;
+};
+
+static const std::vector<SynthField> synth_common_fields = {
+    {"int64", "time_called", true},   {"int64", "time_returned", true},
+    {"int64", "time_recorded", true}, {"int32", "executing_pid", true},
+    {"int32", "errno_number", true},  {"int64", "return_value", true},
+    {"int64", "unique_id", false}};
+
+static const std::vector<SynthField> synth_stat_fields = {
+    {"int32", "stat_result_dev", true},
+    {"int32", "stat_result_ino", true},
+    {"int32", "stat_result_mode", true},
+    {"int32", "stat_result_nlink", true},
+    {"int32", "stat_result_uid", true},
+    {"int32", "stat_result_gid", true},
+    {"int32", "stat_result_rdev", true},
+    {"int32", "stat_result_blksize", true},
+    {"int32", "stat_result_blocks", true},
+    {"int64", "stat_result_size", true},
+    {"int64", "stat_result_atime", true},
+    {"int64", "stat_result_mtime", true},
+    {"int64", "stat_result_ctime", true}};
+
+/*
+ * Return the fields that the replayer reads from the extents of
+ * syscall, besides the common ones.
+ */
+static std::vector<SynthField> synth_fields(SynthSyscall syscall) {
+  std::vector<SynthField> fields;
+  SynthField descriptor = {"int32", "descriptor", false};
+  SynthField pathname = {"variable32", "given_pathname", true};
+  switch (syscall) {
+    case SYNTH_UMASK:
+      fields = {{"int32", "mode_value", true}};
+      break;
+    case SYNTH_MKDIR:
+      fields = {pathname, {"int32", "mode_value", true}};
+      break;
+    case SYNTH_OPEN:
+      fields = {pathname,
+                {"int32", "open_value", true},
+                {"int32", "mode_value", true}};
+      break;
+    case SYNTH_FTRUNCATE:
+      fields = {descriptor, {"int64", "truncate_length", false}};
+      break;
+    case SYNTH_CLONE:
+      fields = {{"int64", "flag_value", true},
+                {"int64", "child_stack_address", false},
+                {"int64", "parent_thread_id", true},
+                {"int64", "child_thread_id", true},
+                {"int64", "new_tls", true}};
+      break;
+    case SYNTH_CLOSE:
+    case SYNTH_FSYNC:
+      fields = {descriptor};
+      break;
+    case SYNTH_READ:
+    case SYNTH_PREAD:
+      fields = {descriptor,
+                {"variable32", "data_read", true},
+                {"int64", "bytes_requested", false}};
+      break;
+    case SYNTH_WRITE:
+    case SYNTH_PWRITE:
+      fields = {descriptor,
+                {"variable32", "data_written", true},
+                {"int64", "bytes_requested", false}};
+      break;
+    case SYNTH_LSEEK:
+      fields = {descriptor,
+                {"int64", "offset", false},
+                {"byte", "whence", false}};
+      break;
+    case SYNTH_STAT:
+      fields = {pathname};
+      break;
+    case SYNTH_FSTAT:
+      fields = {descriptor};
+      break;
+    default:
+      break;
+  }
+  if (syscall == SYNTH_PREAD || syscall == SYNTH_PWRITE) {
+    fields.push_back({"int64", "offset", false});
+  }
+  if (syscall == SYNTH_STAT || syscall == SYNTH_FSTAT) {
+    fields.insert(fields.end(), synth_stat_fields.begin(),
+                  synth_stat_fields.end());
+  }
+  return fields;
+}
+
+/*
+ * Parse a size such as 4096, 4k, 1m or 2g. Return 0 if size is
+ * malformed.
+ */
+static uint64_t parse_size(const std::string &size) {
+  char *end;
+  uint64_t value = strtoull(size.c_str(), &end, 10);
+  if (end == size.c_str()) {
+    return 0;
+  }
+  std::string suffix(end);
+  if (suffix == "k" || suffix == "K") {
+    value <<= 10;
+  } else if (suffix == "m" || suffix == "M") {
+    value <<= 20;
+  } else if (suffix == "g" || suffix == "G") {
+    value <<= 30;
+  } else if (!suffix.empty()) {
+    return 0;
+  }
+  return value;
+}
+
+/*
+ * Parse a whole unsigned number. Return false if value is malformed.
+ */
+static bool parse_unsigned(const std::string &value, uint64_t &number) {
+  char *end;
+  number = strtoull(value.c_str(), &end, 10);
+  return !value.empty() && value[0] != '-' && *end == '\0';
+}
+
+/*
+ * Parse a weight, a positive number. Return false if value is
+ * malformed.
+ */
+static bool parse_weight(const std::string &value, double &weight) {
+  char *end;
+  weight = strtod(value.c_str(), &end);
+  return !value.empty() && *end == '\0' && weight > 0.0;
+}
+
+static std::string trim(const std::string &text) {
+  size_t begin = text.find_first_not_of(" \t\r");
+  if (begin == std::string::npos) {
+    return "";
+  }
+  return text.substr(begin, text.find_last_not_of(" \t\r") - begin + 1);
+}
+
+WorkloadSpec::WorkloadSpec()
+    : processes(1),
+      threads(1),
+      records(1000000),
+      files(100),
+      file_size(1024 * 1024),
+      directory("trace-synth"),
+      mix({{SYNTH_READ, 1.0}, {SYNTH_WRITE, 1.0}}),
+      io_sizes({{4096, 1.0}}),
+      io_size_range(false),
+      sequential(1.0),
+      ops_per_open(100),
+      fsync_every(0),
+      syscall_time(10000),
+      think_time(0),
+      start_time(1577836800),
+      seed(0) {}
+
+bool WorkloadSpec::set(const std::string &key, const std::string &value,
+                       std::string &error) {
+  uint64_t number;
+  if (key == "processes" || key == "threads" || key == "files" ||
+      key == "ops_per_open") {
+    if (!parse_unsigned(value, number) || number == 0 ||
+        number > INT32_MAX / 2) {
+      error = key + " must be a number from 1 to " +
+              std::to_string(INT32_MAX / 2);
+      return false;
+    }
+    if (key == "processes") {
+      processes = number;
+    } else if (key == "threads") {
+      threads = number;
+    } else if (key == "files") {
+      files = number;
+    } else {
+      ops_per_open = number;
+    }
+  } else if (key == "records" || key == "fsync_every" || key == "seed" ||
+             key == "start_time") {
+    if (!parse_unsigned(value, number)) {
+      error = key + " must be a whole number";
+      return false;
+    }
+    if (key == "records") {
+      records = number;
+    } else if (key == "fsync_every") {
+      fsync_every = number;
+    } else if (key == "seed") {
+      seed = number;
+    } else {
+      start_time = number;
+    }
+  } else if (key == "syscall_time" || key == "think_time") {
+    // Given in microseconds
+    if (!parse_unsigned(value, number)) {
+      error = key + " must be a whole number of microseconds";
+      return false;
+    }
+    (key == "syscall_time" ? syscall_time : think_time) = number * 1000;
+  } else if (key == "file_size") {
+    file_size = parse_size(value);
+    if (file_size == 0) {
+      error = "file_size must be a size such as 4096, 64k or 1g";
+      return false;
+    }
+  } else if (key == "directory") {
+    if (value.empty()) {
+      error = "directory must not be empty";
+      return false;
+    }
+    directory = value;
+  } else if (key == "sequential") {
+    char *end;
+    sequential = strtod(value.c_str(), &end);
+    if (value.empty() || *end != '\0' || sequential < 0.0 ||
+        sequential > 1.0) {
+      error = "sequential must be a fraction from 0 to 1";
+      return false;
+    }
+  } else if (key == "mix") {
+    // read:60,write:30,fsync:10
+    std::vector<std::pair<SynthSyscall, double>> weights;
+    std::stringstream entries(value);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+      size_t colon = entry.find(':');
+      std::string name = trim(entry.substr(0, colon));
+      double weight = 1.0;
+      if (colon != std::string::npos &&
+          !parse_weight(trim(entry.substr(colon + 1)), weight)) {
+        error = "wrong weight in mix entry '" + entry + "'";
+        return false;
+      }
+      auto syscall = std::find_if(
+          synth_syscall_names + SYNTH_CLOSE + 1,
+          synth_syscall_names + SYNTH_SYSCALLS,
+          [&name](const char *syscall_name) { return name == syscall_name; });
+      if (syscall == synth_syscall_names + SYNTH_SYSCALLS) {
+        error = "mix may only hold read, write, pread, pwrite, lseek, "
+                "fsync, stat and fstat, not '" + name + "'";
+        return false;
+      }
+      weights.emplace_back(
+          static_cast<SynthSyscall>(syscall - synth_syscall_names), weight);
+    }
+    if (weights.empty()) {
+      error = "mix must hold at least one system call";
+      return false;
+    }
+    mix = weights;
+  } else if (key == "io_size") {
+    // 4k, 4k-64k or 4k:70,64k:30
+    std::vector<std::pair<uint64_t, double>> sizes;
+    size_t dash = value.find('-');
+    if (dash != std::string::npos) {
+      uint64_t min = parse_size(trim(value.substr(0, dash)));
+      uint64_t max = parse_size(trim(value.substr(dash + 1)));
+      if (min == 0 || max < min) {
+        error = "wrong io_size range '" + value + "'";
+        return false;
+      }
+      io_sizes = {{min, 1.0}, {max, 1.0}};
+      io_size_range = true;
+      return true;
+    }
+    std::stringstream entries(value);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+      size_t colon = entry.find(':');
+      uint64_t size = parse_size(trim(entry.substr(0, colon)));
+      double weight = 1.0;
+      if (size == 0 ||
+          (colon != std::string::npos &&
+           !parse_weight(trim(entry.substr(colon + 1)), weight))) {
+        error = "wrong io_size entry '" + entry + "'";
+        return false;
+      }
+      sizes.emplace_back(size, weight);
+    }
+    if (sizes.empty()) {
+      error = "io_size must hold at least one size";
+      return false;
+    }
+    io_sizes = sizes;
+    io_size_range = false;
+  } else {
+    error = "unknown key '" + key + "'";
+    return false;
+  }
+  return true;
+}
+
+bool WorkloadSpec::load(std::istream &spec, std::string &error) {
+  std::string line;
+  for (int number = 1; std::getline(spec, line); number++) {
+    line = trim(line.substr(0, line.find('#')));
+    if (line.empty()) {
+      continue;
+    }
+    size_t equals = line.find('=');
+    if (equals == std::string::npos) {
+      error = "line " + std::to_string(number) + ": expected key = value";
+      return false;
+    }
+    if (!set(trim(line.substr(0, equals)), trim(line.substr(equals + 1)),
+             error)) {
+      error = "line " + std::to_string(number) + ": " + error;
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * The calls of one traced thread. Each thread has its own random
+ * generator, seeded from the seed of the spec and its pid, so that the
+ * trace does not depend on how many jobs generate it.
+ */
+class SynthThread {
+ private:
+  const WorkloadSpec &spec_;
+  std::mt19937_64 random_;
+  std::discrete_distribution<int> mix_;
+  std::discrete_distribution<int> sizes_;
+  std::uniform_int_distribution<uint64_t> size_range_;
+  std::exponential_distribution<double> think_;
+  std::bernoulli_distribution sequential_;
+  std::uniform_int_distribution<int32_t> files_;
+  int32_t pid_;
+  int32_t descriptor_;
+  uint64_t clock_;
+  // Records left to generate
+  uint64_t remaining_;
+  // Open file, -1 if none
+  int32_t file_;
+  // File position, and where the next sequential pread or pwrite starts
+  uint64_t position_;
+  uint64_t next_offset_;
+  uint64_t session_left_;
+  uint64_t writes_;
+  // Generated records that are called after the current window
+  std::vector<SynthRecord> pending_;
+
+  void emit(SynthSyscall syscall, int64_t return_value, int64_t offset = 0,
+            int64_t size = 0, int32_t file = -1) {
+    SynthRecord record;
+    record.time_called = clock_;
+    record.time_returned = clock_ + spec_.syscall_time;
+    record.unique_id = -1;
+    record.return_value = return_value;
+    record.offset = offset;
+    record.size = size;
+    record.executing_pid = pid_;
+    record.descriptor = descriptor_;
+    record.file = file;
+    record.syscall = syscall;
+    pending_.push_back(record);
+    clock_ = record.time_returned;
+    if (remaining_ > 0) {
+      remaining_--;
+    }
+  }
+
+  uint64_t next_size() {
+    uint64_t size = spec_.io_size_range ? size_range_(random_)
+                                        : spec_.io_sizes[sizes_(random_)].first;
+    return std::min(size, spec_.file_size);
+  }
+
+  uint64_t random_offset(uint64_t size) {
+    uint64_t offset = std::uniform_int_distribution<uint64_t>(
+        0, spec_.file_size - size)(random_);
+    return offset - offset % SYNTH_ALIGNMENT;
+  }
+
+  /*
+   * Return the offset of the next I/O of size bytes that starts at
+   * offset if it is sequential.
+   */
+  uint64_t next_io_offset(uint64_t offset, uint64_t size) {
+    if (!sequential_(random_)) {
+      return random_offset(size);
+    }
+    // Sequential I/O wraps around at the end of the file
+    return offset + size > spec_.file_size ? 0 : offset;
+  }
+
+  void next_call() {
+    if (remaining_ == 0) {
+      if (file_ >= 0) {
+        emit(SYNTH_CLOSE, 0);
+        file_ = -1;
+      }
+      return;
+    }
+    if (session_left_ == 0) {
+      if (file_ >= 0) {
+        emit(SYNTH_CLOSE, 0);
+      }
+      file_ = files_(random_);
+      emit(SYNTH_OPEN, descriptor_, O_RDWR, 0644, file_);
+      position_ = 0;
+      next_offset_ = 0;
+      session_left_ = spec_.ops_per_open;
+    }
+    SynthSyscall syscall = spec_.mix[mix_(random_)].first;
+    uint64_t size = next_size();
+    uint64_t offset;
+    switch (syscall) {
+      case SYNTH_READ:
+      case SYNTH_WRITE:
+        offset = next_io_offset(position_, size);
+        if (offset != position_) {
+          emit(SYNTH_LSEEK, offset, offset, SEEK_SET);
+        }
+        emit(syscall, size, 0, size);
+        position_ = offset + size;
+        break;
+      case SYNTH_PREAD:
+      case SYNTH_PWRITE:
+        offset = next_io_offset(next_offset_, size);
+        emit(syscall, size, offset, size);
+        next_offset_ = offset + size;
+        break;
+      case SYNTH_LSEEK:
+        position_ = random_offset(0);
+        emit(SYNTH_LSEEK, position_, position_, SEEK_SET);
+        break;
+      case SYNTH_STAT:
+        emit(SYNTH_STAT, 0, 0, 0, files_(random_));
+        break;
+      case SYNTH_FSYNC:
+        writes_ = 0;
+        emit(SYNTH_FSYNC, 0);
+        break;
+      default:
+        emit(syscall, 0, 0, 0, file_);
+        break;
+    }
+    if (syscall == SYNTH_WRITE || syscall == SYNTH_PWRITE) {
+      writes_++;
+      if (spec_.fsync_every != 0 && writes_ >= spec_.fsync_every) {
+        writes_ = 0;
+        emit(SYNTH_FSYNC, 0);
+      }
+    }
+    session_left_--;
+    if (spec_.think_time != 0) {
+      clock_ += static_cast<uint64_t>(think_(random_));
+    }
+  }
+
+ public:
+  SynthThread(const WorkloadSpec &spec, int32_t pid, int32_t descriptor,
+              uint64_t start, uint64_t records)
+      : spec_(spec),
+        random_(spec.seed * 0x9e3779b97f4a7c15ULL + pid),
+        sequential_(spec.sequential),
+        files_(0, spec.files - 1),
+        pid_(pid),
+        descriptor_(descriptor),
+        clock_(start),
+        remaining_(records),
+        file_(-1),
+        position_(0),
+        next_offset_(0),
+        session_left_(0),
+        writes_(0) {
+    std::vector<double> weights;
+    for (auto &entry : spec.mix) {
+      weights.push_back(entry.second);
+    }
+    mix_ = std::discrete_distribution<int>(weights.begin(), weights.end());
+    weights.clear();
+    for (auto &entry : spec.io_sizes) {
+      weights.push_back(entry.second);
+    }
+    sizes_ = std::discrete_distribution<int>(weights.begin(), weights.end());
+    if (spec.io_size_range) {
+      size_range_ = std::uniform_int_distribution<uint64_t>(
+          spec.io_sizes[0].first, spec.io_sizes[1].first);
+    }
+    if (spec.think_time != 0) {
+      think_ = std::exponential_distribution<double>(1.0 / spec.think_time);
+    }
+  }
+
+  /**
+   * Append the records called before end to records, in time order.
+   */
+  void generate(uint64_t end, std::vector<SynthRecord> &records) {
+    while (clock_ < end && (remaining_ > 0 || file_ >= 0)) {
+      next_call();
+    }
+    auto later = std::find_if(
+        pending_.begin(), pending_.end(),
+        [end](const SynthRecord &record) { return record.time_called >= end; });
+    records.insert(records.end(), pending_.begin(), later);
+    pending_.erase(pending_.begin(), later);
+  }
+
+  /**
+   * Return true once every record of the thread is generated.
+   */
+  bool done() const {
+    return remaining_ == 0 && file_ < 0 && pending_.empty();
+  }
+};
+
+/*
+ * Writes synthetic records to the extents of their system calls.
+ */
+class SynthWriter {
+ private:
+  // Output of the extents of one system call
+  struct Output {
+    ExtentSeries series;
+    std::unique_ptr<OutputModule> module;
+    std::vector<std::unique_ptr<Field>> fields;
+    Int64Field *time_called = nullptr;
+    Int64Field *time_returned = nullptr;
+    Int64Field *time_recorded = nullptr;
+    Int32Field *executing_pid = nullptr;
+    Int32Field *errno_number = nullptr;
+    Int64Field *return_value = nullptr;
+    Int64Field *unique_id = nullptr;
+    Int32Field *descriptor = nullptr;
+    Variable32Field *given_pathname = nullptr;
+    Variable32Field *data = nullptr;
+    Int32Field *mode_value = nullptr;
+    Int32Field *open_value = nullptr;
+    Int64Field *bytes_requested = nullptr;
+    Int64Field *offset = nullptr;
+    ByteField *whence = nullptr;
+    Int64Field *truncate_length = nullptr;
+    Int64Field *flag_value = nullptr;
+    Int64Field *child_stack_address = nullptr;
+    Int64Field *parent_thread_id = nullptr;
+    Int64Field *child_thread_id = nullptr;
+    Int64Field *new_tls = nullptr;
+    std::vector<Int32Field *> stat_int32;
+    std::vector<Int64Field *> stat_int64;
+
+    explicit Output(const ExtentType::Ptr &type) : series(type) {}
+
+    /*
+     * Create the field named name of type and return it.
+     */
+    template <typename FieldType>
+    FieldType *add(const SynthField &field) {
+      FieldType *created = new FieldType(
+          series, field.name, field.nullable ? Field::flag_nullable : 0);
+      fields.emplace_back(created);
+      return created;
+    }
+  };
+
+  const WorkloadSpec &spec_;
+  int64_t start_tfracs_;
+  DataSeriesSink sink_;
+  ExtentTypeLibrary library_;
+  std::unique_ptr<Output> outputs_[SYNTH_SYSCALLS];
+  std::vector<std::string> paths_;
+
+  int64_t to_tfracs(uint64_t ns) const {
+    return start_tfracs_ + ((ns / 1000000000ULL) << 32) +
+           (((ns % 1000000000ULL) << 32) / 1000000000ULL);
+  }
+
+ public:
+  SynthWriter(const WorkloadSpec &spec, const std::string &filename)
+      : spec_(spec),
+        start_tfracs_(spec.start_time << 32),
+        // LZF keeps up with the generator, unlike the default of trying
+        // every algorithm on every extent
+        sink_(filename, Extent::compress_lzf) {
+    for (uint32_t file = 0; file < spec.files; file++) {
+      paths_.push_back(spec.directory + "/f" + std::to_string(file));
+    }
+    std::vector<ExtentType::Ptr> types;
+    for (int syscall = 0; syscall < SYNTH_SYSCALLS; syscall++) {
+      std::string xml = std::string("<ExtentType name=\"") +
+                        SYNTH_EXTENT_TYPE_PREFIX +
+                        synth_syscall_names[syscall] +
+                        "\" version=\"1.0\" "
+                        "pack_null_compact=\"non_bool\">\n";
+      std::vector<SynthField> fields = synth_common_fields;
+      std::vector<SynthField> specific =
+          synth_fields(static_cast<SynthSyscall>(syscall));
+      fields.insert(fields.end(), specific.begin(), specific.end());
+      for (auto &field : fields) {
+        xml += std::string("  <field type=\"") + field.type + "\" name=\"" +
+               field.name + "\"" +
+               (field.nullable ? " opt_nullable=\"yes\"" : "") + " />\n";
+      }
+      xml += "</ExtentType>\n";
+      types.push_back(library_.registerTypePtr(xml));
+    }
+    sink_.writeExtentLibrary(library_);
+
+    for (int syscall = 0; syscall < SYNTH_SYSCALLS; syscall++) {
+      Output *output = new Output(types[syscall]);
+      outputs_[syscall].reset(output);
+      std::vector<SynthField> fields = synth_common_fields;
+      std::vector<SynthField> specific =
+          synth_fields(static_cast<SynthSyscall>(syscall));
+      fields.insert(fields.end(), specific.begin(), specific.end());
+      for (auto &field : fields) {
+        std::string name = field.name;
+        std::string type = field.type;
+        if (type == "variable32") {
+          auto created = output->add<Variable32Field>(field);
+          (name == "given_pathname" ? output->given_pathname
+                                    : output->data) = created;
+        } else if (type == "byte") {
+          output->whence = output->add<ByteField>(field);
+        } else if (type == "int32") {
+          auto created = output->add<Int32Field>(field);
+          if (name == "executing_pid") {
+            output->executing_pid = created;
+          } else if (name == "errno_number") {
+            output->errno_number = created;
+          } else if (name == "descriptor") {
+            output->descriptor = created;
+          } else if (name == "mode_value") {
+            output->mode_value = created;
+          } else if (name == "open_value") {
+            output->open_value = created;
+          } else {
+            output->stat_int32.push_back(created);
+          }
+        } else {
+          auto created = output->add<Int64Field>(field);
+          if (name == "time_called") {
+            output->time_called = created;
+          } else if (name == "time_returned") {
+            output->time_returned = created;
+          } else if (name == "time_recorded") {
+            output->time_recorded = created;
+          } else if (name == "return_value") {
+            output->return_value = created;
+          } else if (name == "unique_id") {
+            output->unique_id = created;
+          } else if (name == "bytes_requested") {
+            output->bytes_requested = created;
+          } else if (name == "offset") {
+            output->offset = created;
+          } else if (name == "truncate_length") {
+            output->truncate_length = created;
+          } else if (name == "flag_value") {
+            output->flag_value = created;
+          } else if (name == "child_stack_address") {
+            output->child_stack_address = created;
+          } else if (name == "parent_thread_id") {
+            output->parent_thread_id = created;
+          } else if (name == "child_thread_id") {
+            output->child_thread_id = created;
+          } else if (name == "new_tls") {
+            output->new_tls = created;
+          } else {
+            output->stat_int64.push_back(created);
+          }
+        }
+      }
+      output->module.reset(new OutputModule(sink_, output->series,
+                                            types[syscall], SYNTH_EXTENT_SIZE));
+    }
+  }
+
+  /**
+   * Write record to the extents of its system call.
+   */
+  void write(const SynthRecord &record) {
+    Output &out = *outputs_[record.syscall];
+    out.module->newRecord();
+    out.time_called->set(to_tfracs(record.time_called));
+    out.time_returned->set(to_tfracs(record.time_returned));
+    out.time_recorded->set(to_tfracs(record.time_returned));
+    out.executing_pid->set(record.executing_pid);
+    out.errno_number->set(0);
+    out.return_value->set(record.return_value);
+    out.unique_id->set(record.unique_id);
+    switch (record.syscall) {
+      case SYNTH_UMASK:
+        out.mode_value->set(record.size);
+        break;
+      case SYNTH_MKDIR:
+        out.given_pathname->set(spec_.directory);
+        out.mode_value->set(record.size);
+        break;
+      case SYNTH_OPEN:
+        out.given_pathname->set(paths_[record.file]);
+        out.open_value->set(record.offset);
+        out.mode_value->set(record.size);
+        break;
+      case SYNTH_FTRUNCATE:
+        out.descriptor->set(record.descriptor);
+        out.truncate_length->set(record.offset);
+        break;
+      case SYNTH_CLONE:
+        out.flag_value->set(record.offset);
+        out.child_stack_address->set(0);
+        out.parent_thread_id->set(0);
+        out.child_thread_id->set(0);
+        out.new_tls->set(0);
+        break;
+      case SYNTH_READ:
+      case SYNTH_WRITE:
+      case SYNTH_PREAD:
+      case SYNTH_PWRITE:
+        out.descriptor->set(record.descriptor);
+        // Traces carry no data, which writes replace with zeros
+        out.data->setNull();
+        out.bytes_requested->set(record.size);
+        if (out.offset != nullptr) {
+          out.offset->set(record.offset);
+        }
+        break;
+      case SYNTH_LSEEK:
+        out.descriptor->set(record.descriptor);
+        out.offset->set(record.offset);
+        out.whence->set(record.size);
+        break;
+      case SYNTH_STAT:
+      case SYNTH_FSTAT:
+        if (record.syscall == SYNTH_STAT) {
+          out.given_pathname->set(paths_[record.file]);
+        } else {
+          out.descriptor->set(record.descriptor);
+        }
+        {
+          /*
+           * dev, ino, mode, nlink, uid, gid, rdev, blksize, blocks. The
+           * files are replayed by the user running trace-synth. blksize
+           * and blocks depend on the file system and on how much of the
+           * sparse files the replay fills in, so they are left null,
+           * which the replayer does not verify.
+           */
+          int32_t stat_int32[] = {0,
+                                  record.file + 1,
+                                  S_IFREG | 0644,
+                                  1,
+                                  static_cast<int32_t>(geteuid()),
+                                  static_cast<int32_t>(getegid()),
+                                  0};
+          size_t known = sizeof(stat_int32) / sizeof(stat_int32[0]);
+          for (size_t field = 0; field < out.stat_int32.size(); field++) {
+            if (field < known) {
+              out.stat_int32[field]->set(stat_int32[field]);
+            } else {
+              out.stat_int32[field]->setNull();
+            }
+          }
+          // size, atime, mtime, ctime
+          int64_t stat_int64[] = {static_cast<int64_t>(spec_.file_size),
+                                  start_tfracs_, start_tfracs_, start_tfracs_};
+          for (size_t field = 0; field < out.stat_int64.size(); field++) {
+            out.stat_int64[field]->set(stat_int64[field]);
+          }
+        }
+        break;
+      default:
+        out.descriptor->set(record.descriptor);
+        break;
+    }
+  }
+
+  /**
+   * Write the last extents and close the file.
+   */
+  void close() {
+    for (auto &output : outputs_) {
+      // Deleting the output module writes the last extent
+      output->module.reset();
+    }
+    sink_.close();
+  }
+};
+
+TraceSynthesizer::TraceSynthesizer(const WorkloadSpec &spec,
+                                   const std::string &filename,
+                                   unsigned int jobs)
+    : spec_(spec),
+      jobs_(std::max(jobs, 1u)),
+      writer_(new SynthWriter(spec_, filename)),
+      written_(0) {}
+
+TraceSynthesizer::~TraceSynthesizer() {}
+
+std::vector<SynthRecord> TraceSynthesizer::setup() const {
+  std::vector<SynthRecord> records;
+  uint64_t clock = 0;
+  auto emit = [&](SynthSyscall syscall, int32_t pid, int64_t return_value,
+                  int64_t offset, int64_t size, int32_t file) {
+    SynthRecord record;
+    record.time_called = clock;
+    record.time_returned = clock + spec_.syscall_time;
+    record.unique_id = -1;
+    record.return_value = return_value;
+    record.offset = offset;
+    record.size = size;
+    record.executing_pid = pid;
+    record.descriptor = SYNTH_FIRST_DESCRIPTOR;
+    record.file = file;
+    record.syscall = syscall;
+    records.push_back(record);
+    clock = record.time_returned;
+  };
+
+  // The replayer starts with the umask of the first process
+  emit(SYNTH_UMASK, SYNTH_FIRST_PID, 022, 0, 022, -1);
+  emit(SYNTH_MKDIR, SYNTH_FIRST_PID, 0, 0, 0755, -1);
+  for (uint32_t file = 0; file < spec_.files; file++) {
+    emit(SYNTH_OPEN, SYNTH_FIRST_PID, SYNTH_FIRST_DESCRIPTOR,
+         O_CREAT | O_RDWR | O_TRUNC, 0644, file);
+    emit(SYNTH_FTRUNCATE, SYNTH_FIRST_PID, 0, spec_.file_size, 0, -1);
+    emit(SYNTH_CLOSE, SYNTH_FIRST_PID, 0, 0, 0, -1);
+  }
+  for (uint32_t process = 1; process < spec_.processes; process++) {
+    int32_t pid = SYNTH_FIRST_PID + process * spec_.threads;
+    emit(SYNTH_CLONE, SYNTH_FIRST_PID, pid, SIGCHLD, 0, -1);
+  }
+  for (uint32_t process = 0; process < spec_.processes; process++) {
+    int32_t pid = SYNTH_FIRST_PID + process * spec_.threads;
+    for (uint32_t thread = 1; thread < spec_.threads; thread++) {
+      emit(SYNTH_CLONE, pid, pid + thread, SYNTH_THREAD_CLONE_FLAGS, 0, -1);
+    }
+  }
+  return records;
+}
+
+std::vector<SynthRecord> TraceSynthesizer::generate_window(uint64_t end) {
+  // Each job generates the records of every jobs_-th thread
+  std::vector<std::vector<SynthRecord>> streams(threads_.size());
+  std::vector<std::thread> jobs;
+  for (unsigned int job = 0; job < jobs_ && job < threads_.size(); job++) {
+    jobs.emplace_back([this, job, end, &streams]() {
+      for (size_t thread = job; thread < threads_.size(); thread += jobs_) {
+        threads_[thread]->generate(end, streams[thread]);
+      }
+    });
+  }
+  for (auto &job : jobs) {
+    job.join();
+  }
+
+  // Merge the streams by time, ties going to the lower thread
+  typedef std::pair<uint64_t, size_t> Head;
+  std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+  std::vector<size_t> positions(streams.size(), 0);
+  size_t total = 0;
+  for (size_t thread = 0; thread < streams.size(); thread++) {
+    if (!streams[thread].empty()) {
+      heads.emplace(streams[thread][0].time_called, thread);
+    }
+    total += streams[thread].size();
+  }
+  std::vector<SynthRecord> records;
+  records.reserve(total);
+  while (!heads.empty()) {
+    size_t thread = heads.top().second;
+    heads.pop();
+    records.push_back(streams[thread][positions[thread]++]);
+    if (positions[thread] < streams[thread].size()) {
+      heads.emplace(streams[thread][positions[thread]].time_called, thread);
+    }
+  }
+  return records;
+}
+
+uint64_t TraceSynthesizer::generate() {
+  std::vector<SynthRecord> window = setup();
+  uint64_t end = window.back().time_returned;
+
+  uint32_t thread_count = spec_.processes * spec_.threads;
+  for (uint32_t thread = 0; thread < thread_count; thread++) {
+    // Records are split evenly, the first threads taking the remainder
+    uint64_t records = spec_.records / thread_count +
+                       (thread < spec_.records % thread_count ? 1 : 0);
+    threads_.emplace_back(new SynthThread(
+        spec_, SYNTH_FIRST_PID + thread,
+        SYNTH_FIRST_DESCRIPTOR + thread % spec_.threads, end, records));
+  }
+  // Trace time in which all threads call about SYNTH_WINDOW_RECORDS times
+  uint64_t span = std::max<uint64_t>(
+      (spec_.syscall_time + spec_.think_time) *
+          std::max<uint64_t>(SYNTH_WINDOW_RECORDS / thread_count, 1),
+      1);
+
+  while (true) {
+    bool more = std::any_of(
+        threads_.begin(), threads_.end(),
+        [](const std::unique_ptr<SynthThread> &thread) {
+          return !thread->done();
+        });
+    // The next window is generated while this one is written
+    std::future<std::vector<SynthRecord>> next;
+    if (more) {
+      end += span;
+      next = std::async(std::launch::async,
+                        &TraceSynthesizer::generate_window, this, end);
+    }
+    for (auto &record : window) {
+      record.unique_id = written_++;
+      writer_->write(record);
+    }
+    if (!more) {
+      break;
+    }
+    window = next.get();
+  }
+  writer_->close();
+  return written_;
+}
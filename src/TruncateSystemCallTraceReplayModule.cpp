@@ -56,5 +56,5 @@ void TruncateSystemCallTraceReplayModule::processRow() {
   char *path = (char *)given_pathname_.val();
   int64_t length = truncate_length_.val();
   // Replay the truncate system call
-  replayed_ret_val_ = truncate(path, length);
+  replayed_ret_val_ = engine_->truncate(path, length);
 }
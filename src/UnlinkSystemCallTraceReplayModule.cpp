@@ -47,7 +47,7 @@ void UnlinkSystemCallTraceReplayModule::print_specific_fields() {
 
 void UnlinkSystemCallTraceReplayModule::processRow() {
   // Replay the unlink system call
-  replayed_ret_val_ = unlink(pathname);
+  replayed_ret_val_ = engine_->unlink(pathname);
   delete[] pathname;
 }
 
@@ -92,5 +92,5 @@ void UnlinkatSystemCallTraceReplayModule::processRow() {
     return;
   }
   // Replay the unlinkat system call
-  replayed_ret_val_ = unlinkat(dirfd, path, flags);
+  replayed_ret_val_ = engine_->unlinkat(dirfd, path, flags);
 }
@@ -75,12 +75,12 @@ void UtimeSystemCallTraceReplayModule::processRow() {
           " It will assign the current time to the file's",
           " access_time and mod_time.");
     }
-    replayed_ret_val_ = utime(pathname, nullptr);
+    replayed_ret_val_ = engine_->utime(pathname, nullptr);
   } else {
     utimebuf.actime = Tfrac_to_sec(access_t);
     utimebuf.modtime = Tfrac_to_sec(mod_t);
 
-    replayed_ret_val_ = utime(pathname, &utimebuf);
+    replayed_ret_val_ = engine_->utime(pathname, &utimebuf);
   }
 }
 
@@ -127,14 +127,14 @@ void UtimesSystemCallTraceReplayModule::processRow() {
           " It will assign the current time to the file's",
           " access_time and mod_time.");
     }
-    replayed_ret_val_ = utimes(pathname, nullptr);
+    replayed_ret_val_ = engine_->utimes(pathname, nullptr);
   } else {
     struct timeval tv_access_time = Tfrac_to_timeval(access_time_.val());
     struct timeval tv_mod_time = Tfrac_to_timeval(mod_time_.val());
     tv[0] = tv_access_time;
     tv[1] = tv_mod_time;
 
-    replayed_ret_val_ = utimes(pathname, tv);
+    replayed_ret_val_ = engine_->utimes(pathname, tv);
   }
 }
 
@@ -199,16 +199,16 @@ void UtimensatSystemCallTraceReplayModule::processRow() {
      * XXX: The glibc wrapper for utimensat will give the error EINVAL
      * if the pathname is NULL, while, for the system call itself,
      * NULL is a valid pathname in some situations.  Calling the wrapper
-     * resulted in errors replaying a cp -a command, so we call the
-     * utimensat system call directly. - Nina
+     * resulted in errors replaying a cp -a command, so the engine calls
+     * the utimensat system call directly. - Nina
      */
-    replayed_ret_val_ = syscall(SYS_utimensat, dirfd, pathname, NULL, flags);
+    replayed_ret_val_ = engine_->utimensat(dirfd, pathname, NULL, flags);
   } else {
     struct timespec ts_access_time = Tfrac_to_timespec(access_time_.val());
     struct timespec ts_mod_time = Tfrac_to_timespec(mod_time_.val());
     ts[0] = ts_access_time;
     ts[1] = ts_mod_time;
 
-    replayed_ret_val_ = syscall(SYS_utimensat, dirfd, pathname, ts, flags);
+    replayed_ret_val_ = engine_->utimensat(dirfd, pathname, ts, flags);
   }
 }
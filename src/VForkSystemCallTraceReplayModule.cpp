@@ -36,6 +36,7 @@
 #include <thread>
 #include "tbb/atomic.h"
 #include "tbb/concurrent_vector.h"
+#include "VirtualAddressSpace.hpp"
 
 extern tbb::concurrent_vector<std::thread> threads;
 extern void executionThread(int64_t threadID);
@@ -59,7 +60,7 @@ void VForkSystemCallTraceReplayModule::processRow() {
    * A call to vfork() is equivalent to calling clone(2) with flags
    * specified as: CLONE_VM | CLONE_VFORK | SIGCHLD
    */
-  bool shared_umask = false, shared_files = false;
+  bool shared_umask = false, shared_files = false, shared_vm = true;
   pid_t ppid = executing_pid();
   pid_t pid = return_value();
   // Clone resources tables
@@ -67,6 +68,7 @@ void VForkSystemCallTraceReplayModule::processRow() {
       ppid, pid, shared_umask);
   SystemCallTraceReplayModule::replayer_resources_manager_.clone_fd_table(
       ppid, pid, shared_files);
+  VM_manager::getInstance()->clone_VM_area(ppid, pid, shared_vm);
 
   nThreads++;
   setRunning(pid, nullptr);
@@ -23,160 +23,242 @@
  */
 
 #include "VirtualAddressSpace.hpp"
+#include <sys/mman.h>
 #include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <iterator>
 #include "SystemCallTraceReplayModule.hpp"
 
-VM_manager* VM_manager::instance = NULL;
-VM_manager* VM_manager::getInstance() {
-  if (!instance) {
-    instance = new VM_manager();
+ReplayedMapping::ReplayedMapping(void* start, uint64_t size) {
+  auto start_int = reinterpret_cast<uint64_t>(start);
+  refs_[start_int] = 1;
+  refs_[start_int + size] = 0;
+}
+
+void ReplayedMapping::split(uint64_t addr) {
+  auto it = refs_.upper_bound(addr);
+  if (it == refs_.begin()) {
+    refs_.emplace_hint(it, addr, 0);
+    return;
   }
-  return instance;
+  auto prev = std::prev(it);
+  if (prev->first != addr) refs_.emplace_hint(it, addr, prev->second);
 }
 
-VM_area* VM_manager::get_VM_area(pid_t pid) {
-  std::unordered_map<pid_t, VM_area*>::const_iterator process_vm_area =
-      process_map.find(pid);
-  if (process_vm_area == process_map.end()) {
-    VM_area* area = new VM_area();
-    process_map[pid] = area;
-    return area;
+void ReplayedMapping::adjust(uint64_t start, uint64_t end, int delta,
+                             ReplayedRanges* unused) {
+  if (start >= end) return;
+  split(start);
+  split(end);
+  auto first = refs_.find(start);
+  auto last = refs_.find(end);
+  for (auto it = first; it != last; ++it) {
+    if (delta < 0 && it->second == 0) continue;
+    it->second += delta;
+    if (it->second == 0 && unused != nullptr) {
+      unused->emplace_back(it->first, std::next(it)->first);
+    }
+  }
+
+  // Merge the ranges that now count the same as the range before them
+  auto it = first == refs_.begin() ? first : std::prev(first);
+  while (true) {
+    auto next = std::next(it);
+    if (next == refs_.end() || next->first > end) break;
+    if (next->second == it->second) {
+      refs_.erase(next);
+    } else {
+      it = next;
+    }
   }
-  return process_map[pid];
 }
 
-void VM_area::insert_VM_node(VM_node* node) {
-  vma_lock.lock();
-  vma.push_back(node);
-  vma_lock.unlock();
-  return;
+void ReplayedMapping::acquire(void* start, uint64_t size) {
+  auto start_int = reinterpret_cast<uint64_t>(start);
+  std::lock_guard<std::mutex> lock(lock_);
+  adjust(start_int, start_int + size, 1, nullptr);
 }
 
-enum overlaps { left = 4, right = 2, enclosed = 8, enclosing = 1, invalid = 0 };
+void ReplayedMapping::release(void* start, uint64_t size,
+                              std::pair<uint64_t, uint64_t> keep) {
+  auto start_int = reinterpret_cast<uint64_t>(start);
+  ReplayedRanges unused;
+  std::lock_guard<std::mutex> lock(lock_);
+  adjust(start_int, start_int + size, -1, &unused);
+  for (auto& range : unused) {
+    // Unmap the parts of the range before and after keep
+    uint64_t pieces[2][2] = {
+        {range.first, std::min(range.second, keep.first)},
+        {std::max(range.first, keep.second), range.second}};
+    for (auto& piece : pieces) {
+      if (piece[0] < piece[1]) {
+        munmap(reinterpret_cast<void*>(piece[0]), piece[1] - piece[0]);
+      }
+    }
+  }
+}
 
-bool check_left_overlapping(uint64_t addr_int, size_t size, uint64_t start_addr,
-                            uint64_t end_addr) {
-  return ((addr_int + size) >= end_addr) && (addr_int > start_addr) &&
-         (addr_int < end_addr);
+bool ReplayedMapping::read(const void* addr, size_t size, void* buffer) {
+  auto start = reinterpret_cast<uint64_t>(addr);
+  std::lock_guard<std::mutex> lock(lock_);
+  auto it = refs_.upper_bound(start);
+  if (it == refs_.begin()) return false;
+  // The key at the end of the mapping counts zero
+  for (--it; it != refs_.end() && it->first < start + size; ++it) {
+    if (it->second == 0) return false;
+  }
+  memcpy(buffer, addr, size);
+  return true;
 }
 
-bool check_right_overlapping(uint64_t addr_int, size_t size,
-                             uint64_t start_addr, uint64_t end_addr) {
-  return ((addr_int + size) > start_addr) && ((addr_int + size) < end_addr) &&
-         (addr_int <= start_addr);
+VM_manager* VM_manager::getInstance() {
+  // Initialization of a local static is thread safe since C++11
+  static VM_manager instance;
+  return &instance;
 }
 
-bool check_enclosed_overlapping(uint64_t addr_int, size_t size,
-                                uint64_t start_addr, uint64_t end_addr) {
-  return (addr_int <= start_addr) && ((addr_int + size) >= end_addr);
+std::shared_ptr<VM_area> VM_manager::get_VM_area(pid_t pid) {
+  {
+    ProcessMap::const_accessor process_vm_area;
+    if (process_map.find(process_vm_area, pid)) {
+      return process_vm_area->second;
+    }
+  }
+  ProcessMap::accessor process_vm_area;
+  if (process_map.insert(process_vm_area, pid)) {
+    process_vm_area->second = std::make_shared<VM_area>();
+  }
+  return process_vm_area->second;
 }
 
-bool check_enclosing_overlapping(uint64_t addr_int, size_t size,
-                                 uint64_t start_addr, uint64_t end_addr) {
-  return (addr_int > start_addr) && ((addr_int + size) < end_addr);
+void VM_manager::clone_VM_area(pid_t ppid, pid_t pid, bool shared_vm) {
+  std::shared_ptr<VM_area> parent_area = get_VM_area(ppid);
+  std::shared_ptr<VM_area> area =
+      shared_vm ? parent_area : std::make_shared<VM_area>(*parent_area);
+
+  ProcessMap::accessor process_vm_area;
+  process_map.insert(process_vm_area, pid);
+  process_vm_area->second = area;
 }
 
-std::vector<VM_node*>* VM_area::find_VM_node(void* addr, size_t size) {
-  auto addr_int = reinterpret_cast<uint64_t>(addr);
-  auto result = new std::vector<VM_node*>(vma.size());
-  std::copy_if(vma.begin(), vma.end(), result->begin(), [&](VM_node* vnode)
-                                                            -> bool {
-    auto start_addr = reinterpret_cast<uint64_t>(vnode->traced_start_address);
-    auto end_addr = start_addr + vnode->map_size;
-    return check_left_overlapping(addr_int, size, start_addr, end_addr) ||
-           check_right_overlapping(addr_int, size, start_addr, end_addr) ||
-           check_enclosed_overlapping(addr_int, size, start_addr, end_addr) ||
-           check_enclosing_overlapping(addr_int, size, start_addr, end_addr);
-  });
-  return result;
+void VM_manager::reset_VM_area(pid_t pid) {
+  ProcessMap::accessor process_vm_area;
+  process_map.insert(process_vm_area, pid);
+  process_vm_area->second = std::make_shared<VM_area>();
 }
 
-bool VM_area::delete_VM_node(void* addr, size_t size) {
-  auto addr_int = reinterpret_cast<uint64_t>(addr);
+void VM_manager::remove_VM_area(pid_t pid) { process_map.erase(pid); }
 
-  vma_lock.lock();
-
-  list();
-  auto result = find_VM_node(addr, size);
-
-  for (auto node : *result) {
-    if (node == NULL) continue;
-    SystemCallTraceReplayModule::syscall_logger_->log_info(
-        "addr ",
-        boost::format("%02x") %
-            reinterpret_cast<uint64_t>(node->traced_start_address));
-    // we have only two cases
-    // first delete the node
-    // second just update
-    auto start_addr = reinterpret_cast<uint64_t>(node->traced_start_address);
-    auto end_addr = start_addr + node->map_size;
-
-    int overlapped = 0;
-    overlapped |= check_left_overlapping(addr_int, size, start_addr, end_addr)
-                      ? left
-                      : invalid;
-    overlapped |= check_right_overlapping(addr_int, size, start_addr, end_addr)
-                      ? right
-                      : invalid;
-    overlapped |=
-        check_enclosed_overlapping(addr_int, size, start_addr, end_addr)
-            ? enclosed
-            : invalid;
-    overlapped |=
-        check_enclosing_overlapping(addr_int, size, start_addr, end_addr)
-            ? enclosing
-            : invalid;
-    SystemCallTraceReplayModule::syscall_logger_->log_info("overllaped ",
-                                                           overlapped);
-
-    switch (overlapped) {
-      case enclosed: {
-        vma.erase(std::find(vma.begin(), vma.end(), node));
-        break;
-      }
-      case left: {
-        node->map_size = addr_int - start_addr;
-        break;
-      }
-      case right: {
-        auto new_start_addr = addr_int + size;
-        node->replayed_start_address = reinterpret_cast<void*>(
-            reinterpret_cast<uint64_t>(node->replayed_start_address) +
-            (new_start_addr - start_addr));
-        node->map_size -= (new_start_addr - start_addr);
-        node->traced_start_address = reinterpret_cast<void*>(new_start_addr);
-        break;
-      }
-      case enclosing: {
-        // create a new node
-        auto new_traced_addr = addr_int + size;
-        auto new_replyed_addr =
-            reinterpret_cast<uint64_t>(node->replayed_start_address) +
-            new_traced_addr - start_addr;
-        auto new_size = end_addr - new_traced_addr;
-        auto new_node =
-            new VM_node(reinterpret_cast<void*>(new_traced_addr),
-                        reinterpret_cast<void*>(new_replyed_addr), new_size,
-                        node->traced_fd, node->replayed_fd);
-        vma.push_back(new_node);
-
-        // update the size of the node
-        node->map_size = addr_int - start_addr;
-        break;
-      }
+VM_area::VM_area(const VM_area& other) {
+  std::lock_guard<std::mutex> lock(other.vma_lock);
+  vma = other.vma;
+  for (auto& entry : vma) {
+    VM_node& node = entry.second;
+    if (node.mapping) {
+      node.mapping->acquire(node.replayed_start_address, node.map_size);
+    }
+  }
+}
+
+VM_area::~VM_area() {
+  for (auto& entry : vma) {
+    VM_node& node = entry.second;
+    if (node.mapping) {
+      node.mapping->release(node.replayed_start_address, node.map_size);
     }
   }
-  result->clear();
-  delete result;
+}
+
+std::map<uint64_t, VM_node>::iterator VM_area::first_overlap(uint64_t addr) {
+  auto it = vma.upper_bound(addr);
+  if (it != vma.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first + prev->second.map_size > addr) return prev;
+  }
+  return it;
+}
+
+bool VM_area::carve(uint64_t start, uint64_t end,
+                    std::pair<uint64_t, uint64_t> keep) {
+  bool overlapped = false;
+  auto it = first_overlap(start);
+  while (it != vma.end() && it->first < end) {
+    overlapped = true;
+    VM_node &node = it->second;
+    auto start_addr = it->first;
+    auto end_addr = start_addr + node.map_size;
+
+    if (node.mapping) {
+      // release the memory of the part of the region that goes away
+      auto cut_start = std::max(start_addr, start);
+      auto cut_end = std::min(end_addr, end);
+      auto replayed_cut = reinterpret_cast<uint64_t>(
+                              node.replayed_start_address) +
+                          cut_start - start_addr;
+      node.mapping->release(reinterpret_cast<void*>(replayed_cut),
+                            cut_end - cut_start, keep);
+    }
+
+    if (end_addr > end) {
+      // keep the part of the region past the unmapped range
+      auto new_replayed_addr =
+          reinterpret_cast<uint64_t>(node.replayed_start_address) + end -
+          start_addr;
+      vma.emplace_hint(std::next(it), end,
+                       VM_node(reinterpret_cast<void*>(end),
+                               reinterpret_cast<void*>(new_replayed_addr),
+                               end_addr - end, node.traced_fd,
+                               node.replayed_fd, node.mapping));
+    }
+    if (start_addr < start) {
+      // keep the part of the region before the unmapped range
+      node.map_size = start - start_addr;
+      ++it;
+    } else {
+      it = vma.erase(it);
+    }
+  }
+  return overlapped;
+}
+
+void VM_area::insert_VM_node(const VM_node& node) {
+  auto start = reinterpret_cast<uint64_t>(node.traced_start_address);
+  if (node.map_size == 0) return;
+
+  // The mmap of node already replaced whatever was mapped at its memory
+  std::pair<uint64_t, uint64_t> keep(0, 0);
+  if (node.mapping) {
+    keep.first = reinterpret_cast<uint64_t>(node.replayed_start_address);
+    keep.second = keep.first + node.map_size;
+  }
+  std::lock_guard<std::mutex> lock(vma_lock);
+  carve(start, start + node.map_size, keep);
+  vma.emplace(start, node);
+}
+
+bool VM_area::get_VM_node(void* addr, size_t size, VM_node* node) {
+  auto start = reinterpret_cast<uint64_t>(addr);
+
+  std::lock_guard<std::mutex> lock(vma_lock);
+  auto it = first_overlap(start);
+  if (it == vma.end() || it->first >= start + size) return false;
+  *node = it->second;
+  return true;
+}
+
+bool VM_area::delete_VM_node(void* addr, size_t size) {
+  auto addr_int = reinterpret_cast<uint64_t>(addr);
 
-  vma_lock.unlock();
-  return false;
+  std::lock_guard<std::mutex> lock(vma_lock);
+  return carve(addr_int, addr_int + size);
 }
 
 void VM_area::list() {
-  for (VM_node* node : vma) {
-    SystemCallTraceReplayModule::syscall_logger_->log_info(
+  std::lock_guard<std::mutex> lock(vma_lock);
+  for (auto& entry : vma) {
+    const VM_node* node = &entry.second;
+    SystemCallTraceReplayModule::syscall_logger_->log_debug(
         "Current node in VM_area: traced_addr(",
         boost::format("0x%02x") % (node->traced_start_address), "), ",
         "replayed_addr(",
@@ -35,6 +35,7 @@
 #include <utility>
 
 #include "WriteSystemCallTraceReplayModule.hpp"
+#include "AsyncIOEngine.hpp"
 
 WriteSystemCallTraceReplayModule::WriteSystemCallTraceReplayModule(
     DataSeriesModule &source, bool verbose_flag, bool verify_flag,
@@ -44,7 +45,8 @@ WriteSystemCallTraceReplayModule::WriteSystemCallTraceReplayModule(
       pattern_data_(std::move(pattern_data)),
       descriptor_(series, "descriptor"),
       data_written_(series, "data_written", Field::flag_nullable),
-      bytes_requested_(series, "bytes_requested") {
+      bytes_requested_(series, "bytes_requested"),
+      aligned_buffer_(false) {
   sys_call_name_ = "write";
 }
 
@@ -71,30 +73,78 @@ void WriteSystemCallTraceReplayModule::processRow() {
 
   // Check to see if user wants to use pattern
   if (!pattern_data_.empty()) {
-    if (pattern_data_ == "random") {
-      // Fill write buffer using rand()
-      data_buffer = random_fill_buffer(data_buffer, nbytes);
-    } else if (pattern_data_ == "urandom") {
-      // Fill write buffer using data generated from /dev/urandom
-      SystemCallTraceReplayModule::random_file_.read(data_buffer, nbytes);
-    } else {
-      // Write zeros or pattern specified in pattern_data
-      unsigned char pattern = pattern_data_[0];
-
-      /*
-       * XXX FUTURE WORK: Currently we support pattern of one byte.
-       * For multi byte pattern data, we have to modify the
-       * implementation of filling data_buffer.
-       */
-      memset(data_buffer, pattern, nbytes);
-    }
+    fill_pattern_buffer(pattern_data_, data_buffer, nbytes);
   }
 
-  // Replay write system call as normal.
-  replayed_ret_val_ = write(replayed_fd, data_buffer, nbytes);
+  if (is_direct_io(executingPidVal, traced_fd)) {
+    if (submit_direct_io(replayed_fd, -1)) {
+      // The buffer is freed once the request completes.
+      return;
+    }
+    replayed_ret_val_ =
+        aligned_buffer_pool_.direct_write(replayed_fd, data_buffer, nbytes);
+  } else {
+    // Replay write system call as normal.
+    replayed_ret_val_ = engine_->write(replayed_fd, data_buffer, nbytes);
+  }
 
   // Free the buffer
-  delete[] data_buffer;
+  release_buffer();
+}
+
+void WriteSystemCallTraceReplayModule::use_aligned_buffer() {
+  if (aligned_buffer_) {
+    return;
+  }
+  char *aligned = aligned_buffer_pool_.get(nbytes);
+  if (aligned == nullptr) {
+    syscall_logger_->log_warn("Unable to allocate an aligned buffer of ",
+                              nbytes, " bytes for ", sys_call_name_);
+    return;
+  }
+  if (data_buffer != nullptr) {
+    std::memcpy(aligned, data_buffer, nbytes);
+    delete[] data_buffer;
+  }
+  data_buffer = aligned;
+  aligned_buffer_ = true;
+}
+
+void WriteSystemCallTraceReplayModule::release_buffer() {
+  if (aligned_buffer_) {
+    aligned_buffer_pool_.put(data_buffer, nbytes);
+    aligned_buffer_ = false;
+  } else {
+    delete[] data_buffer;
+  }
+  data_buffer = nullptr;
+}
+
+bool WriteSystemCallTraceReplayModule::submit_direct_io(int fd, off_t offset) {
+  use_aligned_buffer();
+  /*
+   * With O_APPEND the kernel picks the offset at the time of the write,
+   * which we cannot reserve up front, so such writes stay synchronous.
+   */
+  int flags = replayer_resources_manager_.get_flags(executingPidVal, traced_fd);
+  if (aio_engine_ == nullptr || !aligned_buffer_ || (flags & O_APPEND) != 0) {
+    return false;
+  }
+
+  // The engine turns down unaligned requests, which go through a bounce
+  // buffer synchronously.
+  async_pending_ = true;
+  if (!aio_engine_->submit_write(executingPidVal, this, fd, data_buffer, nbytes,
+                                 offset)) {
+    async_pending_ = false;
+  }
+  return async_pending_;
+}
+
+void WriteSystemCallTraceReplayModule::complete_async_io(int64_t result) {
+  set_async_result(result);
+  completeProcessing();
+  release_buffer();
 }
 
 void WriteSystemCallTraceReplayModule::prepareRow() {
@@ -104,7 +154,10 @@ void WriteSystemCallTraceReplayModule::prepareRow() {
   auto dataBuf = reinterpret_cast<const char *>(data_written_.val());
   if (nbytes != 0) {
     data_buffer = new char[nbytes];
-    if (data_buffer != NULL && replayed_ret_val_ > 0) {
+    if (data_written_.isNull()) {
+      // Traces without data, like those of trace-synth, write zeros
+      std::memset(data_buffer, 0, nbytes);
+    } else if (data_buffer != NULL && replayed_ret_val_ > 0) {
       std::memcpy(data_buffer, dataBuf, replayed_ret_val_);
     }
   } else {
@@ -147,35 +200,22 @@ void PWriteSystemCallTraceReplayModule::processRow() {
 
   // Check to see if user wants to use pattern
   if (!pattern_data_.empty()) {
-    data_buffer = new char[nbytes];
-    if (pattern_data_ == "random") {
-      // Fill write buffer using rand()
-      data_buffer = random_fill_buffer(data_buffer, nbytes);
-    } else if (pattern_data_ == "urandom") {
-      // Fill write buffer using data generated from /dev/urandom
-      SystemCallTraceReplayModule::random_file_.read(data_buffer, nbytes);
-    } else {
-      // Write zeros or pattern specified in pattern_data
-      unsigned char pattern = pattern_data_[0];
-
-      /*
-       * XXX FUTURE WORK: Currently we support pattern of one byte.
-       * For multi byte pattern data, we have to modify the
-       * implementation of filling data_buffer.
-       */
-      memset(data_buffer, pattern, nbytes);
+    fill_pattern_buffer(pattern_data_, data_buffer, nbytes);
+  }
+
+  if (is_direct_io(pid, traced_fd)) {
+    if (submit_direct_io(fd, off)) {
+      // The buffer is freed once the request completes.
+      return;
     }
-    replayed_ret_val_ = pwrite(fd, data_buffer, nbytes, off);
+    replayed_ret_val_ =
+        aligned_buffer_pool_.direct_pwrite(fd, data_buffer, nbytes, off);
   } else {
-    // Write the traced data
-    replayed_ret_val_ = pwrite(fd, data_buffer, nbytes, off);
+    replayed_ret_val_ = engine_->pwrite(fd, data_buffer, nbytes, off);
   }
 
   // Free the buffer
-  if (!pattern_data_.empty() && data_buffer != nullptr) {
-    delete[] data_buffer;
-  }
-  delete[] data_buffer;
+  release_buffer();
 }
 
 void PWriteSystemCallTraceReplayModule::prepareRow() {
@@ -32,6 +32,7 @@
  * about this class.
  */
 
+#include <algorithm>
 #include <utility>
 
 #include "WritevSystemCallTraceReplayModule.hpp"
@@ -45,63 +46,30 @@ WritevSystemCallTraceReplayModule::WritevSystemCallTraceReplayModule(
       count_(series, "count", Field::flag_nullable),
       iov_number_(series, "iov_number"),
       data_written_(series, "iov_data_written", Field::flag_nullable),
-      bytes_requested_(series, "bytes_requested") {
+      bytes_requested_(series, "bytes_requested"),
+      traced_fd(-1),
+      iovcnt(0),
+      nbytes(0),
+      arena(nullptr) {
   sys_call_name_ = "writev";
 }
 
 void WritevSystemCallTraceReplayModule::print_specific_fields() {
-  // Save the postion of first record.
-  const void *first_record_pos = series.getCurPos();
-
   /*
    * Print the descriptor value, number of iovec and total
-   * number of bytes written from the first record of dataseries file.
+   * number of bytes requested by the writev call.
    */
   pid_t pid = executing_pid();
-  int replayed_fd = replayer_resources_manager_.get_fd(pid, descriptor_.val());
-  syscall_logger_->log_info("traced fd(", descriptor_.val(), "), ",
-                            "replayed fd(", replayed_fd, "), ", "count:(",
-                            count_.val(), "), ", "bytes requested:(",
-                            bytes_requested_.val(), ")");
-
-  int count = count_.val();
-
-  /*
-   * Iteratively fetch the new record to print the iov_number
-   * and data written for each iovec buffers.
-   */
-  while (count > 0 && series.morerecords()) {
-    ++series;
-    syscall_logger_->log_info("iov_number:(", iov_number_.val(), "), ",
-                              "data_written:(", data_written_.val(), ")");
-    count--;
-  }
-
-  // Again, set the pointer to the first record.
-  series.setCurPos(first_record_pos);
+  int replayed_fd = replayer_resources_manager_.get_fd(pid, traced_fd);
+  syscall_logger_->log_info("traced fd(", traced_fd, "), ", "replayed fd(",
+                            replayed_fd, "), ", "count:(", iovcnt, "), ",
+                            "bytes requested:(", nbytes, ")");
 }
 
 void WritevSystemCallTraceReplayModule::processRow() {
   // Get replaying file descriptor.
   pid_t pid = executing_pid();
-  int fd = replayer_resources_manager_.get_fd(pid, descriptor_.val());
-  int count = count_.val(); /* Number of write io vectors */
-  int iov_number = iov_number_.val();
-  auto data_buffer = new char *[count];
-
-  /*
-   * The total number of rows processed by single readv system
-   * call is one plus number of iovec which is equal to the
-   * count field as described in SNIA document for readv system
-   * call.
-   */
-  rows_per_call_ = count + 1;
-
-  // Save the position of the first record in the Extent Series.
-  const void *first_record_pos = series.getCurPos();
-  int iovcnt = count;
-
-  struct iovec iov[count];
+  int fd = replayer_resources_manager_.get_fd(pid, traced_fd);
 
   if (fd == SYSCALL_SIMULATED) {
     /*
@@ -109,82 +77,86 @@ void WritevSystemCallTraceReplayModule::processRow() {
      * The system call will not be replayed.
      * Original return value and data will be returned.
      */
-    replayed_ret_val_ = return_value_.val();
-    return;
-  }
+    replayed_ret_val_ = return_value();
+  } else {
+    // Check to see if user wants to use pattern
+    if (!pattern_data_.empty()) {
+      // The buffers are contiguous, so the payload is filled at once.
+      fill_pattern_buffer(pattern_data_,
+                          arena + iovcnt * sizeof(struct iovec), nbytes);
+    }
 
-  /*
-   * If iov number is equal to '-1', this means it is first record of
-   * single writev system call.
-   */
-  if (iov_number == -1) {
-    /*
-     * Iteratively fetch the records and save the bytes_requested, iov
-     * number and actual buffer for each record of single writev system
-     * call.
-     */
-    while (iovcnt > 0 && series.morerecords()) {
-      // This moves the pointer in extent series to next record
-      ++series;
+    // Replay the writev system call.
+    replayed_ret_val_ = engine_->writev(fd, iov(), iovcnt);
+  }
 
-      int iov_num = iov_number_.val();
-      size_t bytes_requested = bytes_requested_.val();
+  // Free the iovec array and data.
+  delete[] arena;
+  arena = nullptr;
+}
 
-      // Check to see if user wants to use pattern
-      if (!pattern_data_.empty()) {
-        /*
-         * Allocate memory and copy the actual buffer.
-         * XXX NOTE: ***** FUTURE WORK *****
-         * Instead of allocating individual buffer, we can allocate
-         * one single buffer.
-         */
-        data_buffer[iov_num] = new char[bytes_requested];
-        if (pattern_data_ == "random") {
-          // Fill write buffer using rand()
-          data_buffer[iov_num] =
-              random_fill_buffer(data_buffer[iov_num], bytes_requested);
-        } else if (pattern_data_ == "urandom") {
-          // Fill write buffer using data generated from /dev/urandom
-          SystemCallTraceReplayModule::random_file_.read(data_buffer[iov_num],
-                                                         bytes_requested);
-        } else {
-          // Write zeros or pattern specified in pattern_data
-          unsigned char pattern = pattern_data_[0];
+void WritevSystemCallTraceReplayModule::prepareRow() {
+  traced_fd = descriptor_.val();
+  int count = std::max(count_.val(), 0); /* Number of write io vectors */
+  bool first_record = iov_number_.val() == -1;
 
-          /*
-           * XXX FUTURE WORK: Currently we support pattern of one byte.
-           * For multi byte pattern data, we have to modify the
-           * implementation of filling data_buffer.
-           */
-          memset(data_buffer[iov_num], pattern, bytes_requested);
-        }
-      } else {
-        // Write the traced data
-        data_buffer[iov_num] = (char *)data_written_.val();
-      }
+  /*
+   * The total number of rows processed by single writev system
+   * call is one plus number of iovec which is equal to the
+   * count field as described in SNIA document for writev system
+   * call.
+   */
+  rows_per_call_ = count + 1;
 
-      // Construct the struct iovec from each record.
-      iov[iov_num].iov_base = data_buffer[iov_num];
-      iov[iov_num].iov_len = bytes_requested;
+  // Save the position of the first record in the Extent Series.
+  const void *first_record_pos = series.getCurPos();
 
-      iovcnt--;
-    }
+  /*
+   * If iov number is equal to '-1', this is the first record of a
+   * single writev system call and the iovec records follow it.
+   * Sum their sizes so that a single arena can hold all the data.
+   */
+  iovcnt = first_record ? count : 0;
+  nbytes = 0;
+  for (int rows = 0; rows < iovcnt && series.morerecords(); rows++) {
+    // This moves the pointer in extent series to next record
+    ++series;
+    nbytes += bytes_requested_.val();
   }
 
-  // Replay the writev system call.
-  replayed_ret_val_ = writev(fd, iov, count);
+  size_t iov_bytes = iovcnt * sizeof(struct iovec);
+  arena = new char[iov_bytes + nbytes];
+  for (int iov_num = 0; iov_num < iovcnt; iov_num++) {
+    iov()[iov_num].iov_base = nullptr;
+    iov()[iov_num].iov_len = 0;
+  }
 
-  // Free data buffer.
-  for (int iovcnt_ = 0; iovcnt_ < count; iovcnt_++) {
-    if (!pattern_data_.empty()) {
-      delete[] data_buffer[iovcnt_];
+  // Lay out the data in the arena, copying the traced data unless a
+  // pattern replaces it.
+  series.setCurPos(first_record_pos);
+  size_t offset = 0;
+  for (int rows = 0; rows < iovcnt && series.morerecords(); rows++) {
+    ++series;
+    int iov_num = iov_number_.val();
+    size_t bytes_requested = bytes_requested_.val();
+    if (iov_num < 0 || iov_num >= iovcnt || offset + bytes_requested > nbytes) {
+      continue;
+    }
+    char *data = arena + iov_bytes + offset;
+    iov()[iov_num].iov_base = data;
+    iov()[iov_num].iov_len = bytes_requested;
+    if (pattern_data_.empty()) {
+      size_t traced_bytes = data_written_.isNull() ? 0 : data_written_.size();
+      traced_bytes = std::min(traced_bytes, bytes_requested);
+      if (traced_bytes > 0) {
+        memcpy(data, data_written_.val(), traced_bytes);
+      }
+      memset(data + traced_bytes, 0, bytes_requested - traced_bytes);
     }
+    offset += bytes_requested;
   }
-  delete[] data_buffer;
 
-  /*
-   * After executing a single writev system call, set the
-   * pointer in the Extent Series to the first record.
-   */
+  // Set the pointer to the first record again before moving past the call.
   series.setCurPos(first_record_pos);
+  SystemCallTraceReplayModule::prepareRow();
 }